@@ -0,0 +1,115 @@
+/**
+ * \file ntpresponder.c
+ * \brief standalone local NTP stand-in server
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Run the stand-in server used by zntpbench from the command line, to
+ * try zntpdate by hand against a bad network:
+ *
+ *   ntpresponder -p 12300 -d 0.005 -b 0.020 -j 0.002 -l 0.1 &
+ *   zntpdate -dv --port 12300 127.0.0.1
+ *
+ * or as a NTS server, the client trusting the certificate it made:
+ *
+ *   ntpresponder -p 12300 -N 4460 -C /tmp/nts.pem &
+ *   zntpdate -dv --nts /tmp/nts --nts-ca /tmp/nts.pem 127.0.0.1
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "trace.h"
+#include "responder.h"
+
+/* -- globals used by the zntpdate library -- */
+options_t    gAppOptions;
+trace_desc_t *gAppTrace;
+
+/*!
+  \brief display usage and exit
+  ******************************************************************
+*/
+static void usage( void)
+{
+  fprintf( stderr,
+           "Usage: ntpresponder [options]\n"
+           "  -p port    UDP port on 127.0.0.1 (default 12300)\n"
+           "  -d secs    request path delay\n"
+           "  -b secs    reply path delay (default: same as -d)\n"
+           "  -j secs    max random jitter added to each path\n"
+           "  -l ratio   loss probability of requests (0-1)\n"
+           "  -k ratio   probability to reply a RATE Kiss-o'-Death (0-1)\n"
+           "  -o secs    offset of the served clock\n"
+           "  -s n       stratum (default 2)\n"
+           "  -N port    also a NTS-KE server on this TCP port, NTS requests checked\n"
+           "  -C file    where to write its certificate (default nts.pem)\n");
+  exit(1);
+}
+
+/*!
+  \brief Program entry point
+  ******************************************************************
+
+  \param argc number of argument
+  \param argv arguments list
+  \return 0 if success else 1
+*/
+int main( int argc, char **argv)
+{
+  responder_opts_t opts;
+  responder_t r;
+  pthread_t ke;
+  int c, back = 0;
+
+  memset( &opts, 0, sizeof(opts));
+  opts.m_port = 12300;
+  opts.m_seed = 1;
+  opts.m_ntsCert = "nts.pem";
+
+  while( (c = getopt( argc, argv, "p:d:b:j:l:k:o:s:N:C:h")) != -1) {
+    switch( c) {
+    case 'p': opts.m_port = atoi( optarg); break;
+    case 'd': opts.m_delay = atof( optarg); break;
+    case 'b': opts.m_delayBack = atof( optarg); back = 1; break;
+    case 'j': opts.m_jitter = atof( optarg); break;
+    case 'l': opts.m_loss = atof( optarg); break;
+    case 'k': opts.m_kod = atof( optarg); break;
+    case 'o': opts.m_offset = atof( optarg); break;
+    case 's': opts.m_stratum = atoi( optarg); break;
+    case 'N': opts.m_nts = 1; opts.m_ntsPort = atoi( optarg); break;
+    case 'C': opts.m_ntsCert = optarg; break;
+    default : usage(); break;
+    }
+  }
+  if( !back) opts.m_delayBack = opts.m_delay;
+
+  if( responder_open( &r, &opts) < 0) {
+    perror( "ntpresponder");
+    return 1;
+  }
+  fprintf( stderr, "ntpresponder: listening on 127.0.0.1:%d\n", r.m_port);
+  if( opts.m_nts) {
+    fprintf( stderr, "ntpresponder: NTS-KE on 127.0.0.1:%d, certificate in %s\n", r.m_kePort, opts.m_ntsCert);
+    pthread_create( &ke, NULL, responder_ke_run, &r);
+  }
+  responder_run( &r);
+  responder_close( &r);
+
+  return 0;
+}
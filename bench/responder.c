@@ -0,0 +1,530 @@
+/**
+ * \file responder.c
+ * \brief local NTP stand-in server
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * A tiny NTP server bound on the loopback used to measure zntpdate.
+ * Path delays are emulated by sleeping before taking the receive
+ * time-stamp (request path) and after taking the transmit time-stamp
+ * (reply path), so an asymmetric configuration really biases the
+ * offset computed by the client by (delay - delayBack) / 2.
+ *
+ * With m_nts it is also a NTS-KE server (TLS 1.3 with a self-signed
+ * certificate made at start and written into m_ntsCert for the client
+ * --nts-ca) and checks NTS requests. Its cookies are the keys of the
+ * session sealed by a master key drawn at start: cookies of a former
+ * run are refused by a Kiss-o'-Death NTSN, as a server rotating its
+ * keys would do.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ntppacket.h"
+#include "nts.h"
+#include "responder.h"
+
+#ifdef HAVE_NTS
+#  include <openssl/evp.h>
+#  include <openssl/ec.h>
+#  include <openssl/pem.h>
+#  include <openssl/rand.h>
+#  include <openssl/ssl.h>
+#  include <openssl/x509v3.h>
+#endif
+
+/* -- local functions -- */
+
+/*!
+  \brief uniform random number in [0, 1)
+  ******************************************************************
+
+  \param seed random state
+*/
+static double rnd( unsigned *seed)
+{
+  return rand_r( seed) / ((double)RAND_MAX + 1.0);
+}
+
+/*!
+  \brief sleep a path delay plus its jitter
+  ******************************************************************
+
+  \param delay fixed delay (s)
+  \param jitter max random delay (s)
+  \param seed random state
+*/
+static void path_sleep( double delay, double jitter, unsigned *seed)
+{
+  struct timespec ts;
+
+  delay += jitter * rnd( seed);
+  if( delay <= 0) return;
+
+  ts.tv_sec  = (time_t)delay;
+  ts.tv_nsec = (long)((delay - (double)ts.tv_sec) * 1e9);
+  while( nanosleep( &ts, &ts) < 0 && errno == EINTR);
+}
+
+#ifdef HAVE_NTS
+#define COOKIE_LEN  (16 + 16 + 2 * ktNTS_KEYLEN) /*!< nonce, SIV, sealed keys    */
+
+/*!
+  \struct nts_request_t
+  \brief what the reply to a NTS request needs
+  ******************************************************************
+*/
+typedef struct nts_request_t {
+  uint8_t m_uid[ktNTS_UIDLEN];   /*!< echoed                                     */
+  uint8_t m_c2s[ktNTS_KEYLEN];   /*!< keys of the cookie                         */
+  uint8_t m_s2c[ktNTS_KEYLEN];
+  int     m_cookies;             /*!< cookies to send: 1 + placeholders          */
+  int     m_nak;                 /*!< cookie not ours: reply NTSN                */
+
+} nts_request_t;
+
+static inline int get16( const uint8_t *p)
+{
+  return p[0] << 8 | p[1];
+}
+
+static inline void put16( uint8_t *p, int v)
+{
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+/*!
+  \brief a cookie: the keys sealed by the master key
+*/
+static void cookie_make( nts_aead_t *master, const uint8_t *c2s, const uint8_t *s2c, uint8_t cookie[COOKIE_LEN])
+{
+  uint8_t keys[2 * ktNTS_KEYLEN];
+
+  memcpy( keys, c2s, ktNTS_KEYLEN);
+  memcpy( keys + ktNTS_KEYLEN, s2c, ktNTS_KEYLEN);
+  nts_random( cookie, 16);
+  nts_seal( master, NULL, 0, cookie, 16, keys, sizeof(keys), cookie + 16);
+}
+
+/*!
+  \brief check a NTS request
+  \return 0 if it is one to answer, else -1
+*/
+static int nts_check( nts_aead_t *master, nts_aead_t *c2s, const uint8_t *buf, int n, nts_request_t *req)
+{
+  uint8_t keys[2 * ktNTS_KEYLEN], plain[ktNTS_MSGLEN];
+  const uint8_t *cookie = NULL, *p;
+  int pos, type, size, clen = 0, uid = 0, ok;
+
+  memset( req, 0, sizeof(*req));
+  for( pos = sizeof(ntp_packet_t); pos + 4 <= n; pos += size) {
+    type = get16( buf + pos);
+    size = get16( buf + pos + 2);
+    if( size < 4 || size % 4 || pos + size > n) return -1;
+    if( type == eNTS_EF_UID && size == 4 + ktNTS_UIDLEN) {
+      memcpy( req->m_uid, buf + pos + 4, ktNTS_UIDLEN);
+      uid = 1;
+    }
+    else if( type == eNTS_EF_COOKIE) {
+      cookie = buf + pos + 4;
+      clen   = size - 4;
+      req->m_cookies++;
+    }
+    else if( type == eNTS_EF_PLACEHOLDER) req->m_cookies++;
+    else if( type == eNTS_EF_AUTH) break;
+  }
+  if( !uid || !cookie || pos + 4 > n) return -1;
+
+  if( clen != COOKIE_LEN || nts_unseal( master, NULL, 0, cookie, 16, cookie + 16, clen - 16, keys) != sizeof(keys)) {
+    req->m_nak = 1;
+    return 0;
+  }
+  memcpy( req->m_c2s, keys, ktNTS_KEYLEN);
+  memcpy( req->m_s2c, keys + ktNTS_KEYLEN, ktNTS_KEYLEN);
+
+  p = buf + pos;
+  if( 8 + ((get16( p + 4) + 3) & ~3) + get16( p + 6) > size || nts_aead_rekey( c2s, req->m_c2s) < 0) return -1;
+  ok = nts_unseal( c2s, buf, pos, p + 8, get16( p + 4), p + 8 + ((get16( p + 4) + 3) & ~3), get16( p + 6), plain) >= 0;
+  return ok ? 0 : -1;
+}
+
+/*!
+  \brief append the NTS fields of a reply, its header set
+  \return length of the reply
+*/
+static int nts_answer( nts_aead_t *master, nts_aead_t *s2c, const nts_request_t *req, uint8_t *buf)
+{
+  uint8_t plain[ktNTS_COOKIES * (4 + COOKIE_LEN)], nonce[16], *auth;
+  int len = sizeof(ntp_packet_t), plen = 0, i, clen;
+
+  put16( buf + len, eNTS_EF_UID);
+  put16( buf + len + 2, 4 + ktNTS_UIDLEN);
+  memcpy( buf + len + 4, req->m_uid, ktNTS_UIDLEN);
+  len += 4 + ktNTS_UIDLEN;
+  if( req->m_nak) {
+    ((ntp_packet_t *)buf)->stratum = 0;
+    memcpy( &((ntp_packet_t *)buf)->refId, "NTSN", 4);
+    return len;
+  }
+
+  for( i = 0; i < req->m_cookies && i < ktNTS_COOKIES; i++, plen += 4 + COOKIE_LEN) {
+    put16( plain + plen, eNTS_EF_COOKIE);
+    put16( plain + plen + 2, 4 + COOKIE_LEN);
+    cookie_make( master, req->m_c2s, req->m_s2c, plain + plen + 4);
+  }
+
+  nts_random( nonce, sizeof(nonce));
+  auth = buf + len;
+  if( nts_aead_rekey( s2c, req->m_s2c) < 0) return len;
+  clen = nts_seal( s2c, buf, len, nonce, sizeof(nonce), plain, plen, auth + 8 + sizeof(nonce));
+  put16( auth, eNTS_EF_AUTH);
+  put16( auth + 2, 4 + 4 + (int)sizeof(nonce) + ((clen + 3) & ~3));
+  put16( auth + 4, sizeof(nonce));
+  put16( auth + 6, clen);
+  memcpy( auth + 8, nonce, sizeof(nonce));
+  return len + get16( auth + 2);
+}
+
+/*!
+  \brief ALPN: only NTS-KE
+*/
+static int alpn_select( SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                        const unsigned char *in, unsigned int inlen, void *arg)
+{
+  static const unsigned char alpn[] = { 7, 'n', 't', 's', 'k', 'e', '/', '1' };
+
+  (void)ssl; (void)arg;
+  if( SSL_select_next_proto( (unsigned char **)out, outlen, alpn, sizeof(alpn), in, inlen) != OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+/*!
+  \brief TLS 1.3 server context with a new self-signed certificate
+  \return the context or NULL
+*/
+static SSL_CTX *tls_context( const char *certFile)
+{
+  EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, NULL);
+  EVP_PKEY *key = NULL;
+  X509 *cert = X509_new();
+  X509_NAME *name;
+  X509_EXTENSION *ext;
+  SSL_CTX *ctx = NULL;
+  FILE *f;
+
+  if( !pctx || !cert || EVP_PKEY_keygen_init( pctx) <= 0 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid( pctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen( pctx, &key) <= 0)
+    goto DONE;
+
+  X509_set_version( cert, 2);
+  ASN1_INTEGER_set( X509_get_serialNumber( cert), 1);
+  X509_gmtime_adj( X509_getm_notBefore( cert), -3600);
+  X509_gmtime_adj( X509_getm_notAfter( cert), 7 * 86400);
+  X509_set_pubkey( cert, key);
+  name = X509_get_subject_name( cert);
+  X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+  X509_set_issuer_name( cert, name);
+  if( (ext = X509V3_EXT_conf_nid( NULL, NULL, NID_subject_alt_name, "IP:127.0.0.1,DNS:localhost"))) {
+    X509_add_ext( cert, ext, -1);
+    X509_EXTENSION_free( ext);
+  }
+  if( !X509_sign( cert, key, EVP_sha256())) goto DONE;
+
+  if( certFile) {
+    if( !(f = fopen( certFile, "w"))) goto DONE;
+    PEM_write_X509( f, cert);
+    fclose( f);
+  }
+
+  if( !(ctx = SSL_CTX_new( TLS_server_method()))) goto DONE;
+  SSL_CTX_set_min_proto_version( ctx, TLS1_3_VERSION);
+  SSL_CTX_set_alpn_select_cb( ctx, alpn_select, NULL);
+  if( SSL_CTX_use_certificate( ctx, cert) != 1 || SSL_CTX_use_PrivateKey( ctx, key) != 1) {
+    SSL_CTX_free( ctx);
+    ctx = NULL;
+  }
+DONE:
+  EVP_PKEY_CTX_free( pctx);
+  EVP_PKEY_free( key);
+  X509_free( cert);
+  return ctx;
+}
+
+/*!
+  \brief one NTS-KE exchange: keys exported, eight cookies and our UDP port
+*/
+static void ke_serve( responder_t *r, nts_aead_t *master, int fd)
+{
+  uint8_t head[4], body[256], reply[8 * (4 + COOKIE_LEN) + 64], c2s[ktNTS_KEYLEN], s2c[ktNTS_KEYLEN];
+  int len = 0, type, n, i, proto = 0, aead = 0;
+  SSL *ssl = SSL_new( (SSL_CTX *)r->m_tls);
+
+  if( !ssl) return;
+  SSL_set_fd( ssl, fd);
+  if( SSL_accept( ssl) != 1) goto DONE;
+
+  do {
+    if( SSL_read( ssl, head, 4) != 4 || (n = get16( head + 2)) > (int)sizeof(body)) goto DONE;
+    if( n && SSL_read( ssl, body, n) != n) goto DONE;
+    type = get16( head) & ~eNTS_KE_CRITICAL;
+    for( i = 0; i + 1 < n; i += 2) {
+      if( type == eNTS_KE_NEXTPROTO && get16( body + i) == 0) proto = 1;
+      if( type == eNTS_KE_AEAD && get16( body + i) == ktNTS_AEAD_SIV) aead = 1;
+    }
+  } while( type != eNTS_KE_END);
+
+  if( !proto || !aead || nts_export_keys( ssl, c2s, s2c) < 0) {
+    static const uint8_t bad[] = { 0x80, eNTS_KE_ERROR, 0, 2, 0, 1, 0x80, eNTS_KE_END, 0, 0 };
+    SSL_write( ssl, bad, sizeof(bad));
+    goto DONE;
+  }
+
+  put16( reply, eNTS_KE_CRITICAL | eNTS_KE_NEXTPROTO); put16( reply + 2, 2); put16( reply + 4, 0);
+  put16( reply + 6, eNTS_KE_AEAD); put16( reply + 8, 2); put16( reply + 10, ktNTS_AEAD_SIV);
+  put16( reply + 12, eNTS_KE_PORT); put16( reply + 14, 2); put16( reply + 16, r->m_port);
+  len = 18;
+  for( i = 0; i < ktNTS_COOKIES; i++, len += 4 + COOKIE_LEN) {
+    put16( reply + len, eNTS_KE_COOKIE);
+    put16( reply + len + 2, COOKIE_LEN);
+    cookie_make( master, c2s, s2c, reply + len + 4);
+  }
+  put16( reply + len, eNTS_KE_CRITICAL | eNTS_KE_END); put16( reply + len + 2, 0);
+  len += 4;
+  if( SSL_write( ssl, reply, len) == len) r->m_ke++;
+  SSL_shutdown( ssl);
+DONE:
+  SSL_free( ssl);
+}
+
+/*!
+  \brief open the NTS-KE socket and the TLS context
+*/
+static int ke_open( responder_t *r)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  struct timeval tv = { 0, 100000 };   // wake up to check m_stop
+  int on = 1;
+
+  if( RAND_bytes( r->m_master, sizeof(r->m_master)) != 1 ||
+      !(r->m_tls = tls_context( r->m_opts.m_ntsCert)) ||
+      (r->m_keSocket = socket( PF_INET, SOCK_STREAM, 0)) < 0) return -1;
+  setsockopt( r->m_keSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt( r->m_keSocket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  memset( &addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK);
+  addr.sin_port        = htons( r->m_opts.m_ntsPort);
+  if( bind( r->m_keSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen( r->m_keSocket, 16) < 0 ||
+      getsockname( r->m_keSocket, (struct sockaddr *)&addr, &len) < 0) return -1;
+  r->m_kePort = ntohs( addr.sin_port);
+  return 0;
+}
+#endif
+
+
+/*!
+  \brief open the stand-in server socket
+  ******************************************************************
+
+  \param r    responder to initialize
+  \param opts its behaviour
+  \return bound port or <0 if failed
+*/
+int responder_open( responder_t *r, const responder_opts_t *opts)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  struct timeval tv = { 0, 100000 };   // wake up to check m_stop
+
+  memset( r, 0, sizeof(*r));
+  r->m_opts = *opts;
+  r->m_keSocket = -1;
+  if( !r->m_opts.m_stratum) r->m_opts.m_stratum = 2;
+
+  if( (r->m_socket = socket( PF_INET, SOCK_DGRAM, 0)) < 0) return -1;
+
+  memset( &addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK);
+  addr.sin_port        = htons( opts->m_port);
+  if( bind( r->m_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      getsockname( r->m_socket, (struct sockaddr *)&addr, &len) < 0) {
+    close( r->m_socket);
+    return -2;
+  }
+  setsockopt( r->m_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  r->m_port = ntohs( addr.sin_port);
+
+  if( opts->m_nts) {
+#ifdef HAVE_NTS
+    if( ke_open( r) == 0) return r->m_port;
+#endif
+    responder_close( r);
+    return -3;
+  }
+  return r->m_port;
+}
+
+/*!
+  \brief serve requests until m_stop is set
+  ******************************************************************
+
+  Signature suitable for pthread_create().
+
+  \param arg the responder (responder_t *)
+  \return NULL
+*/
+void *responder_run( void *arg)
+{
+  responder_t *r = (responder_t *)arg;
+  responder_opts_t *o = &r->m_opts;
+  union {
+    ntp_packet_t m_packet;
+    uint8_t      m_data[ktNTS_MSGLEN];
+  } buf;
+  ntp_packet_t *packet = &buf.m_packet;
+  struct sockaddr_in from;
+  socklen_t len;
+  ntp_ts_t now;
+  int n, size;
+#ifdef HAVE_NTS
+  nts_request_t nts;
+  nts_aead_t master, c2s, s2c;            // c2s and s2c: keyed by each request
+
+  memset( &c2s, 0, sizeof(c2s));
+  memset( &s2c, 0, sizeof(s2c));
+  if( o->m_nts && nts_aead_init( &master, r->m_master) < 0) return NULL;
+#endif
+
+  while( !r->m_stop) {
+    len = sizeof(from);
+    n = recvfrom( r->m_socket, &buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+    if( n < (int)sizeof(*packet) || NTP_MODE(packet->li_vn_mode) != NTP_MODE_CLIENT) continue;
+    r->m_received++;
+
+    if( rnd( &o->m_seed) < o->m_loss) {
+      r->m_dropped++;
+      continue;
+    }
+#ifdef HAVE_NTS
+    if( o->m_nts && n > (int)sizeof(*packet) && nts_check( &master, &c2s, buf.m_data, n, &nts) < 0) continue;
+#endif
+
+    path_sleep( o->m_delay, o->m_jitter, &o->m_seed);
+    now = ntp_ts_add( ntp_ts_now(), o->m_offset);
+
+    packet->origTm_s   = packet->txTm_s;
+    packet->origTm_f   = packet->txTm_f;
+    ntp_ts_put( now, &packet->rxTm_s, &packet->rxTm_f);
+    packet->li_vn_mode = NTP_LI_VN_MODE( NTP_LI_NONE, NTP_VN(packet->li_vn_mode), NTP_MODE_SERVER);
+    packet->stratum    = (uint8_t)o->m_stratum;
+    packet->poll       = 4;
+    packet->precision  = (uint8_t)-20;
+    packet->rootDelay  = 0;
+    packet->rootDispersion = htonl( 1 << 6);          // ~1 ms
+    packet->refId      = htonl( INADDR_LOOPBACK);
+    ntp_ts_put( now, &packet->refTm_s, &packet->refTm_f);
+
+    if( rnd( &o->m_seed) < o->m_kod) {
+      packet->stratum = 0;
+      memcpy( &packet->refId, "RATE", 4);
+    }
+
+    ntp_ts_put( ntp_ts_add( ntp_ts_now(), o->m_offset), &packet->txTm_s, &packet->txTm_f);
+    size = sizeof(*packet);
+#ifdef HAVE_NTS
+    if( o->m_nts && n > (int)sizeof(*packet)) {
+      size = nts_answer( &master, &s2c, &nts, buf.m_data);
+      r->m_ntsNak += nts.m_nak;
+    }
+#endif
+    path_sleep( o->m_delayBack, o->m_jitter, &o->m_seed);
+
+    if( sendto( r->m_socket, &buf, size, 0, (struct sockaddr *)&from, len) == size)
+      r->m_sent++;
+  }
+
+#ifdef HAVE_NTS
+  if( o->m_nts) {
+    nts_aead_free( &master);
+    nts_aead_free( &c2s);
+    nts_aead_free( &s2c);
+  }
+#endif
+  return NULL;
+}
+
+/*!
+  \brief serve NTS key exchanges until m_stop is set
+  ******************************************************************
+
+  Signature suitable for pthread_create(), run beside responder_run()
+  when m_nts is set.
+
+  \param arg the responder (responder_t *)
+  \return NULL
+*/
+void *responder_ke_run( void *arg)
+{
+#ifdef HAVE_NTS
+  responder_t *r = (responder_t *)arg;
+  struct timeval tv = { 2, 0 };
+  nts_aead_t master;
+  int fd;
+
+  if( nts_aead_init( &master, r->m_master) < 0) return NULL;
+  while( !r->m_stop) {
+    if( (fd = accept( r->m_keSocket, NULL, NULL)) < 0) continue;
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ke_serve( r, &master, fd);
+    close( fd);
+  }
+  nts_aead_free( &master);
+#else
+  (void)arg;
+#endif
+  return NULL;
+}
+
+/*!
+  \brief close the stand-in server socket
+  ******************************************************************
+
+  \param r the responder
+*/
+void responder_close( responder_t *r)
+{
+  if( r->m_socket >= 0) close( r->m_socket);
+  r->m_socket = -1;
+  if( r->m_keSocket >= 0) close( r->m_keSocket);
+  r->m_keSocket = -1;
+#ifdef HAVE_NTS
+  SSL_CTX_free( (SSL_CTX *)r->m_tls);
+#endif
+  r->m_tls = NULL;
+}
@@ -0,0 +1,68 @@
+/**
+ * \file responder.h
+ * \brief local NTP stand-in server header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef RESPONDER_H_
+#define RESPONDER_H_
+
+#include <stdint.h>
+
+/*!
+  \struct responder_opts_t
+  \brief behaviour of the stand-in server
+  ******************************************************************
+*/
+typedef struct responder_opts_t {
+  int      m_port;               /*!< UDP port on loopback (0: any free port)    */
+  double   m_delay;              /*!< request path delay (s)                     */
+  double   m_delayBack;          /*!< reply path delay (s), asymmetric if != m_delay */
+  double   m_jitter;             /*!< max random delay added to each path (s)    */
+  double   m_loss;               /*!< probability to drop a request (0-1)        */
+  double   m_kod;                /*!< probability to reply a RATE Kiss-o'-Death  */
+  double   m_offset;             /*!< server clock offset to system clock (s)    */
+  int      m_stratum;            /*!< stratum of the replies                     */
+  unsigned m_seed;               /*!< random seed, runs are reproducible         */
+  int      m_nts;                /*!< also a NTS-KE server, NTS requests checked */
+  int      m_ntsPort;            /*!< NTS-KE TCP port (0: any free port)         */
+  const char *m_ntsCert;         /*!< where to write the self-signed certificate */
+
+} responder_opts_t;
+
+/*!
+  \struct responder_t
+  \brief a running stand-in server
+  ******************************************************************
+*/
+typedef struct responder_t {
+  responder_opts_t m_opts;       /*!< behaviour                                  */
+  int              m_socket;     /*!< UDP socket                                 */
+  int              m_port;       /*!< bound port                                 */
+  volatile int     m_stop;       /*!< set to stop responder_run()                */
+  unsigned long    m_received;   /*!< requests received                          */
+  unsigned long    m_sent;       /*!< replies sent                               */
+  unsigned long    m_dropped;    /*!< requests dropped (loss)                    */
+  int              m_keSocket;   /*!< NTS-KE TCP socket, -1 if none              */
+  int              m_kePort;     /*!< its bound port                             */
+  void            *m_tls;        /*!< its TLS context (SSL_CTX *)                */
+  uint8_t          m_master[32]; /*!< key of the cookies, new at each start      */
+  unsigned long    m_ke;         /*!< key exchanges done                         */
+  unsigned long    m_ntsNak;     /*!< NTS requests with a bad cookie (NTSN)      */
+
+} responder_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int   responder_open  ( responder_t *r, const responder_opts_t *opts);
+void *responder_run   ( void *r);
+void *responder_ke_run( void *r);
+void  responder_close ( responder_t *r);
+
+#endif /* RESPONDER_H_ */
@@ -0,0 +1,686 @@
+/**
+ * \file zntpbench.c
+ * \brief zntpdate benchmarks
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Run with "make bench". Every benchmark talks to the stand-in server
+ * of responder.c on the loopback, so results only depend on this host.
+ * The report is written as JSON on stdout (or into -o file) to be kept
+ * and compared between releases:
+ *
+ *  first_sample     whole ntpdate() (debug mode) until a sample is got
+ *  offset_accuracy  error of the measured offset against a known
+ *                   server offset, for delay/jitter/asymmetry cases
+ *  loss, kod        behaviour when requests are lost or refused
+ *  query_throughput NTP exchanges per second with ntp_query()
+ *  rate_check       cost of the server rate limiting of one request,
+ *                   for one client and for many clients
+ *  clock_read       cost of reading the published clock state
+ *  auth             cost of the MAC of a request, signed and checked,
+ *                   for MD5, SHA1 and AES-CMAC keys
+ *  nts              NTP exchange with the NTS fields of a cached
+ *                   session against a plain one, and a full NTS-KE
+ *  trace_write      cost of one trace message
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "main.h"
+#include "trace.h"
+#include "ntpdate.h"
+#include "ratelimit.h"
+#include "publish.h"
+#include "auth.h"
+#include "nts.h"
+#include "responder.h"
+
+#define BENCH_SERVER_OFFSET   0.250  /*!< offset of the stand-in server clock (s)  */
+#define BENCH_TRACE_MSGS     200000  /*!< messages written by trace_write bench    */
+#define BENCH_RATE_CHECKS   4000000  /*!< requests accounted by rate_check bench   */
+#define BENCH_CLOCK_READS  10000000  /*!< reads of the published clock state       */
+#define BENCH_AUTH_PACKETS  1000000  /*!< packets signed then checked per key type   */
+#define BENCH_NTS_KE             50  /*!< NTS key exchanges at most                */
+
+/* -- globals used by the zntpdate library -- */
+options_t    gAppOptions;
+trace_desc_t *gAppTrace;
+
+/*!
+  \struct bench_stats_t
+  \brief summary of a series of measures
+  ******************************************************************
+*/
+typedef struct bench_stats_t {
+  int    m_count;                /*!< number of measures                         */
+  double m_min;                  /*!< minimum                                    */
+  double m_median;               /*!< median                                     */
+  double m_p99;                  /*!< 99th percentile                            */
+  double m_max;                  /*!< maximum                                    */
+  double m_mean;                 /*!< mean                                       */
+  double m_stddev;               /*!< standard deviation                         */
+
+} bench_stats_t;
+
+/*!
+  \struct bench_server_t
+  \brief a stand-in server running in its own thread
+  ******************************************************************
+*/
+typedef struct bench_server_t {
+  responder_t m_responder;       /*!< the server                                 */
+  pthread_t   m_thread;          /*!< its thread                                 */
+  pthread_t   m_keThread;        /*!< its NTS-KE thread (m_nts)                  */
+
+} bench_server_t;
+
+/* -- local functions -- */
+
+/*!
+  \brief monotonic time in seconds
+*/
+static double now( void)
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*!
+  \brief compare doubles for qsort()
+*/
+static int cmp_double( const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*!
+  \brief compute a series summary (the series is sorted)
+  ******************************************************************
+
+  \param v     measures
+  \param n     number of measures
+  \param stats where to put the summary
+*/
+static void compute_stats( double *v, int n, bench_stats_t *stats)
+{
+  double sum = 0, sq = 0;
+  int i;
+
+  memset( stats, 0, sizeof(*stats));
+  if( n <= 0) return;
+
+  qsort( v, (size_t)n, sizeof(*v), cmp_double);
+  for( i = 0; i < n; i++) sum += v[i];
+  stats->m_mean = sum / n;
+  for( i = 0; i < n; i++) sq += (v[i] - stats->m_mean) * (v[i] - stats->m_mean);
+
+  stats->m_count  = n;
+  stats->m_min    = v[0];
+  stats->m_median = v[n / 2];
+  stats->m_p99    = v[(int)((n - 1) * 0.99)];
+  stats->m_max    = v[n - 1];
+  stats->m_stddev = sqrt( sq / n);
+}
+
+/*!
+  \brief write a series summary as JSON members, scaled to unit
+*/
+static void print_stats( FILE *out, const bench_stats_t *s, double scale, const char *unit)
+{
+  fprintf( out, "\"count\": %d, \"min_%s\": %.3f, \"median_%s\": %.3f, \"p99_%s\": %.3f, "
+           "\"max_%s\": %.3f, \"mean_%s\": %.3f, \"stddev_%s\": %.3f",
+           s->m_count, unit, s->m_min * scale, unit, s->m_median * scale, unit, s->m_p99 * scale,
+           unit, s->m_max * scale, unit, s->m_mean * scale, unit, s->m_stddev * scale);
+}
+
+/*!
+  \brief start a stand-in server and point gAppOptions to it
+*/
+static int server_start( bench_server_t *srv, const responder_opts_t *opts)
+{
+  if( responder_open( &srv->m_responder, opts) < 0) return -1;
+  if( pthread_create( &srv->m_thread, NULL, responder_run, &srv->m_responder)) {
+    responder_close( &srv->m_responder);
+    return -1;
+  }
+  if( opts->m_nts && pthread_create( &srv->m_keThread, NULL, responder_ke_run, &srv->m_responder)) {
+    srv->m_responder.m_stop = 1;
+    pthread_join( srv->m_thread, NULL);
+    responder_close( &srv->m_responder);
+    return -1;
+  }
+  gAppOptions.m_port = srv->m_responder.m_port;
+  return 0;
+}
+
+/*!
+  \brief stop a stand-in server
+*/
+static void server_stop( bench_server_t *srv)
+{
+  srv->m_responder.m_stop = 1;
+  pthread_join( srv->m_thread, NULL);
+  if( srv->m_responder.m_opts.m_nts) pthread_join( srv->m_keThread, NULL);
+  responder_close( &srv->m_responder);
+}
+
+/*!
+  \brief open a socket and the address of the stand-in server
+*/
+static int client_open( struct sockaddr_in *addr)
+{
+  memset( addr, 0, sizeof(*addr));
+  addr->sin_family      = AF_INET;
+  addr->sin_addr.s_addr = htonl( INADDR_LOOPBACK);
+  addr->sin_port        = htons( gAppOptions.m_port);
+
+  return socket( PF_INET, SOCK_DGRAM, 0);
+}
+
+/*!
+  \brief time of the whole ntpdate() until it got its sample
+*/
+static int bench_first_sample( FILE *out, int runs)
+{
+  responder_opts_t opts;
+  bench_server_t srv;
+  bench_stats_t st;
+  double *v = calloc( (size_t)runs, sizeof(double)), t;
+  int i, n = 0;
+
+  memset( &opts, 0, sizeof(opts));
+  opts.m_seed = 1;
+  if( !v || server_start( &srv, &opts) < 0) return -1;
+
+  for( i = 0; i < runs; i++) {
+    t = now();
+    if( ntpdate() == 0) v[n++] = now() - t;
+  }
+  server_stop( &srv);
+
+  compute_stats( v, n, &st);
+  fprintf( out, "  \"first_sample\": { \"runs\": %d, ", runs);
+  print_stats( out, &st, 1e6, "us");
+  fprintf( out, " },\n");
+  free( v);
+  return 0;
+}
+
+/*!
+  \brief error of the measured offset for one network case
+*/
+static int bench_accuracy_case( FILE *out, const char *name, double delay, double back,
+                                double jitter, int runs, int last)
+{
+  responder_opts_t opts;
+  bench_server_t srv;
+  bench_stats_t st, dl;
+  struct sockaddr_in addr;
+  ntp_sample_t sample;
+  double *v = calloc( (size_t)runs, sizeof(double));
+  double *d = calloc( (size_t)runs, sizeof(double));
+  int i, n = 0, s;
+
+  memset( &opts, 0, sizeof(opts));
+  opts.m_delay     = delay;
+  opts.m_delayBack = back;
+  opts.m_jitter    = jitter;
+  opts.m_offset    = BENCH_SERVER_OFFSET;
+  opts.m_seed      = 1;
+  if( !v || !d || server_start( &srv, &opts) < 0) return -1;
+
+  s = client_open( &addr);
+  for( i = 0; s >= 0 && i < runs; i++) {
+    if( ntp_query( s, &addr, &sample, NULL) == 0) {
+      d[n] = sample.m_delay;
+      v[n++] = sample.m_offset - BENCH_SERVER_OFFSET;
+    }
+  }
+  if( s >= 0) close( s);
+  server_stop( &srv);
+
+  compute_stats( v, n, &st);
+  compute_stats( d, n, &dl);
+  fprintf( out, "    { \"name\": \"%s\", \"delay_ms\": %.3f, \"delay_back_ms\": %.3f, \"jitter_ms\": %.3f, "
+           "\"expected_bias_us\": %.3f, \"mean_delay_us\": %.3f, \"error\": { ",
+           name, delay * 1e3, back * 1e3, jitter * 1e3, (delay - back) / 2 * 1e6, dl.m_mean * 1e6);
+  print_stats( out, &st, 1e6, "us");
+  fprintf( out, " } }%s\n", last ? "" : ",");
+  free( v);
+  free( d);
+  return 0;
+}
+
+/*!
+  \brief offset accuracy for several network cases
+*/
+static int bench_accuracy( FILE *out, int runs)
+{
+  fprintf( out, "  \"offset_accuracy\": [\n");
+  bench_accuracy_case( out, "loopback",   0,     0,     0,      runs, 0);
+  bench_accuracy_case( out, "symmetric",  0.002, 0.002, 0,      runs, 0);
+  bench_accuracy_case( out, "jitter",     0.002, 0.002, 0.002,  runs, 0);
+  bench_accuracy_case( out, "asymmetric", 0.001, 0.005, 0,      runs, 1);
+  fprintf( out, "  ],\n");
+  return 0;
+}
+
+/*!
+  \brief behaviour with lost requests and with Kiss-o'-Death replies
+*/
+static int bench_failures( FILE *out, int runs)
+{
+  responder_opts_t opts;
+  bench_server_t srv;
+  struct sockaddr_in addr;
+  ntp_sample_t sample;
+  int i, s, ok = 0, timeouts = 0, kod = 0, timeout = gAppOptions.m_timeout;
+  double t;
+
+  /* lost requests: each loss costs one timeout */
+  memset( &opts, 0, sizeof(opts));
+  opts.m_loss = 0.2;
+  opts.m_seed = 1;
+  if( server_start( &srv, &opts) < 0) return -1;
+  gAppOptions.m_timeout = 1;
+
+  s = client_open( &addr);
+  t = now();
+  for( i = 0; s >= 0 && i < runs; i++) {
+    switch( ntp_query( s, &addr, &sample, NULL)) {
+    case eNTP_OK:       ok++; break;
+    case eNTP_ETIMEOUT: timeouts++; break;
+    default: break;
+    }
+  }
+  t = now() - t;
+  if( s >= 0) close( s);
+  server_stop( &srv);
+  fprintf( out, "  \"loss\": { \"loss_ratio\": %.2f, \"runs\": %d, \"ok\": %d, \"timeouts\": %d, "
+           "\"requests\": %lu, \"mean_ms\": %.3f },\n",
+           opts.m_loss, runs, ok, timeouts, srv.m_responder.m_received, t / runs * 1e3);
+
+  /* refused requests */
+  memset( &opts, 0, sizeof(opts));
+  opts.m_kod  = 1;
+  opts.m_seed = 1;
+  if( server_start( &srv, &opts) < 0) return -1;
+
+  s = client_open( &addr);
+  t = now();
+  for( i = 0; s >= 0 && i < runs; i++) {
+    if( ntp_query( s, &addr, &sample, NULL) == eNTP_EKOD) kod++;
+  }
+  t = now() - t;
+  if( s >= 0) close( s);
+  server_stop( &srv);
+  fprintf( out, "  \"kod\": { \"runs\": %d, \"kod\": %d, \"mean_us\": %.3f },\n", runs, kod, t / runs * 1e6);
+
+  gAppOptions.m_timeout = timeout;
+  return 0;
+}
+
+/*!
+  \brief NTP exchanges per second against a zero delay server
+*/
+static int bench_throughput( FILE *out, double seconds)
+{
+  responder_opts_t opts;
+  bench_server_t srv;
+  struct sockaddr_in addr;
+  ntp_sample_t sample;
+  unsigned long exchanges = 0;
+  double t, end;
+  int s;
+
+  memset( &opts, 0, sizeof(opts));
+  opts.m_seed = 1;
+  if( server_start( &srv, &opts) < 0) return -1;
+
+  s = client_open( &addr);
+  t = now();
+  end = t + seconds;
+  while( s >= 0 && now() < end) {
+    if( ntp_query( s, &addr, &sample, NULL) == 0) exchanges++;
+  }
+  t = now() - t;
+  if( s >= 0) close( s);
+  server_stop( &srv);
+
+  fprintf( out, "  \"query_throughput\": { \"seconds\": %.3f, \"exchanges\": %lu, "
+           "\"exchanges_per_s\": %.1f, \"packets_per_s\": %.1f },\n",
+           t, exchanges, exchanges / t, 2 * exchanges / t);
+  return 0;
+}
+
+/*!
+  \brief cost of rate_check() for one client and for clients spread over the table
+*/
+static int bench_ratelimit( FILE *out)
+{
+  rate_table_t table;
+  uint32_t addr, tick;
+  double t, one, many;
+  int i, limited[2] = { 0, 0 };
+
+  if( rate_init( &table, ktRATE_AVERAGE, ktRATE_BURST, 1) < 0) return -1;
+
+  tick = rate_now();
+  t = now();
+  for( i = 0; i < BENCH_RATE_CHECKS; i++)
+    limited[0] += (rate_check( &table, 0x0A000001, tick + (i >> 10)) != eRATE_PASS);
+  one = (now() - t) / BENCH_RATE_CHECKS;
+
+  /* 1M clients: most of them are evicted before they come back */
+  addr = 1;
+  t = now();
+  for( i = 0; i < BENCH_RATE_CHECKS; i++) {
+    addr = addr * 1664525 + 1013904223;
+    limited[1] += (rate_check( &table, (addr >> 12) | 1, tick + (i >> 10)) != eRATE_PASS);
+  }
+  many = (now() - t) / BENCH_RATE_CHECKS;
+  rate_free( &table);
+
+  fprintf( out, "  \"rate_check\": { \"checks\": %d, \"ns_one_client\": %.1f, \"ns_many_clients\": %.1f, "
+           "\"limited_one\": %d, \"limited_many\": %d },\n", BENCH_RATE_CHECKS, one * 1e9, many * 1e9, limited[0], limited[1]);
+  return 0;
+}
+
+/*!
+  \brief cost of zntp_clock_read(), alone and with the error bound
+*/
+static int bench_clockread( FILE *out)
+{
+  const zntp_clock_page_t *page;
+  zntp_clock_t clock;
+  char path[] = "/tmp/zntpbench.XXXXXX";
+  double t, read, bound, sum = 0;
+  int i, fd;
+
+  if( (fd = mkstemp( path)) < 0) return -1;
+  close( fd);
+  if( publish_open( path) < 0 || !(page = zntp_clock_open( path))) {
+    unlink( path);
+    return -1;
+  }
+
+  t = now();
+  for( i = 0; i < BENCH_CLOCK_READS; i++) {
+    zntp_clock_read( page, &clock);
+    sum += clock.m_offset;
+  }
+  read = (now() - t) / BENCH_CLOCK_READS;
+
+  t = now();
+  for( i = 0; i < BENCH_CLOCK_READS; i++) {
+    zntp_clock_read( page, &clock);
+    sum += zntp_clock_error( &clock, zntp_clock_mono());
+  }
+  bound = (now() - t) / BENCH_CLOCK_READS;
+
+  zntp_clock_close( page);
+  publish_close();
+  unlink( path);
+
+  fprintf( out, "  \"clock_read\": { \"reads\": %d, \"ns_per_read\": %.1f, \"ns_per_error_bound\": %.1f, "
+           "\"check\": %.0f },\n", BENCH_CLOCK_READS, read * 1e9, bound * 1e9, sum);
+  return 0;
+}
+
+/*!
+  \brief cost of auth_sign() and auth_verify() of a request per key type
+*/
+static int bench_auth( FILE *out)
+{
+  static const char *names[3] = { "md5", "sha1", "cmac" };
+  struct {
+    ntp_packet_t m_packet;
+    uint8_t      m_mac[ktAUTH_MACLEN];
+  } request;
+  char path[] = "/tmp/zntpbench.XXXXXX";
+  const auth_key_t *key;
+  double t, sign, verify;
+  uint32_t id;
+  int i, k, len = 0, fd, line, failed = 0;
+  FILE *f;
+
+  /* the AES-CMAC key, last, is refused without libcrypto */
+  for( k = 3; k >= 2; k--) {
+    if( (fd = mkstemp( path)) < 0 || !(f = fdopen( fd, "w"))) return -1;
+    fprintf( f, "1 MD5 zntpbench\n2 SHA1 zntpbench\n");
+    if( k == 3) fprintf( f, "3 AES128CMAC 000102030405060708090a0b0c0d0e0f\n");
+    fclose( f);
+    i = auth_load( path, &line);
+    unlink( path);
+    strcpy( path, "/tmp/zntpbench.XXXXXX");
+    if( i == k) break;
+  }
+  if( k < 2) return -1;
+
+  fprintf( out, "  \"auth\": { \"packets\": %d", BENCH_AUTH_PACKETS);
+  for( k = 1; (key = auth_find( k)) != NULL; k++) {
+    ntp_request_build( &request.m_packet, ntp_ts_now());
+
+    t = now();
+    for( i = 0; i < BENCH_AUTH_PACKETS; i++) {
+      request.m_packet.txTm_f = (uint32_t)i;
+      len = auth_sign( key, (uint8_t *)&request, sizeof(request.m_packet));
+    }
+    sign = (now() - t) / BENCH_AUTH_PACKETS;
+
+    t = now();
+    for( i = 0; i < BENCH_AUTH_PACKETS; i++) {
+      failed += (auth_verify( (const uint8_t *)&request, len, &id) != eAUTH_OK);
+    }
+    verify = (now() - t) / BENCH_AUTH_PACKETS;
+
+    fprintf( out, ", \"ns_sign_%s\": %.1f, \"ns_verify_%s\": %.1f", names[k - 1], sign * 1e9, names[k - 1], verify * 1e9);
+  }
+  fprintf( out, ", \"failed\": %d },\n", failed);
+  return 0;
+}
+
+/*!
+  \brief NTP exchange with and without NTS, and NTS key exchange
+  ******************************************************************
+
+  The NTS exchanges use the cookies of a session opened once, as the
+  polls following a run that wrote the cache.
+*/
+static int bench_nts( FILE *out, int runs)
+{
+  responder_opts_t opts;
+  bench_server_t srv;
+  struct sockaddr_in addr;
+  ntp_sample_t sample;
+  nts_session_t *session;
+  bench_stats_t plain, nts, ke;
+  char dir[] = "/tmp/zntpbench.XXXXXX", cert[64], cache[64];
+  double *v, t;
+  int i, n, s, failed = 0;
+
+  if( !mkdtemp( dir) || !(v = (double *)malloc( (size_t)runs * sizeof(*v)))) return -1;
+  snprintf( cert, sizeof(cert), "%s/ca.pem", dir);
+  snprintf( cache, sizeof(cache), "%s/127.0.0.1.nts", dir);
+
+  memset( &opts, 0, sizeof(opts));
+  opts.m_seed    = 1;
+  opts.m_nts     = 1;
+  opts.m_ntsCert = cert;
+  if( server_start( &srv, &opts) < 0) {
+    free( v);
+    rmdir( dir);
+    return -1;
+  }
+  gAppOptions.m_ntsCa   = cert;
+  gAppOptions.m_ntsPort = srv.m_responder.m_kePort;
+
+  s = client_open( &addr);
+  for( i = 0, n = 0; s >= 0 && i < runs; i++) {
+    t = now();
+    if( ntp_query( s, &addr, &sample, NULL) == 0) v[n++] = now() - t;
+  }
+  compute_stats( v, n, &plain);
+
+  gAppOptions.m_ntsDir = dir;
+  session = nts_open( "127.0.0.1", &addr);
+  for( i = 0, n = 0; s >= 0 && session && i < runs; i++) {
+    t = now();
+    if( ntp_query( s, &addr, &sample, NULL) == 0) v[n++] = now() - t;
+    else failed++;
+  }
+  compute_stats( v, n, &nts);
+
+  for( i = 0, n = 0; session && i < runs && i < BENCH_NTS_KE; i++) {
+    t = now();
+    if( nts_ke( session) == 0) v[n++] = now() - t;
+    else failed++;
+  }
+  compute_stats( v, n, &ke);
+
+  nts_close();
+  gAppOptions.m_ntsDir = NULL;
+  gAppOptions.m_ntsCa  = NULL;
+  if( s >= 0) close( s);
+  server_stop( &srv);
+  unlink( cache);
+  unlink( cert);
+  rmdir( dir);
+  free( v);
+
+  fprintf( out, "  \"nts\": { \"plain\": { ");
+  print_stats( out, &plain, 1e6, "us");
+  fprintf( out, " }, \"nts_cached\": { ");
+  print_stats( out, &nts, 1e6, "us");
+  fprintf( out, " }, \"key_exchange\": { ");
+  print_stats( out, &ke, 1e6, "us");
+  fprintf( out, " }, \"failed\": %d },\n", failed);
+  return 0;
+}
+
+/*!
+  \brief cost of trace_write() with and without time-stamp
+*/
+static int bench_trace( FILE *out)
+{
+  trace_desc_t *saved = gAppTrace;
+  trace_desc_t trace;
+  double t, plain, stamped;
+  int i;
+
+  memset( &trace, 0, sizeof(trace));
+  trace.m_type = eStdout;
+  if( !(trace.m_file = fopen( "/dev/null", "w"))) return -1;
+  gAppTrace = &trace;
+
+  t = now();
+  for( i = 0; i < BENCH_TRACE_MSGS; i++)
+    trace_write( gAppTrace, eINFO_MSG_TYPE, "Offset %+.6fs, delay %.6fs", i * 1e-6, i * 2e-6);
+  plain = (now() - t) / BENCH_TRACE_MSGS;
+
+  t = now();
+  for( i = 0; i < BENCH_TRACE_MSGS; i++)
+    trace_write( gAppTrace, eINFO_MSG_TYPE | eWITH_TIMESTAMP, "Offset %+.6fs, delay %.6fs", i * 1e-6, i * 2e-6);
+  stamped = (now() - t) / BENCH_TRACE_MSGS;
+
+  fclose( trace.m_file);
+  gAppTrace = saved;
+
+  fprintf( out, "  \"trace_write\": { \"messages\": %d, \"ns_per_msg\": %.1f, \"ns_per_msg_timestamp\": %.1f }\n",
+           BENCH_TRACE_MSGS, plain * 1e9, stamped * 1e9);
+  return 0;
+}
+
+
+/*!
+  \brief Benchmarks entry point
+  ******************************************************************
+
+  \param argc number of argument
+  \param argv arguments list
+  \return 0 if success else 1
+*/
+int main( int argc, char **argv)
+{
+  FILE *out = stdout;
+  trace_desc_t trace;
+  struct utsname un;
+  time_t t = time(NULL);
+  char date[32];
+  int c, runs = 200;
+
+  while( (c = getopt( argc, argv, "n:o:h")) != -1) {
+    switch( c) {
+    case 'n': runs = atoi( optarg); break;
+    case 'o':
+      if( !(out = fopen( optarg, "w"))) {
+        perror( optarg);
+        return 1;
+      }
+      break;
+    default:
+      fprintf( stderr, "Usage: zntpbench [-n runs] [-o file.json]\n");
+      return 1;
+    }
+  }
+  if( runs <= 0) runs = 1;
+
+  /* zntpdate in debug mode towards the stand-in server, logs are discarded */
+  memset( &gAppOptions, 0, sizeof(gAppOptions));
+  gAppOptions.m_version = 3;
+  gAppOptions.m_debug   = 1;
+  gAppOptions.m_timeout = TIMEOUT_SECS;
+  strcpy( gAppOptions.m_hosts[0], "127.0.0.1");
+  gAppOptions.m_nhosts  = 1;
+
+  memset( &trace, 0, sizeof(trace));
+  trace.m_type = eStdout;
+  trace.m_file = fopen( "/dev/null", "w");
+  gAppTrace = &trace;
+
+  uname( &un);
+  strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime( &t));
+  fprintf( out, "{\n  \"package\": \"%s\", \"version\": \"%s\", \"date\": \"%s\", "
+           "\"host\": \"%s\", \"machine\": \"%s\", \"kernel\": \"%s\",\n",
+           PACKAGE, VERSION, date, un.nodename, un.machine, un.release);
+
+  bench_first_sample( out, runs);
+  bench_accuracy( out, runs);
+  bench_failures( out, runs / 10 > 0 ? runs / 10 : 1);
+  bench_throughput( out, 1.0);
+  bench_ratelimit( out);
+  bench_clockread( out);
+  bench_auth( out);
+  bench_nts( out, runs);
+  bench_trace( out);
+  fprintf( out, "}\n");
+
+  if( trace.m_file) fclose( trace.m_file);
+  if( out != stdout) fclose( out);
+  return 0;
+}
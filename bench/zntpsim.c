@@ -0,0 +1,456 @@
+/**
+ * \file zntpsim.c
+ * \brief deterministic network and clock simulator
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Drive the synchronization engine of zntpdate (sync.c) against a
+ * virtual clock and simulated servers, one second of simulated time per
+ * iteration, so days are simulated in seconds and a given seed always
+ * gives the same result.
+ *
+ *  - the local oscillator has a frequency error (-s, ppm) doing a
+ *    random walk (-w, ppm per square root of second);
+ *  - slews are applied at most at 500 ppm like adjtime();
+ *  - each server sees its own path: one-way delay (-d), asymmetry
+ *    (-a, share of the delay moved to the request path), exponential
+ *    jitter (-j) and loss (-l); -F servers are falsetickers off by 50 ms;
+ *  - with -O, no server answers for a while: the worst clock error of
+ *    this holdover and the steps done when servers are back are written
+ *    too, the error bound growing by -R (ppm) as --holdover;
+ *  - with -H, the samples are appended to a history file as --history
+ *    does, e.g. to try --analyze on a year of polls.
+ *
+ * The error of the local clock (local - true time) is recorded after
+ * a warm up and its distribution is written as JSON. With -c every
+ * strategy (step, slew) and filter (last, mindelay, median) are run on
+ * the same scenario to compare them.
+ *
+ * Run "make sim" for the comparison with default values.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "trace.h"
+#include "ntpdate.h"
+#include "sync.h"
+#include "history.h"
+
+#define SIM_MAX_SLEW          500e-6  /*!< slew rate of adjtime() (s/s)            */
+#define SIM_FALSETICKER_ERR   0.050   /*!< error of a falseticker server (s)       */
+#define SIM_PROCESSING        10e-6   /*!< server processing time (s)              */
+#define SIM_RECORD_EVERY      16      /*!< record the clock error every n seconds  */
+
+/*!
+  \struct sim_params_t
+  \brief a simulation scenario
+  ******************************************************************
+*/
+typedef struct sim_params_t {
+  double   m_days;               /*!< simulated duration                         */
+  double   m_warmup;             /*!< not recorded at start (s)                  */
+  int      m_poll;               /*!< seconds between polls                      */
+  double   m_skew;               /*!< oscillator frequency error (s/s)           */
+  double   m_wander;             /*!< frequency random walk (s/s per sqrt(s))    */
+  double   m_initial;            /*!< initial clock error (s)                    */
+  int      m_servers;            /*!< number of servers                          */
+  int      m_falsetickers;       /*!< number of wrong servers among them         */
+  double   m_delay;              /*!< one-way delay (s)                          */
+  double   m_asym;               /*!< share of delay moved to request path (-1,1)*/
+  double   m_jitter;             /*!< mean of exponential jitter per path (s)    */
+  double   m_loss;               /*!< loss probability                           */
+  double   m_outageStart;        /*!< no server from this time (s)               */
+  double   m_outageLen;          /*!< for this long (s), 0: no outage            */
+  double   m_holdoverRate;       /*!< error growth of the engine in holdover (s/s)*/
+  unsigned m_seed;               /*!< random seed                                */
+
+} sim_params_t;
+
+/*!
+  \struct sim_clock_t
+  \brief the virtual local clock
+  ******************************************************************
+*/
+typedef struct sim_clock_t {
+  double   m_true;               /*!< true time since start (s)                  */
+  double   m_error;              /*!< local clock - true time (s)                */
+  double   m_skew;               /*!< current oscillator frequency error (s/s)   */
+  double   m_freq;               /*!< frequency correction of the engine (s/s)   */
+  double   m_slewLeft;           /*!< slew still to apply (s)                    */
+  unsigned m_seed;               /*!< random state                               */
+
+} sim_clock_t;
+
+options_t    gAppOptions;      /*!< needed by libzntp, unused               */
+trace_desc_t *gAppTrace;
+
+static trace_desc_t gSimTrace = { eStdout, NULL }; /*!< errors of libzntp, to stderr */
+
+static ntp_ts_t gEpoch;          /*!< NTP time-stamp of the simulation start     */
+
+/* -- local functions -- */
+
+/*!
+  \brief uniform random number in (0, 1)
+*/
+static double rnd( unsigned *seed)
+{
+  return (rand_r( seed) + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+/*!
+  \brief normal random number (Box-Muller)
+*/
+static double gauss( unsigned *seed)
+{
+  return sqrt( -2 * log( rnd( seed))) * cos( 2 * M_PI * rnd( seed));
+}
+
+/*!
+  \brief virtual clock operations for the synchronization engine
+  ******************************************************************
+*/
+static int sim_step( void *ctx, double offset)
+{
+  ((sim_clock_t *)ctx)->m_error += offset;
+  ((sim_clock_t *)ctx)->m_slewLeft = 0;
+  return 0;
+}
+
+static int sim_slew( void *ctx, double offset)
+{
+  ((sim_clock_t *)ctx)->m_slewLeft += offset;  // given with the pending one, as sys_slew()
+  return 0;
+}
+
+static int sim_freq( void *ctx, double freq)
+{
+  ((sim_clock_t *)ctx)->m_freq = freq;
+  return 0;
+}
+
+static double sim_elapsed( void *ctx)
+{
+  return ((sim_clock_t *)ctx)->m_true;
+}
+
+/*!
+  \brief advance the virtual clock by dt seconds
+*/
+static void sim_advance( sim_clock_t *c, const sim_params_t *p, double dt)
+{
+  double slew = c->m_slewLeft, max = SIM_MAX_SLEW * dt;
+
+  c->m_skew  += p->m_wander * sqrt( dt) * gauss( &c->m_seed);
+  c->m_error += (c->m_skew + c->m_freq) * dt;
+
+  if( slew >  max) slew =  max;
+  if( slew < -max) slew = -max;
+  c->m_error    += slew;
+  c->m_slewLeft -= slew;
+  c->m_true     += dt;
+}
+
+/*!
+  \brief one simulated NTP exchange with a server
+  ******************************************************************
+
+  \param c      the virtual clock
+  \param p      the scenario
+  \param server index of the server
+  \param sample where to put the sample
+  \return 0 if a reply was received else -1
+*/
+static int sim_query( sim_clock_t *c, const sim_params_t *p, int server, ntp_sample_t *sample)
+{
+  double up, down, bias = 0, t = c->m_true;
+
+  if( rnd( &c->m_seed) < p->m_loss) return -1;
+  if( t >= p->m_outageStart && t < p->m_outageStart + p->m_outageLen) return -1;
+
+  up   = p->m_delay * (1 + p->m_asym) - p->m_jitter * log( rnd( &c->m_seed));
+  down = p->m_delay * (1 - p->m_asym) - p->m_jitter * log( rnd( &c->m_seed));
+  if( server < p->m_falsetickers) bias = (server % 2 ? -1 : 1) * SIM_FALSETICKER_ERR;
+
+  /* local time-stamps drift with the local clock during the exchange */
+  memset( sample, 0, sizeof(*sample));
+  sample->m_t1 = ntp_ts_add( gEpoch, t + c->m_error);
+  sample->m_t2 = ntp_ts_add( gEpoch, t + up + bias);
+  sample->m_t3 = ntp_ts_add( gEpoch, t + up + SIM_PROCESSING + bias);
+  sample->m_t4 = ntp_ts_add( gEpoch, t + up + SIM_PROCESSING + down + c->m_error
+                             + (c->m_skew + c->m_freq) * (up + SIM_PROCESSING + down));
+  sample->m_stratum  = 2;
+  sample->m_rootDisp = 0.0001;
+  ntp_sample_compute( sample);
+
+  return 0;
+}
+
+/*!
+  \brief compare doubles for qsort()
+*/
+static int cmp_double( const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*!
+  \brief run one scenario with one strategy and filter, write JSON
+  ******************************************************************
+
+  \param out      JSON output
+  \param p        the scenario
+  \param strategy correction strategy
+  \param filter   filter algorithm
+*/
+static int sim_run( FILE *out, const sim_params_t *p, sync_strategy strategy, sync_filter filter)
+{
+  static const char *strategies[] = { "step", "slew" };
+  static const char *filters[]    = { "last", "mindelay", "median" };
+  sim_clock_t clock;
+  sync_clock_t ops = { sim_step, sim_slew, sim_freq, sim_elapsed, &clock };
+  sync_engine_t engine;
+  sync_result_t result;
+  ntp_sample_t polled[ktSYNC_MAXPEERS];
+  int got[ktSYNC_MAXPEERS];
+  double duration = p->m_days * 86400, next = 0, sum = 0, sq = 0, *errs = NULL, *abserr = NULL;
+  double holdoverMax = 0, rejoinError = 0;
+  long n = 0, cap, i;
+  int k, nosource = 0, holdover = 0, steps = 0, rejoined = 0;
+
+  cap  = (long)(duration / SIM_RECORD_EVERY) + 1;
+  errs = calloc( (size_t)cap, sizeof(double));
+  abserr = calloc( (size_t)cap, sizeof(double));
+  if( !errs || !abserr) return -1;
+
+  memset( &clock, 0, sizeof(clock));
+  clock.m_error = p->m_initial;
+  clock.m_skew  = p->m_skew;
+  clock.m_seed  = p->m_seed;
+  sync_init( &engine, &ops, p->m_servers, strategy, filter, p->m_poll);
+  engine.m_holdoverRate = p->m_holdoverRate;
+
+  while( clock.m_true < duration) {
+    if( clock.m_true >= next) {
+      for( k = 0; k < p->m_servers; k++) {
+        if( !(got[k] = (sim_query( &clock, p, k, &polled[k]) == 0))) continue;
+        if( strategy == eSYNC_STRATEGY_SLEW) polled[k].m_offset -= clock.m_slewLeft;  // as ntpdate()
+        sync_add_sample( &engine, k, &polled[k]);
+      }
+      if( p->m_outageLen > 0 && clock.m_true >= p->m_outageStart + p->m_outageLen && !rejoined) {
+        rejoined    = 1;                       // servers back: how far the clock went
+        rejoinError = clock.m_error;
+        steps       = engine.m_steps;
+      }
+      switch( sync_update( &engine, &result)) {
+      case eSYNC_HOLDOVER:
+        holdover++;
+        /* fall through */
+      case eSYNC_NOSOURCE:
+        nosource++;
+        break;
+      }
+      for( k = 0; k < p->m_servers; k++) {
+        if( got[k]) history_add( k, &polled[k], result.m_action, (result.m_selected >> k) & 1);
+      }
+      next += p->m_poll;
+    }
+    sim_advance( &clock, p, 1.0);
+
+    if( clock.m_true >= p->m_outageStart && clock.m_true < p->m_outageStart + p->m_outageLen &&
+        fabs( clock.m_error) > holdoverMax) holdoverMax = fabs( clock.m_error);
+
+    if( clock.m_true >= p->m_warmup && (long)clock.m_true % SIM_RECORD_EVERY == 0 && n < cap) {
+      errs[n++] = clock.m_error;
+      sum += clock.m_error;
+      sq  += clock.m_error * clock.m_error;
+    }
+  }
+
+  for( i = 0; i < n; i++) abserr[i] = fabs( errs[i]);
+  qsort( errs, (size_t)n, sizeof(double), cmp_double);
+  qsort( abserr, (size_t)n, sizeof(double), cmp_double);
+
+  fprintf( out, "    { \"strategy\": \"%s\", \"filter\": \"%s\", \"steps\": %d, \"no_source\": %d, "
+           "\"final_freq_ppm\": %.3f, \"final_skew_ppm\": %.3f,\n      \"error\": { \"count\": %ld",
+           strategies[strategy], filters[filter], engine.m_steps, nosource,
+           engine.m_freq * 1e6, clock.m_skew * 1e6, n);
+  if( n > 0) {
+    fprintf( out, ", \"mean_us\": %.3f, \"rms_us\": %.3f, \"min_us\": %.3f, \"median_us\": %.3f, \"max_us\": %.3f, "
+             "\"abs_p50_us\": %.3f, \"abs_p95_us\": %.3f, \"abs_p99_us\": %.3f, \"abs_max_us\": %.3f",
+             sum / n * 1e6, sqrt( sq / n) * 1e6, errs[0] * 1e6, errs[n / 2] * 1e6, errs[n - 1] * 1e6,
+             abserr[n / 2] * 1e6, abserr[(long)((n - 1) * 0.95)] * 1e6,
+             abserr[(long)((n - 1) * 0.99)] * 1e6, abserr[n - 1] * 1e6);
+  }
+  fprintf( out, " }");
+  if( p->m_outageLen > 0) {
+    fprintf( out, ",\n      \"holdover\": { \"polls\": %d, \"abs_max_us\": %.3f, \"bound_us\": %.3f, "
+             "\"rejoin_us\": %.3f, \"rejoin_steps\": %d }", holdover, holdoverMax * 1e6,
+             engine.m_holdoverRate * p->m_outageLen * 1e6, rejoinError * 1e6, rejoined ? engine.m_steps - steps : 0);
+  }
+  fprintf( out, " }");
+
+  free( errs);
+  free( abserr);
+  return 0;
+}
+
+/*!
+  \brief display usage and exit
+*/
+static void usage( void)
+{
+  fprintf( stderr,
+           "Usage: zntpsim [options]\n"
+           "  -D days    simulated duration (default 2)\n"
+           "  -W secs    warm up not recorded (default 3600)\n"
+           "  -p secs    poll interval (default 64)\n"
+           "  -s ppm     oscillator frequency error (default 20)\n"
+           "  -w ppm     frequency random walk per sqrt(s) (default 0.001)\n"
+           "  -i secs    initial clock error (default 0.5)\n"
+           "  -n n       number of servers (default 3, max %d)\n"
+           "  -F n       number of falsetickers among them (default 0)\n"
+           "  -d secs    one-way path delay (default 0.005)\n"
+           "  -a ratio   path asymmetry, -1 to 1 (default 0)\n"
+           "  -j secs    mean exponential jitter per path (default 0.0005)\n"
+           "  -l ratio   loss probability (default 0.01)\n"
+           "  -O h:len   no server from hour h for len hours (holdover)\n"
+           "  -R ppm     error growth in holdover (default 15)\n"
+           "  -m name    strategy: step or slew (default slew)\n"
+           "  -f name    filter: last, mindelay or median (default mindelay)\n"
+           "  -c         compare all strategies and filters\n"
+           "  -H f[:n]   append the samples to history file f of n records (not with -c)\n"
+           "  -S seed    random seed (default 1)\n"
+           "  -o file    JSON output (default stdout)\n", ktSYNC_MAXPEERS);
+  exit(1);
+}
+
+/*!
+  \brief Simulator entry point
+  ******************************************************************
+
+  \param argc number of argument
+  \param argv arguments list
+  \return 0 if success else 1
+*/
+int main( int argc, char **argv)
+{
+  struct timespec start = { 1767225600, 0 };   // 1 Jan 2026
+  sim_params_t p;
+  FILE *out = stdout;
+  char *history = NULL;
+  unsigned records;
+  int c, compare = 0, strategy = eSYNC_STRATEGY_SLEW, filter = eSYNC_FILTER_MINDELAY, s, f;
+
+  memset( &p, 0, sizeof(p));
+  p.m_days    = 2;
+  p.m_warmup  = 3600;
+  p.m_poll    = 64;
+  p.m_skew    = 20e-6;
+  p.m_wander  = 1e-9;
+  p.m_initial = 0.5;
+  p.m_servers = 3;
+  p.m_delay   = 0.005;
+  p.m_jitter  = 0.0005;
+  p.m_loss    = 0.01;
+  p.m_holdoverRate = ktSYNC_HOLDOVER_RATE;
+  p.m_seed    = 1;
+
+  while( (c = getopt( argc, argv, "D:W:p:s:w:i:n:F:d:a:j:l:O:R:m:f:cS:o:H:h")) != -1) {
+    switch( c) {
+    case 'D': p.m_days = atof( optarg); break;
+    case 'W': p.m_warmup = atof( optarg); break;
+    case 'p': p.m_poll = atoi( optarg); break;
+    case 's': p.m_skew = atof( optarg) * 1e-6; break;
+    case 'w': p.m_wander = atof( optarg) * 1e-6; break;
+    case 'i': p.m_initial = atof( optarg); break;
+    case 'n': p.m_servers = atoi( optarg); break;
+    case 'F': p.m_falsetickers = atoi( optarg); break;
+    case 'd': p.m_delay = atof( optarg); break;
+    case 'a': p.m_asym = atof( optarg); break;
+    case 'j': p.m_jitter = atof( optarg); break;
+    case 'l': p.m_loss = atof( optarg); break;
+    case 'O':
+      if( sscanf( optarg, "%lf:%lf", &p.m_outageStart, &p.m_outageLen) != 2) usage();
+      p.m_outageStart *= 3600;
+      p.m_outageLen   *= 3600;
+      break;
+    case 'R': p.m_holdoverRate = atof( optarg) * 1e-6; break;
+    case 'm':
+      if( !strcmp( optarg, "step")) strategy = eSYNC_STRATEGY_STEP;
+      else if( !strcmp( optarg, "slew")) strategy = eSYNC_STRATEGY_SLEW;
+      else usage();
+      break;
+    case 'f': if( (filter = sync_filter_parse( optarg)) < 0) usage(); break;
+    case 'c': compare = 1; break;
+    case 'S': p.m_seed = (unsigned)atoi( optarg); break;
+    case 'H': history = optarg; break;
+    case 'o':
+      if( !(out = fopen( optarg, "w"))) {
+        perror( optarg);
+        return 1;
+      }
+      break;
+    default: usage(); break;
+    }
+  }
+  if( p.m_servers < 1 || p.m_servers > ktSYNC_MAXPEERS || p.m_poll < 1 || p.m_days <= 0) usage();
+
+  gEpoch = ntp_ts_from_timespec( &start);
+  if( history) {
+    char name[16];
+
+    if( compare || history_parse( history, &records) < 0) usage();
+    gSimTrace.m_file = stderr;
+    gAppTrace = &gSimTrace;
+    if( history_open( history, records) < 0) return 1;
+    for( c = 0; c < p.m_servers; c++) {
+      snprintf( name, sizeof(name), "sim%d", c);
+      history_server( name);
+    }
+  }
+
+  fprintf( out, "{\n  \"scenario\": { \"days\": %g, \"poll\": %d, \"skew_ppm\": %g, \"wander_ppm\": %g, "
+           "\"initial_s\": %g, \"servers\": %d, \"falsetickers\": %d, \"delay_s\": %g, \"asym\": %g, "
+           "\"jitter_s\": %g, \"loss\": %g, \"outage_h\": [ %g, %g ], \"holdover_ppm\": %g, \"seed\": %u },\n"
+           "  \"runs\": [\n",
+           p.m_days, p.m_poll, p.m_skew * 1e6, p.m_wander * 1e6, p.m_initial, p.m_servers,
+           p.m_falsetickers, p.m_delay, p.m_asym, p.m_jitter, p.m_loss,
+           p.m_outageStart / 3600, p.m_outageLen / 3600, p.m_holdoverRate * 1e6, p.m_seed);
+
+  if( compare) {
+    for( s = eSYNC_STRATEGY_STEP; s <= eSYNC_STRATEGY_SLEW; s++) {
+      for( f = eSYNC_FILTER_LAST; f <= eSYNC_FILTER_MEDIAN; f++) {
+        sim_run( out, &p, s, f);
+        fprintf( out, "%s\n", (s == eSYNC_STRATEGY_SLEW && f == eSYNC_FILTER_MEDIAN) ? "" : ",");
+      }
+    }
+  }
+  else {
+    sim_run( out, &p, strategy, filter);
+    fprintf( out, "\n");
+  }
+  fprintf( out, "  ]\n}\n");
+
+  if( out != stdout) fclose( out);
+  history_close();
+  return 0;
+}
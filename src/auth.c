@@ -0,0 +1,478 @@
+/**
+ * \file auth.c
+ * \brief NTP symmetric key authentication (MD5, SHA1, AES-CMAC)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Keys come from a key file in the ntpd/chronyd format:
+ *
+ *   # id  type        key
+ *   1     MD5         secret          (20 chars at most: ASCII)
+ *   2     SHA1        HEX:0123...     (or more than 20 chars: hex)
+ *   3     AES128CMAC  00112233445566778899aabbccddeeff
+ *
+ * A MAC is the key id (network order) followed by the digest of the
+ * packet, appended after it. MD5 and SHA1 hash the key then the
+ * packet: the digest state after the key is computed once at load, so
+ * a packet only costs a copy of that state and the hash of 48 bytes.
+ * AES-CMAC (needs libcrypto) keeps a keyed AES-CBC context and the
+ * CMAC subkeys: the MAC is the last block of the CBC encryption of the
+ * packet, its last block masked by a subkey, one EVP call using AES-NI.
+ * The keys are read-only once loaded, the threads share them without
+ * lock; as an EVP context cannot be used by two threads at once, each
+ * thread uses its own copy, made at its first packet.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#if defined(HAVE_OPENSSL_EVP_H) && defined(HAVE_LIBCRYPTO)
+#  include <pthread.h>
+#  include <openssl/evp.h>
+#  define HAVE_CMAC 1
+#endif
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "md5.h"
+#include "sha1.h"
+#include "auth.h"
+
+#define NTP_HEADER_LEN   48      /*!< packet without extension fields nor MAC   */
+#define ASCII_MAXLEN     20      /*!< longer keys without prefix are in hex     */
+
+/*!
+  \struct auth_key_t
+  \brief a key with its precomputed digest context
+*/
+struct auth_key_t {
+  uint32_t m_id;                 /*!< key id                                     */
+  int      m_type;               /*!< auth_type                                  */
+  int      m_len;                /*!< digest length                              */
+  union {
+    md5_t  m_md5;                /*!< key already hashed                         */
+    sha1_t m_sha1;               /*!< key already hashed                         */
+#ifdef HAVE_CMAC
+    struct {
+      EVP_CIPHER_CTX *m_aes;     /*!< AES-128-CBC keyed, copied by each thread   */
+      uint8_t m_k1[16];          /*!< subkey of complete last blocks             */
+      uint8_t m_k2[16];          /*!< subkey of padded last blocks               */
+    } m_cmac;
+#endif
+  } m_ctx;
+};
+
+static auth_key_t gKeys[ktAUTH_MAXKEYS]; /*!< sorted by id                       */
+static int        gNkeys = 0;
+
+#ifdef HAVE_CMAC
+#define CMAC_CHUNK       256     /*!< bytes encrypted per EVP call               */
+
+/*!
+  \struct auth_local_t
+  \brief AES contexts of a thread, one per key
+*/
+typedef struct auth_local_t {
+  unsigned        m_gen;         /*!< gGen when made                             */
+  EVP_CIPHER_CTX *m_aes[ktAUTH_MAXKEYS]; /*!< copies of m_cmac.m_aes             */
+
+} auth_local_t;
+
+static pthread_key_t  gLocal;
+static pthread_once_t gLocalOnce = PTHREAD_ONCE_INIT;
+static unsigned       gGen = 0;  /*!< incremented by each auth_load()           */
+#endif
+
+/*!
+  \brief key id order
+*/
+static int cmp_key( const void *a, const void *b)
+{
+  uint32_t x = ((const auth_key_t *)a)->m_id, y = ((const auth_key_t *)b)->m_id;
+
+  return (x > y) - (x < y);
+}
+
+static inline uint32_t get32( const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void put32( uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+#ifdef HAVE_CMAC
+/*!
+  \brief CMAC subkey: shift left one bit, reduce by the polynomial
+*/
+static void cmac_double( const uint8_t in[16], uint8_t out[16])
+{
+  int i;
+
+  for( i = 0; i < 15; i++) out[i] = (uint8_t)(in[i] << 1 | in[i + 1] >> 7);
+  out[15] = (uint8_t)(in[15] << 1);
+  if( in[0] & 0x80) out[15] ^= 0x87;
+}
+
+/*!
+  \brief free the AES contexts of a thread
+*/
+static void local_free( void *arg)
+{
+  auth_local_t *local = (auth_local_t *)arg;
+  int i;
+
+  for( i = 0; i < ktAUTH_MAXKEYS; i++) EVP_CIPHER_CTX_free( local->m_aes[i]);
+  free( local);
+}
+
+static void local_init( void)
+{
+  pthread_key_create( &gLocal, local_free);
+}
+
+/*!
+  \brief AES context of a key for the calling thread
+*/
+static EVP_CIPHER_CTX *local_aes( const auth_key_t *key)
+{
+  auth_local_t *local;
+  int i, k = (int)(key - gKeys);
+
+  pthread_once( &gLocalOnce, local_init);
+  if( !(local = (auth_local_t *)pthread_getspecific( gLocal))) {
+    if( !(local = (auth_local_t *)calloc( 1, sizeof(*local)))) return NULL;
+    local->m_gen = gGen;
+    pthread_setspecific( gLocal, local);
+  }
+  if( local->m_gen != gGen) {            // keys reloaded
+    for( i = 0; i < ktAUTH_MAXKEYS; i++) {
+      EVP_CIPHER_CTX_free( local->m_aes[i]);
+      local->m_aes[i] = NULL;
+    }
+    local->m_gen = gGen;
+  }
+  if( !local->m_aes[k] && (local->m_aes[k] = EVP_CIPHER_CTX_new()) &&
+      !EVP_CIPHER_CTX_copy( local->m_aes[k], key->m_ctx.m_cmac.m_aes)) {
+    EVP_CIPHER_CTX_free( local->m_aes[k]);
+    local->m_aes[k] = NULL;
+  }
+  return local->m_aes[k];
+}
+
+/*!
+  \brief AES-128-CMAC (RFC 4493)
+*/
+static void cmac( const auth_key_t *key, const uint8_t *msg, int len, uint8_t mac[16])
+{
+  static const uint8_t zero[16] = { 0 };
+  EVP_CIPHER_CTX *aes = local_aes( key);
+  uint8_t buf[CMAC_CHUNK], last[16];
+  const uint8_t *sub;
+  int i, n, rest, done = 0, out;
+
+  memset( mac, 0, 16);
+  if( !aes || !EVP_EncryptInit_ex( aes, NULL, NULL, NULL, zero)) return;
+
+  /* all blocks but the last, by chunks: only the chaining value matters */
+  rest = len ? len - 16 * ((len - 1) / 16) : 0;
+  for( n = len - rest; done < n; done += i) {
+    i = (n - done > CMAC_CHUNK) ? CMAC_CHUNK : n - done;
+    EVP_EncryptUpdate( aes, buf, &out, msg + done, i);
+  }
+
+  memset( last, 0, sizeof(last));
+  memcpy( last, msg + done, (size_t)rest);
+  if( rest == 16) sub = key->m_ctx.m_cmac.m_k1;
+  else {
+    last[rest] = 0x80;
+    sub = key->m_ctx.m_cmac.m_k2;
+  }
+  for( i = 0; i < 16; i++) last[i] ^= sub[i];
+  EVP_EncryptUpdate( aes, mac, &out, last, 16);
+}
+#endif
+
+/*!
+  \brief digest of a packet
+*/
+static void digest( const auth_key_t *key, const uint8_t *packet, int len, uint8_t *out)
+{
+  md5_t md5;
+  sha1_t sha1;
+
+  switch( key->m_type) {
+  case eAUTH_MD5:
+    md5 = key->m_ctx.m_md5;
+    md5_update( &md5, packet, (size_t)len);
+    md5_final( &md5, out);
+    break;
+  case eAUTH_SHA1:
+    sha1 = key->m_ctx.m_sha1;
+    sha1_update( &sha1, packet, (size_t)len);
+    sha1_final( &sha1, out);
+    break;
+#ifdef HAVE_CMAC
+  case eAUTH_CMAC:
+    cmac( key, packet, len, out);
+    break;
+#endif
+  default:
+    break;
+  }
+}
+
+/*!
+  \brief decode a key of the key file
+  ******************************************************************
+
+  \param text "HEX:..." or "ASCII:..." or, without prefix, ASCII
+              up to 20 characters and hex above
+  \param key  the decoded key
+  \return its length or -1 if invalid
+*/
+static int key_decode( const char *text, uint8_t key[ktAUTH_MAXKEYLEN])
+{
+  int len, i, hex;
+  unsigned byte;
+
+  if( !strncasecmp( text, "HEX:", 4))        { text += 4; hex = 1; }
+  else if( !strncasecmp( text, "ASCII:", 6)) { text += 6; hex = 0; }
+  else hex = strlen( text) > ASCII_MAXLEN;
+
+  len = (int)strlen( text);
+  if( !hex) {
+    if( len == 0 || len > ktAUTH_MAXKEYLEN) return -1;
+    memcpy( key, text, (size_t)len);
+    return len;
+  }
+  if( len == 0 || len % 2 || len / 2 > ktAUTH_MAXKEYLEN) return -1;
+  for( i = 0; i < len / 2; i++) {
+    if( !isxdigit( (unsigned char)text[2 * i]) || !isxdigit( (unsigned char)text[2 * i + 1]) ||
+        sscanf( text + 2 * i, "%2x", &byte) != 1) return -1;
+    key[i] = (uint8_t)byte;
+  }
+  return len / 2;
+}
+
+/*!
+  \brief load the key file (--keys)
+  ******************************************************************
+
+  \param path the key file
+  \param line set to the line of a syntax error
+  \return number of keys, -1 if not readable, -2 if a line is invalid,
+          -3 if a key type is not supported by this build
+*/
+int auth_load( const char *path, int *line)
+{
+  char buf[256], type[16], text[128];
+  uint8_t key[ktAUTH_MAXKEYLEN];
+  auth_key_t *k;
+  unsigned long id;
+  FILE *f;
+  int len, n, err = 0;
+#ifdef HAVE_CMAC
+  uint8_t zero[16], l[16];
+  int out;
+#endif
+
+  if( !(f = fopen( path, "r"))) return -1;
+  *line = 0;
+#ifdef HAVE_CMAC
+  for( n = 0; n < gNkeys; n++) {
+    if( gKeys[n].m_type == eAUTH_CMAC) EVP_CIPHER_CTX_free( gKeys[n].m_ctx.m_cmac.m_aes);
+  }
+  gGen++;
+#endif
+  gNkeys = 0;
+
+  while( fgets( buf, sizeof(buf), f)) {
+    (*line)++;
+    if( strchr( buf, '#')) *strchr( buf, '#') = '\0';
+    if( (n = sscanf( buf, "%lu %15s %127s", &id, type, text)) <= 0) continue;
+    if( n != 3 || id == 0 || id > 0xFFFFFFFFUL || gNkeys >= ktAUTH_MAXKEYS || (len = key_decode( text, key)) < 0) {
+      err = -2;
+      break;
+    }
+
+    k = &gKeys[gNkeys];
+    memset( k, 0, sizeof(*k));
+    k->m_id = (uint32_t)id;
+    if( !strcasecmp( type, "MD5") || !strcmp( type, "M")) {
+      k->m_type = eAUTH_MD5;
+      k->m_len  = ktMD5_LEN;
+      md5_init( &k->m_ctx.m_md5);
+      md5_update( &k->m_ctx.m_md5, key, (size_t)len);
+    }
+    else if( !strcasecmp( type, "SHA1")) {
+      k->m_type = eAUTH_SHA1;
+      k->m_len  = ktSHA1_LEN;
+      sha1_init( &k->m_ctx.m_sha1);
+      sha1_update( &k->m_ctx.m_sha1, key, (size_t)len);
+    }
+    else if( !strcasecmp( type, "AES128CMAC") || !strcasecmp( type, "AES128")) {
+#ifdef HAVE_CMAC
+      if( len != 16) {
+        err = -2;
+        break;
+      }
+      k->m_type = eAUTH_CMAC;
+      k->m_len  = 16;
+      memset( zero, 0, sizeof(zero));
+      if( !(k->m_ctx.m_cmac.m_aes = EVP_CIPHER_CTX_new()) ||
+          !EVP_EncryptInit_ex( k->m_ctx.m_cmac.m_aes, EVP_aes_128_cbc(), NULL, key, zero) ||
+          !EVP_CIPHER_CTX_set_padding( k->m_ctx.m_cmac.m_aes, 0) ||
+          !EVP_EncryptUpdate( k->m_ctx.m_cmac.m_aes, l, &out, zero, 16)) {
+        EVP_CIPHER_CTX_free( k->m_ctx.m_cmac.m_aes);
+        err = -3;
+        break;
+      }
+      cmac_double( l, k->m_ctx.m_cmac.m_k1);
+      cmac_double( k->m_ctx.m_cmac.m_k1, k->m_ctx.m_cmac.m_k2);
+#else
+      err = -3;
+      break;
+#endif
+    }
+    else {
+      err = -3;
+      break;
+    }
+    gNkeys++;
+  }
+  fclose( f);
+  memset( key, 0, sizeof(key));
+  memset( text, 0, sizeof(text));
+  memset( buf, 0, sizeof(buf));
+  if( err) {
+#ifdef HAVE_CMAC
+    for( n = 0; n < gNkeys; n++) {
+      if( gKeys[n].m_type == eAUTH_CMAC) EVP_CIPHER_CTX_free( gKeys[n].m_ctx.m_cmac.m_aes);
+    }
+#endif
+    gNkeys = 0;
+    return err;
+  }
+
+  qsort( gKeys, (size_t)gNkeys, sizeof(*gKeys), cmp_key);
+  return gNkeys;
+}
+
+/*!
+  \brief key of the key file
+  ******************************************************************
+
+  \param id key id
+  \return the key or NULL if unknown
+*/
+const auth_key_t *auth_find( uint32_t id)
+{
+  auth_key_t probe;
+
+  probe.m_id = id;
+  return (const auth_key_t *)bsearch( &probe, gKeys, (size_t)gNkeys, sizeof(*gKeys), cmp_key);
+}
+
+/*!
+  \brief append the MAC of a packet
+  ******************************************************************
+
+  \param key    the key
+  \param packet the packet, room for ktAUTH_MACLEN more bytes
+  \param len    its length
+  \return the length with the MAC
+*/
+int auth_sign( const auth_key_t *key, uint8_t *packet, int len)
+{
+  put32( packet + len, key->m_id);
+  digest( key, packet, len, packet + len + 4);
+  return len + 4 + key->m_len;
+}
+
+/*!
+  \brief append a crypto-NAK (MAC of key id 0, no digest)
+  ******************************************************************
+
+  \param packet the packet, room for 4 more bytes
+  \param len    its length
+  \return the length with the crypto-NAK
+*/
+int auth_nak( uint8_t *packet, int len)
+{
+  put32( packet + len, 0);
+  return len + 4;
+}
+
+/*!
+  \brief check the MAC of a packet
+  ******************************************************************
+
+  The MAC is the last 20 (MD5, CMAC) or 24 (SHA1) bytes, after the
+  header and the extension fields if any. The digests are compared in
+  constant time.
+
+  \param packet the packet
+  \param len    its length
+  \param id     set to the key id of the MAC, 0 if none
+  \return auth_status
+*/
+int auth_verify( const uint8_t *packet, int len, uint32_t *id)
+{
+  const auth_key_t *key;
+  uint8_t mac[ktAUTH_MACLEN];
+  int at, maclen, i, diff = 0, status = eAUTH_NONE;
+
+  *id = 0;
+  if( len == NTP_HEADER_LEN + 4 && get32( packet + NTP_HEADER_LEN) == 0) return eAUTH_NAK;
+
+  for( maclen = ktAUTH_MACLEN; maclen >= ktAUTH_MACLEN - 4; maclen -= 4) {
+    at = len - maclen;
+    if( at < NTP_HEADER_LEN || at % 4) continue;
+    if( !(key = auth_find( get32( packet + at))) || key->m_len + 4 != maclen) {
+      if( status == eAUTH_NONE) {
+        *id    = get32( packet + at);
+        status = eAUTH_UNKNOWN;
+      }
+      continue;
+    }
+    *id = key->m_id;
+    digest( key, packet, at, mac);
+    for( i = 0; i < key->m_len; i++) diff |= mac[i] ^ packet[at + 4 + i];
+    return diff ? eAUTH_BAD : eAUTH_OK;
+  }
+  return status;
+}
+
+/*!
+  \brief text of an auth_status
+*/
+const char *auth_status_name( int status)
+{
+  switch( status) {
+  case eAUTH_OK:      return _("authenticated");
+  case eAUTH_NONE:    return _("no MAC");
+  case eAUTH_UNKNOWN: return _("unknown key");
+  case eAUTH_BAD:     return _("bad MAC");
+  case eAUTH_NAK:     return _("crypto-NAK");
+  default:            return "?";
+  }
+}
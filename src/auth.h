@@ -0,0 +1,60 @@
+/**
+ * \file auth.h
+ * \brief NTP symmetric key authentication header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef AUTH_H_
+#define AUTH_H_
+
+#include <stdint.h>
+
+#define ktAUTH_MAXKEYS     64    /*!< keys of the key file at most               */
+#define ktAUTH_MAXKEYLEN   32    /*!< longest key (bytes)                        */
+#define ktAUTH_MACLEN      24    /*!< longest MAC: key id and SHA1 digest        */
+
+/*!
+  \enum auth_type
+  \brief digest of a key
+  ******************************************************************
+*/
+typedef enum auth_type {
+  eAUTH_MD5 = 1,                 /*!< MD5(key | packet), RFC 5905                */
+  eAUTH_SHA1,                    /*!< SHA1(key | packet)                         */
+  eAUTH_CMAC,                    /*!< AES-128-CMAC(key, packet), RFC 8573        */
+
+}auth_type;
+
+/*!
+  \enum auth_status
+  \brief result of auth_verify()
+  ******************************************************************
+*/
+typedef enum auth_status {
+  eAUTH_OK      =  0,            /*!< MAC of a known key, right                  */
+  eAUTH_NONE    = -1,            /*!< no MAC                                     */
+  eAUTH_UNKNOWN = -2,            /*!< MAC of a key not in the key file           */
+  eAUTH_BAD     = -3,            /*!< wrong MAC                                  */
+  eAUTH_NAK     = -4,            /*!< crypto-NAK: the peer refused our MAC       */
+
+}auth_status;
+
+/*! a key with its precomputed digest context, read-only once loaded */
+typedef struct auth_key_t auth_key_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int               auth_load  ( const char *path, int *line);
+const auth_key_t *auth_find  ( uint32_t id);
+int               auth_sign  ( const auth_key_t *key, uint8_t *packet, int len);
+int               auth_nak   ( uint8_t *packet, int len);
+int               auth_verify( const uint8_t *packet, int len, uint32_t *id);
+const char       *auth_status_name( int status);
+
+#endif /* AUTH_H_ */
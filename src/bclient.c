@@ -0,0 +1,260 @@
+/**
+ * \file bclient.c
+ * \brief broadcast and multicast client (--bclient)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --bclient, the daemon does not poll the servers: it listens for
+ * the broadcast (mode 5) packets they send to a broadcast address or a
+ * multicast group (see --broadcast of the server mode), so the load of
+ * a server does not grow with its clients.
+ *
+ * A broadcast only tells T3, when it left the server. The first one of
+ * each server is followed by a unicast exchange with it, which gives
+ * the offset of the clock; the one-way delay of the broadcasts is what
+ * the broadcast lacks to give the same offset:
+ *
+ *   delay = unicast offset - (T3 - T4)      (0 .. ktBCLIENT_MAXDELAY)
+ *
+ * which also takes in the time the server takes to send a broadcast,
+ * so it may be longer than the unicast round trip.
+ *
+ * Then each broadcast is a sample of offset T3 - T4 + delay and of
+ * round trip 2 delay, for the synchronization engine as usual.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "timing.h"
+#include "sync.h"
+#include "auth.h"
+#include "netio.h"
+#include "systemd.h"
+#include "bclient.h"
+
+/*!
+  \struct bclient_sender_t
+  \brief a server heard
+*/
+typedef struct bclient_sender_t {
+  int    m_calibrated;           /*!< m_delay is known                           */
+  double m_delay;                /*!< one-way delay of its broadcasts (s)        */
+
+} bclient_sender_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static bclient_sender_t gSenders[ktSYNC_MAXPEERS];
+
+/*!
+  \brief listen for the broadcasts sent to an address
+  ******************************************************************
+
+  \param group broadcast address or multicast group, joined then
+  \return the socket or -1 if failed
+*/
+int bclient_open( const char *group)
+{
+  struct sockaddr_in addr;
+  struct ip_mreq mreq;
+  struct in_addr to;
+  int s, one = 1;
+
+  if( !inet_aton( group, &to)) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Invalid broadcast address %s"), group);
+    return -1;
+  }
+  if( (s = socket( PF_INET, SOCK_DGRAM, 0)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+    return -1;
+  }
+  setsockopt( s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt( s, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+  memset( &addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY);
+  addr.sin_port        = htons( gAppOptions.m_port);
+  if( bind( s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot listen on port %d: %s"), gAppOptions.m_port, strerror( errno));
+    close( s);
+    return -1;
+  }
+  if( IN_MULTICAST( ntohl( to.s_addr))) {
+    memset( &mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr        = to;
+    mreq.imr_interface.s_addr = htonl( INADDR_ANY);
+    if( setsockopt( s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot join %s: %s"), group, strerror( errno));
+      close( s);
+      return -1;
+    }
+  }
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Listening for NTP broadcasts to %s on port %d"), group, gAppOptions.m_port);
+  return s;
+}
+
+/*!
+  \brief one-way delay of the broadcasts of a server
+  ******************************************************************
+
+  \param s        socket of the unicast exchange
+  \param sender   the server heard
+  \param addr     its address, NTP port
+  \param apparent T3 - T4 of the broadcast just heard (s)
+  \return 0 if OK or -1 if the server did not answer
+*/
+static int calibrate( int s, bclient_sender_t *sender, const struct sockaddr_in *addr, double apparent)
+{
+  ntp_sample_t unicast;
+
+  systemd_watchdog();                      // several servers may be calibrated in a row
+  if( ntp_query( s, addr, &unicast, NULL) != eNTP_OK) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Broadcast server %s did not answer, delay not calibrated"),
+                 inet_ntoa( addr->sin_addr));
+    return -1;
+  }
+  sender->m_delay = unicast.m_offset - apparent;
+  if( sender->m_delay < 0 || sender->m_delay > ktBCLIENT_MAXDELAY) sender->m_delay = unicast.m_delay / 2;
+  sender->m_calibrated = 1;
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Broadcast server %s: one-way delay %.3fms (round trip %.3fms)"),
+               inet_ntoa( addr->sin_addr), sender->m_delay * 1e3, unicast.m_delay * 1e3);
+  return 0;
+}
+
+/*!
+  \brief read the broadcasts of a poll
+  ******************************************************************
+
+  A server heard for the first time is added to the senders (unless
+  they are fixed by the command line) and its delay calibrated. The
+  last broadcast of each server is kept.
+
+  \param bs       socket of bclient_open()
+  \param s        socket of the unicast exchanges
+  \param seconds  how long to listen
+  \param senders  servers heard, the NTP port of their address
+  \param nsenders their number
+  \param fixed    only the senders given are listened to
+  \param samples  sample of each server
+  \param valid    set for the servers heard
+  \param rejected incremented for each broadcast failing authentication
+  \return number of servers heard
+*/
+int bclient_collect( int bs, int s, int seconds, struct sockaddr_in *senders, int *nsenders, int fixed,
+                     ntp_sample_t *samples, int *valid, unsigned long *rejected)
+{
+  union {
+    struct cmsghdr m_align;
+    uint8_t        m_buf[128];
+  } ctrl;                                    // kernel receive time-stamps
+  uint8_t in[ktBCLIENT_BUFSIZE];
+  const ntp_packet_t *packet = (const ntp_packet_t *)in;
+  struct sockaddr_in from;
+  struct msghdr hdr;
+  struct iovec iov;
+  struct timeval tv;
+  struct timespec stamp;
+  fd_set fds;
+  ntp_sample_t *sample;
+  ntp_ts_t t3, t4;
+  double end = timing_now() + seconds, left;
+  uint32_t keyId;
+  int i, n, got = 0;
+
+  while( (left = end - timing_now()) > 0) {
+    systemd_watchdog();
+    if( systemd_interval() > 0 && left > systemd_interval()) left = systemd_interval();
+    FD_ZERO( &fds);
+    FD_SET( bs, &fds);
+    tv.tv_sec  = (time_t)left;
+    tv.tv_usec = (suseconds_t)((left - tv.tv_sec) * 1e6);
+    if( (n = select( bs + 1, &fds, NULL, NULL, &tv)) <= 0) {
+      if( n < 0 && errno != EINTR) break;
+      continue;
+    }
+
+    memset( &hdr, 0, sizeof(hdr));
+    iov.iov_base       = in;
+    iov.iov_len        = sizeof(in);
+    hdr.msg_name       = &from;
+    hdr.msg_namelen    = sizeof(from);
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = &ctrl;
+    hdr.msg_controllen = sizeof(ctrl);
+    n = recvmsg( bs, &hdr, MSG_DONTWAIT);
+    if( n < (int)sizeof(ntp_packet_t)) continue;
+    netio_rx_stamp( &hdr, &stamp);
+    t4 = stamp.tv_sec ? ntp_ts_from_timespec( &stamp) : ntp_ts_now();
+
+    if( NTP_MODE( packet->li_vn_mode) != NTP_MODE_BROADCAST || NTP_LI( packet->li_vn_mode) == NTP_LI_ALARM ||
+        packet->stratum == 0 || packet->stratum >= 16) continue;
+    if( gAppOptions.m_keyId && (auth_verify( in, n, &keyId) != eAUTH_OK || keyId != gAppOptions.m_keyId)) {
+      (*rejected)++;
+      continue;
+    }
+
+    for( i = 0; i < *nsenders && senders[i].sin_addr.s_addr != from.sin_addr.s_addr; i++);
+    if( i == *nsenders) {
+      if( fixed || i == ktSYNC_MAXPEERS) continue;
+      senders[i] = from;
+      senders[i].sin_port = htons( gAppOptions.m_port);
+      strncpy( gAppOptions.m_hosts[i], inet_ntoa( from.sin_addr), ktHOSTNAMELEN);
+      memset( &gSenders[i], 0, sizeof(gSenders[i]));
+      (*nsenders)++;
+    }
+
+    t3 = ntp_ts_get( packet->txTm_s, packet->txTm_f);
+    if( !gSenders[i].m_calibrated && calibrate( s, &gSenders[i], &senders[i], ntp_ts_diff( t3, t4)) < 0) continue;
+
+    sample = &samples[i];
+    memset( sample, 0, sizeof(*sample));
+    sample->m_t1        = ntp_ts_add( t4, -2 * gSenders[i].m_delay);
+    sample->m_t2        = t3;
+    sample->m_t3        = t3;
+    sample->m_t4        = t4;
+    sample->m_leap      = NTP_LI( packet->li_vn_mode);
+    sample->m_stratum   = packet->stratum;
+    sample->m_refId     = ntohl( packet->refId);
+    sample->m_rootDelay = ntp_short_to_secs( packet->rootDelay);
+    sample->m_rootDisp  = ntp_short_to_secs( packet->rootDispersion);
+    ntp_sample_compute( sample);
+    if( gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("Broadcast from %s, stratum %d, offset %+.6fs"),
+                   gAppOptions.m_hosts[i], sample->m_stratum, sample->m_offset);
+    }
+    if( !valid[i]) got++;
+    valid[i] = 1;
+  }
+  return got;
+}
@@ -0,0 +1,29 @@
+/**
+ * \file bclient.h
+ * \brief broadcast and multicast client (--bclient) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef BCLIENT_H_
+#define BCLIENT_H_
+
+#include <netinet/in.h>
+
+#include "ntpdate.h"
+
+#define ktBCLIENT_BUFSIZE  512   /*!< largest broadcast read (MAC included)      */
+#define ktBCLIENT_MAXDELAY 0.100 /*!< longest one-way delay believed (s)          */
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int bclient_open   ( const char *group);
+int bclient_collect( int bs, int s, int seconds, struct sockaddr_in *senders, int *nsenders, int fixed,
+                     ntp_sample_t *samples, int *valid, unsigned long *rejected);
+
+#endif /* BCLIENT_H_ */
@@ -0,0 +1,731 @@
+/**
+ * \file capture.c
+ * \brief offline analysis of NTP exchanges in pcap/pcapng captures
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Replay a tcpdump capture (--pcap): the file is memory-mapped and read
+ * once in order, packets are never copied, NTP fields are read in place
+ * at their offset in ntp_packet_t.
+ *
+ * Client requests are kept in a hash table by transmit time-stamp and
+ * addresses; the reply echoing it as originate time-stamp closes the
+ * exchange. The capture time-stamps of the request and the reply play
+ * the role of T1 and T4, so offset and delay are those of the capturing
+ * host's clock against the server:
+ *
+ *   offset = ((T2 - T1) + (T3 - T4)) / 2
+ *   delay  = (T4 - T1) - (T3 - T2)
+ *
+ * The client clock against the capture clock is also given: transmit
+ * time-stamp of the request minus its capture time.
+ *
+ * Supported: pcap (micro and nanosecond, both byte orders), pcapng
+ * (enhanced packet blocks, if_tsresol), Ethernet with VLAN tags, Linux
+ * cooked (v1, v2), loopback, raw IP; IPv4 (not fragmented) and IPv6
+ * (no extension header), UDP on --port.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntpdate.h"
+#include "timing.h"
+#include "capture.h"
+
+#define CAP_TABLE_BITS     18            /*!< pending requests: 2^18 slots           */
+#define CAP_TABLE_SIZE     (1 << CAP_TABLE_BITS)
+#define CAP_PROBES         8             /*!< slots probed from the hashed one       */
+#define CAP_MAXIF          64            /*!< pcapng interfaces per section          */
+#define CAP_OUTBUF         (1 << 20)     /*!< buffer of the JSON output              */
+
+#define PCAP_MAGIC_US      0xA1B2C3D4    /*!< pcap, microsecond time-stamps          */
+#define PCAP_MAGIC_NS      0xA1B23C4D    /*!< pcap, nanosecond time-stamps           */
+#define PCAPNG_SHB         0x0A0D0D0A    /*!< pcapng section header block            */
+#define PCAPNG_IDB         0x00000001    /*!< pcapng interface description block     */
+#define PCAPNG_EPB         0x00000006    /*!< pcapng enhanced packet block           */
+#define PCAPNG_BOM         0x1A2B3C4D    /*!< pcapng byte order magic                */
+
+/* link types (www.tcpdump.org/linktypes.html) */
+#define LINK_NULL          0
+#define LINK_ETHERNET      1
+#define LINK_RAW_OLD       12
+#define LINK_RAW_OLD2      14
+#define LINK_RAW           101
+#define LINK_LOOP          108
+#define LINK_LINUX_SLL     113
+#define LINK_IPV4          228
+#define LINK_IPV6          229
+#define LINK_LINUX_SLL2    276
+
+/*! read a NTP field of a packet in place */
+#define NTP_FIELD(p, field)   be32( (p) + offsetof(ntp_packet_t, field))
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+/*!
+  \struct cap_pending_t
+  \brief a request waiting for its reply
+*/
+typedef struct cap_pending_t {
+  ntp_ts_t m_tx;                 /*!< transmit time-stamp of the client, 0: free */
+  uint64_t m_flow;               /*!< hash of addresses and ports                */
+  ntp_ts_t m_when;               /*!< capture time                               */
+
+} cap_pending_t;
+
+/*!
+  \struct cap_server_t
+  \brief summary of the exchanges with one server
+*/
+typedef struct cap_server_t {
+  uint8_t  m_addr[16];           /*!< address (4 bytes for IPv4)                 */
+  int      m_alen;               /*!< address length                             */
+  uint64_t m_count;              /*!< exchanges                                  */
+  uint64_t m_kod;                /*!< Kiss-o'-Death replies                      */
+  double   m_sumOffset;          /*!< sum of offsets (s)                         */
+  double   m_minOffset;          /*!< lowest offset (s)                          */
+  double   m_maxOffset;          /*!< highest offset (s)                         */
+  double   m_minDelay;           /*!< lowest delay (s)                           */
+  char     m_name[INET6_ADDRSTRLEN]; /*!< printable address                      */
+
+} cap_server_t;
+
+/*!
+  \struct cap_ctx_t
+  \brief state of an analysis
+*/
+typedef struct cap_ctx_t {
+  cap_pending_t *m_table;        /*!< pending requests                           */
+  cap_server_t   m_servers[ktCAPTURE_MAXSERVERS]; /*!< per server summary        */
+  int            m_nservers;     /*!< servers in m_servers                       */
+  FILE          *m_out;          /*!< JSON lines, may be NULL                    */
+  int            m_port;         /*!< NTP port                                   */
+
+  uint64_t       m_packets;      /*!< packets read                               */
+  uint64_t       m_ntp;          /*!< NTP packets                                */
+  uint64_t       m_requests;     /*!< client requests                            */
+  uint64_t       m_replies;      /*!< server replies                             */
+  uint64_t       m_exchanges;    /*!< replies matched to their request           */
+  uint64_t       m_kod;          /*!< Kiss-o'-Death replies matched              */
+  uint64_t       m_orphans;      /*!< replies without request                    */
+  uint64_t       m_skipped;      /*!< unsupported link, fragments, truncated     */
+
+} cap_ctx_t;
+
+/*!
+  \struct cap_if_t
+  \brief a capture interface
+*/
+typedef struct cap_if_t {
+  int      m_link;               /*!< link type                                  */
+  uint64_t m_rate;               /*!< time-stamp units per second                */
+
+} cap_if_t;
+
+/* -- local functions -- */
+
+static inline uint16_t be16( const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+static inline uint32_t be32( const uint8_t *p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+
+/*!
+  \brief 32 bits of the file in its byte order
+*/
+static inline uint32_t rd32( const uint8_t *p, int swap)
+{
+  uint32_t v;
+
+  memcpy( &v, p, sizeof(v));
+  return swap ? __builtin_bswap32( v) : v;
+}
+
+static inline uint16_t rd16( const uint8_t *p, int swap)
+{
+  uint16_t v;
+
+  memcpy( &v, p, sizeof(v));
+  return swap ? __builtin_bswap16( v) : v;
+}
+
+/*!
+  \brief NTP time-stamp of a capture time-stamp
+  ******************************************************************
+
+  \param ts   time-stamp since 1970
+  \param rate units per second
+*/
+static ntp_ts_t cap_time( uint64_t ts, uint64_t rate)
+{
+  uint64_t secs = ts / rate, rem = ts % rate;
+  uint64_t frac = (rate <= 0xFFFFFFFFULL) ? (rem << 32) / rate : (uint64_t)((double)rem / rate * NTP_FRAC);
+
+  return ((secs + NTP_TIMESTAMP_DELTA) << 32) | (frac & 0xFFFFFFFFULL);
+}
+
+/*!
+  \brief hash of a flow, client then server (FNV-1a)
+*/
+static uint64_t cap_flow( const uint8_t *client, uint16_t cport, const uint8_t *server, uint16_t sport, int alen)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  int i;
+
+  for( i = 0; i < alen; i++) h = (h ^ client[i]) * 0x100000001b3ULL;
+  for( i = 0; i < alen; i++) h = (h ^ server[i]) * 0x100000001b3ULL;
+  h = (h ^ cport) * 0x100000001b3ULL;
+  h = (h ^ sport) * 0x100000001b3ULL;
+  return h;
+}
+
+/*!
+  \brief slot of the table to start probing from
+*/
+static inline uint32_t cap_slot( ntp_ts_t tx, uint64_t flow)
+{
+  uint64_t h = (tx ^ flow) * 0x9E3779B97F4A7C15ULL;
+
+  return (uint32_t)(h >> (64 - CAP_TABLE_BITS));
+}
+
+/*!
+  \brief printable address
+*/
+static const char *cap_addr( const uint8_t *addr, int alen, char *buf, size_t len)
+{
+  return inet_ntop( alen == 4 ? AF_INET : AF_INET6, addr, buf, len);
+}
+
+/*!
+  \brief summary of a server, created on first use
+*/
+static cap_server_t *cap_server( cap_ctx_t *c, const uint8_t *addr, int alen)
+{
+  int i;
+
+  for( i = 0; i < c->m_nservers; i++) {
+    if( c->m_servers[i].m_alen == alen && !memcmp( c->m_servers[i].m_addr, addr, alen)) return &c->m_servers[i];
+  }
+  if( c->m_nservers >= ktCAPTURE_MAXSERVERS) return NULL;
+
+  memcpy( c->m_servers[i].m_addr, addr, alen);
+  c->m_servers[i].m_alen = alen;
+  cap_addr( addr, alen, c->m_servers[i].m_name, sizeof(c->m_servers[i].m_name));
+  c->m_nservers++;
+  return &c->m_servers[i];
+}
+
+/*!
+  \brief JSON output helpers, much faster than printf() for the
+  millions of lines of a big capture
+  ******************************************************************
+*/
+static char *put_str( char *b, const char *str)
+{
+  while( *str) *b++ = *str++;
+  return b;
+}
+
+static char *put_uint( char *b, uint64_t v)
+{
+  char tmp[20];
+  int n = 0;
+
+  do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while( v);
+  while( n) *b++ = tmp[--n];
+  return b;
+}
+
+/*!
+  \brief a fixed point number: v / 10^decimals
+*/
+static char *put_fixed( char *b, int64_t v, int decimals)
+{
+  static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+  uint64_t u = (v < 0) ? (uint64_t)-v : (uint64_t)v, frac;
+  int i;
+
+  if( v < 0) *b++ = '-';
+  b = put_uint( b, u / pow10[decimals]);
+  *b++ = '.';
+  frac = u % pow10[decimals];
+  for( i = decimals - 1; i >= 0; i--) {
+    b[i] = (char)('0' + frac % 10);
+    frac /= 10;
+  }
+  return b + decimals;
+}
+
+/*!
+  \brief seconds as fixed point with 9 decimals
+*/
+static inline char *put_secs( char *b, double secs)
+{
+  return put_fixed( b, (int64_t)(secs * 1e9 + (secs < 0 ? -0.5 : 0.5)), 9);
+}
+
+/*!
+  \brief a NTP request or reply
+  ******************************************************************
+
+  \param c     the analysis
+  \param ntp   NTP payload (at least 48 bytes)
+  \param src   source address
+  \param dst   destination address
+  \param alen  address length
+  \param sport source port
+  \param dport destination port
+  \param when  capture time
+*/
+static void cap_ntp( cap_ctx_t *c, const uint8_t *ntp, const uint8_t *src, const uint8_t *dst, int alen,
+                     uint16_t sport, uint16_t dport, ntp_ts_t when)
+{
+  cap_pending_t *slot = NULL, *victim = NULL;
+  cap_server_t *server = NULL;
+  ntp_sample_t sample;
+  ntp_ts_t tx;
+  uint64_t flow;
+  uint32_t h;
+  int i, mode = NTP_MODE( ntp[0]);
+  char cbuf[INET6_ADDRSTRLEN], sbuf[INET6_ADDRSTRLEN];
+
+  c->m_ntp++;
+
+  if( mode == NTP_MODE_CLIENT && dport == c->m_port) {
+    /*
+     * request: keep it, replacing a free, expired or the oldest slot
+     ***************************************************************************
+     */
+    c->m_requests++;
+    tx   = ((ntp_ts_t)NTP_FIELD( ntp, txTm_s) << 32) | NTP_FIELD( ntp, txTm_f);
+    flow = cap_flow( src, sport, dst, dport, alen);
+    h    = cap_slot( tx, flow);
+    for( i = 0; i < CAP_PROBES; i++) {
+      slot = &c->m_table[(h + i) & (CAP_TABLE_SIZE - 1)];
+      if( !slot->m_tx || ntp_ts_diff( when, slot->m_when) > ktCAPTURE_EXPIRE) break;
+      if( !victim || slot->m_when < victim->m_when) victim = slot;
+    }
+    if( i == CAP_PROBES) slot = victim;
+    slot->m_tx   = tx;
+    slot->m_flow = flow;
+    slot->m_when = when;
+    return;
+  }
+  if( mode != NTP_MODE_SERVER || sport != c->m_port) return;
+
+  /*
+   * reply: find its request
+   ***************************************************************************
+   */
+  c->m_replies++;
+  tx   = ((ntp_ts_t)NTP_FIELD( ntp, origTm_s) << 32) | NTP_FIELD( ntp, origTm_f);
+  flow = cap_flow( dst, dport, src, sport, alen);
+  h    = cap_slot( tx, flow);
+  for( i = 0; i < CAP_PROBES; i++) {
+    slot = &c->m_table[(h + i) & (CAP_TABLE_SIZE - 1)];
+    if( slot->m_tx == tx && slot->m_flow == flow && tx) break;
+  }
+  if( i == CAP_PROBES || ntp_ts_diff( when, slot->m_when) > ktCAPTURE_EXPIRE) {
+    c->m_orphans++;
+    return;
+  }
+  slot->m_tx = 0;
+
+  server = cap_server( c, src, alen);
+  if( ntp[offsetof(ntp_packet_t, stratum)] == 0) {
+    c->m_kod++;
+    if( server) server->m_kod++;
+    return;
+  }
+
+  memset( &sample, 0, sizeof(sample));
+  sample.m_t1 = slot->m_when;
+  sample.m_t2 = ((ntp_ts_t)NTP_FIELD( ntp, rxTm_s) << 32) | NTP_FIELD( ntp, rxTm_f);
+  sample.m_t3 = ((ntp_ts_t)NTP_FIELD( ntp, txTm_s) << 32) | NTP_FIELD( ntp, txTm_f);
+  sample.m_t4 = when;
+  ntp_sample_compute( &sample);
+  c->m_exchanges++;
+
+  if( server) {
+    if( !server->m_count || sample.m_offset < server->m_minOffset) server->m_minOffset = sample.m_offset;
+    if( !server->m_count || sample.m_offset > server->m_maxOffset) server->m_maxOffset = sample.m_offset;
+    if( !server->m_count || sample.m_delay < server->m_minDelay) server->m_minDelay = sample.m_delay;
+    server->m_sumOffset += sample.m_offset;
+    server->m_count++;
+  }
+
+  if( c->m_out) {
+    char line[512], *b = line;
+
+    b = put_str( b, "{\"type\":\"exchange\",\"time\":");
+    b = put_fixed( b, (int64_t)ntp_ts_to_time( when) * 1000000 + (int64_t)(((when & 0xFFFFFFFFULL) * 1000000) >> 32), 6);
+    b = put_str( b, ",\"client\":\"");
+    b = put_str( b, cap_addr( dst, alen, cbuf, sizeof(cbuf)));
+    b = put_str( b, "\",\"client_port\":");
+    b = put_uint( b, dport);
+    b = put_str( b, ",\"server\":\"");
+    b = put_str( b, server ? server->m_name : cap_addr( src, alen, sbuf, sizeof(sbuf)));
+    b = put_str( b, "\",\"version\":");
+    b = put_uint( b, NTP_VN( ntp[0]));
+    b = put_str( b, ",\"stratum\":");
+    b = put_uint( b, ntp[offsetof(ntp_packet_t, stratum)]);
+    b = put_str( b, ",\"offset\":");
+    b = put_secs( b, sample.m_offset);
+    b = put_str( b, ",\"delay\":");
+    b = put_secs( b, sample.m_delay);
+    b = put_str( b, ",\"client_offset\":");
+    b = put_secs( b, ntp_ts_diff( tx, slot->m_when));
+    b = put_str( b, "}\n");
+    fwrite( line, 1, (size_t)(b - line), c->m_out);
+  }
+}
+
+/*!
+  \brief decode link, IP and UDP layers of a packet
+  ******************************************************************
+
+  \param c      the analysis
+  \param link   link type
+  \param p      packet data
+  \param caplen captured length
+  \param when   capture time
+*/
+static void cap_packet( cap_ctx_t *c, int link, const uint8_t *p, uint32_t caplen, ntp_ts_t when)
+{
+  const uint8_t *end = p + caplen, *src = NULL, *dst = NULL;
+  uint16_t type = 0, sport, dport, ulen;
+  int alen, hlen;
+
+  c->m_packets++;
+
+  /*
+   * link layer: find the IP header
+   ***************************************************************************
+   */
+  switch( link) {
+  case LINK_ETHERNET:
+    { if( caplen < 14) goto SKIP;
+      type = be16( p + 12);
+      p += 14;
+      while( (type == 0x8100 || type == 0x88A8) && end - p >= 4) {   // VLAN tags
+        type = be16( p + 2);
+        p += 4;
+      }
+    } break;
+
+  case LINK_LINUX_SLL:
+    { if( caplen < 16) goto SKIP;
+      type = be16( p + 14);
+      p += 16;
+    } break;
+
+  case LINK_LINUX_SLL2:
+    { if( caplen < 20) goto SKIP;
+      type = be16( p);
+      p += 20;
+    } break;
+
+  case LINK_NULL:
+  case LINK_LOOP:
+    { if( caplen < 4) goto SKIP;
+      p += 4;
+    } break;
+
+  case LINK_RAW:
+  case LINK_RAW_OLD:
+  case LINK_RAW_OLD2:
+  case LINK_IPV4:
+  case LINK_IPV6:
+    break;
+
+  default:
+    goto SKIP;
+  }
+  if( end - p < 1) goto SKIP;
+  if( !type) type = ((p[0] >> 4) == 4) ? 0x0800 : ((p[0] >> 4) == 6) ? 0x86DD : 0;
+
+  /*
+   * IP layer: find the UDP header
+   ***************************************************************************
+   */
+  if( type == 0x0800) {
+    if( end - p < 20 || (p[0] >> 4) != 4) goto SKIP;
+    hlen = (p[0] & 0xF) * 4;
+    if( p[9] != IPPROTO_UDP) return;
+    if( be16( p + 6) & 0x3FFF) goto SKIP;                 // fragment
+    if( hlen < 20 || end - p < hlen) goto SKIP;
+    src  = p + 12;
+    dst  = p + 16;
+    alen = 4;
+    p   += hlen;
+  }
+  else if( type == 0x86DD) {
+    if( end - p < 40 || (p[0] >> 4) != 6) goto SKIP;
+    if( p[6] != IPPROTO_UDP) return;
+    src  = p + 8;
+    dst  = p + 24;
+    alen = 16;
+    p   += 40;
+  }
+  else return;
+
+  if( end - p < 8) goto SKIP;
+  sport = be16( p);
+  dport = be16( p + 2);
+  ulen  = be16( p + 4);
+  if( sport != c->m_port && dport != c->m_port) return;
+  if( ulen < 8 + sizeof(ntp_packet_t) || end - p < 8 + (int)sizeof(ntp_packet_t)) goto SKIP;
+
+  cap_ntp( c, p + 8, src, dst, alen, sport, dport, when);
+  return;
+
+SKIP:
+  c->m_skipped++;
+}
+
+/*!
+  \brief read a pcap file
+  ******************************************************************
+
+  \return 0 if OK or -1 if the file is damaged
+*/
+static int cap_pcap( cap_ctx_t *c, const uint8_t *data, size_t size)
+{
+  const uint8_t *p = data + 24, *end = data + size;
+  uint32_t magic;
+  uint64_t rate;
+  int swap, link;
+
+  memcpy( &magic, data, sizeof(magic));
+  swap = (magic == __builtin_bswap32( PCAP_MAGIC_US) || magic == __builtin_bswap32( PCAP_MAGIC_NS));
+  rate = (rd32( data, swap) == PCAP_MAGIC_NS) ? 1000000000ULL : 1000000ULL;
+  link = (int)(rd32( data + 20, swap) & 0xFFFF);
+
+  while( end - p >= 16) {
+    uint32_t caplen = rd32( p + 8, swap);
+
+    if( (size_t)(end - p - 16) < caplen) return -1;
+    cap_packet( c, link, p + 16, caplen,
+                cap_time( (uint64_t)rd32( p, swap) * rate + rd32( p + 4, swap), rate));
+    p += 16 + caplen;
+  }
+  return (p == end) ? 0 : -1;
+}
+
+/*!
+  \brief read a pcapng file
+  ******************************************************************
+
+  \return 0 if OK or -1 if the file is damaged
+*/
+static int cap_pcapng( cap_ctx_t *c, const uint8_t *data, size_t size)
+{
+  const uint8_t *p = data, *end = data + size, *opt, *oend;
+  cap_if_t ifs[CAP_MAXIF];
+  uint32_t type, len, id, caplen;
+  int swap = 0, nifs = 0, i;
+
+  while( end - p >= 12) {
+    type = rd32( p, swap);
+    if( type == PCAPNG_SHB) {
+      /* a new section may change the byte order */
+      if( end - p < 28) return -1;
+      swap  = (rd32( p + 8, 0) != PCAPNG_BOM);
+      if( swap && rd32( p + 8, 1) != PCAPNG_BOM) return -1;
+      nifs = 0;
+    }
+    len = rd32( p + 4, swap);
+    if( len < 12 || len % 4 || (size_t)(end - p) < len) return -1;
+
+    switch( type) {
+    case PCAPNG_IDB:
+      { if( len < 20 || nifs >= CAP_MAXIF) break;
+        ifs[nifs].m_link = rd16( p + 8, swap);
+        ifs[nifs].m_rate = 1000000ULL;
+        /* options: look for if_tsresol */
+        for( opt = p + 16, oend = p + len - 4; oend - opt >= 4; ) {
+          uint16_t code = rd16( opt, swap), olen = rd16( opt + 2, swap);
+
+          if( code == 0 || oend - opt - 4 < olen) break;
+          if( code == 9 && olen >= 1) {
+            int v = opt[4] & 0x7F;
+            uint64_t r = 1;
+
+            if( opt[4] & 0x80) r = (v < 64) ? (uint64_t)1 << v : 0;
+            else for( i = 0; i < v && r; i++) r = (r <= 1844674407370955161ULL) ? r * 10 : 0;
+            if( r) ifs[nifs].m_rate = r;
+          }
+          opt += 4 + ((olen + 3) & ~3);
+        }
+        nifs++;
+      } break;
+
+    case PCAPNG_EPB:
+      { if( len < 32) return -1;
+        id     = rd32( p + 8, swap);
+        caplen = rd32( p + 20, swap);
+        if( caplen > len - 32) return -1;
+        if( id >= (uint32_t)nifs) {
+          c->m_packets++;
+          c->m_skipped++;
+          break;
+        }
+        cap_packet( c, ifs[id].m_link, p + 28, caplen,
+                    cap_time( (uint64_t)rd32( p + 12, swap) << 32 | rd32( p + 16, swap), ifs[id].m_rate));
+      } break;
+
+    default:
+      break;
+    }
+    p += len;
+  }
+  return (p == end) ? 0 : -1;
+}
+
+
+/*!
+  \brief analyze the NTP exchanges of a capture (--pcap)
+  ******************************************************************
+
+  Exchanges go to --stats as JSON lines, a summary is traced.
+
+  \param filename pcap or pcapng file
+  \return 0 if OK or <0 if failed
+*/
+int capture_analyze( const char *filename)
+{
+  cap_ctx_t *c = NULL;
+  struct stat st;
+  const uint8_t *data = MAP_FAILED;
+  uint32_t magic = 0;
+  double start;
+  int fd = -1, err = 0, i;
+
+  start = timing_now();
+
+  /*
+   * map the whole file, read it once in order
+   ***************************************************************************
+   */
+  if( (fd = open( filename, O_RDONLY)) < 0 || fstat( fd, &st) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open %s: %s"), filename, strerror( errno));
+    err = -1;
+    goto BAIL;
+  }
+  if( st.st_size >= 24) {
+    data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if( data == MAP_FAILED) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot map %s"), filename);
+    err = -1;
+    goto BAIL;
+  }
+  madvise( (void *)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  c = calloc( 1, sizeof(*c));
+  if( c) c->m_table = calloc( CAP_TABLE_SIZE, sizeof(*c->m_table));
+  if( !c || !c->m_table) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+    err = -1;
+    goto BAIL;
+  }
+  c->m_port = gAppOptions.m_port;
+
+  if( gAppOptions.m_statsFile) {
+    c->m_out = strcmp( gAppOptions.m_statsFile, "-") ? fopen( gAppOptions.m_statsFile, "a") : stdout;
+    if( !c->m_out) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open statistics file %s"), gAppOptions.m_statsFile);
+      err = -1;
+      goto BAIL;
+    }
+    if( c->m_out != stdout) setvbuf( c->m_out, NULL, _IOFBF, CAP_OUTBUF);
+    else {
+      trace_flush( gAppTrace);
+      fputc( '\n', c->m_out);               // trace lines are ended by the next one
+    }
+  }
+
+  memcpy( &magic, data, sizeof(magic));
+  if( magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+      magic == __builtin_bswap32( PCAP_MAGIC_US) || magic == __builtin_bswap32( PCAP_MAGIC_NS)) {
+    err = cap_pcap( c, data, (size_t)st.st_size);
+  }
+  else if( magic == PCAPNG_SHB) {
+    err = cap_pcapng( c, data, (size_t)st.st_size);
+  }
+  else {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s is not a pcap or pcapng file"), filename);
+    err = -1;
+    goto BAIL;
+  }
+  if( err) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("%s is truncated or damaged"), filename);
+  }
+
+  /*
+   * summary
+   ***************************************************************************
+   */
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("%llu packets, %llu NTP, %llu requests, %llu replies"),
+               (unsigned long long)c->m_packets, (unsigned long long)c->m_ntp,
+               (unsigned long long)c->m_requests, (unsigned long long)c->m_replies);
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("%llu exchanges, %llu KoD, %llu replies without request"),
+               (unsigned long long)c->m_exchanges, (unsigned long long)c->m_kod, (unsigned long long)c->m_orphans);
+  if( c->m_skipped) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("%llu packets not decoded"), (unsigned long long)c->m_skipped);
+  }
+  for( i = 0; i < c->m_nservers; i++) {
+    const cap_server_t *s = &c->m_servers[i];
+
+    if( !s->m_count) continue;
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: %llu, offset %+.6f [%+.6f %+.6f] delay %.6f"),
+                 s->m_name, (unsigned long long)s->m_count,
+                 s->m_sumOffset / s->m_count, s->m_minOffset, s->m_maxOffset, s->m_minDelay);
+  }
+  if( gAppOptions.m_verbose) {
+    double secs = timing_now() - start;
+
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Read %.1f MB in %.3f s (%.0f MB/s)"),
+                 st.st_size / 1e6, secs, secs > 0 ? st.st_size / 1e6 / secs : 0);
+  }
+
+BAIL:
+  if( c) {
+    if( c->m_out) fflush( c->m_out);
+    if( c->m_out && c->m_out != stdout) fclose( c->m_out);
+    free( c->m_table);
+    free( c);
+  }
+  if( data != MAP_FAILED) munmap( (void *)data, (size_t)st.st_size);
+  if( fd >= 0) close( fd);
+  return err;
+}
@@ -0,0 +1,23 @@
+/**
+ * \file capture.h
+ * \brief offline analysis of NTP exchanges in pcap/pcapng captures header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#define ktCAPTURE_EXPIRE      16.0  /*!< requests without reply are forgotten after (s) */
+#define ktCAPTURE_MAXSERVERS  256   /*!< servers with their own summary              */
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int capture_analyze( const char *filename);
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,542 @@
+/**
+ * \file conffile.c
+ * \brief configuration file and its hot reload (--config)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * The configuration file has one option per line, the long options
+ * without their '--' and a few others, '#' starting a comment:
+ *
+ *   server ntp1.example.org               a server, as on the command line
+ *   server 10.0.0.5 port 1123 noselect    ...with its own port, queried
+ *                                         and recorded but never selected
+ *   poll 16                               --poll 16
+ *   verbose                               -v ('verbose no' is not given);
+ *                                         so are debug, syslog, daemon,
+ *                                         summer (-E) and xleave (-x)
+ *   offset 3600                           -O 3600 (version: -o)
+ *
+ * At start, the options of the file are read before the command line,
+ * which wins over them (options_t.m_fixed tells which ones it gave).
+ *
+ * In daemon mode, a thread watches the file (inotify on its directory,
+ * as editors replace it, else a check every ktCONFIG_CHECK seconds)
+ * and publishes a new snapshot when its content changed and parses.
+ * A snapshot is never modified and is swapped by a single atomic store:
+ * the loops using it never wait for a lock, they take the current one
+ * when they are ready to, e.g. at the start of a poll.
+ *
+ * A snapshot replaced is freed by the watcher once every reader went
+ * past it: each reader tells the generation it took at each
+ * config_get(), a point where it holds no older snapshot (quiescent
+ * state based reclamation).
+ *
+ * The servers and the options of config_field are reloaded, the other
+ * options are only read at start (a warning tells when they changed).
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#endif
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "sync.h"
+#include "ntpdate.h"
+#include "conffile.h"
+
+#define ktCONFIG_MAXTOKENS 8     /*!< words of a line                            */
+
+/*!
+  \struct config_flag_t
+  \brief an option of the file given as a flag on the command line
+*/
+typedef struct config_flag_t {
+  const char *m_name;            /*!< name in the file                           */
+  const char *m_flag;            /*!< the flag                                   */
+  int         m_value;           /*!< the flag takes a value                     */
+
+} config_flag_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static const config_flag_t gFlags[] = {
+  { "verbose", "-v", 0 }, { "debug",  "-d", 0 }, { "syslog",  "-s", 0 },
+  { "daemon",  "-D", 0 }, { "summer", "-E", 0 }, { "xleave",  "-x", 0 },
+  { "offset",  "-O", 1 }, { "version", "-o", 1 },
+  { NULL, NULL, 0 }
+};
+
+/* long options only read at start */
+static const char *gStartOnly[] = {
+  "port", "tz", "stats", "pcap", "history", "analyze", "serve", "bclient", "broadcast", "stratum", "limit",
+  "load", "duration", "threads", "refclock", "publish", "state", "leapfile", "keys", "key", "nts", "nts-ca",
+  "nts-port", "smear", "quick", "io", NULL
+};
+
+static config_t     *gConfig = NULL;   /*!< current snapshot                   */
+static config_t     *gRetired = NULL;  /*!< snapshots replaced, watcher only   */
+static unsigned      gSeen[ktCONFIG_READERS]; /*!< generation each reader took, 0: none */
+static int           gNreaders = 0;
+static unsigned long gFileHash = 0;    /*!< content of the file last read      */
+static char         *gPath = NULL;     /*!< the file watched                   */
+
+/*!
+  \brief FNV-1a hash
+*/
+static unsigned long hash( unsigned long h, const char *data, size_t len)
+{
+  if( !h) h = 14695981039346656037ul;
+  while( len--) h = (h ^ (unsigned char)*data++) * 1099511628211ul;
+  return h;
+}
+
+/*!
+  \brief free a snapshot
+*/
+static void config_free( config_t *config)
+{
+  if( !config) return;
+  free( config->m_text);
+  free( config);
+}
+
+/*!
+  \brief read the whole file
+  ******************************************************************
+
+  \param path  the file
+  \param error message if failed
+  \param size  size of error
+  \return the content, to free, or NULL if failed
+*/
+static char *read_file( const char *path, char *error, size_t size)
+{
+  FILE *f;
+  char *text;
+  size_t n;
+
+  if( !(f = fopen( path, "r"))) {
+    snprintf( error, size, _("cannot be read: %s"), strerror( errno));
+    return NULL;
+  }
+  text = malloc( ktCONFIG_MAXSIZE + 1);
+  n = text ? fread( text, 1, ktCONFIG_MAXSIZE + 1, f) : 0;
+  fclose( f);
+  if( !text || n > ktCONFIG_MAXSIZE) {
+    snprintf( error, size, _("larger than %d bytes"), ktCONFIG_MAXSIZE);
+    free( text);
+    return NULL;
+  }
+  text[n] = '\0';
+  return text;
+}
+
+/*!
+  \brief parse the content of the file into a snapshot
+  ******************************************************************
+
+  \param text  the content, kept by the snapshot (tokens point into it)
+  \param error message if failed
+  \param size  size of error
+  \return the snapshot or NULL if failed (text is freed then)
+*/
+static config_t *config_parse( char *text, char *error, size_t size)
+{
+  config_t *c;
+  config_server_t *server;
+  char *line, *next, *save, *tok[ktCONFIG_MAXTOKENS];
+  const config_flag_t *flag;
+  int i, n, lineno = 0, on;
+
+  if( !(c = calloc( 1, sizeof(*c)))) {
+    snprintf( error, size, _("out of memory"));
+    free( text);
+    return NULL;
+  }
+  c->m_text         = text;
+  c->m_poll         = ktDEFAULT_POLL;
+  c->m_timeout      = TIMEOUT_SECS;
+  c->m_filter       = eSYNC_FILTER_MINDELAY;
+  c->m_holdoverRate = ktSYNC_HOLDOVER_RATE;
+  c->m_holdoverMax  = ktSYNC_HOLDOVER_MAX;
+  c->m_step         = ktSYNC_STEP_THRESHOLD;
+
+  for( line = text; line; line = next) {
+    lineno++;
+    if( (next = strchr( line, '\n'))) *next++ = '\0';
+    if( strchr( line, '#')) *strchr( line, '#') = '\0';
+    for( n = 0, tok[0] = strtok_r( line, " \t\r", &save); tok[n] && n < ktCONFIG_MAXTOKENS - 1; ) {
+      tok[++n] = strtok_r( NULL, " \t\r", &save);
+    }
+    if( n == 0) continue;
+    if( tok[n]) goto INVALID;                // more tokens than any option takes
+    if( c->m_nargs + 2 > ktCONFIG_MAXARGS) {
+      snprintf( error, size, _("line %d: too many options"), lineno);
+      goto FAILED;
+    }
+
+    // a server and its options
+    if( !strcmp( tok[0], "server")) {
+      if( n < 2 || strlen( tok[1]) > ktHOSTNAMELEN) goto INVALID;
+      if( c->m_nservers >= ktMAXHOSTS) {
+        snprintf( error, size, _("line %d: too many servers, %d max"), lineno, ktMAXHOSTS);
+        goto FAILED;
+      }
+      server = &c->m_servers[c->m_nservers++];
+      strcpy( server->m_host, tok[1]);
+      for( i = 2; i < n; i++) {
+        if( !strcmp( tok[i], "noselect")) server->m_noselect = 1;
+        else if( !strcmp( tok[i], "port") && i + 1 < n) {
+          server->m_port = atoi( tok[++i]);
+          if( server->m_port <= 0 || server->m_port > 65535) goto INVALID;
+        }
+        else goto INVALID;
+      }
+      c->m_args[c->m_nargs++] = tok[1];
+      continue;
+    }
+    if( !strcmp( tok[0], "config")) goto UNKNOWN;
+
+    // flags, 'name no' leaves them out
+    for( flag = gFlags; flag->m_name && strcmp( flag->m_name, tok[0]); flag++);
+    if( flag->m_name) {
+      if( flag->m_value ? n != 2 : n > 2) goto INVALID;
+      on = flag->m_value || n == 1 || !strcmp( tok[1], "yes") || !strcmp( tok[1], "on") || !strcmp( tok[1], "1");
+      if( !on && strcmp( tok[1], "no") && strcmp( tok[1], "off") && strcmp( tok[1], "0")) goto INVALID;
+      if( flag->m_flag[1] == 'v') c->m_verbose = on;
+      else c->m_startHash = hash( c->m_startHash, line, tok[n - 1] + strlen( tok[n - 1]) - line);
+      if( on) {
+        c->m_args[c->m_nargs++] = (char *)flag->m_flag;
+        if( flag->m_value) c->m_args[c->m_nargs++] = tok[1];
+      }
+      continue;
+    }
+
+    // long options
+    if( n != 2) goto INVALID;
+    if( !strcmp( tok[0], "poll")) {
+      if( (c->m_poll = atoi( tok[1])) <= 0) goto INVALID;
+    }
+    else if( !strcmp( tok[0], "timeout")) {
+      if( (c->m_timeout = atoi( tok[1])) <= 0) goto INVALID;
+    }
+    else if( !strcmp( tok[0], "filter")) {
+      if( (c->m_filter = sync_filter_parse( tok[1])) < 0) goto INVALID;
+    }
+    else if( !strcmp( tok[0], "holdover")) {
+      if( sync_holdover_parse( tok[1], &c->m_holdoverRate, &c->m_holdoverMax) < 0) goto INVALID;
+    }
+    else if( !strcmp( tok[0], "step")) {
+      if( (c->m_step = atof( tok[1])) <= 0) goto INVALID;
+    }
+    else {
+      for( i = 0; gStartOnly[i] && strcmp( gStartOnly[i], tok[0]); i++);
+      if( !gStartOnly[i]) goto UNKNOWN;
+      c->m_startHash = hash( c->m_startHash, tok[0], strlen( tok[0]) + 1);
+      c->m_startHash = hash( c->m_startHash, tok[1], strlen( tok[1]) + 1);
+    }
+    c->m_long[c->m_nargs]   = 1;               // "--" added by config_args()
+    c->m_args[c->m_nargs++] = tok[0];
+    c->m_args[c->m_nargs++] = tok[1];
+  }
+  return c;
+
+UNKNOWN:
+  snprintf( error, size, _("line %d: unknown option '%s'"), lineno, tok[0]);
+  goto FAILED;
+INVALID:
+  snprintf( error, size, _("line %d: invalid '%s' option"), lineno, tok[0]);
+FAILED:
+  config_free( c);
+  return NULL;
+}
+
+/*!
+  \brief read the configuration file given by --config before the
+  command line
+  ******************************************************************
+
+  The options of the file are put before the ones of the command line,
+  so these win; the options of config_field given by the command line
+  are told in fixed, so that reloads leave them.
+
+  \param argc  number of arguments, updated
+  \param argv  arguments, replaced if a file is read
+  \param fixed config_field given on the command line
+  \return 0 if OK or <0 if the file cannot be read or parsed
+*/
+int config_args( int *argc, char ***argv, unsigned *fixed)
+{
+  const char *path = NULL, *p;
+  char error[256], *text, **args;
+  config_t *c;
+  int i, j, n;
+
+  *fixed = 0;
+  for( i = 1; i < *argc; i++) {
+    p = (*argv)[i];
+    if( p[0] != '-') continue;
+    if( p[1] != '-') {
+      if( strcspn( p, "v") < strcspn( p, "Oo")) *fixed |= eCONFIG_VERBOSE;   // not in the value of -O
+      continue;
+    }
+    if( !strcmp( p, "--poll"))     *fixed |= eCONFIG_POLL;
+    if( !strcmp( p, "--timeout"))  *fixed |= eCONFIG_TIMEOUT;
+    if( !strcmp( p, "--filter"))   *fixed |= eCONFIG_FILTER;
+    if( !strcmp( p, "--holdover")) *fixed |= eCONFIG_HOLDOVER;
+    if( !strcmp( p, "--step"))     *fixed |= eCONFIG_STEP;
+    if( !strcmp( p, "--config") && i + 1 < *argc) path = (*argv)[i + 1];
+    i++;                                       // its value
+  }
+  if( !path) return 0;
+
+  if( !(text = read_file( path, error, sizeof(error)))) goto FAILED;
+  gFileHash = hash( 0, text, strlen( text));
+  if( !(c = config_parse( text, error, sizeof(error)))) goto FAILED;
+  c->m_generation = 1;
+  gConfig = c;
+
+  // argv[0], the file, then the command line; parse_cmd_line() keeps the strings
+  if( !(args = malloc( (*argc + 2 * c->m_nargs + 1) * sizeof(char *)))) return -12;
+  args[0] = (*argv)[0];
+  for( i = 0, n = 1; i < c->m_nargs; i++) {
+    if( !c->m_long[i]) args[n] = strdup( c->m_args[i]);
+    else if( (args[n] = malloc( strlen( c->m_args[i]) + 3))) sprintf( args[n], "--%s", c->m_args[i]);
+    if( !args[n++]) return -12;
+  }
+  for( j = 1; j < *argc; j++) args[n++] = (*argv)[j];
+  args[n] = NULL;
+  *argc = n;
+  *argv = args;
+  return 0;
+
+FAILED:
+  fprintf( stderr, "%s %s: %s\n", gLogSignature[eERROR_MSG_TYPE], path, error);
+  fflush( stderr);
+  return -12;
+}
+
+/*!
+  \brief free the snapshots every reader went past
+  ******************************************************************
+
+  Watcher thread only.
+*/
+static void reclaim( void)
+{
+  config_t **p = &gRetired, *c;
+  unsigned oldest = gConfig->m_generation, seen;
+  int i, n = __atomic_load_n( &gNreaders, __ATOMIC_ACQUIRE);
+
+  for( i = 0; i < n && i < ktCONFIG_READERS; i++) {
+    seen = __atomic_load_n( &gSeen[i], __ATOMIC_ACQUIRE);
+    if( seen && seen < oldest) oldest = seen;
+  }
+  while( (c = *p)) {
+    if( c->m_generation < oldest) {
+      *p = c->m_retired;
+      config_free( c);
+    }
+    else p = &c->m_retired;
+  }
+}
+
+/*!
+  \brief read the file again and publish it if it changed
+  ******************************************************************
+
+  Watcher thread only. A file which does not parse leaves the current
+  snapshot, and is told once.
+*/
+static void reload( void)
+{
+  config_t *c, *old = gConfig;
+  char error[256], *text;
+  unsigned long h;
+
+  if( !(text = read_file( gPath, error, sizeof(error)))) {
+    if( gFileHash) trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Configuration %s %s"), gPath, error);
+    gFileHash = 0;
+    return;
+  }
+  if( (h = hash( 0, text, strlen( text))) == gFileHash) {
+    free( text);
+    return;
+  }
+  gFileHash = h;
+  if( !(c = config_parse( text, error, sizeof(error)))) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Configuration %s not reloaded:"), gPath);
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, "%s", error);
+    trace_flush( gAppTrace);
+    return;
+  }
+  c->m_generation = old->m_generation + 1;
+  __atomic_store_n( &gConfig, c, __ATOMIC_RELEASE);
+  old->m_retired = gRetired;
+  gRetired = old;
+
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Configuration %s reloaded (generation %u)"), gPath, c->m_generation);
+  if( c->m_startHash != old->m_startHash) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Options read at start changed, restart to apply them"));
+  }
+  trace_flush( gAppTrace);
+}
+
+/*!
+  \brief watcher thread
+  ******************************************************************
+
+  Any change in the directory of the file makes it read again: editors
+  replace it by a rename, and symbolic links to it may be swapped.
+*/
+static void *watcher( void *arg)
+{
+  struct timeval tv;
+  fd_set fds;
+  int fd = -1;
+#ifdef HAVE_SYS_INOTIFY_H
+  char events[4096] __attribute__((aligned( __alignof__( struct inotify_event))));
+  char *dir = strdup( gPath);
+
+  if( dir && (fd = inotify_init1( IN_CLOEXEC)) >= 0 &&
+      inotify_add_watch( fd, dirname( dir), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+    close( fd);
+    fd = -1;
+  }
+  free( dir);
+#endif
+  (void)arg;
+  if( fd < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No inotify, %s is checked every %ds"), gPath, ktCONFIG_CHECK);
+  }
+
+  for(;;) {
+    FD_ZERO( &fds);
+    if( fd >= 0) FD_SET( fd, &fds);
+    tv.tv_sec  = ktCONFIG_CHECK;
+    tv.tv_usec = 0;
+    if( select( fd + 1, &fds, NULL, NULL, &tv) > 0) {
+#ifdef HAVE_SYS_INOTIFY_H
+      // let the editor end its writes, then forget the events of them
+      usleep( ktCONFIG_SETTLE * 1000);
+      do {
+        if( read( fd, events, sizeof(events)) <= 0) break;
+        FD_ZERO( &fds);
+        FD_SET( fd, &fds);
+        tv.tv_sec  = 0;
+        tv.tv_usec = 0;
+      } while( select( fd + 1, &fds, NULL, NULL, &tv) > 0);
+#endif
+      reload();
+    }
+    else if( fd < 0) reload();
+    reclaim();
+  }
+  return NULL;
+}
+
+/*!
+  \brief watch the file read by config_args() and reload it
+  ******************************************************************
+
+  \param path the file
+  \return 0 if OK or -1 if failed
+*/
+int config_watch( const char *path)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err = 0;
+
+  if( !gConfig || gPath) return 0;
+  if( !(gPath = strdup( path))) return -1;
+  pthread_attr_init( &attr);
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED);
+  if( pthread_create( &thread, &attr, watcher, NULL)) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("pthread_create() failed"));
+    err = -1;
+  }
+  pthread_attr_destroy( &attr);
+  return err;
+}
+
+/*!
+  \brief register a thread reading the snapshots
+  ******************************************************************
+
+  \return its reader number for config_get(), -1 if too many
+*/
+int config_reader( void)
+{
+  int r = __atomic_fetch_add( &gNreaders, 1, __ATOMIC_ACQ_REL);
+
+  if( r >= ktCONFIG_READERS) return -1;
+  if( gConfig) __atomic_store_n( &gSeen[r], __atomic_load_n( &gConfig, __ATOMIC_ACQUIRE)->m_generation, __ATOMIC_RELEASE);
+  return r;
+}
+
+/*!
+  \brief current snapshot
+  ******************************************************************
+
+  The reader tells it holds no older snapshot: the ones it got before
+  may be freed once replaced. A reader that is not registered (-1)
+  must not keep the snapshot.
+
+  \param reader number given by config_reader()
+  \return the snapshot, NULL if there is no configuration file
+*/
+const config_t *config_get( int reader)
+{
+  config_t *c = __atomic_load_n( &gConfig, __ATOMIC_ACQUIRE);
+
+  if( c && reader >= 0 && reader < ktCONFIG_READERS) {
+    __atomic_store_n( &gSeen[reader], c->m_generation, __ATOMIC_RELEASE);
+  }
+  return c;
+}
+
+/*!
+  \brief options of a server of a snapshot
+  ******************************************************************
+
+  \param config the snapshot, may be NULL
+  \param host   name of the server
+  \return its options or NULL if not in the file
+*/
+const config_server_t *config_server( const config_t *config, const char *host)
+{
+  int i;
+
+  for( i = 0; config && i < config->m_nservers; i++) {
+    if( !strcmp( config->m_servers[i].m_host, host)) return &config->m_servers[i];
+  }
+  return NULL;
+}
@@ -0,0 +1,90 @@
+/**
+ * \file conffile.h
+ * \brief configuration file and its hot reload (--config) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef CONFFILE_H_
+#define CONFFILE_H_
+
+#include <stddef.h>
+
+#include "main.h"
+
+#define ktCONFIG_MAXARGS  128    /*!< command line arguments from the file       */
+#define ktCONFIG_MAXSIZE  65536  /*!< largest file (bytes)                       */
+#define ktCONFIG_READERS  4      /*!< threads reading the snapshots at most      */
+#define ktCONFIG_CHECK    2      /*!< seconds between two checks without inotify */
+#define ktCONFIG_SETTLE   100    /*!< ms to wait for the writes of an editor     */
+
+/*!
+  \enum config_field
+  \brief options which are reloaded, in options_t.m_fixed when given
+  on the command line, which then wins
+*/
+typedef enum config_field {
+  eCONFIG_POLL     = 0x01,       /*!< --poll                                     */
+  eCONFIG_TIMEOUT  = 0x02,       /*!< --timeout                                  */
+  eCONFIG_FILTER   = 0x04,       /*!< --filter                                   */
+  eCONFIG_HOLDOVER = 0x08,       /*!< --holdover                                 */
+  eCONFIG_STEP     = 0x10,       /*!< --step                                     */
+  eCONFIG_VERBOSE  = 0x20,       /*!< -v                                         */
+
+} config_field;
+
+/*!
+  \struct config_server_t
+  \brief a server of the file and its options
+*/
+typedef struct config_server_t {
+  char m_host[ktHOSTNAMELEN+1];  /*!< name or IP address                         */
+  int  m_port;                   /*!< UDP port, 0: --port                        */
+  int  m_noselect;               /*!< queried and recorded, never selected       */
+
+} config_server_t;
+
+/*!
+  \struct config_t
+  \brief a configuration snapshot, never modified once published
+  ******************************************************************
+
+  The options reloaded start at their default, so one removed from
+  the file goes back to it on the next reload.
+*/
+typedef struct config_t {
+  unsigned m_generation;         /*!< 1 for the file read at start, then +1      */
+  config_server_t m_servers[ktMAXHOSTS]; /*!< the servers, in the file order     */
+  int      m_nservers;           /*!< their number                               */
+
+  int      m_poll;               /*!< seconds between polls                      */
+  int      m_timeout;            /*!< seconds to wait for each reply             */
+  int      m_filter;             /*!< sync_filter                                */
+  double   m_holdoverRate;       /*!< error growth without server (s/s)          */
+  int      m_holdoverMax;        /*!< longest holdover (s)                       */
+  double   m_step;               /*!< slew strategy: step above this (s)         */
+  int      m_verbose;            /*!< -v                                         */
+
+  char    *m_args[ktCONFIG_MAXARGS]; /*!< the file as command line arguments     */
+  unsigned char m_long[ktCONFIG_MAXARGS]; /*!< m_args[i] is a long option name */
+  int      m_nargs;              /*!< their number                               */
+  unsigned long m_startHash;     /*!< hash of the options only read at start     */
+  char    *m_text;               /*!< the file, m_args point into it             */
+  struct config_t *m_retired;    /*!< next snapshot waiting to be freed          */
+
+} config_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int             config_args      ( int *argc, char ***argv, unsigned *fixed);
+int             config_watch     ( const char *path);
+int             config_reader    ( void);
+const config_t *config_get       ( int reader);
+const config_server_t *config_server( const config_t *config, const char *host);
+
+#endif /* CONFFILE_H_ */
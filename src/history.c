@@ -0,0 +1,558 @@
+/**
+ * \file history.c
+ * \brief history of the samples in a ring file (--history, --analyze)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --history FILE[:N], every sample of every poll is appended to a
+ * ring of N records (2^20 by default, 16 MB) mapped in memory: a record
+ * is 16 bytes, its time a delta in milliseconds to the previous one
+ * (see history.h), so an append is a few stores and the file never
+ * grows. The oldest records are overwritten.
+ *
+ * --analyze FILE reads it back in one pass, per server:
+ *
+ *  - offset: mean, RMS, jitter (RMS of the differences between
+ *    successive samples) and trend (slope of a least squares line, the
+ *    frequency error left), per day (per hour for less than 2 days)
+ *    and on the whole,
+ *  - delay, steps and how often the selection kept the server,
+ *  - overlapping Allan deviation of the offsets, on a grid of the usual
+ *    poll interval, for tau = 1, 2, 4... polls up to a quarter of the
+ *    span; samples of the polls which stepped the clock are left out.
+ *    It tells how stable the disciplined clock is against the server at
+ *    each time scale.
+ *
+ * A year of polls is a few million records, read in well under a
+ * second. With --stats, the results are also written as JSON lines.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "trace.h"
+#include "timing.h"
+#include "sync.h"
+#include "history.h"
+
+#define ktHISTORY_OTHER    ktHISTORY_MAXSERVERS  /*!< stats of the servers not named */
+#define ktHISTORY_MINADEV  16     /*!< fewest terms of an Allan deviation written  */
+#define ktHISTORY_DAY      86400  /*!< period of the trends (s)                    */
+#define ktHISTORY_HOUR     3600   /*!< ... for less than 2 days                    */
+
+/*!
+  \struct history_stat_t
+  \brief analysis of one server
+  ******************************************************************
+*/
+typedef struct history_stat_t {
+  uint64_t m_count;              /*!< samples                                    */
+  uint64_t m_steps;              /*!< of polls which stepped the clock           */
+  uint64_t m_selected;           /*!< kept by the selection                      */
+  double   m_first, m_last;      /*!< UNIX time of the first and last (s)        */
+  double   m_sum, m_sq;          /*!< offsets: sum, sum of squares               */
+  double   m_min, m_max;         /*!< offsets: extremes                          */
+  double   m_delay, m_minDelay;  /*!< delays: sum, lowest                        */
+  double   m_prev;               /*!< last offset                                */
+  double   m_jitter;             /*!< sum of squared differences of offsets      */
+  uint64_t m_diffs;              /*!< their number                               */
+  double   m_st, m_stt, m_sx, m_stx; /*!< sums of the trend line                 */
+  uint64_t m_gaps[32];           /*!< intervals by power of 2 of milliseconds    */
+  double   m_gapSum[32];         /*!< ... their sum (s)                          */
+
+  int64_t  m_period;             /*!< current trend period, -1 if none           */
+  uint64_t m_pcount;             /*!< its samples                                */
+  double   m_psum, m_psq, m_pjitter; /*!< its offsets                            */
+  uint64_t m_pdiffs;
+
+  double   m_tau0;               /*!< Allan deviation: grid step (s)             */
+  double   *m_x;                 /*!< ... offsets on the grid, NAN: none         */
+  long     m_len;                /*!< ... grid length                            */
+
+} history_stat_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static history_head_t   *gHead    = NULL;  /*!< the mapped file                    */
+static history_record_t *gRecords = NULL;  /*!< its ring                           */
+static size_t            gSize    = 0;     /*!< its size                           */
+
+/*!
+  \brief split "file[:records]"
+  ******************************************************************
+
+  \param spec    the option, the ':' is replaced by a '\0'
+  \param records where to put the number of records
+  \return 0 if OK or -1 if invalid
+*/
+int history_parse( char *spec, unsigned *records)
+{
+  char *colon = strrchr( spec, ':'), *end = NULL;
+  unsigned long n;
+
+  *records = ktHISTORY_RECORDS;
+  if( !colon || !colon[1] || strspn( colon + 1, "0123456789") != strlen( colon + 1)) return spec[0] ? 0 : -1;
+  n = strtoul( colon + 1, &end, 10);
+  if( n < ktHISTORY_MINRECORDS || n > (1ul << 28)) return -1;
+  *colon   = '\0';
+  *records = (unsigned)n;
+  return spec[0] ? 0 : -1;
+}
+
+/*!
+  \brief create (or go on with) the ring file and map it
+  ******************************************************************
+
+  An existing ring keeps its size.
+
+  \param path    the file
+  \param records size of a new ring
+  \return 0 if OK or -1 if failed
+*/
+int history_open( const char *path, unsigned records)
+{
+  history_head_t head;
+  struct stat st;
+  void *map;
+  int fd, fresh;
+
+  if( (fd = open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 || fstat( fd, &st) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open %s: %s"), path, strerror( errno));
+    if( fd >= 0) close( fd);
+    return -1;
+  }
+  fresh = (st.st_size == 0);
+  if( !fresh) {
+    if( pread( fd, &head, sizeof(head), 0) != (ssize_t)sizeof(head) || head.m_magic != ktHISTORY_MAGIC ||
+        head.m_version != ktHISTORY_VERSION || head.m_recordSize != sizeof(history_record_t) ||
+        head.m_capacity < ktHISTORY_MINRECORDS || head.m_nservers > ktHISTORY_MAXSERVERS ||
+        st.st_size != (off_t)(ktHISTORY_HEADSIZE + (off_t)head.m_capacity * sizeof(history_record_t))) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s is not a history file"), path);
+      close( fd);
+      return -1;
+    }
+    if( head.m_capacity != records && records != ktHISTORY_RECORDS) {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("%s keeps its %u records"), path, head.m_capacity);
+    }
+    records = head.m_capacity;
+  }
+
+  gSize = ktHISTORY_HEADSIZE + (size_t)records * sizeof(history_record_t);
+  if( fresh && ftruncate( fd, (off_t)gSize) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open %s: %s"), path, strerror( errno));
+    close( fd);
+    return -1;
+  }
+  map = mmap( NULL, gSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close( fd);
+  if( map == MAP_FAILED) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot map %s"), path);
+    return -1;
+  }
+  gHead    = (history_head_t *)map;
+  gRecords = (history_record_t *)((uint8_t *)map + ktHISTORY_HEADSIZE);
+  if( fresh) {
+    gHead->m_version    = ktHISTORY_VERSION;
+    gHead->m_recordSize = sizeof(history_record_t);
+    gHead->m_capacity   = records;
+    __atomic_store_n( &gHead->m_magic, ktHISTORY_MAGIC, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+/*!
+  \brief index of a server name, added if new
+  ******************************************************************
+
+  \param host name or address, as on the command line
+  \return its index, 255 if the table is full
+*/
+int history_server( const char *host)
+{
+  int i;
+
+  if( !gHead) return 255;
+  for( i = 0; i < (int)gHead->m_nservers; i++) {
+    if( !strncmp( gHead->m_servers[i], host, ktHOSTNAMELEN - 1)) return i;
+  }
+  if( i == ktHISTORY_MAXSERVERS) return 255;
+  strncpy( gHead->m_servers[i], host, ktHOSTNAMELEN - 1);
+  gHead->m_nservers++;
+  return i;
+}
+
+/*!
+  \brief append a sample
+  ******************************************************************
+
+  \param server   index of history_server()
+  \param sample   the sample
+  \param action   what the poll did (sync_action)
+  \param selected the selection kept the server
+*/
+void history_add( int server, const ntp_sample_t *sample, int action, int selected)
+{
+  history_record_t *r;
+  uint64_t now, dt;
+  double disp;
+
+  if( !gHead) return;
+  now = (uint64_t)ntp_ts_to_time( sample->m_t4) * 1000 + (((sample->m_t4 & 0xFFFFFFFFu) * 1000) >> 32);
+  r   = &gRecords[gHead->m_count % gHead->m_capacity];
+
+  if( !gHead->m_count) gHead->m_baseTime = gHead->m_lastTime = now;
+  else if( gHead->m_count >= gHead->m_capacity) gHead->m_baseTime += r->m_dt;   // the oldest goes
+  // the clock went back: the records so far go back with it
+  if( now < gHead->m_lastTime) {
+    dt = gHead->m_lastTime - now;
+    gHead->m_baseTime = (gHead->m_baseTime > dt) ? gHead->m_baseTime - dt : 0;
+    gHead->m_lastTime = now;
+  }
+  dt   = now - gHead->m_lastTime;
+  disp = sample->m_rootDisp * 65536;
+
+  r->m_dt     = (dt > UINT32_MAX) ? UINT32_MAX : (uint32_t)dt;
+  r->m_offset = (float)sample->m_offset;
+  r->m_delay  = (float)sample->m_delay;
+  r->m_disp   = (disp >= 65535) ? 65535 : (disp <= 0) ? 0 : (uint16_t)disp;
+  r->m_server = (uint8_t)server;
+  r->m_flags  = (uint8_t)((action & ktHISTORY_ACTION) | (selected ? ktHISTORY_SELECTED : 0));
+  gHead->m_lastTime += r->m_dt;
+  __atomic_store_n( &gHead->m_count, gHead->m_count + 1, __ATOMIC_RELEASE);
+}
+
+/*!
+  \brief unmap the file
+*/
+void history_close( void)
+{
+  if( gHead) munmap( gHead, gSize);
+  gHead    = NULL;
+  gRecords = NULL;
+}
+
+/*!
+  \brief name of a server of the file
+*/
+static const char *server_name( const history_head_t *head, int server, char *name)
+{
+  if( server >= (int)head->m_nservers) return _("other");
+  memcpy( name, head->m_servers[server], ktHOSTNAMELEN);
+  name[ktHOSTNAMELEN - 1] = '\0';
+  return name;
+}
+
+/*!
+  \brief write the trend of the period ending
+  ******************************************************************
+
+  \param out    JSON output or NULL
+  \param name   the server
+  \param s      its analysis
+  \param period length of the periods (s)
+*/
+static void period_end( FILE *out, const char *name, history_stat_t *s, int period)
+{
+  char date[32];
+  time_t t = (time_t)(s->m_period * period);
+  double mean, rms, jitter;
+
+  if( !s->m_pcount) return;
+  mean   = s->m_psum / s->m_pcount;
+  rms    = sqrt( s->m_psq / s->m_pcount);
+  jitter = s->m_pdiffs ? sqrt( s->m_pjitter / s->m_pdiffs) : 0;
+  strftime( date, sizeof(date), (period == ktHISTORY_DAY) ? "%Y-%m-%d" : "%Y-%m-%d %H:00", gmtime( &t));
+  if( gAppOptions.m_verbose) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s %s: %llu, offset %+.6f rms %.6f jitter %.6f"),
+                 name, date, (unsigned long long)s->m_pcount, mean, rms, jitter);
+  }
+  if( out) {
+    fprintf( out, "{\"type\":\"history_period\",\"server\":\"%s\",\"time\":%ld,\"seconds\":%d,\"count\":%llu,"
+                  "\"offset\":%.9f,\"rms\":%.9f,\"jitter\":%.9f}\n",
+             name, (long)t, period, (unsigned long long)s->m_pcount, mean, rms, jitter);
+  }
+  s->m_pcount = s->m_pdiffs = 0;
+  s->m_psum = s->m_psq = s->m_pjitter = 0;
+}
+
+/*!
+  \brief grid of the Allan deviation: the usual interval between samples
+  ******************************************************************
+
+  \param s its analysis, m_x allocated
+  \return 0 if OK or -1 if no memory
+*/
+static int grid_init( history_stat_t *s)
+{
+  double span = s->m_last - s->m_first;
+  long i, cap = (long)(4 * s->m_count + 16);
+  int b, mode = -1;
+
+  for( b = 0; b < 32; b++) {
+    if( s->m_gaps[b] && (mode < 0 || s->m_gaps[b] > s->m_gaps[mode])) mode = b;
+  }
+  s->m_tau0 = (mode >= 0) ? s->m_gapSum[mode] / s->m_gaps[mode] : 0;
+  if( s->m_tau0 <= 0) return 0;
+  if( span / s->m_tau0 + 1 > cap) s->m_tau0 = span / (cap - 1);   // samples too sparse
+  s->m_len = (long)(span / s->m_tau0 + 0.5) + 1;
+  if( !(s->m_x = malloc( (size_t)s->m_len * sizeof(double)))) return -1;
+  for( i = 0; i < s->m_len; i++) s->m_x[i] = NAN;
+  return 0;
+}
+
+/*!
+  \brief overlapping Allan deviation for tau = 1, 2, 4... grid steps
+  ******************************************************************
+
+  \param out  JSON output or NULL
+  \param name the server
+  \param s    its analysis, grid filled
+*/
+static void allan( FILE *out, const char *name, const history_stat_t *s)
+{
+  const double *x = s->m_x;
+  double sum, d, tau;
+  long i, m, terms;
+
+  for( m = 1; 4 * m < s->m_len; m *= 2) {
+    sum   = 0;
+    terms = 0;
+    for( i = 0; i + 2 * m < s->m_len; i++) {
+      d = x[i + 2 * m] - 2 * x[i + m] + x[i];
+      if( d != d) continue;                  // a sample missing
+      sum += d * d;
+      terms++;
+    }
+    if( terms < ktHISTORY_MINADEV) break;
+    tau = m * s->m_tau0;
+    d   = sqrt( sum / (2.0 * terms)) / tau;
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: ADEV(%.0fs) %.3e (%ld terms)"), name, tau, d, terms);
+    if( out) {
+      fprintf( out, "{\"type\":\"history_adev\",\"server\":\"%s\",\"tau\":%.3f,\"adev\":%.6e,\"terms\":%ld}\n",
+               name, tau, d, terms);
+    }
+  }
+}
+
+/*!
+  \brief analyze a history file
+  ******************************************************************
+
+  \param path the file
+  \return 0 if OK or <0 if failed
+*/
+int history_analyze( const char *path)
+{
+  history_stat_t *stats = NULL, *s;
+  const history_head_t *head;
+  const history_record_t *rec, *r;
+  const uint8_t *data = MAP_FAILED;
+  struct stat st;
+  FILE *out = NULL;
+  char name[ktHOSTNAMELEN];
+  uint64_t count, first, n, i, t;
+  double start, secs, x;
+  int fd = -1, err = 0, k, b, period, nstats;
+
+  start = timing_now();
+
+  if( (fd = open( path, O_RDONLY)) < 0 || fstat( fd, &st) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open %s: %s"), path, strerror( errno));
+    err = -1;
+    goto BAIL;
+  }
+  if( st.st_size >= ktHISTORY_HEADSIZE) data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if( data == MAP_FAILED) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s is not a history file"), path);
+    err = -1;
+    goto BAIL;
+  }
+  head = (const history_head_t *)data;
+  rec  = (const history_record_t *)(data + ktHISTORY_HEADSIZE);
+  if( head->m_magic != ktHISTORY_MAGIC || head->m_version != ktHISTORY_VERSION ||
+      head->m_recordSize != sizeof(history_record_t) || !head->m_capacity ||
+      st.st_size < (off_t)(ktHISTORY_HEADSIZE + (off_t)head->m_capacity * sizeof(history_record_t))) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s is not a history file"), path);
+    err = -1;
+    goto BAIL;
+  }
+  madvise( (void *)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  // a snapshot: the daemon may go on appending
+  count  = __atomic_load_n( &head->m_count, __ATOMIC_ACQUIRE);
+  n      = (count < head->m_capacity) ? count : head->m_capacity;
+  first  = (count < head->m_capacity) ? 0 : count % head->m_capacity;
+  period = (head->m_lastTime - head->m_baseTime < 2000ull * ktHISTORY_DAY) ? ktHISTORY_HOUR : ktHISTORY_DAY;
+  nstats = ktHISTORY_OTHER + 1;
+
+  if( !(stats = calloc( (size_t)nstats, sizeof(*stats)))) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+    err = -1;
+    goto BAIL;
+  }
+  for( k = 0; k < nstats; k++) {
+    stats[k].m_period   = -1;
+    stats[k].m_minDelay = HUGE_VAL;
+    stats[k].m_min      = HUGE_VAL;
+    stats[k].m_max      = -HUGE_VAL;
+  }
+  if( gAppOptions.m_statsFile) {
+    out = strcmp( gAppOptions.m_statsFile, "-") ? fopen( gAppOptions.m_statsFile, "a") : stdout;
+    if( !out) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open statistics file %s"), gAppOptions.m_statsFile);
+      err = -1;
+      goto BAIL;
+    }
+  }
+
+  /*
+   * one pass: statistics and trends
+   ***************************************************************************
+   */
+  for( i = 0, t = head->m_baseTime; i < n; i++) {
+    r  = &rec[(first + i) % head->m_capacity];
+    t += r->m_dt;
+    k  = (r->m_server < ktHISTORY_OTHER) ? r->m_server : ktHISTORY_OTHER;
+    s  = &stats[k];
+    x  = r->m_offset;
+
+    if( s->m_period != (int64_t)(t / 1000 / period)) {
+      period_end( out, server_name( head, k, name), s, period);
+      s->m_period = (int64_t)(t / 1000 / period);
+    }
+    if( s->m_count) {
+      secs = t / 1e3 - s->m_last;
+      for( b = 0; b < 31 && (1ull << (b + 1)) <= (uint64_t)(secs * 1e3); b++);
+      s->m_gaps[b]++;
+      s->m_gapSum[b] += secs;
+      s->m_jitter    += (x - s->m_prev) * (x - s->m_prev);
+      s->m_diffs++;
+      if( s->m_pcount) {
+        s->m_pjitter += (x - s->m_prev) * (x - s->m_prev);
+        s->m_pdiffs++;
+      }
+    }
+    else s->m_first = t / 1e3;
+    s->m_last = t / 1e3;
+    s->m_prev = x;
+    s->m_count++;
+    s->m_sum += x;
+    s->m_sq  += x * x;
+    if( x < s->m_min) s->m_min = x;
+    if( x > s->m_max) s->m_max = x;
+    s->m_delay += r->m_delay;
+    if( r->m_delay < s->m_minDelay) s->m_minDelay = r->m_delay;
+    if( (r->m_flags & ktHISTORY_ACTION) == eSYNC_STEP) s->m_steps++;
+    if( r->m_flags & ktHISTORY_SELECTED) s->m_selected++;
+    secs = s->m_last - s->m_first;
+    s->m_st  += secs;
+    s->m_stt += secs * secs;
+    s->m_sx  += x;
+    s->m_stx += secs * x;
+    s->m_pcount++;
+    s->m_psum += x;
+    s->m_psq  += x * x;
+  }
+
+  /*
+   * second pass: offsets on the grid of each server
+   ***************************************************************************
+   */
+  for( k = 0; k < nstats; k++) {
+    if( stats[k].m_count < 3) continue;
+    if( grid_init( &stats[k]) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+      err = -1;
+      goto BAIL;
+    }
+  }
+  for( i = 0, t = head->m_baseTime; i < n; i++) {
+    r  = &rec[(first + i) % head->m_capacity];
+    t += r->m_dt;
+    s  = &stats[(r->m_server < ktHISTORY_OTHER) ? r->m_server : ktHISTORY_OTHER];
+    if( !s->m_x || (r->m_flags & ktHISTORY_ACTION) == eSYNC_STEP) continue;
+    x = (t / 1e3 - s->m_first) / s->m_tau0 + 0.5;
+    if( x >= 0 && x < s->m_len) s->m_x[(long)x] = r->m_offset;
+  }
+
+  /*
+   * results
+   ***************************************************************************
+   */
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("%llu samples, %llu overwritten, %.1f days"),
+               (unsigned long long)n, (unsigned long long)(count - n),
+               (head->m_lastTime - head->m_baseTime) / 1e3 / ktHISTORY_DAY);
+  for( k = 0; k < nstats; k++) {
+    double mean, rms, jitter, trend = 0, den;
+    const char *who;
+
+    s = &stats[k];
+    if( !s->m_count) continue;
+    who = server_name( head, k, name);
+    period_end( out, who, s, period);
+
+    mean   = s->m_sum / s->m_count;
+    rms    = sqrt( s->m_sq / s->m_count);
+    jitter = s->m_diffs ? sqrt( s->m_jitter / s->m_diffs) : 0;
+    den    = s->m_count * s->m_stt - s->m_st * s->m_st;
+    if( den > 0) trend = (s->m_count * s->m_stx - s->m_st * s->m_sx) / den;
+
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: %llu samples, %.1f days, poll %.0fs"), who,
+                 (unsigned long long)s->m_count, (s->m_last - s->m_first) / ktHISTORY_DAY, s->m_tau0);
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: offset %+.6f [%+.6f %+.6f] rms %.6f"), who,
+                 mean, s->m_min, s->m_max, rms);
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: jitter %.6f, trend %+.4f ppm"), who, jitter, trend * 1e6);
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%s: delay %.6f (min %.6f), %llu steps, %.0f%% kept"), who,
+                 s->m_delay / s->m_count, s->m_minDelay, (unsigned long long)s->m_steps,
+                 100.0 * s->m_selected / s->m_count);
+    if( out) {
+      fprintf( out, "{\"type\":\"history_server\",\"server\":\"%s\",\"first\":%.3f,\"last\":%.3f,\"count\":%llu,"
+                    "\"offset\":%.9f,\"min\":%.9f,\"max\":%.9f,\"rms\":%.9f,\"jitter\":%.9f,\"trend_ppm\":%.6f,"
+                    "\"delay\":%.9f,\"min_delay\":%.9f,\"steps\":%llu,\"selected\":%llu}\n",
+               who, s->m_first, s->m_last, (unsigned long long)s->m_count, mean, s->m_min, s->m_max, rms,
+               jitter, trend * 1e6, s->m_delay / s->m_count, s->m_minDelay, (unsigned long long)s->m_steps,
+               (unsigned long long)s->m_selected);
+    }
+    if( s->m_x) allan( out, who, s);
+  }
+  if( gAppOptions.m_verbose) {
+    secs = timing_now() - start;
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Read %llu samples in %.3f s"), (unsigned long long)n, secs);
+  }
+
+BAIL:
+  if( out) fflush( out);
+  if( out && out != stdout) fclose( out);
+  if( stats) {
+    for( k = 0; k < nstats; k++) free( stats[k].m_x);
+    free( stats);
+  }
+  if( data != MAP_FAILED) munmap( (void *)data, (size_t)st.st_size);
+  if( fd >= 0) close( fd);
+  return err;
+}
@@ -0,0 +1,79 @@
+/**
+ * \file history.h
+ * \brief history of the samples in a ring file (--history, --analyze) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "ntpdate.h"
+
+#define ktHISTORY_MAGIC      0x5A484953u /*!< "ZHIS"                              */
+#define ktHISTORY_VERSION    1
+#define ktHISTORY_RECORDS    (1u << 20)  /*!< default size: 16 MB                 */
+#define ktHISTORY_MINRECORDS 1024        /*!< smallest ring                       */
+#define ktHISTORY_MAXSERVERS 32          /*!< names kept, later ones are "other"  */
+#define ktHISTORY_HEADSIZE   4096        /*!< records start there                 */
+#define ktHISTORY_SELECTED   0x10        /*!< m_flags: kept by the selection      */
+#define ktHISTORY_ACTION     0x0F        /*!< m_flags: sync_action of the poll    */
+
+/*!
+  \struct history_head_t
+  \brief head of the ring file, followed by the records at ktHISTORY_HEADSIZE
+  ******************************************************************
+
+  Record i of the ring is written by the m_count-th append such that
+  m_count % m_capacity == i. Each record tells the milliseconds since
+  the previous one; m_baseTime is the time the oldest one counts from,
+  moved by the m_dt of each record overwritten, and back with the
+  records when the clock is stepped back.
+*/
+typedef struct history_head_t {
+  uint32_t m_magic;              /*!< ktHISTORY_MAGIC                            */
+  uint32_t m_version;            /*!< ktHISTORY_VERSION                          */
+  uint32_t m_recordSize;         /*!< sizeof(history_record_t)                   */
+  uint32_t m_capacity;           /*!< records in the ring                        */
+  uint64_t m_count;              /*!< records ever appended                      */
+  uint64_t m_baseTime;           /*!< UNIX time (ms) before the oldest record    */
+  uint64_t m_lastTime;           /*!< UNIX time (ms) of the newest record        */
+  uint32_t m_nservers;           /*!< names in m_servers                         */
+  uint32_t m_reserved;
+  char     m_servers[ktHISTORY_MAXSERVERS][ktHOSTNAMELEN]; /*!< server names     */
+
+} history_head_t;
+
+/*!
+  \struct history_record_t
+  \brief one sample, 16 bytes
+  ******************************************************************
+*/
+typedef struct history_record_t {
+  uint32_t m_dt;                 /*!< milliseconds since the previous record     */
+  float    m_offset;             /*!< offset (s)                                 */
+  float    m_delay;              /*!< round trip delay (s)                       */
+  uint16_t m_disp;               /*!< root dispersion of the server (2^-16 s)    */
+  uint8_t  m_server;             /*!< index in m_servers, 255 if not kept        */
+  uint8_t  m_flags;              /*!< action of the poll and ktHISTORY_SELECTED  */
+
+} history_record_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int  history_parse  ( char *spec, unsigned *records);
+int  history_open   ( const char *path, unsigned records);
+int  history_server ( const char *host);
+void history_add    ( int server, const ntp_sample_t *sample, int action, int selected);
+void history_close  ( void);
+int  history_analyze( const char *path);
+
+#endif /* HISTORY_H_ */
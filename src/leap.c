@@ -0,0 +1,264 @@
+/**
+ * \file leap.c
+ * \brief leap seconds: leap-seconds.list and kernel arming
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * A leap second is announced by the servers (leap indicator, taken by
+ * majority of the selected servers) or found in a leap-seconds.list
+ * file (--leapfile), which wins when it is valid: its SHA-1 (line "#h")
+ * is checked, like ntpd does, on the digits of the "#$" and "#@" lines
+ * and of the data lines.
+ *
+ * In daemon mode the kernel is told on the last day of the month
+ * (adjtimex STA_INS/STA_DEL, the kernel inserts or deletes the second
+ * at the next UTC midnight), and the clock is never stepped within
+ * ktLEAP_GUARD seconds of the leap: servers late to apply it would
+ * otherwise make every client step by one second.
+ *
+ * With --smear the kernel is left alone: the second is spread over a
+ * window centred on the leap by a frequency offset (linear or cosine),
+ * so that the clock never goes back nor jumps.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(HAVE_ADJTIMEX) && defined(HAVE_SYS_TIMEX_H)
+#  include <sys/timex.h>
+#endif
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntppacket.h"
+#include "sha1.h"
+#include "leap.h"
+
+/* -- GLOBALES -- */
+extern trace_desc_t* gAppTrace;
+
+/*!
+  \brief hash the digits of [p, end)
+*/
+static void hash_digits( sha1_t *h, const char *p, const char *end)
+{
+  for( ; p < end; p++) {
+    if( isdigit( (unsigned char)*p)) sha1_update( h, p, 1);
+  }
+}
+
+/*!
+  \brief load and check a leap-seconds.list
+  ******************************************************************
+
+  \param path the file
+  \param t    the table
+  \return 0 if OK, -1 if not readable, -2 if its hash is wrong
+*/
+int leap_load( const char *path, leap_table_t *t)
+{
+  const char *map, *p, *end, *eol, *data;
+  char line[ktLEAP_LINELEN];      // the file is not NUL terminated, its lines are copied
+  uint32_t expected[5] = { 0, 0, 0, 0, 0 }, when;
+  uint8_t digest[ktSHA1_LEN];
+  struct stat st;
+  sha1_t h;
+  int fd, i, tai, hashed = 0, err = 0;
+  size_t len;
+
+  memset( t, 0, sizeof(*t));
+  if( (fd = open( path, O_RDONLY | O_CLOEXEC)) < 0 || fstat( fd, &st) < 0 || st.st_size == 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot read %s: %s"), path, strerror( errno));
+    if( fd >= 0) close( fd);
+    return -1;
+  }
+  map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close( fd);
+  if( map == MAP_FAILED) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot read %s: %s"), path, strerror( errno));
+    return -1;
+  }
+
+  /*
+   * one pass: the table and the hash of its digits
+   ***************************************************************************
+   */
+  sha1_init( &h);
+  for( p = map, end = map + st.st_size; p < end; p = eol + 1) {
+    if( !(eol = memchr( p, '\n', (size_t)(end - p)))) eol = end;
+    len = ((size_t)(eol - p) < sizeof(line)) ? (size_t)(eol - p) : sizeof(line) - 1;
+    memcpy( line, p, len);
+    line[len] = '\0';
+
+    if( p[0] == '#') {
+      if( eol - p < 2) continue;
+      if( p[1] == '$' || p[1] == '@') {
+        when = (uint32_t)strtoul( line + 2, NULL, 10);
+        if( p[1] == '$') t->m_updated = when;
+        else t->m_expires = when;
+        hash_digits( &h, p + 2, eol);
+      }
+      else if( p[1] == 'h') {
+        hashed = sscanf( line + 2, "%x %x %x %x %x", &expected[0], &expected[1], &expected[2],
+                         &expected[3], &expected[4]) == 5;
+      }
+      continue;
+    }
+
+    if( !(data = memchr( p, '#', (size_t)(eol - p)))) data = eol;
+    hash_digits( &h, p, data);
+    if( sscanf( line, "%u %d", &when, &tai) == 2 && t->m_count < ktLEAP_MAX) {
+      t->m_when[t->m_count] = when;
+      t->m_tai[t->m_count]  = tai;
+      t->m_count++;
+    }
+  }
+  munmap( (void *)map, (size_t)st.st_size);
+
+  sha1_final( &h, digest);
+  for( i = 0; hashed && i < 5; i++) {
+    if( expected[i] != ((uint32_t)digest[4 * i] << 24 | (uint32_t)digest[4 * i + 1] << 16 |
+                        (uint32_t)digest[4 * i + 2] << 8 | digest[4 * i + 3])) hashed = 0;
+  }
+  if( !hashed || !t->m_count) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Bad checksum of %s, not used"), path);
+    memset( t, 0, sizeof(*t));
+    err = -2;
+  }
+  else if( t->m_expires && (uint32_t)(time( NULL) + NTP_TIMESTAMP_DELTA) > t->m_expires) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("%s has expired, please update it"), path);
+  }
+  return err;
+}
+
+/*!
+  \brief NTP time of the first second of the next UTC month
+*/
+uint32_t leap_month_end( uint32_t now)
+{
+  static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  time_t t = (time_t)(now - NTP_TIMESTAMP_DELTA);
+  struct tm tm;
+  int n, year;
+
+  gmtime_r( &t, &tm);
+  year = tm.tm_year + 1900;
+  n = days[tm.tm_mon] + (tm.tm_mon == 1 && ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0));
+  return now - (uint32_t)(((tm.tm_mday - 1) * 24 + tm.tm_hour) * 3600 + tm.tm_min * 60 + tm.tm_sec)
+             + (uint32_t)n * 86400;
+}
+
+/*!
+  \brief leap second at the end of this month according to the table
+  ******************************************************************
+
+  \param t    the table (may be empty)
+  \param now  NTP seconds
+  \param when set to the NTP second following the leap
+  \return NTP_LI_INSERT, NTP_LI_DELETE or NTP_LI_NONE
+*/
+int leap_pending( const leap_table_t *t, uint32_t now, uint32_t *when)
+{
+  int i;
+
+  for( i = 1; i < t->m_count; i++) {
+    if( t->m_when[i] <= now) continue;
+    if( t->m_when[i] > leap_month_end( now)) break;
+    *when = t->m_when[i];
+    return (t->m_tai[i] > t->m_tai[i - 1]) ? NTP_LI_INSERT : NTP_LI_DELETE;
+  }
+  return NTP_LI_NONE;
+}
+
+/*!
+  \brief tell the kernel to insert or delete a second at next midnight
+  ******************************************************************
+
+  \param leap NTP_LI_INSERT, NTP_LI_DELETE or NTP_LI_NONE to disarm
+  \return 0 if OK else errno
+*/
+int leap_kernel_arm( int leap)
+{
+#if defined(HAVE_ADJTIMEX) && defined(HAVE_SYS_TIMEX_H)
+  struct timex tx;
+
+  memset( &tx, 0, sizeof(tx));
+  if( adjtimex( &tx) < 0) return errno;
+  tx.modes  = ADJ_STATUS;
+  tx.status = (tx.status & ~(STA_INS | STA_DEL)) |
+              (leap == NTP_LI_INSERT ? STA_INS : leap == NTP_LI_DELETE ? STA_DEL : 0);
+  return adjtimex( &tx) < 0 ? errno : 0;
+#else
+  return leap ? ENOSYS : 0;
+#endif
+}
+
+/*!
+  \brief part of the leap second smeared at a given time
+  ******************************************************************
+
+  \param shape  leap_smear_shape
+  \param window smear window (s)
+  \param t      time from the leap (s), negative before it
+  \param rate   set to the derivative of the result (1/s)
+  \return from 0 before the window to 1 after it
+*/
+double leap_smear( int shape, double window, double t, double *rate)
+{
+  double x = t / window + 0.5;
+
+  *rate = 0;
+  if( shape == eLEAP_SMEAR_NONE || x <= 0) return 0;
+  if( x >= 1) return 1;
+  if( shape == eLEAP_SMEAR_COSINE) {
+    *rate = M_PI / 2 * sin( M_PI * x) / window;
+    return (1 - cos( M_PI * x)) / 2;
+  }
+  *rate = 1 / window;
+  return x;
+}
+
+/*!
+  \brief parse the --smear option
+  ******************************************************************
+
+  \param spec   "linear" or "cosine", then ":HOURS" (1 to 48)
+  \param shape  leap_smear_shape
+  \param window smear window (s), ktLEAP_SMEAR if not given
+  \return 0 if OK else -1
+*/
+int leap_smear_parse( const char *spec, int *shape, int *window)
+{
+  char name[8] = "";
+  int hours = ktLEAP_SMEAR / 3600;
+
+  if( sscanf( spec, "%7[a-z]:%d", name, &hours) < 1 || hours < 1 || hours > 48) return -1;
+  if( !strcmp( name, "linear"))      *shape = eLEAP_SMEAR_LINEAR;
+  else if( !strcmp( name, "cosine")) *shape = eLEAP_SMEAR_COSINE;
+  else return -1;
+  *window = hours * 3600;
+  return 0;
+}
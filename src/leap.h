@@ -0,0 +1,71 @@
+/**
+ * \file leap.h
+ * \brief leap seconds header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef LEAP_H_
+#define LEAP_H_
+
+#include <stdint.h>
+
+#define ktLEAP_MAX        64     /*!< leap seconds kept from the list            */
+#define ktLEAP_GUARD    3600     /*!< no step this close to a leap second (s)    */
+#define ktLEAP_LIST     "/usr/share/zoneinfo/leap-seconds.list" /*!< usual place */
+#define ktLEAP_SMEAR    86400    /*!< default smear window, centred on leap (s)  */
+#define ktLEAP_LINELEN   256     /*!< longer lines of the list are cut           */
+
+/*!
+  \enum leap_smear_shape
+  \brief how a leap second is spread over the smear window (--smear)
+  ******************************************************************
+*/
+typedef enum leap_smear_shape {
+  eLEAP_SMEAR_NONE = 0,          /*!< no smear, the kernel applies the leap      */
+  eLEAP_SMEAR_LINEAR,            /*!< constant frequency offset over the window  */
+  eLEAP_SMEAR_COSINE,            /*!< frequency offset rising then falling back  */
+
+}leap_smear_shape;
+
+/*!
+  \struct leap_table_t
+  \brief leap seconds of a leap-seconds.list (IERS/NIST format)
+  ******************************************************************
+*/
+typedef struct leap_table_t {
+  uint32_t m_when[ktLEAP_MAX];   /*!< NTP second from which TAI-UTC is m_tai     */
+  int      m_tai[ktLEAP_MAX];    /*!< TAI-UTC (s)                                */
+  int      m_count;              /*!< entries                                    */
+  uint32_t m_updated;            /*!< NTP time of the list ("#$")                */
+  uint32_t m_expires;            /*!< NTP time it is valid until ("#@")          */
+
+} leap_table_t;
+
+/*!
+  \struct leap_state_t
+  \brief leap second to come, from the list or the servers
+  ******************************************************************
+*/
+typedef struct leap_state_t {
+  int      m_leap;               /*!< NTP_LI_INSERT, NTP_LI_DELETE or NONE       */
+  uint32_t m_when;               /*!< NTP second following the leap (midnight)   */
+  int      m_armed;              /*!< told to the kernel                         */
+
+} leap_state_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int      leap_load      ( const char *path, leap_table_t *t);
+int      leap_pending   ( const leap_table_t *t, uint32_t now, uint32_t *when);
+uint32_t leap_month_end ( uint32_t now);
+int      leap_kernel_arm( int leap);
+double   leap_smear     ( int shape, double window, double t, double *rate);
+int      leap_smear_parse( const char *spec, int *shape, int *window);
+
+#endif /* LEAP_H_ */
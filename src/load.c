@@ -0,0 +1,574 @@
+/**
+ * \file load.c
+ * \brief NTP load generator
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Find the capacity of NTP servers (--load): client requests are sent
+ * to the servers at a given rate during --duration seconds, then at the
+ * next rate of the sweep, and round trip times go into log-linear
+ * histograms.
+ *
+ * The load is open loop: each thread has a sender which follows a
+ * schedule (absolute clock_nanosleep() on the monotonic clock, late
+ * requests are sent at once to catch up) whatever the replies, and a
+ * receiver. The round trip time is measured from the scheduled time,
+ * so a late sender shows in the latency instead of hiding it. Requests
+ * due together and replies go by batches (--io, see netio.c); replies
+ * are dated by the kernel.
+ *
+ * Requests are matched to replies by their transmit time-stamp, echoed
+ * by the server: its low bits hold a sequence number indexing a ring
+ * of requests in flight. A reply later than ktLOAD_DRAIN is lost.
+ * The sender publishes a slot by storing its time-stamp last, the
+ * receiver takes it back by swapping the time-stamp to 0: a slot being
+ * written again meanwhile makes the reply stale.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntpdate.h"
+#include "timing.h"
+#include "netio.h"
+#include "auth.h"
+#include "load.h"
+
+#define LOAD_RINGBITS  16                    /*!< requests in flight per thread: 2^16 */
+#define LOAD_RING      (1 << LOAD_RINGBITS)
+#define LOAD_RINGMASK  (LOAD_RING - 1)
+#define LOAD_RCVBUF    (4 << 20)             /*!< socket receive buffer (bytes)      */
+#define LOAD_STARTUP   0.05                  /*!< delay before the first request (s) */
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+/*!
+  \struct load_slot_t
+  \brief a request in flight
+*/
+typedef struct load_slot_t {
+  ntp_ts_t m_tx;                 /*!< transmit time-stamp, 0 if answered or being
+                                      written (atomic, published last)           */
+  double   m_sched;              /*!< monotonic time it was scheduled at         */
+  int      m_server;             /*!< index of the server                        */
+
+} load_slot_t;
+
+/*!
+  \struct load_stats_t
+  \brief what happened with one server
+*/
+typedef struct load_stats_t {
+  uint64_t    m_sent;            /*!< requests sent                              */
+  uint64_t    m_recv;            /*!< replies in time                            */
+  uint64_t    m_kod;             /*!< Kiss-o'-Death replies                      */
+  uint64_t    m_late;            /*!< replies later than ktLOAD_DRAIN            */
+  load_hist_t m_rtt;             /*!< round trip times (ns)                      */
+
+} load_stats_t;
+
+/*!
+  \struct load_worker_t
+  \brief a sender and a receiver sharing one socket
+*/
+typedef struct load_worker_t {
+  pthread_t   m_sender;          /*!< sending thread                             */
+  pthread_t   m_receiver;        /*!< receiving thread                           */
+  int         m_socket;          /*!< UDP socket                                 */
+  netio_t    *m_tx;              /*!< batched sends of the sender                */
+  netio_t    *m_rx;              /*!< batched receives of the receiver           */
+
+  const struct sockaddr_in *m_servers; /*!< servers addresses                    */
+  int         m_nservers;        /*!< number of servers                          */
+  double      m_start;           /*!< monotonic time of the first request        */
+  double      m_end;             /*!< no request scheduled after it              */
+  double      m_interval;        /*!< seconds between two requests               */
+  int         m_stop;            /*!< stop now, the step failed (atomic)         */
+
+  load_slot_t *m_ring;           /*!< requests in flight                         */
+  load_stats_t m_stats[ktMAXHOSTS]; /*!< per server                              */
+  uint64_t    m_sendErr;         /*!< send failures                              */
+  uint64_t    m_stale;           /*!< replies matching no request                */
+  uint64_t    m_authFailed;      /*!< replies without the MAC of --key           */
+  double      m_maxLag;          /*!< latest request behind its schedule (s)     */
+
+} load_worker_t;
+
+/*!
+  \brief histogram bucket of a value
+*/
+static int hist_index( uint64_t ns)
+{
+  int e = 0;
+
+  while( (ns >> e) >= ktLOAD_SUB) e++;
+  if( e >= ktLOAD_EXPS) return ktLOAD_EXPS * ktLOAD_SUB - 1;
+  return e * ktLOAD_SUB + (int)(ns >> e);
+}
+
+/*!
+  \brief record a value into a histogram
+  ******************************************************************
+
+  \param h  the histogram
+  \param ns the value (ns)
+*/
+void load_hist_add( load_hist_t *h, uint64_t ns)
+{
+  h->m_count[hist_index( ns)]++;
+  if( !h->m_total || ns < h->m_min) h->m_min = ns;
+  if( ns > h->m_max) h->m_max = ns;
+  h->m_total++;
+}
+
+/*!
+  \brief add a histogram to another one
+  ******************************************************************
+
+  \param to   the histogram to complete
+  \param from the histogram to add
+*/
+void load_hist_merge( load_hist_t *to, const load_hist_t *from)
+{
+  int i;
+
+  if( !from->m_total) return;
+  for( i = 0; i < ktLOAD_EXPS * ktLOAD_SUB; i++) to->m_count[i] += from->m_count[i];
+  if( !to->m_total || from->m_min < to->m_min) to->m_min = from->m_min;
+  if( from->m_max > to->m_max) to->m_max = from->m_max;
+  to->m_total += from->m_total;
+}
+
+/*!
+  \brief value below which a percentage of the values are
+  ******************************************************************
+
+  \param h   the histogram
+  \param pct the percentage (0-100)
+  \return the middle of the bucket holding it (ns), 0 if empty
+*/
+uint64_t load_hist_percentile( const load_hist_t *h, double pct)
+{
+  uint64_t target, seen = 0, value;
+  int i, e;
+
+  if( !h->m_total) return 0;
+
+  target = (uint64_t)ceil( pct / 100 * h->m_total);
+  if( target < 1) target = 1;
+  for( i = 0; i < ktLOAD_EXPS * ktLOAD_SUB; i++) {
+    seen += h->m_count[i];
+    if( seen >= target) break;
+  }
+
+  e = i / ktLOAD_SUB;
+  value = ((uint64_t)(i % ktLOAD_SUB) << e) + (((uint64_t)1 << e) >> 1);
+  if( value < h->m_min) value = h->m_min;
+  if( value > h->m_max) value = h->m_max;
+  return value;
+}
+
+/*!
+  \brief parse a rate or a sweep of rates
+  ******************************************************************
+
+  \param spec "RATE" or "FROM:TO:STEP" (requests per second)
+  \param from first rate
+  \param to   last rate
+  \param step rate increment, 0 for a single rate
+  \return 0 if OK else -1
+*/
+int load_parse( const char *spec, double *from, double *to, double *step)
+{
+  char end;
+
+  *step = 0;
+  if( sscanf( spec, "%lf:%lf:%lf%c", from, to, step, &end) == 3) {
+    return (*from > 0 && *to >= *from && *step > 0) ? 0 : -1;
+  }
+  if( sscanf( spec, "%lf%c", from, &end) == 1) {
+    *to = *from;
+    return (*from > 0) ? 0 : -1;
+  }
+  return -1;
+}
+
+/*!
+  \brief sending thread: follow the schedule whatever the replies
+*/
+static void *load_sender( void *arg)
+{
+  load_worker_t *w = (load_worker_t *)arg;
+  struct {
+    ntp_packet_t m_packet;
+    uint8_t      m_mac[ktAUTH_MACLEN];
+  } requests[ktNETIO_BATCH];
+  const auth_key_t *key = gAppOptions.m_keyId ? auth_find( gAppOptions.m_keyId) : NULL;
+  netio_msg_t msgs[ktNETIO_BATCH];
+  load_slot_t *slot = NULL;
+  struct timespec ts;
+  ntp_ts_t tx;
+  double sched = w->m_start, now;
+  uint32_t seq = 0;
+  int dest[ktNETIO_BATCH];
+  int server = 0, n, i, queued;
+
+  while( sched < w->m_end && !__atomic_load_n( &w->m_stop, __ATOMIC_RELAXED)) {
+    now = timing_now();
+    if( now < sched) {
+      ts.tv_sec  = (time_t)sched;
+      ts.tv_nsec = (long)((sched - ts.tv_sec) * 1e9);
+      while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+      now = timing_now();
+    }
+    if( now - sched > w->m_maxLag) w->m_maxLag = now - sched;
+
+    /* every request due, several if we woke up late, sent together */
+    for( n = 0; n < ktNETIO_BATCH && sched <= now && sched < w->m_end; n++) {
+      tx = (ntp_ts_now() & ~(ntp_ts_t)LOAD_RINGMASK) | (seq & LOAD_RINGMASK);
+      slot = &w->m_ring[seq & LOAD_RINGMASK];
+      __atomic_store_n( &slot->m_tx, 0, __ATOMIC_RELAXED);
+      __atomic_thread_fence( __ATOMIC_RELEASE);
+      __atomic_store( &slot->m_sched, &sched, __ATOMIC_RELAXED);
+      __atomic_store_n( &slot->m_server, server, __ATOMIC_RELAXED);
+      __atomic_store_n( &slot->m_tx, tx, __ATOMIC_RELEASE);
+
+      ntp_request_build( &requests[n].m_packet, tx);
+      msgs[n].m_data = (uint8_t *)&requests[n];
+      msgs[n].m_len  = sizeof(requests[n].m_packet);
+      if( key) msgs[n].m_len = auth_sign( key, msgs[n].m_data, msgs[n].m_len);
+      msgs[n].m_addr = w->m_servers[server];
+      dest[n]        = server;
+
+      seq++;
+      server = (server + 1) % w->m_nservers;
+      sched += w->m_interval;
+    }
+
+    queued = netio_send( w->m_tx, msgs, n);
+    for( i = 0; i < n; i++) {
+      if( i < queued) w->m_stats[dest[i]].m_sent++;
+      else w->m_sendErr++;
+    }
+  }
+  w->m_sendErr += netio_errors( w->m_tx);
+  return NULL;
+}
+
+/*!
+  \brief receiving thread: match replies and record round trip times
+*/
+static void *load_receiver( void *arg)
+{
+  load_worker_t *w = (load_worker_t *)arg;
+  netio_msg_t msgs[ktNETIO_BATCH];
+  ntp_packet_t *reply;
+  load_slot_t *slot = NULL;
+  load_stats_t *st = NULL;
+  struct timespec real;
+  ntp_ts_t org;
+  double now, rtt, at, sched;
+  uint32_t keyId;
+  int i, n, server;
+
+  while( (now = timing_now()) < w->m_end + ktLOAD_DRAIN && !__atomic_load_n( &w->m_stop, __ATOMIC_RELAXED)) {
+    n = netio_recv( w->m_rx, msgs, ktNETIO_BATCH, 100);
+    if( n <= 0) continue;                  // timeout, check the time
+    now = timing_now();
+    clock_gettime( CLOCK_REALTIME, &real);
+
+    for( i = 0; i < n; i++) {
+      /* the slot of a request is only reused LOAD_RING requests later,
+         its time-stamp tells if the reply is still for it */
+      reply = (ntp_packet_t *)msgs[i].m_data;
+      org   = ntp_ts_get( reply->origTm_s, reply->origTm_f);
+      slot  = &w->m_ring[org & LOAD_RINGMASK];
+      if( msgs[i].m_len < (int)sizeof(*reply) || NTP_MODE(reply->li_vn_mode) != NTP_MODE_SERVER ||
+          __atomic_load_n( &slot->m_tx, __ATOMIC_ACQUIRE) != org) {
+        w->m_stale++;
+        continue;
+      }
+      __atomic_load( &slot->m_sched, &sched, __ATOMIC_RELAXED);
+      server = __atomic_load_n( &slot->m_server, __ATOMIC_RELAXED);
+      __atomic_thread_fence( __ATOMIC_ACQUIRE);
+      if( !__atomic_compare_exchange_n( &slot->m_tx, &org, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        w->m_stale++;                      // written again meanwhile
+        continue;
+      }                                    // duplicates are stale now
+      if( gAppOptions.m_keyId && (auth_verify( msgs[i].m_data, msgs[i].m_len, &keyId) != eAUTH_OK ||
+                                  keyId != gAppOptions.m_keyId)) {
+        w->m_authFailed++;
+        continue;
+      }
+
+      /* arrival on the monotonic clock, from the kernel time-stamp if any */
+      at = now;
+      if( msgs[i].m_stamp.tv_sec) {
+        at -= (real.tv_sec - msgs[i].m_stamp.tv_sec) + (real.tv_nsec - msgs[i].m_stamp.tv_nsec) * 1e-9;
+      }
+
+      st  = &w->m_stats[server];
+      rtt = at - sched;
+      if( rtt > ktLOAD_DRAIN) st->m_late++;
+      else if( reply->stratum == 0) st->m_kod++;
+      else {
+        st->m_recv++;
+        load_hist_add( &st->m_rtt, (uint64_t)(rtt > 0 ? rtt * 1e9 : 0));
+      }
+    }
+  }
+  return NULL;
+}
+
+/*!
+  \brief write percentiles of a histogram as a JSON object
+*/
+static void write_rtt_json( FILE *out, const load_hist_t *h)
+{
+  fprintf( out, "{\"min\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"p9999\":%.1f,\"max\":%.1f}",
+           h->m_min / 1e3, load_hist_percentile( h, 50) / 1e3, load_hist_percentile( h, 90) / 1e3,
+           load_hist_percentile( h, 99) / 1e3, load_hist_percentile( h, 99.9) / 1e3,
+           load_hist_percentile( h, 99.99) / 1e3, h->m_max / 1e3);
+}
+
+/*!
+  \brief run the load at one rate then report
+  ******************************************************************
+
+  \param rate     requests per second, all threads and servers together
+  \param servers  servers addresses
+  \param nservers number of servers
+  \param stats    JSON lines output, may be NULL
+  \return 0 if OK or <0 if failed
+*/
+static int load_step( double rate, const struct sockaddr_in *servers, int nservers, FILE *stats)
+{
+  int nthreads = gAppOptions.m_threads, duration = gAppOptions.m_loadDuration;
+  int i, k, err = 0, rcvbuf = LOAD_RCVBUF, one = 1, started;
+  load_worker_t *workers = NULL;
+  load_stats_t *total = NULL;               // per server, then all servers in [nservers]
+  uint64_t sendErr = 0, stale = 0, authFailed = 0, lost;
+  double start, maxLag = 0;
+
+  workers = calloc( (size_t)nthreads, sizeof(*workers));
+  total   = calloc( (size_t)nservers + 1, sizeof(*total));
+  if( !workers || !total) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+    err = -1;
+    goto BAIL;
+  }
+
+  /*
+   * one socket per thread, threads interleaved on the schedule
+   ***************************************************************************
+   */
+  for( i = 0; i < nthreads; i++) workers[i].m_socket = -1;
+
+  start = timing_now() + LOAD_STARTUP;
+  for( i = 0; i < nthreads; i++) {
+    load_worker_t *w = &workers[i];
+
+    w->m_ring = calloc( LOAD_RING, sizeof(*w->m_ring));
+    if( !w->m_ring || (w->m_socket = socket( PF_INET, SOCK_DGRAM, 0)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+      err = -1;
+      goto BAIL;
+    }
+    setsockopt( w->m_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt( w->m_socket, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    if( !(w->m_tx = netio_open( w->m_socket, gAppOptions.m_io, 0)) ||
+        !(w->m_rx = netio_open( w->m_socket, gAppOptions.m_io, 1))) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+      err = -1;
+      goto BAIL;
+    }
+
+    w->m_servers  = servers;
+    w->m_nservers = nservers;
+    w->m_interval = nthreads / rate;
+    w->m_start    = start + i / rate;
+    w->m_end      = start + duration;
+  }
+
+  for( started = 0; started < nthreads; started++) {
+    if( pthread_create( &workers[started].m_receiver, NULL, load_receiver, &workers[started])) break;
+    if( pthread_create( &workers[started].m_sender, NULL, load_sender, &workers[started])) {
+      __atomic_store_n( &workers[started].m_stop, 1, __ATOMIC_RELAXED);
+      pthread_join( workers[started].m_receiver, NULL);
+      break;
+    }
+  }
+  if( started < nthreads) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("pthread_create() failed"));
+    for( i = 0; i < started; i++) __atomic_store_n( &workers[i].m_stop, 1, __ATOMIC_RELAXED);
+    err = -1;
+  }
+  for( i = 0; i < started; i++) {
+    pthread_join( workers[i].m_sender, NULL);
+    pthread_join( workers[i].m_receiver, NULL);
+  }
+  if( err) goto BAIL;
+
+  /*
+   * merge the threads
+   ***************************************************************************
+   */
+  for( i = 0; i < nthreads; i++) {
+    for( k = 0; k < nservers; k++) {
+      const load_stats_t *from = &workers[i].m_stats[k];
+      load_stats_t *to[2] = { &total[k], &total[nservers] };
+      int j;
+
+      for( j = 0; j < 2; j++) {
+        to[j]->m_sent += from->m_sent;
+        to[j]->m_recv += from->m_recv;
+        to[j]->m_kod  += from->m_kod;
+        to[j]->m_late += from->m_late;
+        load_hist_merge( &to[j]->m_rtt, &from->m_rtt);
+      }
+    }
+    sendErr    += workers[i].m_sendErr;
+    stale      += workers[i].m_stale;
+    authFailed += workers[i].m_authFailed;
+    if( workers[i].m_maxLag > maxLag) maxLag = workers[i].m_maxLag;
+  }
+
+  /*
+   * report
+   ***************************************************************************
+   */
+  {
+    const load_stats_t *t = &total[nservers];
+
+    lost = t->m_sent - t->m_recv - t->m_kod;
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Load %.0f/s: sent %llu, received %llu, lost %.3f%%, KoD %llu"),
+                 rate, (unsigned long long)t->m_sent, (unsigned long long)t->m_recv,
+                 t->m_sent ? 100.0 * lost / t->m_sent : 0, (unsigned long long)t->m_kod);
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("RTT (us): p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f"),
+                 load_hist_percentile( &t->m_rtt, 50) / 1e3, load_hist_percentile( &t->m_rtt, 90) / 1e3,
+                 load_hist_percentile( &t->m_rtt, 99) / 1e3, load_hist_percentile( &t->m_rtt, 99.9) / 1e3,
+                 t->m_rtt.m_max / 1e3);
+    if( nservers > 1) {
+      for( k = 0; k < nservers; k++) {
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("  %s: received %llu/%llu, p99 %.0f us"),
+                     inet_ntoa( servers[k].sin_addr), (unsigned long long)total[k].m_recv,
+                     (unsigned long long)total[k].m_sent, load_hist_percentile( &total[k].m_rtt, 99) / 1e3);
+      }
+    }
+    if( gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Sender late by %.3f ms max, %llu send errors, %llu stale"),
+                   maxLag * 1e3, (unsigned long long)sendErr, (unsigned long long)stale);
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("I/O: %s"), netio_name( netio_backend_of( workers[0].m_rx)));
+    }
+    if( gAppOptions.m_keyId) {
+      trace_write( gAppTrace, authFailed ? eWARNING_MSG_TYPE : eINFO_MSG_TYPE,
+                   _("Replies not authenticated by key %u: %llu"), gAppOptions.m_keyId, (unsigned long long)authFailed);
+    }
+    trace_flush( gAppTrace);
+
+    if( stats) {
+      fprintf( stats, "{\"type\":\"load\",\"rate\":%.1f,\"threads\":%d,\"io\":\"%s\",\"duration\":%d,\"achieved\":%.1f,"
+               "\"sent\":%llu,\"received\":%llu,\"lost\":%llu,\"kod\":%llu,\"late\":%llu,\"stale\":%llu,"
+               "\"auth_failed\":%llu,\"send_errors\":%llu,\"max_lag_ms\":%.3f,\"rtt_us\":",
+               rate, nthreads, netio_name( netio_backend_of( workers[0].m_rx)), duration, (double)t->m_sent / duration,
+               (unsigned long long)t->m_sent, (unsigned long long)t->m_recv, (unsigned long long)lost,
+               (unsigned long long)t->m_kod, (unsigned long long)t->m_late, (unsigned long long)stale,
+               (unsigned long long)authFailed, (unsigned long long)sendErr, maxLag * 1e3);
+      write_rtt_json( stats, &t->m_rtt);
+      fprintf( stats, ",\"servers\":[");
+      for( k = 0; k < nservers; k++) {
+        fprintf( stats, "%s{\"host\":\"%s\",\"sent\":%llu,\"received\":%llu,\"kod\":%llu,\"rtt_us\":",
+                 k ? "," : "", inet_ntoa( servers[k].sin_addr), (unsigned long long)total[k].m_sent,
+                 (unsigned long long)total[k].m_recv, (unsigned long long)total[k].m_kod);
+        write_rtt_json( stats, &total[k].m_rtt);
+        fprintf( stats, "}");
+      }
+      fprintf( stats, "]}\n");
+      fflush( stats);
+    }
+  }
+
+BAIL:
+  if( workers) {
+    for( i = 0; i < nthreads; i++) {
+      netio_close( workers[i].m_tx);
+      netio_close( workers[i].m_rx);
+      if( workers[i].m_socket >= 0) close( workers[i].m_socket);
+      free( workers[i].m_ring);
+    }
+  }
+  free( workers);
+  free( total);
+  return err;
+}
+
+
+/*!
+  \brief load generator entry point (--load)
+  ******************************************************************
+
+  \return 0 if OK or <0 if failed
+*/
+int ntp_load( void)
+{
+  struct sockaddr_in servers[ktMAXHOSTS];
+  FILE *stats = NULL;
+  double rate;
+  int i, err = 0;
+
+  for( i = 0; i < gAppOptions.m_nhosts; i++) {
+    resolve_host( gAppOptions.m_hosts[i], &servers[i]);
+  }
+
+  if( gAppOptions.m_statsFile) {
+    stats = strcmp( gAppOptions.m_statsFile, "-") ? fopen( gAppOptions.m_statsFile, "a") : stdout;
+    if( !stats) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open statistics file %s"), gAppOptions.m_statsFile);
+      return -1;
+    }
+  }
+
+  if( gAppOptions.m_verbose) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Load: %d thread(s), %d s per rate"),
+                 gAppOptions.m_threads, gAppOptions.m_loadDuration);
+  }
+
+  /* the sweep goes up to m_loadTo, within rounding */
+  for( rate = gAppOptions.m_loadFrom; !err && rate <= gAppOptions.m_loadTo * (1 + 1e-9); rate += gAppOptions.m_loadStep) {
+    err = load_step( rate, servers, gAppOptions.m_nhosts, stats);
+    if( gAppOptions.m_loadStep <= 0) break;
+  }
+
+  if( stats && stats != stdout) fclose( stats);
+  return err;
+}
@@ -0,0 +1,50 @@
+/**
+ * \file load.h
+ * \brief NTP load generator header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef LOAD_H_
+#define LOAD_H_
+
+#include <stdint.h>
+
+#define ktLOAD_MAXTHREADS   64   /*!< max sending threads                          */
+#define ktLOAD_DURATION     10   /*!< default seconds per load step                */
+#define ktLOAD_DRAIN        1.0  /*!< replies later than this (s) are lost         */
+#define ktLOAD_SUBBITS      6    /*!< histogram precision: 2^-6 (1.6%)             */
+#define ktLOAD_SUB          (1 << ktLOAD_SUBBITS)
+#define ktLOAD_EXPS         36   /*!< histogram range: 2^(36+5) ns, about 36 min   */
+
+/*!
+  \struct load_hist_t
+  \brief latency histogram with log-linear buckets (HDR style)
+  ******************************************************************
+
+  Values below ktLOAD_SUB ns are counted exactly, above each power of
+  two is split into ktLOAD_SUB/2 buckets, so the relative error does
+  not depend on the value.
+*/
+typedef struct load_hist_t {
+  uint64_t m_count[ktLOAD_EXPS * ktLOAD_SUB]; /*!< counts per bucket            */
+  uint64_t m_total;              /*!< values recorded                            */
+  uint64_t m_min;                /*!< lowest value (ns)                          */
+  uint64_t m_max;                /*!< highest value (ns)                         */
+
+} load_hist_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+void     load_hist_add       ( load_hist_t *h, uint64_t ns);
+void     load_hist_merge     ( load_hist_t *to, const load_hist_t *from);
+uint64_t load_hist_percentile( const load_hist_t *h, double pct);
+int      load_parse          ( const char *spec, double *from, double *to, double *step);
+int      ntp_load            ( void);
+
+#endif /* LOAD_H_ */
@@ -72,6 +72,7 @@
 #include <time.h>
 #include <string.h>
 #include <ctype.h>
+#include <arpa/inet.h>
 
 #include "gettext.h" /* for gettext functions */
 #define _(String) gettext (String)
@@ -79,6 +80,19 @@
 
 #include "main.h"
 #include "ntpdate.h"
+#include "sync.h"
+#include "load.h"
+#include "capture.h"
+#include "ratelimit.h"
+#include "server.h"
+#include "netio.h"
+#include "leap.h"
+#include "auth.h"
+#include "nts.h"
+#include "systemd.h"
+#include "quick.h"
+#include "history.h"
+#include "conffile.h"
 #include "trace.h"
 
 /* -- global variables -- */
@@ -120,6 +134,12 @@ int main(int argc, char **argv)
   /* -- set default options and parse arguments -- */
   if (argc <= 1) usage();
 
+#ifndef ZNTP_TINY
+  /* the configuration file first, the command line wins over it */
+  err = config_args( &argc, &argv, &gAppOptions.m_fixed);
+  if(err) goto BAIL;
+#endif
+
   /* parse command line arguments */
   err = parse_cmd_line(argc, argv);
   if(err) goto BAIL;
@@ -127,8 +147,20 @@ int main(int argc, char **argv)
   /* init trace */
   gAppTrace = trace_init( gAppOptions.m_syslog ? eSyslog : eStdout);
 
-  /* do ntpdate */
-  err = ntpdate();
+#ifdef ZNTP_TINY
+  /* the one-shot mode alone (configure --enable-tiny) */
+  err = tiny_sync();
+#else
+  systemd_init();
+
+  /* do ntpdate, load the servers or analyze a capture or a history */
+  if( gAppOptions.m_pcapFile) err = capture_analyze( gAppOptions.m_pcapFile);
+  else if( gAppOptions.m_analyzeFile) err = history_analyze( gAppOptions.m_analyzeFile);
+  else if( gAppOptions.m_loadFrom > 0) err = ntp_load();
+  else if( gAppOptions.m_servePort && (err = server_run()) != 0) goto BAIL;
+  else if( gAppOptions.m_nhosts || gAppOptions.m_bclient) err = ntpdate();
+  else server_wait();
+#endif
   if(err) goto BAIL;
 
   /* close trace */
@@ -153,9 +185,24 @@ static int parse_cmd_line(int argc, char **argv)
   int j = 0;
   char *p = NULL;
   char c = 0, *aaa = NULL;
+#ifndef ZNTP_TINY
+  int line = 0;
+  struct in_addr group;
+#endif
   
   /* default */
   gAppOptions.m_version = 3; // NTP version 3
+  gAppOptions.m_port = NTP_PORT;
+  gAppOptions.m_timeout = TIMEOUT_SECS;
+  gAppOptions.m_poll = ktDEFAULT_POLL;
+  gAppOptions.m_filter = eSYNC_FILTER_MINDELAY;
+  gAppOptions.m_holdoverRate = ktSYNC_HOLDOVER_RATE;
+  gAppOptions.m_holdoverMax = ktSYNC_HOLDOVER_MAX;
+  gAppOptions.m_stepThreshold = ktSYNC_STEP_THRESHOLD;
+  gAppOptions.m_loadDuration = ktLOAD_DURATION;
+  gAppOptions.m_threads = 1;
+  gAppOptions.m_ntsPort = ktNTS_KE_PORT;
+  tzrule_parse( &gAppOptions.m_tzRule, ktTZ_DEFAULT_RULE);
   
   /* parse the arguments */
   while( --argc > 0 ) {
@@ -167,10 +214,201 @@ static int parse_cmd_line(int argc, char **argv)
       if (p[1] == '-') {
         p += 2;
         if (--argc <= 0) {
-          fprintf( stderr, _("%s No argument for\n"), gLogSignature[eERROR_MSG_TYPE]);
+          fprintf( stderr, _("%s No argument for --%s\n"), gLogSignature[eERROR_MSG_TYPE], p);
           err = -1; goto DONE;
         }
-        argv++;
+        aaa = *++argv;
+
+        if( !strcmp( p, "tz")) {
+          if( tzrule_parse( &gAppOptions.m_tzRule, aaa) < 0) {
+            fprintf(stderr, _("%s Invalid POSIX TZ rule <%s>\n"), gLogSignature[eERROR_MSG_TYPE], aaa);
+            err = -8; goto DONE;
+          }
+          gAppOptions.m_enableEST = 1;
+        }
+        else if( !strcmp( p, "port")) {
+          gAppOptions.m_port = atoi( aaa);
+          if( gAppOptions.m_port <= 0 || gAppOptions.m_port > 65535) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "timeout")) {
+          gAppOptions.m_timeout = atoi( aaa);
+          if( gAppOptions.m_timeout <= 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+#ifndef ZNTP_TINY
+        else if( !strcmp( p, "poll")) {
+          gAppOptions.m_poll = atoi( aaa);
+          if( gAppOptions.m_poll <= 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "filter")) {
+          if( (gAppOptions.m_filter = sync_filter_parse( aaa)) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "stats")) {
+          gAppOptions.m_statsFile = aaa;
+        }
+        else if( !strcmp( p, "pcap")) {
+          gAppOptions.m_pcapFile = aaa;
+        }
+        else if( !strcmp( p, "history")) {
+          if( history_parse( aaa, &gAppOptions.m_historyRecords) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+          gAppOptions.m_historyFile = aaa;
+        }
+        else if( !strcmp( p, "analyze")) {
+          gAppOptions.m_analyzeFile = aaa;
+        }
+        else if( !strcmp( p, "serve")) {
+          gAppOptions.m_servePort = atoi( aaa);
+          if( gAppOptions.m_servePort <= 0 || gAppOptions.m_servePort > 65535) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+          gAppOptions.m_daemon = 1;
+        }
+        else if( !strcmp( p, "bclient") || !strcmp( p, "broadcast")) {
+          if( !inet_aton( aaa, &group)) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+          if( p[1] == 'c') {
+            gAppOptions.m_bclient = aaa;
+            gAppOptions.m_daemon = 1;
+          }
+          else gAppOptions.m_broadcast = aaa;
+        }
+        else if( !strcmp( p, "stratum")) {
+          gAppOptions.m_stratum = atoi( aaa);
+          if( gAppOptions.m_stratum <= 0 || gAppOptions.m_stratum > 15) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "limit")) {
+          if( rate_parse( aaa, &gAppOptions.m_rateAverage, &gAppOptions.m_rateBurst, &gAppOptions.m_rateKod) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "load")) {
+          if( load_parse( aaa, &gAppOptions.m_loadFrom, &gAppOptions.m_loadTo, &gAppOptions.m_loadStep) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "duration")) {
+          gAppOptions.m_loadDuration = atoi( aaa);
+          if( gAppOptions.m_loadDuration <= 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "threads")) {
+          gAppOptions.m_threads = atoi( aaa);
+          if( gAppOptions.m_threads <= 0 || gAppOptions.m_threads > ktLOAD_MAXTHREADS) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "refclock")) {
+          if( strncmp( aaa, "shm:", 4) && strncmp( aaa, "sock:", 5)) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+          gAppOptions.m_refclock = aaa;
+          gAppOptions.m_daemon   = 1;
+        }
+        else if( !strcmp( p, "publish")) {
+          gAppOptions.m_publishFile = aaa;
+        }
+        else if( !strcmp( p, "state")) {
+          gAppOptions.m_stateFile = aaa;
+        }
+        else if( !strcmp( p, "leapfile")) {
+          gAppOptions.m_leapFile = aaa;
+        }
+        else if( !strcmp( p, "keys")) {
+          if( (j = auth_load( aaa, &line)) < 0) {
+            if( j == -1) fprintf(stderr, _("%s Cannot read key file <%s>\n"), gLogSignature[eERROR_MSG_TYPE], aaa);
+            else if( j == -3) fprintf(stderr, _("%s Key type not supported, line %d of <%s>\n"),
+                                      gLogSignature[eERROR_MSG_TYPE], line, aaa);
+            else fprintf(stderr, _("%s Invalid key, line %d of <%s>\n"), gLogSignature[eERROR_MSG_TYPE], line, aaa);
+            err = -10; goto DONE;
+          }
+          gAppOptions.m_keysFile = aaa;
+        }
+        else if( !strcmp( p, "key")) {
+          gAppOptions.m_keyId = (unsigned)strtoul( aaa, NULL, 10);
+          if( gAppOptions.m_keyId == 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "nts")) {
+          gAppOptions.m_ntsDir = aaa;
+        }
+        else if( !strcmp( p, "nts-ca")) {
+          gAppOptions.m_ntsCa = aaa;
+        }
+        else if( !strcmp( p, "nts-port")) {
+          gAppOptions.m_ntsPort = atoi( aaa);
+          if( gAppOptions.m_ntsPort <= 0 || gAppOptions.m_ntsPort > 65535) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "smear")) {
+          if( leap_smear_parse( aaa, &gAppOptions.m_smear, &gAppOptions.m_smearWindow) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "holdover")) {
+          if( sync_holdover_parse( aaa, &gAppOptions.m_holdoverRate, &gAppOptions.m_holdoverMax) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "step")) {
+          gAppOptions.m_stepThreshold = atof( aaa);
+          if( gAppOptions.m_stepThreshold <= 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "config")) {
+          gAppOptions.m_configFile = aaa;              // read by config_args()
+        }
+        else if( !strcmp( p, "quick")) {
+          gAppOptions.m_quick = atoi( aaa);
+          if( gAppOptions.m_quick < ktQUICK_MINBUDGET) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+        else if( !strcmp( p, "io")) {
+          if( (gAppOptions.m_io = netio_parse( aaa)) < 0) {
+            fprintf(stderr, _("%s Invalid parameter <%s> for option --%s\n"), gLogSignature[eERROR_MSG_TYPE], aaa, p);
+            err = -10; goto DONE;
+          }
+        }
+#endif
+        else {
+          fprintf(stderr, _("%s Unknown option: --%s\n"), gLogSignature[eERROR_MSG_TYPE], p);
+          err = -9; goto DONE;
+        }
         continue;
       }
       
@@ -178,10 +416,14 @@ static int parse_cmd_line(int argc, char **argv)
         switch (c = *p) {
         case 'V': write_version(); exit(0); break;
         case 'h': usage(); break;
-        case 'v': gAppOptions.m_verbose = 1; break;
         case 'd': gAppOptions.m_debug = 1; break;
-        case 's': gAppOptions.m_syslog = 1; break;
         case 'E': gAppOptions.m_enableEST = 1; break;
+#ifndef ZNTP_TINY
+        case 'v': gAppOptions.m_verbose = 1; break;
+        case 's': gAppOptions.m_syslog = 1; break;
+        case 'D': gAppOptions.m_daemon = 1; break;
+        case 'x': gAppOptions.m_xleave = 1; break;
+#endif
           
           /* flags with parameter.. */
         case 'O':
@@ -245,15 +487,50 @@ static int parse_cmd_line(int argc, char **argv)
       fprintf(stderr, _("%s IP address must be not null!\n"), gLogSignature[eERROR_MSG_TYPE]);
       err = -6; goto DONE;
     }
+    else if( gAppOptions.m_nhosts >= ktMAXHOSTS) {
+      fprintf(stderr, _("%s Too many servers, %d max\n"), gLogSignature[eERROR_MSG_TYPE], ktMAXHOSTS);
+      err = -11; goto DONE;
+    }
     else { 
-      strncpy( gAppOptions.m_host, p, sizeof(gAppOptions.m_host));
+      strncpy( gAppOptions.m_hosts[gAppOptions.m_nhosts++], p, ktHOSTNAMELEN);
       
       continue;
     }
     
   } // while  --argc > 0 
   
-  if( strlen(gAppOptions.m_host) == 0) {
+#ifndef ZNTP_TINY
+  if( gAppOptions.m_keyId && !auth_find( gAppOptions.m_keyId)) {
+    fprintf(stderr, _("%s Key %u not in the key file (--keys)\n"), gLogSignature[eERROR_MSG_TYPE], gAppOptions.m_keyId);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_keyId && gAppOptions.m_ntsDir) {
+    fprintf(stderr, _("%s --key and --nts cannot be used together\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_bclient && gAppOptions.m_ntsDir) {
+    fprintf(stderr, _("%s --bclient and --nts cannot be used together\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_quick && (gAppOptions.m_daemon || gAppOptions.m_ntsDir || gAppOptions.m_xleave)) {
+    fprintf(stderr, _("%s --quick cannot be used with -D, --nts or -x\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_statsFile && !strcmp( gAppOptions.m_statsFile, "-") && !gAppOptions.m_syslog) {
+    fprintf(stderr, _("%s --stats - needs -s, the trace is on the standard output\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_broadcast && !gAppOptions.m_servePort) {
+    fprintf(stderr, _("%s --broadcast needs --serve\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -10; goto DONE;
+  }
+  if( gAppOptions.m_loadFrom > 0 && gAppOptions.m_nhosts == 0) {
+    fprintf(stderr, _("%s --load needs the servers to load\n"), gLogSignature[eERROR_MSG_TYPE]);
+    err = -7; goto DONE;
+  }
+#endif
+  if( gAppOptions.m_nhosts == 0 && !gAppOptions.m_pcapFile && !gAppOptions.m_analyzeFile && !gAppOptions.m_servePort &&
+      !gAppOptions.m_bclient) {
     fprintf(stderr, _("%s No IP address specified\n"), gLogSignature[eERROR_MSG_TYPE]);
     err = -7; goto DONE;
   }
@@ -271,30 +548,182 @@ DONE:
 static void usage(void)  
 {
   write_version();
+#ifdef ZNTP_TINY
+  fprintf( stdout,
+           _("Small static build (configure --enable-tiny): the one-shot mode alone.\n"
+             "\n"
+             "Usage: zntpdate [options] address...\n"
+             "where:\n"
+             " address      IP address of NTP server (8 max), there is no name resolution\n"
+             "              in this build. The servers are queried together; with several\n"
+             "              servers, only those agreeing with the majority are used.\n"
+             " options:\n"
+             "     -o v     NTP version of the requests, 1 or 2 for old servers. The default is 3.\n"
+             "     -O[+-]n  Offset to add before set date, indicate +/- value (seconds).\n"
+             "     --port p UDP port of the NTP server. The default is 123.\n"
+             "     --timeout s\n"
+             "              Seconds to wait for the replies before retrying. The default is 10.\n"
+             "     -E       Enable automatic correction for the summer time.\n"
+             "     --tz r   Summer time rule as a POSIX TZ string (implies -E).\n"
+             "     -d       Debugging mode: all the steps, but the clock is not set.\n"
+             "     -h       Show this command summary.\n"
+             "     -V       Show program version.\n"
+             )
+           );
+#else
   fprintf( stdout,
            _("This tool is like ntpdate but I added a feature to make an offset before set system date\n"
              "and time. It is particulary interesting when your system is configured without TIMEZONE\n"
              "and when you could not set nothing else but GMT0.\n"
-             "If you are localized into an European Summer Time zone don't forget to set -E option so\n"
-             "than one hour will be automatically added in summer.\n"
+             "If you are localized into a summer time zone don't forget to set -E option so\n"
+             "than one hour will be automatically added in summer (use --tz for other rules\n"
+             "than the European one).\n"
              "\n"
-             "Usage: zndtpdate [options] host\n"
+             "Usage: zndtpdate [options] host...\n"
              "where:\n"
-             " host         hostname or IP address of NTP server\n"
+             " host         hostname or IP address of NTP server (8 max). With several\n"
+             "              servers, only those agreeing with the majority are used.\n"
              " options:\n"
              "  .configuration:\n"
              "     -o v     Specify the NTP version for outgoint packets as the integer version,  which\n"
              "              can  be 1 or 2. The default is 3. This allows ntpdate to be used with older\n"
              "              NTP versions.\n"
              "     -O[+-]n  Offset to add before set date, indicate +/- value (seconds).\n"
+             "     --port p UDP port of the NTP server. The default is 123.\n"
+             "     --timeout s\n"
+             "              Seconds to wait for each reply before retrying. The default is 10.\n"
              "     -E       Enable automatic correction for the summer time.\n"
+             "     --tz r   Summer time rule as a POSIX TZ string (implies -E), e.g.\n"
+             "              'EST5EDT,M3.2.0,M11.1.0'. Default is the European rule\n"
+             "              'CET-1CEST,M3.5.0,M10.5.0/3'.\n"
+             "     --keys f Symmetric keys file, ntpd format: 'id type key' lines, type MD5,\n"
+             "              SHA1 or AES128CMAC. The server mode answers requests with a MAC\n"
+             "              of one of them with a MAC of the same key.\n"
+             "     --key id Authenticate the requests with this key of the key file: replies\n"
+             "              without its valid MAC are rejected and counted.\n"
+             "     --nts d  Network Time Security: keys and cookies are got from each server\n"
+             "              by a TLS key exchange, then kept in directory d so that next polls\n"
+             "              and runs need no handshake. Replies not authenticated are rejected\n"
+             "              and counted.\n"
+             "     --nts-ca f\n"
+             "              Trust anchors (PEM) of the NTS-KE servers instead of the system ones.\n"
+             "     --nts-port p\n"
+             "              TCP port of the NTS-KE servers. The default is 4460.\n"
+             "     -x       Interleaved mode: each reply carries the time the previous one\n"
+             "              really left the server (kernel time-stamp), which is used with\n"
+             "              the kernel time-stamps of our requests and replies. Without -D,\n"
+             "              two requests are sent to each server.\n"
+             "     --state f\n"
+             "              Keep in file f what each server did (reachability, delay, jitter,\n"
+             "              Kiss-o'-Death) and query the best ones first on the next runs.\n"
+             "              Without -D, servers under Kiss-o'-Death or unreachable are left\n"
+             "              out, and the first reply of a server with a good record is enough.\n"
+             "     --quick ms\n"
+             "              Synchronize within ms milliseconds in all, name resolution included,\n"
+             "              instead of waiting --timeout for each server: the servers are queried\n"
+             "              at once, the clock is stepped on the first plausible reply (if off by\n"
+             "              more than 128 ms), then the servers are queried again until the end\n"
+             "              of the budget and the refined offset is slewed.\n"
+             "     --config f\n"
+             "              Read the options from file f first, one per line without '--'\n"
+             "              ('poll 16'), the command line winning over them; 'server h [port p]\n"
+             "              [noselect]' adds a server with its own port, queried but never\n"
+             "              selected with noselect; flags are 'verbose', 'debug', 'syslog',\n"
+             "              'daemon', 'summer' (-E), 'xleave', 'offset n' and 'version v'. With\n"
+             "              -D, the file is reloaded when it changes: servers, poll, timeout,\n"
+             "              filter, holdover, step and verbose are applied at the next poll.\n"
+             "  .daemon:\n"
+             "     -D       Daemon mode: stay in foreground and discipline the clock every poll\n"
+             "              interval, slewing it (steps only above 128 ms).\n"
+             "     --poll s Seconds between two polls of the servers. The default is 64.\n"
+             "     --step s Step the clock when it is off by more than s seconds, slew it below.\n"
+             "              The default is 0.128.\n"
+             "     --filter f\n"
+             "              Samples filter of each server: last, mindelay (default), median.\n"
+             "     --holdover r[:h]\n"
+             "              When no server answers, the clock keeps its frequency and its error\n"
+             "              bound grows by r ppm (default 15); after h hours (default 24) it is\n"
+             "              told not synchronized. When servers are back, an offset within the\n"
+             "              bound is slewed (up to 1 s) rather than stepped.\n"
+             "     --refclock r\n"
+             "              Do not touch the clock but hand the offset of each poll over to the\n"
+             "              daemon disciplining it (implies -D): 'shm:N' for the shared memory\n"
+             "              driver unit N of ntpd/chronyd, 'sock:PATH' for chronyd SOCK driver.\n"
+             "     --bclient a\n"
+             "              Do not poll the servers but listen (port --port) for the time they\n"
+             "              broadcast to address a, or multicast group a which is joined\n"
+             "              (implies -D). The one-way delay of each server is measured once\n"
+             "              by a unicast exchange. Servers given on the command line are the\n"
+             "              only ones listened to; with --key, broadcasts must be signed.\n"
+             "     --publish f\n"
+             "              Publish the clock offset, error bound, frequency and leap status at\n"
+             "              every update into file f, to be mapped by applications (zntpclock.h).\n"
+             "     --leapfile f\n"
+             "              Leap seconds list (IERS format, checksum verified), e.g.\n"
+             "              /usr/share/zoneinfo/leap-seconds.list. It wins over the leap\n"
+             "              indicator of the servers. No step is done within an hour of a leap\n"
+             "              second; with -D the kernel inserts or deletes it.\n"
+             "     --smear s[:h]\n"
+             "              Spread leap seconds over h hours (default 24, at most 48) centred\n"
+             "              on them by a frequency offset instead of the kernel step, so the\n"
+             "              clock never goes back: s is linear or cosine. The server mode then\n"
+             "              serves the smeared time and announces no leap second.\n"
+             "  .server:\n"
+             "     --serve p\n"
+             "              Answer NTP requests on UDP port p with the system clock (implies\n"
+             "              -D). Servers given on the command line discipline the clock; without\n"
+             "              any, the clock is told not synchronized unless --stratum is set.\n"
+             "     --stratum n\n"
+             "              Stratum told by the server when it has no server (1 to 15).\n"
+             "     --broadcast a\n"
+             "              Also send the time every poll interval to broadcast address or\n"
+             "              multicast group a (e.g. 224.0.1.1), port p, for the --bclient\n"
+             "              clients, signed with --key if set.\n"
+             "     --threads n\n"
+             "              Serving threads, each with its own socket. The default is 1.\n"
+             "     --limit a[:b[:kod]]\n"
+             "              Rate limit each client to one request every a seconds on average\n"
+             "              with bursts of b (default 8) requests, others are dropped. With\n"
+             "              ':kod', the first dropped request gets a Kiss-o'-Death RATE.\n"
+             "     --io b   How the server and load modes read and send datagrams by batches:\n"
+             "              uring (io_uring, Linux 6.0), mmsg (recvmmsg/sendmmsg) or auto\n"
+             "              (default: uring if the kernel has it, else mmsg).\n"
+             "  .load generator:\n"
+             "     --load r[:to:step]\n"
+             "              Do not set the clock but send r requests per second to the servers\n"
+             "              (shared), whatever the replies, and report round trip times and\n"
+             "              losses. With to and step, the rate goes from r to 'to'.\n"
+             "     --duration s\n"
+             "              Seconds per rate. The default is 10.\n"
+             "     --threads n\n"
+             "              Sending threads, each with its own socket. The default is 1.\n"
+             "  .capture analysis:\n"
+             "     --pcap f Do not set the clock but read the NTP exchanges (port --port) of the\n"
+             "              pcap or pcapng file f, e.g. from tcpdump. Offset and delay of the\n"
+             "              capturing host against each server are computed with the capture\n"
+             "              time-stamps, one JSON line per exchange is written to --stats.\n"
+             "  .history:\n"
+             "     --history f[:n]\n"
+             "              Append every sample (time, offset, delay, dispersion, server, what\n"
+             "              the poll did) to the ring file f of n records (default 1048576, 16\n"
+             "              bytes each), the oldest ones being overwritten.\n"
+             "     --analyze f\n"
+             "              Do not set the clock but analyze the history file f: offset, jitter\n"
+             "              and trend of each server per day and on the whole, and Allan deviation\n"
+             "              of its offsets (-v: the days too). --stats gets them as JSON lines.\n"
              "  .verbose/debug:\n"
              "     -d       Enable the debugging mode, in which zntpdate will go\n"
              "              through all the steps, but do not adjust the local clock.\n"
              "     -s       Divert logging output from the standard output (default) to the system sys-\n"
              "              log facility. This is designed primarily for convenience of cron scripts.\n"
              "     -v       Verbose mode. Information useful for\n"
-             "              general debugging will also be printed.\n"
+             "              general debugging will also be printed, with the time spent in\n"
+             "              each phase (DNS, NTS key exchange, send, wait, retries, clock).\n"
+             "     --stats f\n"
+             "              Append the time spent in each phase as JSON lines to file f ('-' for\n"
+             "              the standard output, with -s so that the trace goes to syslog).\n"
+             "              In daemon mode, histograms and the server request counters are added\n"
+             "              every 16 polls.\n"
              "  .help/version:\n"
              "     -h       Show this command summary.\n"
              "     -V       Show program version.\n"
@@ -302,10 +731,17 @@ static void usage(void)
              "Examples:\n"
              "     How to add automatically 1 hour in winter and 2 hours in summer time?\n"
              "              zntpdate -Ev -O+3600 pool.ntp.org\n"
+             "     How to add automatically the US summer time hour in New York?\n"
+             "              zntpdate -v -O-18000 --tz EST5EDT,M3.2.0,M11.1.0 pool.ntp.org\n"
              "     How to test znptdate without change date and time of your system?\n"
              "              zntpdate -dv pool.ntp.org\n"
+             "     How to serve the time on a LAN gateway, limiting greedy clients?\n"
+             "              zntpdate --serve 123 --limit 8:8:kod --threads 2 pool.ntp.org\n"
+             "     At what rate does the latency of our server degrade?\n"
+             "              zntpdate --load 1000:20000:1000 --threads 4 --stats load.json ntp1\n"
              )
            );
+#endif
   exit(0);
 }
 
@@ -11,7 +11,11 @@
 #ifndef MAIN_H_
 #define MAIN_H_
 
+#include "tzrule.h"
+
 #define ktHOSTNAMELEN 64         /*!< max host name len                          */
+#define ktMAXHOSTS     8         /*!< max NTP servers on the command line        */
+#define ktDEFAULT_POLL 64        /*!< daemon mode: seconds between polls         */
 
 /*!
   \struct options_t
@@ -22,11 +26,56 @@ typedef struct options_t {
   int m_verbose;                 /*!< verbose mode                               */
   int m_debug;                   /*!< debug mode                                 */
   int m_syslog;                  /*!< write log into syslog                      */
-  int m_enableEST;               /*!< use European Summer Time to set date/time  */
+  int m_enableEST;               /*!< use summer time rule to set date/time      */
+  tzrule_t m_tzRule;             /*!< compiled summer time rule (see --tz)       */
 
   int m_version;                 /*!< NTP version (1,2 or 3 by default)          */
   float m_offset;                /*!< offset in seconds                          */  
-  char m_host[ktHOSTNAMELEN+1];  /*!< NTP hostname or IP address                 */
+  char m_hosts[ktMAXHOSTS][ktHOSTNAMELEN+1]; /*!< NTP hostnames or IP addresses */
+  int m_nhosts;                  /*!< number of NTP servers                      */
+  int m_port;                    /*!< NTP server UDP port (123 by default)       */
+  int m_timeout;                 /*!< seconds to wait for each reply             */
+  int m_daemon;                  /*!< keep disciplining the clock every m_poll   */
+  int m_poll;                    /*!< daemon mode: seconds between polls         */
+  int m_filter;                  /*!< clock filter algorithm (see sync_filter)   */
+  double m_holdoverRate;         /*!< error growth without server (s/s)          */
+  int m_holdoverMax;             /*!< longest holdover (s), then not synchronized */
+  double m_stepThreshold;        /*!< daemon mode: step above this offset (s)    */
+  const char *m_statsFile;       /*!< JSON lines of phase timings, "-": stdout   */
+
+  double m_loadFrom;             /*!< load mode (--load): first rate (req/s)     */
+  double m_loadTo;               /*!< load mode: last rate of the sweep          */
+  double m_loadStep;             /*!< load mode: rate increment, 0 if none       */
+  int m_loadDuration;            /*!< load mode: seconds per rate                */
+  int m_threads;                 /*!< load and server modes: threads             */
+  const char *m_pcapFile;        /*!< capture to analyze (--pcap)                */
+
+  int m_servePort;               /*!< server mode (--serve): UDP port, 0: off    */
+  int m_stratum;                 /*!< server mode without server: our stratum    */
+  int m_rateAverage;             /*!< rate limit: seconds between requests, 0: off */
+  int m_rateBurst;               /*!< rate limit: requests allowed at once       */
+  int m_rateKod;                 /*!< rate limit: send Kiss-o'-Death RATE        */
+  int m_io;                      /*!< load and server modes: netio_backend       */
+  const char *m_publishFile;     /*!< clock state mapped file (--publish)        */
+  const char *m_refclock;        /*!< export to ntpd/chronyd, clock untouched    */
+  const char *m_leapFile;        /*!< leap-seconds.list (--leapfile)             */
+  int m_smear;                   /*!< leap_smear_shape, 0: kernel applies leaps  */
+  int m_smearWindow;             /*!< smear window (s)                           */
+  const char *m_keysFile;        /*!< symmetric keys (--keys)                    */
+  unsigned m_keyId;              /*!< key of the requests (--key), 0: none       */
+  const char *m_ntsDir;          /*!< NTS (--nts): cache of keys and cookies     */
+  const char *m_ntsCa;           /*!< NTS-KE trust anchors, NULL: system ones    */
+  int m_ntsPort;                 /*!< NTS-KE TCP port (4460 by default)          */
+  int m_xleave;                  /*!< interleaved mode (-x)                      */
+  const char *m_stateFile;       /*!< servers of former runs (--state)           */
+  const char *m_bclient;         /*!< broadcast client (--bclient): address heard */
+  const char *m_broadcast;       /*!< server mode: address broadcast to          */
+  int m_quick;                   /*!< quick mode (--quick): budget (ms), 0: off  */
+  const char *m_historyFile;     /*!< ring of the samples (--history)            */
+  unsigned m_historyRecords;     /*!< its size (records)                         */
+  const char *m_analyzeFile;     /*!< history to analyze (--analyze)             */
+  const char *m_configFile;      /*!< configuration file (--config)              */
+  unsigned m_fixed;              /*!< config_field given on the command line     */
   
 } options_t;
 
@@ -0,0 +1,120 @@
+/**
+ * \file md5.c
+ * \brief MD5 message digest (RFC 1321)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Only for the NTP symmetric keys of type MD5 (RFC 5905), still the
+ * most deployed ones.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "md5.h"
+
+#define ROL(x, n)  ( ((x) << (n)) | ((x) >> (32 - (n))) )
+
+/* one of the 64 steps, f the round function, g the word, s the shift */
+#define STEP(f, g, s) \
+  do { t = a + (f) + k[i] + w[g]; a = d; d = c; c = b; b = b + ROL( t, s); } while( 0)
+
+/*!
+  \brief hash one 64 bytes block
+*/
+static void md5_block( md5_t *h, const uint8_t *p)
+{
+  static const uint32_t k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391 };
+  static const int r[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+  uint32_t w[16], a, b, c, d, t;
+  int i;
+
+  for( i = 0; i < 16; i++) {
+    w[i] = (uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 | (uint32_t)p[4 * i + 2] << 16 | (uint32_t)p[4 * i + 3] << 24;
+  }
+
+  /* one loop per round function, no branch in the loops */
+  a = h->m_state[0]; b = h->m_state[1]; c = h->m_state[2]; d = h->m_state[3];
+  for( i = 0; i < 16; i++) STEP( (b & c) | (~b & d), i,                 r[i % 4]);
+  for( ; i < 32; i++)      STEP( (d & b) | (~d & c), (5 * i + 1) % 16,  r[4 + i % 4]);
+  for( ; i < 48; i++)      STEP( b ^ c ^ d,          (3 * i + 5) % 16,  r[8 + i % 4]);
+  for( ; i < 64; i++)      STEP( c ^ (b | ~d),       (7 * i) % 16,      r[12 + i % 4]);
+  h->m_state[0] += a; h->m_state[1] += b; h->m_state[2] += c; h->m_state[3] += d;
+}
+
+/*!
+  \brief start a digest
+*/
+void md5_init( md5_t *h)
+{
+  h->m_state[0] = 0x67452301;
+  h->m_state[1] = 0xEFCDAB89;
+  h->m_state[2] = 0x98BADCFE;
+  h->m_state[3] = 0x10325476;
+  h->m_length   = 0;
+}
+
+/*!
+  \brief hash more bytes
+*/
+void md5_update( md5_t *h, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t used = (size_t)(h->m_length % 64), n;
+
+  h->m_length += len;
+  while( len) {
+    n = 64 - used;
+    if( n > len) n = len;
+    memcpy( h->m_block + used, p, n);
+    used += n;
+    p    += n;
+    len  -= n;
+    if( used == 64) {
+      md5_block( h, h->m_block);
+      used = 0;
+    }
+  }
+}
+
+/*!
+  \brief end the digest
+*/
+void md5_final( md5_t *h, uint8_t digest[ktMD5_LEN])
+{
+  uint64_t bits = h->m_length * 8;
+  uint8_t pad[72];
+  size_t used = (size_t)(h->m_length % 64), n;
+  int i;
+
+  n = (used < 56) ? 56 - used : 120 - used;
+  memset( pad, 0, sizeof(pad));
+  pad[0] = 0x80;
+  for( i = 0; i < 8; i++) pad[n + i] = (uint8_t)(bits >> (8 * i));
+  md5_update( h, pad, n + 8);
+
+  for( i = 0; i < 4; i++) {
+    digest[4 * i]     = (uint8_t)h->m_state[i];
+    digest[4 * i + 1] = (uint8_t)(h->m_state[i] >> 8);
+    digest[4 * i + 2] = (uint8_t)(h->m_state[i] >> 16);
+    digest[4 * i + 3] = (uint8_t)(h->m_state[i] >> 24);
+  }
+}
@@ -0,0 +1,39 @@
+/**
+ * \file md5.h
+ * \brief MD5 message digest header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef MD5_H_
+#define MD5_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ktMD5_LEN    16          /*!< digest length (bytes)                      */
+
+/*!
+  \struct md5_t
+  \brief MD5 computation in progress
+  ******************************************************************
+*/
+typedef struct md5_t {
+  uint32_t m_state[4];           /*!< intermediate hash                          */
+  uint64_t m_length;             /*!< bytes hashed                               */
+  uint8_t  m_block[64];          /*!< pending bytes                              */
+
+} md5_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+void md5_init  ( md5_t *h);
+void md5_update( md5_t *h, const void *data, size_t len);
+void md5_final ( md5_t *h, uint8_t digest[ktMD5_LEN]);
+
+#endif /* MD5_H_ */
@@ -0,0 +1,809 @@
+/**
+ * \file netio.c
+ * \brief batched datagram I/O: io_uring or recvmmsg()/sendmmsg()
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * The server and load modes move datagrams by batches of up to
+ * ktNETIO_BATCH, with one of two backends (--io):
+ *
+ *  mmsg   recvmmsg() and sendmmsg(): one system call per batch, plus a
+ *         poll() when there is nothing to read.
+ *  uring  io_uring, driven by its system calls (no liburing): a single
+ *         multishot recvmsg stays armed and fills buffers the kernel
+ *         picks from a provided buffer ring, sends are queued and
+ *         submitted with one io_uring_enter() per batch, which also
+ *         waits for the next datagrams.
+ *
+ * The uring backend needs Linux 6.0 (multishot recvmsg); "auto" falls
+ * back to mmsg when the kernel, or the headers at build time, do not
+ * have it, or when io_uring is disabled (containers, sysctl).
+ *
+ * Datagrams carry the kernel receive time when the socket has
+ * SO_TIMESTAMPNS, so time-stamps do not depend on the batch position.
+ * The kernel can also tell when each datagram left (netio_tx_enable()),
+ * later and on the error queue of the socket (netio_tx_stamp()).
+ *=====================================================================
+ */
+
+#define _GNU_SOURCE                          /* recvmmsg(), sendmmsg() */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/io_uring.h>
+#  if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#    define NETIO_URING 1
+#  endif
+#endif
+
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H)
+#  include <linux/net_tstamp.h>
+#  include <linux/errqueue.h>
+#  ifdef SO_TIMESTAMPING
+#    define NETIO_TXSTAMP 1
+#  endif
+#endif
+
+#include "netio.h"
+
+#define NETIO_CTRLLEN  128                   /*!< control data: the time-stamps  */
+
+#ifdef NETIO_URING
+#define URING_ENTRIES  256                   /*!< submission queue entries       */
+#define URING_CQSIZE   4096                  /*!< completion queue entries       */
+#define URING_BUFS     1024                  /*!< receive buffers (power of 2)   */
+#define URING_BUFSIZE  704                   /*!< header, address, control, data */
+#define URING_SENDS    256                   /*!< sends in flight                */
+#define URING_RECV     (~(uint64_t)0)        /*!< user_data of the receive       */
+#define URING_CANCEL   (~(uint64_t)1)        /*!< user_data of its cancellation  */
+
+/*!
+  \struct uring_send_t
+  \brief a send in flight: the kernel reads it until its completion
+*/
+typedef struct uring_send_t {
+  struct msghdr      m_hdr;
+  struct iovec       m_iov;
+  struct sockaddr_in m_addr;
+  uint8_t            m_data[ktNETIO_MSGLEN];
+
+} uring_send_t;
+
+/*!
+  \struct uring_done_t
+  \brief a datagram received but not delivered yet
+*/
+typedef struct uring_done_t {
+  uint16_t m_bid;                /*!< its buffer                                 */
+  int      m_len;                /*!< bytes in the buffer                        */
+
+} uring_done_t;
+#endif
+
+/*!
+  \struct netio_t
+  \brief the I/O of one socket
+*/
+struct netio_t {
+  int           m_backend;       /*!< eNETIO_MMSG or eNETIO_URING                */
+  int           m_socket;        /*!< the socket                                 */
+  int           m_receive;       /*!< 0: only sends                              */
+  unsigned long m_errors;        /*!< failed sends                               */
+
+  /* mmsg */
+  struct mmsghdr     m_hdr[ktNETIO_BATCH];
+  struct iovec       m_iov[ktNETIO_BATCH];
+  struct sockaddr_in m_name[ktNETIO_BATCH];
+  uint8_t            m_ctrl[ktNETIO_BATCH][NETIO_CTRLLEN];
+  uint8_t            m_data[ktNETIO_BATCH][ktNETIO_MSGLEN];
+
+#ifdef NETIO_URING
+  int           m_ring;          /*!< io_uring file descriptor, -1 if none       */
+  void         *m_sqMap, *m_cqMap;
+  size_t        m_sqLen, m_cqLen;
+  struct io_uring_sqe *m_sqes;
+  unsigned     *m_sqHead, *m_sqTail, *m_sqArray, m_sqMask, m_sqEntries;
+  unsigned     *m_cqHead, *m_cqTail, m_cqMask;
+  struct io_uring_cqe *m_cqes;
+  unsigned      m_toSubmit;      /*!< queued entries not submitted yet           */
+
+  struct io_uring_buf_ring *m_bufRing; /*!< buffers given to the kernel          */
+  uint8_t      *m_bufs;          /*!< URING_BUFS buffers                         */
+  uint16_t      m_bufTail;
+  struct msghdr m_recvHdr;       /*!< sizes of address and control              */
+  int           m_armed;         /*!< the multishot receive is running          */
+
+  uring_done_t  m_done[URING_BUFS]; /*!< received, FIFO                          */
+  unsigned      m_doneHead, m_ndone;
+  uint16_t      m_held[ktNETIO_BATCH]; /*!< buffers delivered by the last call   */
+  int           m_nheld;
+
+  uring_send_t *m_sends;         /*!< URING_SENDS slots                          */
+  int           m_free[URING_SENDS];
+  int           m_nfree;
+#endif
+};
+
+/*!
+  \brief kernel receive time of a message (SO_TIMESTAMPNS), 0 if none
+  ******************************************************************
+
+  \param hdr   the message, with its control data
+  \param stamp where to put the time
+*/
+void netio_rx_stamp( struct msghdr *hdr, struct timespec *stamp)
+{
+  struct cmsghdr *cmsg;
+
+  stamp->tv_sec  = 0;
+  stamp->tv_nsec = 0;
+  for( cmsg = CMSG_FIRSTHDR( hdr); cmsg; cmsg = CMSG_NXTHDR( hdr, cmsg)) {
+    if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy( stamp, CMSG_DATA( cmsg), sizeof(*stamp));
+      break;
+    }
+  }
+}
+
+/*!
+  \brief ask the kernel for the transmit time of the datagrams sent
+  ******************************************************************
+
+  The driver time-stamps each datagram as it leaves (software
+  time-stamping) and the time is queued on the error queue of the
+  socket with the number of the datagram, not its data: 0 for the
+  first one sent after this call, then one more for each.
+
+  \param s the socket
+  \return 0 if OK or -1 if the system cannot
+*/
+int netio_tx_enable( int s)
+{
+#ifdef NETIO_TXSTAMP
+  int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+              SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+  return setsockopt( s, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+
+/*!
+  \brief read a transmit time-stamp from the error queue, no wait
+  ******************************************************************
+
+  \param s     the socket, see netio_tx_enable()
+  \param id    number of the datagram
+  \param stamp when it left
+  \return 1 if one was read, 0 if the queue is empty
+*/
+int netio_tx_stamp( int s, uint32_t *id, struct timespec *stamp)
+{
+#ifdef NETIO_TXSTAMP
+  union {
+    struct cmsghdr m_align;
+    uint8_t        m_buf[256];
+  } ctrl;
+  struct msghdr hdr;
+  struct cmsghdr *cmsg;
+  struct sock_extended_err err;
+  struct scm_timestamping ts;
+  int got;
+
+  for(;;) {
+    memset( &hdr, 0, sizeof(hdr));
+    hdr.msg_control    = &ctrl;
+    hdr.msg_controllen = sizeof(ctrl);
+    if( recvmsg( s, &hdr, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return 0;
+
+    got = 0;
+    for( cmsg = CMSG_FIRSTHDR( &hdr); cmsg; cmsg = CMSG_NXTHDR( &hdr, cmsg)) {
+      if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+        memcpy( &ts, CMSG_DATA( cmsg), sizeof(ts));
+        *stamp = ts.ts[0];
+        if( stamp->tv_sec || stamp->tv_nsec) got |= 1;
+      }
+      else if( cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) {
+        memcpy( &err, CMSG_DATA( cmsg), sizeof(err));
+        if( err.ee_errno == ENOMSG && err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && err.ee_info == SCM_TSTAMP_SND) {
+          *id = err.ee_data;
+          got |= 2;
+        }
+      }
+    }
+    if( got == 3) return 1;                  // else not a transmit time-stamp
+  }
+#else
+  return 0;
+#endif
+}
+
+/*
+ *=====================================================================
+ * mmsg backend
+ *=====================================================================
+ */
+
+/*!
+  \brief receive with recvmmsg(), poll() first if nothing is there
+*/
+static int mmsg_recv( netio_t *io, netio_msg_t *msgs, int max, int timeout)
+{
+  struct pollfd pfd;
+  int i, n;
+
+  if( max > ktNETIO_BATCH) max = ktNETIO_BATCH;
+  for( i = 0; i < max; i++) {
+    memset( &io->m_hdr[i], 0, sizeof(io->m_hdr[i]));
+    io->m_iov[i].iov_base             = io->m_data[i];
+    io->m_iov[i].iov_len              = ktNETIO_MSGLEN;
+    io->m_hdr[i].msg_hdr.msg_iov        = &io->m_iov[i];
+    io->m_hdr[i].msg_hdr.msg_iovlen     = 1;
+    io->m_hdr[i].msg_hdr.msg_name       = &io->m_name[i];
+    io->m_hdr[i].msg_hdr.msg_namelen    = sizeof(io->m_name[i]);
+    io->m_hdr[i].msg_hdr.msg_control    = io->m_ctrl[i];
+    io->m_hdr[i].msg_hdr.msg_controllen = NETIO_CTRLLEN;
+  }
+
+  n = recvmmsg( io->m_socket, io->m_hdr, max, MSG_DONTWAIT, NULL);
+  if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    pfd.fd     = io->m_socket;
+    pfd.events = POLLIN;
+    if( poll( &pfd, 1, timeout) <= 0) return 0;
+    n = recvmmsg( io->m_socket, io->m_hdr, max, MSG_DONTWAIT, NULL);
+  }
+  if( n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+  for( i = 0; i < n; i++) {
+    msgs[i].m_data = io->m_data[i];
+    msgs[i].m_len  = (int)io->m_hdr[i].msg_len;
+    memcpy( &msgs[i].m_addr, &io->m_name[i], sizeof(msgs[i].m_addr));
+    netio_rx_stamp( &io->m_hdr[i].msg_hdr, &msgs[i].m_stamp);
+  }
+  return n;
+}
+
+/*!
+  \brief send with sendmmsg(), up to the first datagram that fails
+*/
+static int mmsg_send( netio_t *io, const netio_msg_t *msgs, int n)
+{
+  int i, done = 0, r;
+
+  if( n > ktNETIO_BATCH) n = ktNETIO_BATCH;
+  for( i = 0; i < n; i++) {
+    memset( &io->m_hdr[i], 0, sizeof(io->m_hdr[i]));
+    io->m_iov[i].iov_base          = msgs[i].m_data;
+    io->m_iov[i].iov_len           = (size_t)msgs[i].m_len;
+    io->m_hdr[i].msg_hdr.msg_iov     = &io->m_iov[i];
+    io->m_hdr[i].msg_hdr.msg_iovlen  = 1;
+    io->m_hdr[i].msg_hdr.msg_name    = (void *)&msgs[i].m_addr;
+    io->m_hdr[i].msg_hdr.msg_namelen = sizeof(msgs[i].m_addr);
+  }
+
+  while( done < n) {
+    r = sendmmsg( io->m_socket, &io->m_hdr[done], (unsigned)(n - done), 0);
+    if( r < 0) {
+      if( errno == EINTR) continue;
+      break;                                 // the rest is told not queued
+    }
+    done += r;
+  }
+  return done;
+}
+
+#ifdef NETIO_URING
+/*
+ *=====================================================================
+ * io_uring backend
+ *=====================================================================
+ */
+
+/*!
+  \brief io_uring_enter(): submit the queued entries, maybe wait
+  ******************************************************************
+
+  \param io      the I/O
+  \param wait    wait for one completion
+  \param timeout if waiting, milliseconds (<0: no limit)
+  \return >= 0 or -1 with errno
+*/
+static int uring_enter( netio_t *io, int wait, int timeout)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  int r;
+
+  memset( &arg, 0, sizeof(arg));
+  if( wait && timeout >= 0) {
+    ts.tv_sec   = timeout / 1000;
+    ts.tv_nsec  = (timeout % 1000) * 1000000L;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts      = (uint64_t)(uintptr_t)&ts;
+    flags      |= IORING_ENTER_EXT_ARG;
+  }
+  r = (int)syscall( __NR_io_uring_enter, io->m_ring, io->m_toSubmit, wait ? 1 : 0, flags,
+                    (flags & IORING_ENTER_EXT_ARG) ? (void *)&arg : NULL,
+                    (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : (size_t)0);
+  if( r > 0) io->m_toSubmit -= ((unsigned)r < io->m_toSubmit) ? (unsigned)r : io->m_toSubmit;
+  return r;
+}
+
+/*!
+  \brief a free submission entry, NULL if the queue is full
+*/
+static struct io_uring_sqe *uring_sqe( netio_t *io)
+{
+  unsigned tail = *io->m_sqTail, head = __atomic_load_n( io->m_sqHead, __ATOMIC_ACQUIRE);
+  struct io_uring_sqe *sqe;
+
+  if( tail - head >= io->m_sqEntries) return NULL;
+  sqe = &io->m_sqes[tail & io->m_sqMask];
+  memset( sqe, 0, sizeof(*sqe));
+  io->m_sqArray[tail & io->m_sqMask] = tail & io->m_sqMask;
+  __atomic_store_n( io->m_sqTail, tail + 1, __ATOMIC_RELEASE);
+  io->m_toSubmit++;
+  return sqe;
+}
+
+/*!
+  \brief give a buffer back to the kernel (visible at uring_bufs_publish)
+*/
+static void uring_buf_give( netio_t *io, uint16_t bid)
+{
+  struct io_uring_buf *b = &io->m_bufRing->bufs[io->m_bufTail & (URING_BUFS - 1)];
+
+  b->addr = (uint64_t)(uintptr_t)(io->m_bufs + (size_t)bid * URING_BUFSIZE);
+  b->len  = URING_BUFSIZE;
+  b->bid  = bid;
+  io->m_bufTail++;
+}
+
+static void uring_bufs_publish( netio_t *io)
+{
+  __atomic_store_n( &io->m_bufRing->tail, io->m_bufTail, __ATOMIC_RELEASE);
+}
+
+/*!
+  \brief read the completions: sends free their slot, datagrams wait
+  ******************************************************************
+
+  \return -1 if the kernel refused the multishot receive, else 0
+*/
+static int uring_reap( netio_t *io)
+{
+  unsigned head = *io->m_cqHead, tail = __atomic_load_n( io->m_cqTail, __ATOMIC_ACQUIRE);
+  struct io_uring_cqe *cqe;
+  int err = 0;
+
+  for( ; head != tail; head++) {
+    cqe = &io->m_cqes[head & io->m_cqMask];
+    if( cqe->user_data == URING_RECV) {
+      if( !(cqe->flags & IORING_CQE_F_MORE)) io->m_armed = 0;
+      if( cqe->flags & IORING_CQE_F_BUFFER) {
+        io->m_done[(io->m_doneHead + io->m_ndone) & (URING_BUFS - 1)].m_bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        io->m_done[(io->m_doneHead + io->m_ndone) & (URING_BUFS - 1)].m_len = cqe->res;
+        io->m_ndone++;
+      }
+      else if( cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) err = -1;
+    }
+    else if( cqe->user_data != URING_CANCEL) {
+      if( cqe->res < 0) io->m_errors++;
+      io->m_free[io->m_nfree++] = (int)cqe->user_data;
+    }
+  }
+  __atomic_store_n( io->m_cqHead, head, __ATOMIC_RELEASE);
+  return err;
+}
+
+/*!
+  \brief arm the multishot receive
+*/
+static int uring_arm( netio_t *io)
+{
+  struct io_uring_sqe *sqe = uring_sqe( io);
+
+  if( !sqe) return -1;
+  sqe->opcode    = IORING_OP_RECVMSG;
+  sqe->fd        = io->m_socket;
+  sqe->addr      = (uint64_t)(uintptr_t)&io->m_recvHdr;
+  sqe->ioprio    = IORING_RECV_MULTISHOT;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = URING_RECV;
+  io->m_armed = 1;
+  return 0;
+}
+
+/*!
+  \brief stop the receive and wait for the sends: the kernel must not
+         touch the buffers once freed
+*/
+static void uring_drain( netio_t *io)
+{
+  struct io_uring_sqe *sqe;
+  int tries;
+
+  if( io->m_armed && (sqe = uring_sqe( io))) {
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->addr      = URING_RECV;
+    sqe->user_data = URING_CANCEL;
+  }
+  for( tries = 0; tries < 10 && (io->m_armed || io->m_nfree < URING_SENDS); tries++) {
+    uring_enter( io, 1, 100);
+    uring_reap( io);
+  }
+}
+
+/*!
+  \brief release the io_uring resources
+*/
+static void uring_close( netio_t *io)
+{
+  if( io->m_ring >= 0 && io->m_sends) uring_drain( io);
+  if( io->m_ring >= 0) close( io->m_ring);
+  if( io->m_sqes) munmap( io->m_sqes, io->m_sqEntries * sizeof(struct io_uring_sqe));
+  if( io->m_cqMap && io->m_cqMap != io->m_sqMap) munmap( io->m_cqMap, io->m_cqLen);
+  if( io->m_sqMap) munmap( io->m_sqMap, io->m_sqLen);
+  free( io->m_bufRing);
+  free( io->m_bufs);
+  free( io->m_sends);
+  io->m_ring = -1;
+  io->m_sqes = NULL;
+  io->m_sqMap = io->m_cqMap = NULL;
+  io->m_bufRing = NULL;
+  io->m_bufs = NULL;
+  io->m_sends = NULL;
+}
+
+/*!
+  \brief tell if the kernel knows an operation
+*/
+static int uring_has_op( struct io_uring_probe *probe, int op)
+{
+  return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+/*!
+  \brief set the ring up
+  ******************************************************************
+
+  \return 0 if OK or -1 if the kernel cannot (then all is released)
+*/
+static int uring_open( netio_t *io)
+{
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  struct io_uring_probe *probe;
+  int i, ok;
+
+  memset( &p, 0, sizeof(p));
+  p.flags      = IORING_SETUP_CQSIZE;
+  p.cq_entries = URING_CQSIZE;
+  io->m_ring = (int)syscall( __NR_io_uring_setup, URING_ENTRIES, &p);
+  if( io->m_ring < 0) return -1;
+  if( !(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) goto FAIL;
+
+  /* the operations */
+  probe = calloc( 1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+  if( !probe) goto FAIL;
+  ok = syscall( __NR_io_uring_register, io->m_ring, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+       uring_has_op( probe, IORING_OP_RECVMSG) && uring_has_op( probe, IORING_OP_SENDMSG);
+  free( probe);
+  if( !ok) goto FAIL;
+
+  /* the rings */
+  io->m_sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  io->m_cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if( p.features & IORING_FEAT_SINGLE_MMAP) {
+    if( io->m_cqLen > io->m_sqLen) io->m_sqLen = io->m_cqLen;
+    io->m_cqLen = io->m_sqLen;
+  }
+  io->m_sqMap = mmap( NULL, io->m_sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->m_ring, IORING_OFF_SQ_RING);
+  if( io->m_sqMap == MAP_FAILED) { io->m_sqMap = NULL; goto FAIL; }
+  if( p.features & IORING_FEAT_SINGLE_MMAP) io->m_cqMap = io->m_sqMap;
+  else {
+    io->m_cqMap = mmap( NULL, io->m_cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->m_ring, IORING_OFF_CQ_RING);
+    if( io->m_cqMap == MAP_FAILED) { io->m_cqMap = NULL; goto FAIL; }
+  }
+  io->m_sqEntries = p.sq_entries;
+  io->m_sqes = mmap( NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, io->m_ring, IORING_OFF_SQES);
+  if( io->m_sqes == MAP_FAILED) { io->m_sqes = NULL; goto FAIL; }
+
+  io->m_sqHead  = (unsigned *)((char *)io->m_sqMap + p.sq_off.head);
+  io->m_sqTail  = (unsigned *)((char *)io->m_sqMap + p.sq_off.tail);
+  io->m_sqMask  = *(unsigned *)((char *)io->m_sqMap + p.sq_off.ring_mask);
+  io->m_sqArray = (unsigned *)((char *)io->m_sqMap + p.sq_off.array);
+  io->m_cqHead  = (unsigned *)((char *)io->m_cqMap + p.cq_off.head);
+  io->m_cqTail  = (unsigned *)((char *)io->m_cqMap + p.cq_off.tail);
+  io->m_cqMask  = *(unsigned *)((char *)io->m_cqMap + p.cq_off.ring_mask);
+  io->m_cqes    = (struct io_uring_cqe *)((char *)io->m_cqMap + p.cq_off.cqes);
+
+  /* the send slots */
+  if( !(io->m_sends = calloc( URING_SENDS, sizeof(*io->m_sends)))) goto FAIL;
+  for( i = 0; i < URING_SENDS; i++) io->m_free[i] = URING_SENDS - 1 - i;
+  io->m_nfree = URING_SENDS;
+
+  /* the receive buffers, a multishot receive fills one per datagram */
+  if( io->m_receive) {
+    if( posix_memalign( (void **)&io->m_bufRing, 4096, URING_BUFS * sizeof(struct io_uring_buf))) {
+      io->m_bufRing = NULL;
+      goto FAIL;
+    }
+    memset( io->m_bufRing, 0, URING_BUFS * sizeof(struct io_uring_buf));
+    if( posix_memalign( (void **)&io->m_bufs, 64, (size_t)URING_BUFS * URING_BUFSIZE)) {
+      io->m_bufs = NULL;
+      goto FAIL;
+    }
+    memset( &reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)io->m_bufRing;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid         = 0;
+    if( syscall( __NR_io_uring_register, io->m_ring, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto FAIL;
+    for( i = 0; i < URING_BUFS; i++) uring_buf_give( io, (uint16_t)i);
+    uring_bufs_publish( io);
+
+    memset( &io->m_recvHdr, 0, sizeof(io->m_recvHdr));
+    io->m_recvHdr.msg_namelen    = sizeof(struct sockaddr_in);
+    io->m_recvHdr.msg_controllen = NETIO_CTRLLEN;
+  }
+  return 0;
+
+FAIL:
+  uring_close( io);
+  return -1;
+}
+
+/*!
+  \brief deliver the received datagrams, wait for some if none
+*/
+static int uring_recv( netio_t *io, netio_msg_t *msgs, int max, int timeout)
+{
+  struct io_uring_recvmsg_out *out;
+  struct msghdr hdr;
+  uint8_t *buf;
+  size_t head;
+  int i, n, len;
+
+  /* the buffers of the previous call go back to the kernel */
+  for( i = 0; i < io->m_nheld; i++) uring_buf_give( io, io->m_held[i]);
+  if( io->m_nheld) uring_bufs_publish( io);
+  io->m_nheld = 0;
+
+  if( uring_reap( io) < 0) return -2;
+  if( !io->m_ndone) {
+    if( !io->m_armed && uring_arm( io) < 0) return -1;
+    if( uring_enter( io, 1, timeout) < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) return -1;
+    if( uring_reap( io) < 0) return -2;
+  }
+  else if( io->m_toSubmit) uring_enter( io, 0, 0);
+
+  if( max > ktNETIO_BATCH) max = ktNETIO_BATCH;
+  head = sizeof(*out) + io->m_recvHdr.msg_namelen + io->m_recvHdr.msg_controllen;
+  for( n = 0; n < max && io->m_ndone; ) {
+    uring_done_t done = io->m_done[io->m_doneHead];
+
+    io->m_doneHead = (io->m_doneHead + 1) & (URING_BUFS - 1);
+    io->m_ndone--;
+    io->m_held[io->m_nheld++] = done.m_bid;
+
+    buf = io->m_bufs + (size_t)done.m_bid * URING_BUFSIZE;
+    out = (struct io_uring_recvmsg_out *)buf;
+    if( done.m_len < (int)head || out->namelen < sizeof(struct sockaddr_in)) continue;
+    len = done.m_len - (int)head;
+    if( (int)out->payloadlen < len) len = (int)out->payloadlen;
+
+    msgs[n].m_data = buf + head;
+    msgs[n].m_len  = len;
+    memcpy( &msgs[n].m_addr, buf + sizeof(*out), sizeof(msgs[n].m_addr));
+    memset( &hdr, 0, sizeof(hdr));
+    hdr.msg_control    = buf + sizeof(*out) + io->m_recvHdr.msg_namelen;
+    hdr.msg_controllen = out->controllen;
+    netio_rx_stamp( &hdr, &msgs[n].m_stamp);
+    n++;
+  }
+  return n;
+}
+
+/*!
+  \brief queue the sends, submitted together
+*/
+static int uring_send( netio_t *io, const netio_msg_t *msgs, int n)
+{
+  struct io_uring_sqe *sqe;
+  uring_send_t *slot;
+  int i, k;
+
+  uring_reap( io);
+  for( i = 0; i < n; i++) {
+    /* all slots in flight: wait for one */
+    while( !io->m_nfree) {
+      if( uring_enter( io, 1, -1) < 0 && errno != EINTR && errno != EBUSY) return i;
+      uring_reap( io);
+    }
+    if( !(sqe = uring_sqe( io))) {
+      uring_enter( io, 0, 0);
+      if( !(sqe = uring_sqe( io))) break;
+    }
+
+    k = io->m_free[--io->m_nfree];
+    slot = &io->m_sends[k];
+    memcpy( slot->m_data, msgs[i].m_data, (size_t)msgs[i].m_len);
+    memcpy( &slot->m_addr, &msgs[i].m_addr, sizeof(slot->m_addr));
+    slot->m_iov.iov_base     = slot->m_data;
+    slot->m_iov.iov_len      = (size_t)msgs[i].m_len;
+    memset( &slot->m_hdr, 0, sizeof(slot->m_hdr));
+    slot->m_hdr.msg_name     = &slot->m_addr;
+    slot->m_hdr.msg_namelen  = sizeof(slot->m_addr);
+    slot->m_hdr.msg_iov      = &slot->m_iov;
+    slot->m_hdr.msg_iovlen   = 1;
+
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = io->m_socket;
+    sqe->addr      = (uint64_t)(uintptr_t)&slot->m_hdr;
+    sqe->len       = 1;
+    sqe->user_data = (uint64_t)k;
+  }
+  if( io->m_toSubmit) uring_enter( io, 0, 0);
+  return i;
+}
+#endif /* NETIO_URING */
+
+/*
+ *=====================================================================
+ * interface
+ *=====================================================================
+ */
+
+/*!
+  \brief set the batched I/O of a socket up
+  ******************************************************************
+
+  \param s       UDP socket
+  \param backend netio_backend, eNETIO_AUTO or eNETIO_URING fall back
+                 to eNETIO_MMSG if io_uring is not available
+  \param receive 0 if only sending (no receive buffers)
+  \return the I/O or NULL if no memory
+*/
+netio_t *netio_open( int s, int backend, int receive)
+{
+  netio_t *io = calloc( 1, sizeof(*io));
+
+  if( !io) return NULL;
+  io->m_socket  = s;
+  io->m_receive = receive;
+  io->m_backend = eNETIO_MMSG;
+#ifdef NETIO_URING
+  io->m_ring = -1;
+  if( backend != eNETIO_MMSG && uring_open( io) == 0) io->m_backend = eNETIO_URING;
+#else
+  (void)backend;
+#endif
+  return io;
+}
+
+/*!
+  \brief release the I/O (the socket stays open)
+*/
+void netio_close( netio_t *io)
+{
+  if( !io) return;
+#ifdef NETIO_URING
+  uring_close( io);
+#endif
+  free( io);
+}
+
+/*!
+  \brief receive a batch of datagrams
+  ******************************************************************
+
+  Datagrams stay valid until the next call.
+
+  \param io      the I/O
+  \param msgs    the datagrams
+  \param max     size of msgs
+  \param timeout milliseconds to wait for the first one (<0: no limit)
+  \return number of datagrams (0 on timeout) or <0 if failed
+*/
+int netio_recv( netio_t *io, netio_msg_t *msgs, int max, int timeout)
+{
+#ifdef NETIO_URING
+  if( io->m_backend == eNETIO_URING) {
+    int n = uring_recv( io, msgs, max, timeout);
+
+    if( n != -2) return n;
+    uring_close( io);                      // no multishot receive: before 6.0
+    io->m_backend = eNETIO_MMSG;
+  }
+#endif
+  return mmsg_recv( io, msgs, max, timeout);
+}
+
+/*!
+  \brief send a batch of datagrams
+  ******************************************************************
+
+  The datagrams are copied, the caller may reuse them at once.
+
+  \param io   the I/O
+  \param msgs the datagrams (m_len <= ktNETIO_MSGLEN)
+  \param n    how many
+  \return number of datagrams queued, the first ones of msgs; sends
+          failing once queued are counted by netio_errors()
+*/
+int netio_send( netio_t *io, const netio_msg_t *msgs, int n)
+{
+#ifdef NETIO_URING
+  if( io->m_backend == eNETIO_URING) return uring_send( io, msgs, n);
+#endif
+  return mmsg_send( io, msgs, n);
+}
+
+/*!
+  \brief backend in use
+*/
+int netio_backend_of( const netio_t *io)
+{
+  return io->m_backend;
+}
+
+/*!
+  \brief sends that failed so far
+*/
+unsigned long netio_errors( const netio_t *io)
+{
+  return io->m_errors;
+}
+
+/*!
+  \brief name of a backend
+*/
+const char *netio_name( int backend)
+{
+  switch( backend) {
+  case eNETIO_MMSG:  return "mmsg";
+  case eNETIO_URING: return "uring";
+  default:           return "auto";
+  }
+}
+
+/*!
+  \brief parse the --io option
+  ******************************************************************
+
+  \param name "auto", "uring" or "mmsg"
+  \return the netio_backend or -1 if unknown
+*/
+int netio_parse( const char *name)
+{
+  if( !strcmp( name, "auto"))  return eNETIO_AUTO;
+  if( !strcmp( name, "mmsg"))  return eNETIO_MMSG;
+  if( !strcmp( name, "uring")) return eNETIO_URING;
+  return -1;
+}
@@ -0,0 +1,66 @@
+/**
+ * \file netio.h
+ * \brief batched datagram I/O header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef NETIO_H_
+#define NETIO_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define ktNETIO_BATCH    64      /*!< datagrams per call at most                 */
+#define ktNETIO_MSGLEN   512     /*!< longest datagram, longer ones are cut      */
+
+/*!
+  \enum netio_backend
+  \brief how datagrams go to and from the kernel (--io)
+  ******************************************************************
+*/
+typedef enum netio_backend {
+  eNETIO_AUTO = 0,               /*!< io_uring if the kernel has it, else mmsg   */
+  eNETIO_MMSG,                   /*!< recvmmsg()/sendmmsg(), poll() to wait      */
+  eNETIO_URING,                  /*!< io_uring: multishot receive, batched sends */
+
+}netio_backend;
+
+/*!
+  \struct netio_msg_t
+  \brief a datagram received or to send
+  ******************************************************************
+*/
+typedef struct netio_msg_t {
+  uint8_t           *m_data;     /*!< datagram, valid until the next netio_recv  */
+  int                m_len;      /*!< its length                                 */
+  struct sockaddr_in m_addr;     /*!< source (received) or destination (sent)    */
+  struct timespec    m_stamp;    /*!< kernel receive time (SO_TIMESTAMPNS), or 0 */
+
+} netio_msg_t;
+
+/*! the I/O of one socket, used by one thread at a time */
+typedef struct netio_t netio_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+netio_t      *netio_open   ( int s, int backend, int receive);
+void          netio_close  ( netio_t *io);
+int           netio_recv   ( netio_t *io, netio_msg_t *msgs, int max, int timeout);
+int           netio_send   ( netio_t *io, const netio_msg_t *msgs, int n);
+int           netio_backend_of( const netio_t *io);
+unsigned long netio_errors ( const netio_t *io);
+const char   *netio_name   ( int backend);
+int           netio_parse  ( const char *name);
+void          netio_rx_stamp( struct msghdr *hdr, struct timespec *stamp);
+int           netio_tx_enable( int s);
+int           netio_tx_stamp( int s, uint32_t *id, struct timespec *stamp);
+
+#endif /* NETIO_H_ */
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -43,10 +44,13 @@
 
 #include <errno.h>        /* for perror                     */
 #include <sys/select.h>   /* for timeval struct             */
-#include <time.h>         /* for mktime and struct tm       */
+#include <time.h>         /* for gmtime and struct tm       */
 #include <sys/time.h>     /* for settimeofday function      */
 #include <signal.h>       /* for sigaction()                */
 #include <unistd.h>       /* for alarm function             */
+#ifdef HAVE_SYS_TIMEX_H
+#  include <sys/timex.h>  /* for adjtimex function          */
+#endif
 
 #include "gettext.h"      /* for gettext functions          */
 #define _(String) gettext (String)
@@ -54,73 +58,61 @@
 
 #include "main.h"
 #include "trace.h"
+#include "tzrule.h"
+#include "sync.h"
+#include "server.h"
+#include "publish.h"
+#include "refclock.h"
+#include "leap.h"
+#include "auth.h"
+#include "nts.h"
+#include "netio.h"
+#include "reputation.h"
+#include "bclient.h"
+#include "systemd.h"
+#include "quick.h"
+#include "history.h"
+#include "conffile.h"
 
 #include "ntpdate.h"
 
 /* -- other defines --*/
-#define MAXLEN                    1024  /*!< check our buffers                       */
-#define NTPMODETYPE                  3  /*!< NTP mode type client                    */
-#define SUMMERTIMEMONTHBEGIN         3  /*!< European Summer Time begin at March     */
-#define SUMMERTIMEMONTHEND          10  /*!< European Summer Time end at October     */
-#define TIMEOUT_SECS                10  /*!< time for waiting response of NTP Server */
 #define NTP_MAXREQUEST_TRIES         3  /*!< max retries to get response             */
 
-#define NTP_TIMESTAMP_DELTA 2208988800  /*!< NTP time-stamp of 1 Jan 1970            */
-
 /* -- GLOBALES -- */
 extern options_t     gAppOptions;
 extern trace_desc_t* gAppTrace;
 
-/*!
-  \struct ntp_packet
-  \brief ntp packet structure
-  ******************************************************************  
-  */
-typedef struct ntp_packet_t {  
-  uint8_t li_vn_mode;       /*!<  8 bits. li, vn, and mode.                              
-                                       li.  Two bits.   Leap indicator.                     
-                                       vn.  Three bits. Version number of the protocol.     
-                                     mode.  Three bits. Client will pick mode 3 for client. */
-
-  uint8_t stratum;          /*!<  8 bits. Stratum level of the local clock.                 */
-  uint8_t poll;             /*!<  8 bits. Maximum interval between successive messages.     */
-  uint8_t precision;        /*!<  8 bits. Precision of the local clock.                     */
-
-  uint32_t rootDelay;       /*!<  32 bits. Total round trip delay time.                     */
-  uint32_t rootDispersion;  /*!<  32 bits. Max error aloud from primary clock source.       */
-  uint32_t refId;           /*!<  32 bits. Reference clock identifier.                      */
-
-  uint32_t refTm_s;         /*!<  32 bits. Reference time-stamp seconds.                    */
-  uint32_t refTm_f;         /*!<  32 bits. Reference time-stamp fraction of a second.       */
-
-  uint32_t origTm_s;        /*!<  32 bits. Originate time-stamp seconds.                    */
-  uint32_t origTm_f;        /*!<  32 bits. Originate time-stamp fraction of a second.       */
-
-  uint32_t rxTm_s;          /*!<  32 bits. Received time-stamp seconds.                     */
-  uint32_t rxTm_f;          /*!<  32 bits. Received time-stamp fraction of a second.        */
+static double gCorrected = 0;           /*!< corrections given to the system clock (s) */
+static double gSyncError = 0;           /*!< error bound at the last correction (s)  */
 
-  uint32_t txTm_s;          /*!<  32 bits. The most important field the client cares about. 
-                                  Transmit time-stamp seconds.                              */
-  uint32_t txTm_f;          /*!<  32 bits. Transmit time-stamp fraction of a second.        */
-
-} ntp_packet_t;
+/*
+ * configure --enable-tiny (ZNTP_TINY) builds the clock operations, the
+ * request, the checks of the replies, the summer time and the report
+ * of this file, the rest is left out (see tiny.c)
+ */
+#ifndef ZNTP_TINY
+static volatile sig_atomic_t tries = 0; /*!< Count of times sent - GLOBAL for signal-handler access */
+static unsigned long gAuthFailures = 0; /*!< replies rejected by the authentication (--key, --nts) */
+static server_source_t gSource;         /*!< last source told to the server mode     */
+static zntp_clock_t    gClock;          /*!< last state published (--publish)        */
+static int gNoSelect[ktMAXHOSTS];       /*!< servers never selected (--config)       */
 
 /*!
-  \enum ntp_version
-  \brief many NTP protocol version (eNTP_V3 by default)
-  ******************************************************************  
+  \struct xleave_peer_t
+  \brief interleaved mode (-x): the last exchange with a server
 */
-typedef enum ntp_version {
-  eNTP_V1 = 010,                   /*!< 00 001 000 binary = v1 */
-  eNTP_V2 = 020,                   /*!< 00 010 000 binary = v2 */
-  eNTP_V3 = 030,                   /*!< 00 011 000 binary = v3 */
+typedef struct xleave_peer_t {
+  struct sockaddr_in m_addr;     /*!< the server                                 */
+  ntp_ts_t m_t1;                 /*!< our transmit time, the kernel one if known */
+  ntp_ts_t m_t2;                 /*!< its receive time, 0: nothing to go on with */
+  ntp_ts_t m_t4;                 /*!< our receive time, the kernel one if known  */
+  double   m_corrected;          /*!< gCorrected at that time                    */
 
-}ntp_version;
-static int NTP_MODE_TYPE = 003;
+} xleave_peer_t;
 
-int tries = 0;                     /*!< Count of times sent - GLOBAL for signal-handler access */
-ntp_packet_t packet_sending = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-ntp_packet_t packet_receiving = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static xleave_peer_t gXleave[ktMAXHOSTS];
+static int           gNxleave = 0;
 
 /*!
   \brief Handler for SIGALRM
@@ -132,6 +124,7 @@ static void CatchAlarm(int ignored)
 {
   tries += 1;
 }
+#endif
 
 
 /*!
@@ -150,340 +143,633 @@ static char *zctime( const time_t *time)
 }
 
 
+#ifndef ZNTP_TINY
 /*!
-  \brief  Calculates start date and end of the period of summer time.
-   ******************************************************************
+  \brief dump a received packet into the trace
+  ******************************************************************
+
+  \param packet the packet (network order)
+*/
+static void dump_packet( const ntp_packet_t *packet)
+{
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "NTP.RefID: '0x%x'", ntohl(packet->refId));
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.2x", "li_vn_mode", packet->li_vn_mode);
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.2x", "stratum", packet->stratum);
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.2x", "poll", packet->poll);
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.2x", "precision", packet->precision);
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rootDelay", ntohl(packet->rootDelay));
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rootDispersion", ntohl(packet->rootDispersion));
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "refTm_s", ntohl(packet->refTm_s));
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "refTm_f", ntohl(packet->refTm_f));
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "origTm_s", ntohl(packet->origTm_s));
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "origTm_f", ntohl(packet->origTm_f));
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rxTm_s", ntohl(packet->rxTm_s));
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rxTm_f", ntohl(packet->rxTm_f));
+
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "txTm_s", ntohl(packet->txTm_s));
+  trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "txTm_f", ntohl(packet->txTm_f));
+}
+#endif
+
 
-  \param year calculates for this year
-  \param bebin the start date
-  \param end the end date
-  \return 0 if OK or <0 if failed
+/*!
+  \brief step the system clock
+  ******************************************************************
 
-  \warning the year must be lesser than 2099 !
+  \param offset seconds to add to the system clock
+  \return 0 if OK or errno if failed
 */
-static int EuropeanSummerTime( const int year, time_t *begin, time_t *end)
-{  
-  struct tm st;
-  
-  /* ready until 2099 ! */
-  if(year > 2099) return -1;
-
-  /* start of summer time */
-  memset( &st, 0, sizeof(st));
-  st.tm_hour = 1;                             // 0-23 (1 heure GMT0)
-  st.tm_year = year - 1900;                   // years since 1900
-  st.tm_mday = 31 - (5 * year / 4 + 4) % 7;   // 1-31
-  st.tm_mon = SUMMERTIMEMONTHBEGIN - 1;       // 0-11
-  *begin = mktime( &st);
-
-  /* end of summer time */
-  memset( &st, 0, sizeof(st));
-  st.tm_hour = 1;                             // 0-23 (1 heure GMT0)
-  st.tm_year = year - 1900;                   // years since 1900
-  st.tm_mday = 31 - (5 * year / 4 + 1) % 7;
-  st.tm_mon = SUMMERTIMEMONTHEND - 1;
-  *end = mktime( &st);
+static int step_clock( double offset)
+{
+  struct timeval new_timeval;
+  double secs = floor( offset);
+  int err = 0;
+
+  gettimeofday( &new_timeval, NULL);
+  new_timeval.tv_sec  += (time_t)secs;
+  new_timeval.tv_usec += (suseconds_t)((offset - secs) * 1e6);
+  if( new_timeval.tv_usec >= 1000000) {
+    new_timeval.tv_sec++;
+    new_timeval.tv_usec -= 1000000;
+  }
+
+#ifdef SYSV_TIMEOFDAY 
+  err = settimeofday( &new_timeval);
+#else
+  err = settimeofday( &new_timeval, 0);
+#endif   
+
+  return err ? errno : 0;
+}
+
+
+/*!
+  \brief system clock operations for the synchronization engine
+  ******************************************************************
+*/
+static int sys_step( void *ctx, double offset)
+{
+  (void)ctx;
+  gCorrected += offset;
+  return step_clock( offset);
+}
+
+/* slew given to adjtime() and not done yet by the kernel (s) */
+static double sys_pending( void)
+{
+  struct timeval left;
+
+  if( adjtime( NULL, &left)) return 0;
+  return left.tv_sec + left.tv_usec * 1e-6;
+}
 
+static int sys_slew( void *ctx, double offset)
+{
+  struct timeval delta;
+  double secs;
+
+  (void)ctx;
+  gCorrected += offset;
+
+  /* adjtime() drops the slew left, which the samples of the engine
+     count as done (they are taken net of it): it is given again */
+  offset += sys_pending();
+  secs = floor( offset);
+  delta.tv_sec  = (time_t)secs;
+  delta.tv_usec = (suseconds_t)((offset - secs) * 1e6);
+  return adjtime( &delta, NULL) ? errno : 0;
+}
+
+static int sys_freq( void *ctx, double freq)
+{
+#if defined(HAVE_ADJTIMEX) && defined(HAVE_SYS_TIMEX_H)
+  struct timex tx;
+
+  (void)ctx;
+  /* kernel frequency is in ppm with 16 bits fraction */
+  memset( &tx, 0, sizeof(tx));
+  tx.modes = ADJ_FREQUENCY;
+  tx.freq  = (long)(freq * 1e6 * 65536);
+  return adjtimex( &tx) < 0 ? errno : 0;
+#else
+  (void)ctx; (void)freq;
   return 0;
+#endif
 }
 
+static double sys_elapsed( void *ctx)
+{
+  (void)ctx;
+  return timing_now();
+}
 
+#ifndef ZNTP_TINY
 /*!
-  \brief main ntpdate function
-   ******************************************************************
- 
-   Use this function to set date/time get by NTP protocol
+  \brief tell the kernel whether the clock is synchronized, and how well
+  ******************************************************************
 
-   return 0 if OK or <0 if failed
+  STA_UNSYNC is cleared as ntpd does, so that systemd-time-wait-sync
+  (and the RTC update of the kernel) see a synchronized clock; the
+  kernel grows the error bound by itself until the next update.
+
+  \param error  error bound (s), <0 if not synchronized anymore
+  \param jitter estimated error (s)
 */
-int ntpdate(void)
+static void sys_synced( double error, double jitter)
 {
-  int    err=0;
-  int    i;			                           // misc var i
-  int    s = -1;                           // socket
-  time_t tmit = -1;                        // the time -- This is a time_t sort of
+#if defined(HAVE_ADJTIMEX) && defined(HAVE_SYS_TIMEX_H)
+  struct timex tx;
+
+  memset( &tx, 0, sizeof(tx));
+  if( adjtimex( &tx) < 0) return;
+  tx.modes = ADJ_STATUS | ADJ_MAXERROR | ADJ_ESTERROR;
+  if( error < 0) {
+    tx.status  |= STA_UNSYNC;
+    tx.maxerror = tx.esterror = 16000000;    // NTP MAXDISP (us)
+  }
+  else {
+    tx.status  &= ~STA_UNSYNC;
+    tx.maxerror = (long)(error * 1e6);
+    tx.esterror = (long)(jitter * 1e6);
+  }
+  adjtimex( &tx);
+#endif
+}
+#endif
 
-  char hostname[ktHOSTNAMELEN+1];
-  int  portno = 123;                       // NTP is port 123
-  
-  //unsigned char msg[NTP_MAXREQUEST_LEN];   // = { eNTP_V1,0,0,0,0,0,0,0,0};  // the packet we send
-  //unsigned long buf[MAXLEN];               // the buffer we get back
-  //unsigned      msgLen;
+/*!
+  \brief debug mode (-d): the engine runs but the clock is not touched,
+  corrections are accumulated to be removed from next samples
+  ******************************************************************
+*/
+static double gDryRunApplied = 0;
 
+static int dry_correct( void *ctx, double offset)
+{
+  *(double *)ctx += offset;
+  return 0;
+}
 
-  
-  struct hostent     *he = NULL;           // host for gethostbyname
-  struct protoent    *proto = NULL;	       // proto
-  struct sockaddr_in server_addr;          // the socket structure
+static int dry_freq( void *ctx, double freq)
+{
+  (void)ctx; (void)freq;
+  return 0;
+}
 
-  struct sigaction myAction;               // for setting signal handler
+static const sync_clock_t gSystemClock = { sys_step,    sys_slew,    sys_freq, sys_elapsed, NULL };
+static const sync_clock_t gDryRunClock = { dry_correct, dry_correct, dry_freq, sys_elapsed, &gDryRunApplied };
 
-  /*
-   *  get hostname options
-   ***************************************************************************
-   */
-  strncpy( hostname, gAppOptions.m_host, sizeof(hostname));
-  if( gAppOptions.m_verbose) {
-    trace_write( gAppTrace, eINFO_MSG_TYPE,
-                 _("Try NTP with host: %s"), hostname);
-  }
-  
-  /*
-   * open UDP socket
-   ***************************************************************************
-   */
-  proto = getprotobyname( "udp");
-  if( (s = socket( PF_INET, SOCK_DGRAM, proto->p_proto)) < 0) {
-    trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
-    goto BAIL;    
+
+/*!
+  \brief build a client request
+  ******************************************************************
+
+  Our message is all zeros except for the version, the mode type
+  client and our transmit time-stamp. It should be a total of 48
+  bytes long.
+
+  \param request the packet to fill
+  \param t1      transmit time-stamp, echoed by the server
+*/
+void ntp_request_build( ntp_packet_t *request, ntp_ts_t t1)
+{
+  memset( request, 0, sizeof(*request));
+  request->li_vn_mode = (gAppOptions.m_version == 1) ? eNTP_V1 :
+    (gAppOptions.m_version == 2) ? eNTP_V2 : eNTP_V3;
+  request->li_vn_mode += NTP_MODE_CLIENT;
+  ntp_ts_put( t1, &request->txTm_s, &request->txTm_f);
+}
+
+/*!
+  \brief take a sample from a reply
+  ******************************************************************
+
+  \param reply  the reply (network order)
+  \param t1     our transmit time-stamp of the request
+  \param t4     our receive time-stamp of the reply
+  \param sample where to put the sample, offset and delay not computed
+*/
+void ntp_reply_sample( const ntp_packet_t *reply, ntp_ts_t t1, ntp_ts_t t4, ntp_sample_t *sample)
+{
+  memset( sample, 0, sizeof(*sample));
+  sample->m_t1         = t1;
+  sample->m_t2         = ntp_ts_get( reply->rxTm_s, reply->rxTm_f);
+  sample->m_t3         = ntp_ts_get( reply->txTm_s, reply->txTm_f);
+  sample->m_t4         = t4;
+  sample->m_leap       = NTP_LI( reply->li_vn_mode);
+  sample->m_stratum    = reply->stratum;
+  sample->m_refId      = ntohl( reply->refId);
+  sample->m_rootDelay  = ntp_short_to_secs( reply->rootDelay);
+  sample->m_rootDisp   = ntp_short_to_secs( reply->rootDispersion);
+}
+
+/*!
+  \brief is the sample of a reply usable?
+  ******************************************************************
+
+  \param sample the sample
+  \return eNTP_OK or why not (see ntp_query_err)
+*/
+int ntp_sample_check( const ntp_sample_t *sample)
+{
+  uint32_t code = htonl( sample->m_refId);
+
+  /* a stratum 0 reply is a Kiss-o'-Death, refId holds the ASCII code */
+  if( sample->m_stratum == 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Kiss-o'-Death received: %.4s"), (const char *)&code);
+    return eNTP_EKOD;
   }
-  else {
-    if( s && gAppOptions.m_verbose ) {
-      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Open socket: %d"),s);
-    }
+  if( sample->m_leap == NTP_LI_ALARM) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Server not synchronized"));
+    return eNTP_EUNSYNC;
   }
-  
-  /*
-   * get ip address and try get host by name
-   ***************************************************************************
-   */
-  memset( &server_addr, 0, sizeof( server_addr ));
-  server_addr.sin_family=AF_INET;
-  
-  // try get host by name
-  he = gethostbyname( hostname);
-  if( !he ||
-      he->h_addrtype != AF_INET ||
-      (int) he->h_length > (int) sizeof(struct in_addr)) {
-    server_addr.sin_addr.s_addr = inet_addr(hostname);
+  if( sample->m_t3 == 0 || sample->m_t2 == 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Invalid transmit time"));
+    return eNTP_EINVALID;
   }
-  else {
-    memcpy( (char *) &server_addr.sin_addr, he->h_addr_list[0], he->h_length);
+  return eNTP_OK;
+}
+
+#ifndef ZNTP_TINY
+
+
+/*!
+  \brief interleaved mode state of a server, added if new
+*/
+static xleave_peer_t *xleave_find( const struct sockaddr_in *addr)
+{
+  int i;
+
+  for( i = 0; i < gNxleave; i++) {
+    if( gXleave[i].m_addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+        gXleave[i].m_addr.sin_port == addr->sin_port) return &gXleave[i];
   }
-  
-  /*
-   * port number
-   ***************************************************************************
-   */
-  server_addr.sin_port = htons(portno);
-  trace_write( gAppTrace, eINFO_MSG_TYPE,
-               _("Try to connect to hostname: '%s' (%s)..."),
-               hostname,
-               inet_ntoa( server_addr.sin_addr));
-  trace_flush( gAppTrace);
-  
-  /*
-   * build a message.  Our message is all zeros except for a one in the
-   * protocol version field
-   * msg[] in binary is 00 001 000 00000000 
-   * it should be a total of 48 bytes long
-   ***************************************************************************
-   */
-  
-  // send the data with initializing first byte (NTP version and mode type client)
-  //memset( msg, 0, sizeof(msg));
-  
-  //TODO : à revoir pour le déclarer dynamiquement dans l'objet packet
-  //msg[0] = (gAppOptions.m_version == 1) ? eNTP_V1 :
-  //  (gAppOptions.m_version == 2) ? eNTP_V2 : eNTP_V3;
-  //msg[0] += NTPMODETYPE;
-  packet_sending.li_vn_mode = (gAppOptions.m_version == 1) ? eNTP_V1 :
-    (gAppOptions.m_version == 2) ? eNTP_V2 : eNTP_V3;
-  packet_sending.li_vn_mode += NTPMODETYPE;
+  if( gNxleave >= ktMAXHOSTS) return NULL;
+  memset( &gXleave[gNxleave], 0, sizeof(gXleave[0]));
+  gXleave[gNxleave].m_addr = *addr;
+  return &gXleave[gNxleave++];
+}
 
-  if( gAppOptions.m_verbose) {
-    trace_write( gAppTrace, eINFO_MSG_TYPE, _("NTP version: %d"), gAppOptions.m_version);
+/*!
+  \brief forget the interleaved mode state of the servers not queried
+  anymore, so that the servers added by a reload find a free slot
+
+  \param servers addresses of the servers queried
+  \param n       their number
+*/
+static void xleave_release( const struct sockaddr_in *servers, int n)
+{
+  int i, j;
+
+  for( i = 0; i < gNxleave; ) {
+    for( j = 0; j < n; j++) {
+      if( gXleave[i].m_addr.sin_addr.s_addr == servers[j].sin_addr.s_addr &&
+          gXleave[i].m_addr.sin_port == servers[j].sin_port) break;
+    }
+    if( j < n) i++;
+    else gXleave[i] = gXleave[--gNxleave];   // the last one takes the slot
   }
-  
-  /*
-   * Set signal handler for alarm signal
-   ***************************************************************************
-   */
-  myAction.sa_handler = CatchAlarm;
-  if (sigfillset(&myAction.sa_mask) < 0) {  /* block everything in handler */
-    trace_write( gAppTrace, eERROR_MSG_TYPE, _("sigfillset() failed"));
-    goto BAIL;
+}
+
+
+/*!
+  \brief build a request, signed (--key) or with NTS fields (--nts)
+  ******************************************************************
+
+  In interleaved mode, the request also carries the receive time-stamps
+  of the previous exchange: the server one as origin and ours as
+  receive time-stamp, so that the server knows which reply we want the
+  transmit time of.
+
+  \param packet room for the request
+  \param size   its size
+  \param t1     transmit time-stamp
+  \param key    key of the MAC or NULL
+  \param nts    NTS session or NULL
+  \param xl     interleaved mode state or NULL
+  \return length of the request or -1 if no NTS cookie left
+*/
+static int request_seal( uint8_t *packet, int size, ntp_ts_t t1, const auth_key_t *key, nts_session_t *nts,
+                         const xleave_peer_t *xl)
+{
+  ntp_request_build( (ntp_packet_t *)packet, t1);
+  if( xl && xl->m_t2) {
+    ntp_ts_put( xl->m_t2, &((ntp_packet_t *)packet)->origTm_s, &((ntp_packet_t *)packet)->origTm_f);
+    ntp_ts_put( xl->m_t4, &((ntp_packet_t *)packet)->rxTm_s, &((ntp_packet_t *)packet)->rxTm_f);
   }
-  myAction.sa_flags = 0;
-  
-  if (sigaction(SIGALRM, &myAction, 0) < 0) {
-    trace_write( gAppTrace, eERROR_MSG_TYPE, _("sigaction() failed for SIGALRM"));
-     goto BAIL;
+  if( nts) {
+    ((ntp_packet_t *)packet)->li_vn_mode = NTP_LI_VN_MODE( NTP_LI_NONE, 4, NTP_MODE_CLIENT);
+    return nts_request( nts, packet, size);
   }
+  return key ? auth_sign( key, packet, sizeof(ntp_packet_t)) : (int)sizeof(ntp_packet_t);
+}
+
+
+/*!
+  \brief send one request to a NTP server and wait for its reply
+  ******************************************************************
+
+  The request carries our transmit time-stamp (T1) which the server
+  echoes as originate time-stamp, so that replies to an older request
+  or forged replies are ignored. With --key the request carries a MAC
+  and the reply must carry one of the same key. With --nts it carries
+  a cookie and an authenticator, the reply must be authenticated by
+  the keys of the session; a new key exchange is first done if no
+  cookie is left.
+  In interleaved mode (-x), a reply whose origin is our receive time of
+  the previous reply carries the time that reply really left the
+  server: the sample is the one of the previous exchange, with the
+  kernel time-stamps of our socket, corrected by what the clock was
+  given since. Else the reply is a basic one.
+
+  \param s      UDP socket
+  \param addr   server address
+  \param sample where to put the result
+  \param timing where to add send, wait and retry times, may be NULL
+  \return 0 if OK or <0 if failed (see ntp_query_err)
+*/
+int ntp_query( int s, const struct sockaddr_in *addr, ntp_sample_t *sample, timing_t *timing)
+{
+  static int handlerSet = 0;
+  struct {
+    ntp_packet_t m_packet;
+    uint8_t      m_ext[ktNTS_MSGLEN - sizeof(ntp_packet_t)];
+  } out, in;                                 // packets followed by their MAC or NTS fields
+  union {
+    struct cmsghdr m_align;
+    uint8_t        m_buf[128];
+  } ctrl;                                    // kernel receive time-stamps
+  struct msghdr hdr;
+  struct iovec iov;
+  struct timespec stamp;
+  ntp_packet_t reply;
+  const auth_key_t *key = gAppOptions.m_keyId ? auth_find( gAppOptions.m_keyId) : NULL;
+  nts_session_t *nts = gAppOptions.m_ntsDir ? nts_find( addr) : NULL;
+  xleave_peer_t *xl = gAppOptions.m_xleave ? xleave_find( addr) : NULL;
+  xleave_peer_t prev;                        // interleaved: the previous exchange
+  const struct sockaddr_in *to = addr;       // NTS: the server told by the key exchange
+  ntp_ts_t t1, t4, org;
+  double sent;                               // monotonic time of the last send
+  uint32_t keyId, id;
+  int n, len, status, keyed = 0, interleaved = 0;
 
   /*
-   * send to NTP server
+   * Set signal handler for alarm signal
    ***************************************************************************
-   */ 
- 
-  //memset( &packet_sending, 0, sizeof( ntp_packet_t ) );
+   */
+  if( !handlerSet) {
+    struct sigaction myAction;               // for setting signal handler
+
+    memset( &myAction, 0, sizeof(myAction));
+    myAction.sa_handler = CatchAlarm;
+    if (sigfillset(&myAction.sa_mask) < 0) {  /* block everything in handler */
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("sigfillset() failed"));
+      return eNTP_ESYSTEM;
+    }
+    myAction.sa_flags = 0;
 
-  //TODO: use 
-  // Set the first byte's bits to 00,011,011 for li = 0, vn = 3, and mode = 3. The rest will be left set to zero.
-  //*( ( char * ) &packet_sending + 0 ) = 0x1b; // Represents 27 in base 10 or 00011011 in base 2.
+    if (sigaction(SIGALRM, &myAction, 0) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("sigaction() failed for SIGALRM"));
+      return eNTP_ESYSTEM;
+    }
+    handlerSet = 1;
+  }
 
-  i = sendto( s, &packet_sending, sizeof( ntp_packet_t ), 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
-  if( i == -1) {
-    err = errno;
-    trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto() failed"));
-    if( gAppOptions.m_verbose) {
-      trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto(): [error %d]"), err);
-      trace_write( gAppTrace, eERROR_MSG_TYPE, "sendto(): %s", strerror(err));
+  if( gAppOptions.m_ntsDir) {
+    if( !nts) return eNTP_EAUTH;
+    if( !nts_cookies( nts)) {
+      sent = timing_now();
+      n = nts_ke( nts);
+      timing_add( timing, eTIMING_KE, sent);
+      if( n < 0) return eNTP_EAUTH;
+      keyed = 1;
     }
-    goto BAIL;
+    to = nts_address( nts);
   }
-  else {
+
+  tries = 0;
+  sent = timing_now();
+  t1 = ntp_ts_now();
+  if( (len = request_seal( (uint8_t *)&out, sizeof(out), t1, key, nts, xl)) < 0) return eNTP_EAUTH;
+  n = sendto( s, &out, len, 0, (const struct sockaddr *)to, sizeof(*to));
+  sent = timing_add( timing, eTIMING_SEND, sent);
+  if( n != len) {
+    n = errno;
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto() failed"));
     if( gAppOptions.m_verbose) {
-      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Connected to '%s'"), hostname);
+      trace_write( gAppTrace, eERROR_MSG_TYPE, "sendto(): %s", strerror(n));
     }
+    return eNTP_ESEND;
   }
- 
-    
+
   /*
    * get the data back with timeout
    ***************************************************************************
    */
-  if( gAppOptions.m_verbose) {
-    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Attempt receive with timeout %ds"), TIMEOUT_SECS);
-    trace_flush( gAppTrace);
-  }
-
-
- //memset(buf, 0, sizeof(buf));
-
-  alarm( TIMEOUT_SECS);        // Set the timeout
-  while( (i = recv( s, &packet_receiving, sizeof(ntp_packet_t), 0)) < 0) {
-    if( errno == EINTR) {                     // Alarm went off 
-      if( tries < NTP_MAXREQUEST_TRIES) {     // incremented by signal handler
-        
-        if( gAppOptions.m_verbose) {
-          trace_write( gAppTrace, eINFO_MSG_TYPE, _("Timed out, %d more tries..."), NTP_MAXREQUEST_TRIES - tries);
-          trace_flush( gAppTrace);
-        }
-        
-        // trie to send NTP request
-        if( sendto( s, &packet_sending, sizeof(ntp_packet_t), 0, (struct sockaddr *)&server_addr,
-                    sizeof(server_addr)) != sizeof(ntp_packet_t)) {
-          trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto() failed"));
-        }
-        
-        alarm( TIMEOUT_SECS);
-      } 
-      else {
+  alarm( gAppOptions.m_timeout);        // Set the timeout
+  for(;;) {
+    memset( &hdr, 0, sizeof(hdr));
+    iov.iov_base       = &in;
+    iov.iov_len        = sizeof(in);
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = &ctrl;
+    hdr.msg_controllen = sizeof(ctrl);
+    n = recvmsg( s, &hdr, 0);
+    if( n < 0) {
+      if( errno == EINTR) {                     // Alarm went off 
+        if( tries < NTP_MAXREQUEST_TRIES) {     // incremented by signal handler
+          
+          if( gAppOptions.m_verbose) {
+            trace_write( gAppTrace, eINFO_MSG_TYPE, _("Timed out, %d more tries..."), NTP_MAXREQUEST_TRIES - tries);
+            trace_flush( gAppTrace);
+          }
+          
+          // trie to send NTP request, the watchdog waiting meanwhile
+          systemd_watchdog();
+          sent = timing_add( timing, eTIMING_RETRY, sent);
+          if( timing) timing->m_retries++;
+          t1 = ntp_ts_now();
+          if( (len = request_seal( (uint8_t *)&out, sizeof(out), t1, key, nts, xl)) < 0) {
+            trace_write( gAppTrace, eERROR_MSG_TYPE, _("No NTS cookie left"));
+            return eNTP_EAUTH;
+          }
+          n = sendto( s, &out, len, 0, (const struct sockaddr *)to, sizeof(*to));
+          sent = timing_add( timing, eTIMING_SEND, sent);
+          if( n != len) {
+            trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto() failed"));
+          }
+          
+          alarm( gAppOptions.m_timeout);
+          continue;
+        } 
+        timing_add( timing, eTIMING_RETRY, sent);
         trace_write( gAppTrace, eERROR_MSG_TYPE, _("No Response, %d tries"), NTP_MAXREQUEST_TRIES);
-        goto BAIL;
-      }
-    } 
-    else {
+        return eNTP_ETIMEOUT;
+      } 
+      alarm(0);
       trace_write( gAppTrace, eERROR_MSG_TYPE, _("recvfrom() failed"));
-      goto BAIL;
+      return eNTP_ESYSTEM;
+    }
+    t4 = ntp_ts_now();
+    netio_rx_stamp( &hdr, &stamp);           // -x: kernel time-stamp
+    if( stamp.tv_sec) t4 = ntp_ts_from_timespec( &stamp);
+
+    // ignore what is not the reply to our last request, or an interleaved one
+    if( n < (int)sizeof(in.m_packet) || NTP_MODE(in.m_packet.li_vn_mode) != NTP_MODE_SERVER) continue;
+    org = ntp_ts_get( in.m_packet.origTm_s, in.m_packet.origTm_f);
+    if( org == t1) break;
+    if( xl && xl->m_t2 && org == xl->m_t4) {
+      interleaved = 1;
+      break;
     }
   }
   // recvfrom() got something --  cancel the timeout 
   alarm(0);
+  timing_add( timing, eTIMING_WAIT, sent);
+  reply = in.m_packet;
+
+  // a request with a MAC wants a reply with a MAC of the same key
+  if( key && ((status = auth_verify( (const uint8_t *)&in, n, &keyId)) != eAUTH_OK || keyId != gAppOptions.m_keyId)) {
+    gAuthFailures++;
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Reply not authenticated (%s, key %u)"),
+                 (status == eAUTH_OK) ? _("other key") : auth_status_name( status), keyId);
+    return eNTP_EAUTH;
+  }
+  // a NTS request wants a reply authenticated by the session keys
+  if( nts && (status = nts_reply( nts, (const uint8_t *)&in, n)) != eNTS_OK) {
+    gAuthFailures++;
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Reply not authenticated by NTS (%s)"), nts_status_name( status));
+    // cookies of an old server key: once more with new ones
+    if( status == eNTS_NAK && !keyed) return ntp_query( s, addr, sample, timing);
+    return eNTP_EAUTH;
+  }
 
-  if(gAppOptions.m_verbose) {
+  if( gAppOptions.m_verbose) {
     trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("Cool, I had an response!"));
+    dump_packet( &reply);
   }
-  
+
   /*
-   * We get 12 long words back in Network order
+   * interleaved mode: this exchange is the previous one of the next
    ***************************************************************************
    */
-  if( gAppOptions.m_verbose) {
-    u_long id = ntohl(packet_receiving.refId);
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "NTP.RefID: '0x%x'", id);
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "li_vn_mode", ntohl(packet_receiving.li_vn_mode));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "stratum", ntohl(packet_receiving.stratum));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "poll", ntohl(packet_receiving.poll));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "precision", ntohl(packet_receiving.precision));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rootDelay", ntohl(packet_receiving.rootDelay));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rootDispersion", ntohl(packet_receiving.rootDispersion));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "refTm_s", ntohl(packet_receiving.refTm_s));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "refTm_f", ntohl(packet_receiving.refTm_f));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "origTm_s", ntohl(packet_receiving.origTm_s));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "origTm_f", ntohl(packet_receiving.origTm_f));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rxTm_s", ntohl(packet_receiving.rxTm_s));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "rxTm_f", ntohl(packet_receiving.rxTm_f));
-
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "txTm_s", ntohl(packet_receiving.txTm_s));
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "%s: 0x%.8x", "txTm_f", ntohl(packet_receiving.rxTm_f));
+  memset( &prev, 0, sizeof(prev));
+  if( xl) {
+    prev = *xl;
+    xl->m_t1 = t1;
+    while( netio_tx_stamp( s, &id, &stamp) > 0) xl->m_t1 = ntp_ts_from_timespec( &stamp);  // of the last send
+    xl->m_t2 = ntp_ts_get( reply.rxTm_s, reply.rxTm_f);
+    xl->m_t4 = t4;
+    xl->m_corrected = gCorrected;
+    // after a retry, an interleaved reply may be the one of any request sent
+    if( interleaved && tries) xl->m_t2 = 0;
   }
 
-  /* 
-   * These two fields contain the time-stamp seconds as the packet left the NTP server.
-   * The number of seconds correspond to the seconds passed since 1900.
-   * ntohl() converts the bit/byte order from the network's to host's "endianness".
+  /*
+   * We get 12 long words back in Network order
    ***************************************************************************
    */
+  ntp_reply_sample( &reply, xl ? xl->m_t1 : t1, t4, sample);
+  if( interleaved) {
+    sample->m_t1       = prev.m_t1;
+    sample->m_t2       = prev.m_t2;
+    sample->m_t4       = prev.m_t4;
+    sample->m_interleaved = 1;
+  }
+  if( (status = ntp_sample_check( sample)) != eNTP_OK) return status;
 
-  packet_receiving.txTm_s = ntohl( packet_receiving.txTm_s ); // Time-stamp seconds.
-  packet_receiving.txTm_f = ntohl( packet_receiving.txTm_f ); // Time-stamp fraction of a second.
+  ntp_sample_compute( sample);
+  if( interleaved) sample->m_offset -= gCorrected - prev.m_corrected;
 
   if( gAppOptions.m_verbose) {
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "NTP.TransmitTime: 0x%.8x (%ld)", packet_receiving.txTm_s, packet_receiving.txTm_s);
-  }
-  if( packet_receiving.txTm_s <= 0 ) {
-    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Invalid transmit time"));
-    goto BAIL;
+    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("Offset %+.6fs, delay %.6fs%s"), sample->m_offset, sample->m_delay,
+                 sample->m_interleaved ? _(" (interleaved)") : "");
   }
-  
-  /*
-   * Convert time to unix standard time NTP is number of seconds since 0000
-   * UT on 1 January 1900 unix time is seconds since 0000 UT on 1 January
-   * 1970 There has been a trend to add a 2 leap seconds every 3 years.
-   * Leap seconds are only an issue the last second of the month in June and
-   * December if you don't try to set the clock then it can be ignored but
-   * this is importaint to people who coordinate times with GPS clock sources.
-   ***************************************************************************
-   */
-  
-  tmit = ( time_t ) ( packet_receiving.txTm_s - NTP_TIMESTAMP_DELTA );
 
-  if( gAppOptions.m_verbose) {
-    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("UNIX time: %ld"), tmit);
-  } 
-  /* use unix library function to show me the local time (it takes care
-   * of timezone issues for both north and south of the equator and places
-   * that do Summer time/ Daylight savings time.
-   */  
-  trace_write( gAppTrace,  eINFO_IN_MSG_TYPE, _("Time (GMT0): %s"), zctime(&tmit));
+  return eNTP_OK;
+}
 
-  /*
-   * add European Summer Time adjust if option -E is enabled
-   * WARNING: we must do this check before set offset !
-   ***************************************************************************
-   */  
-  if( gAppOptions.m_enableEST) {
-    time_t begin, end;
-    struct tm *ltime = localtime( &tmit);
 
-    err =  EuropeanSummerTime( ltime->tm_year + 1900, &begin, &end);
-    if(err) {
-      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("EuropeanSummerTime() failed: [error %d]"), err);      
+/*!
+  \brief resolve a NTP server address
+  ******************************************************************
+
+  \param hostname name or IP address
+  \param addr     where to put the address
+*/
+void resolve_host( const char *hostname, struct sockaddr_in *addr)
+{
+  struct hostent *he = NULL;               // host for gethostbyname
+
+  memset( addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  
+  // try get host by name
+  he = gethostbyname( hostname);
+  if( !he ||
+      he->h_addrtype != AF_INET ||
+      (int) he->h_length > (int) sizeof(struct in_addr)) {
+    addr->sin_addr.s_addr = inet_addr(hostname);
+  }
+  else {
+    memcpy( (char *) &addr->sin_addr, he->h_addr_list[0], he->h_length);
+  }
+  
+  /*
+   * port number
+   ***************************************************************************
+   */
+  addr->sin_port = htons( gAppOptions.m_port);
+  trace_write( gAppTrace, eINFO_MSG_TYPE,
+               _("Try to connect to hostname: '%s' (%s)..."),
+               hostname,
+               inet_ntoa( addr->sin_addr));
+  trace_flush( gAppTrace);
+}
+
+#endif
+
+/*!
+  \brief seconds to add to UTC to get the wanted local time
+  ******************************************************************
+
+  Summer time (-E) then offset (-O).
+
+  \param tmit UTC time
+  \return the shift (s)
+*/
+double time_shift( time_t tmit)
+{
+  double shift = 0;
+
+  /*
+   * add summer time adjust if option -E is enabled
+   * WARNING: we must do this check before set offset !
+   ***************************************************************************
+   */  
+  if( gAppOptions.m_enableEST) {
+    tzrule_t *rule = &gAppOptions.m_tzRule;
+    time_t begin, end;
+
+    if( !rule->m_hasDst) {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No summer time in rule '%s'"), rule->m_stdName);
     }
     else {
-      if( gAppOptions.m_verbose) {
-        char *tmp = NULL;
-        
-        tmp = ctime(&begin);
-        //tmp[strlen(tmp)-1] = '\0';
-        trace_write( gAppTrace, eINFO_MSG_TYPE, _("European Summer Time start at: %s"), tmp);
-        
-        tmp = ctime(&end);
-        //tmp[strlen(tmp)-1] = '\0';
-        trace_write( gAppTrace, eINFO_MSG_TYPE, _("European Summer Time end at  : %s"), tmp);
+      if( gAppOptions.m_verbose &&
+          tzrule_transitions( rule, tzrule_year(tmit), &begin, &end) == 0) {
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("Summer time (%s) start at: %s"), rule->m_dstName, zctime(&begin));
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("Summer time (%s) end at  : %s"), rule->m_dstName, zctime(&end));
       }
       
-      if( tmit >= begin && tmit < end) {
-        trace_write( gAppTrace, eINFO_MSG_TYPE, _("EST is activated")); 
-        tmit += 3600;
+      if( tzrule_is_dst( rule, tmit)) {
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("Summer time is activated")); 
+        shift += tzrule_dst_shift( rule);
       }
     }
   }
@@ -493,55 +779,900 @@ int ntpdate(void)
    ***************************************************************************
    */
   trace_write( gAppTrace, eINFO_MSG_TYPE, "Offset: %f", gAppOptions.m_offset);
-  tmit += (time_t)gAppOptions.m_offset;
- 
+  shift += gAppOptions.m_offset;
+
+  return shift;
+}
+
+#ifndef ZNTP_TINY
+/*!
+  \brief reference server of a poll: among the servers kept by the
+  selection, lowest stratum, then delay
+  ******************************************************************
+
+  \param result   result of sync_update()
+  \param samples  samples of this poll
+  \param valid    which samples are valid
+  \param nservers number of servers
+  \return its index or -1 if the clock could not be updated
+*/
+static int best_sample( const sync_result_t *result, const ntp_sample_t *samples, const int *valid, int nservers)
+{
+  int i, best = -1;
+
+  if( result->m_action == eSYNC_NOSOURCE || result->m_action == eSYNC_ERROR ||
+      result->m_action == eSYNC_HOLDOVER) return -1;
+
+  for( i = 0; i < nservers; i++) {
+    if( !valid[i] || !((result->m_selected >> i) & 1)) continue;   // falsetickers never
+    if( best < 0 || samples[i].m_stratum < samples[best].m_stratum ||
+        (samples[i].m_stratum == samples[best].m_stratum && samples[i].m_delay < samples[best].m_delay)) best = i;
+  }
+  return best;
+}
+
+/*!
+  \brief error bound of the clock after an update
+  ******************************************************************
+
+  The distance to the primary source: offset just measured, jitter,
+  half the round trip to it and its dispersion.
+
+  \param result result of sync_update()
+  \param s      sample of the reference server
+  \return the bound (s)
+*/
+static double error_bound( const sync_result_t *result, const ntp_sample_t *s)
+{
+  return fabs( result->m_offset) + result->m_jitter + (s->m_rootDelay + s->m_delay) / 2 + s->m_rootDisp;
+}
+
+#endif
+
+/*!
+  \brief error bound of the clock in a holdover (s)
+*/
+static double holdover_error( const sync_result_t *result)
+{
+  return gSyncError + gAppOptions.m_holdoverRate * result->m_holdover;
+}
+
+/*!
+  \brief the holdover lasted too long: the clock is not synchronized
+*/
+static int holdover_expired( const sync_result_t *result)
+{
+  return result->m_action == eSYNC_HOLDOVER && result->m_holdover > gAppOptions.m_holdoverMax;
+}
+
+#ifndef ZNTP_TINY
+/*!
+  \brief tell the server mode how the clock is synchronized
+  ******************************************************************
+
+  Nothing changes when no server could be used. In a holdover, the
+  root dispersion grows with the error bound, until the holdover
+  expires.
+
+  \param result   result of sync_update()
+  \param samples  samples of this poll
+  \param valid    which samples are valid
+  \param servers  servers addresses
+  \param nservers number of servers
+  \param leap     leap second announced
+*/
+static void serve_source( const sync_result_t *result, const ntp_sample_t *samples, const int *valid,
+                          const struct sockaddr_in *servers, int nservers, int leap)
+{
+  server_source_t source;
+  int best = best_sample( result, samples, valid, nservers);
+
+  if( result->m_action == eSYNC_HOLDOVER && gSource.m_stratum) {
+    source = gSource;
+    source.m_leap      = holdover_expired( result) ? NTP_LI_ALARM : leap;
+    source.m_stratum   = holdover_expired( result) ? 16 : gSource.m_stratum;
+    source.m_rootDisp += gAppOptions.m_holdoverRate * result->m_holdover;
+    server_update( &source);
+    return;
+  }
+  if( best < 0) return;
+
+  memset( &source, 0, sizeof(source));
+  source.m_leap      = leap;
+  source.m_stratum   = (samples[best].m_stratum < 15) ? samples[best].m_stratum + 1 : 15;
+  source.m_refId     = ntohl( servers[best].sin_addr.s_addr);
+  source.m_rootDelay = samples[best].m_rootDelay + samples[best].m_delay;
+  source.m_rootDisp  = samples[best].m_rootDisp + result->m_jitter;
+  source.m_refTime   = ntp_ts_now();
+  gSource = source;
+  server_update( &source);
+}
+
+/*!
+  \brief publish the clock state for applications (--publish)
+  ******************************************************************
+
+  The error bound is the one of error_bound(). When no server could be
+  used the previous state stays, its bound growing; in a holdover it
+  is published again with the seconds spent, until it expires.
+
+  \param result   result of sync_update()
+  \param samples  samples of this poll
+  \param valid    which samples are valid
+  \param nservers number of servers
+  \param leap     leap second announced
+*/
+static void publish_clock( const sync_result_t *result, const ntp_sample_t *samples, const int *valid, int nservers,
+                           int leap)
+{
+  zntp_clock_t clock;
+  const ntp_sample_t *s;
+  int best = best_sample( result, samples, valid, nservers);
+
+  if( result->m_action == eSYNC_HOLDOVER && gClock.m_synced) {
+    clock = gClock;
+    clock.m_error    = holdover_error( result);
+    clock.m_holdover = (int32_t)result->m_holdover;
+    if( holdover_expired( result)) {
+      clock.m_leap    = NTP_LI_ALARM;
+      clock.m_stratum = 16;
+      clock.m_synced  = 0;
+    }
+    publish_update( &clock);
+    return;
+  }
+  if( best < 0) return;
+  s = &samples[best];
+
+  memset( &clock, 0, sizeof(clock));
+  clock.m_offset    = result->m_offset;
+  clock.m_error     = error_bound( result, s);
+  clock.m_errorRate = gAppOptions.m_holdoverRate;
+  clock.m_freq      = result->m_freq * 1e6;
+  clock.m_leap      = leap;
+  clock.m_stratum   = (s->m_stratum < 15) ? s->m_stratum + 1 : 15;
+  clock.m_synced    = 1;
+  clock.m_poll      = gAppOptions.m_daemon ? gAppOptions.m_poll : 0;
+  gClock = clock;
+  publish_update( &clock);
+}
+
+/*!
+  \brief hand the combined offset over to ntpd or chronyd (--refclock)
+  ******************************************************************
+
+  \param result   result of sync_update()
+  \param samples  samples of this poll
+  \param valid    which samples are valid
+  \param nservers number of servers
+  \param leap     leap second announced
+*/
+static void export_sample( const sync_result_t *result, const ntp_sample_t *samples, const int *valid, int nservers,
+                           int leap)
+{
+  int best = best_sample( result, samples, valid, nservers);
+
+  if( best < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No sample exported"));
+    return;
+  }
+  if( refclock_send( result->m_offset, leap) == 0) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Offset %+.6fs exported to %s"), result->m_offset, gAppOptions.m_refclock);
+  }
+}
+
+/*!
+  \brief leap second announced by most of the servers of this poll
+  ******************************************************************
+
+  \param samples  samples of this poll
+  \param valid    which samples are valid
+  \param nservers number of servers
+  \return NTP_LI_INSERT, NTP_LI_DELETE or NTP_LI_NONE
+*/
+static int leap_vote( const ntp_sample_t *samples, const int *valid, int nservers)
+{
+  int i, n = 0, votes[4] = { 0, 0, 0, 0 };
+
+  for( i = 0; i < nservers; i++) {
+    if( !valid[i]) continue;
+    votes[samples[i].m_leap & 3]++;
+    n++;
+  }
+  if( 2 * votes[NTP_LI_INSERT] > n) return NTP_LI_INSERT;
+  if( 2 * votes[NTP_LI_DELETE] > n) return NTP_LI_DELETE;
+  return NTP_LI_NONE;
+}
+
+/*!
+  \brief follow the leap second to come, before the clock is corrected
+  ******************************************************************
+
+  A valid leap-seconds.list wins over the servers. Servers only say
+  "at the end of this month", and some keep saying it a while after
+  the leap: their announcements are ignored the day after one.
+  No step is done within ktLEAP_GUARD seconds of the leap. In daemon
+  mode the kernel is armed on its last day, unless it is smeared:
+  then the servers offsets are corrected by the part of the second
+  smeared so far and the engine gets its rate as frequency bias.
+
+  \param state     leap second to come or just done
+  \param table     leap-seconds.list, may be empty
+  \param announced leap_vote() of this poll
+  \param engine    the synchronization engine
+  \param smear     set to the correction of the servers offsets (s)
+  \return the leap indicator to tell (NTP_LI_NONE while smearing)
+*/
+static int leap_poll( leap_state_t *state, const leap_table_t *table, int announced, sync_engine_t *engine,
+                      double *smear)
+{
+  uint32_t now = (uint32_t)(time( NULL) + NTP_TIMESTAMP_DELTA), when = 0;
+  int next, err, passed = (state->m_when && state->m_when <= now);
+  double part, rate, sign;
+  time_t tmit;
+
+  if( !passed || now - state->m_when >= 86400) {
+    if( table->m_count) next = leap_pending( table, now, &when);
+    else if( (next = announced) != NTP_LI_NONE) when = leap_month_end( now);
+
+    if( next != NTP_LI_NONE && (next != state->m_leap || when != state->m_when)) {
+      tmit = (time_t)(when - NTP_TIMESTAMP_DELTA);
+      trace_write( gAppTrace, eINFO_MSG_TYPE, next == NTP_LI_INSERT ? _("Leap second to insert before %s") :
+                   _("Leap second to delete before %s"), zctime( &tmit));
+      state->m_leap  = next;
+      state->m_when  = when;
+      state->m_armed = 0;
+      passed = 0;
+    }
+    else if( next == NTP_LI_NONE && state->m_leap != NTP_LI_NONE) {
+      if( !passed) {
+        trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Leap second cancelled"));
+        state->m_when = 0;
+        if( state->m_armed) leap_kernel_arm( NTP_LI_NONE);
+      }
+      state->m_leap  = NTP_LI_NONE;
+      state->m_armed = 0;         /* once done the kernel clears it */
+    }
+  }
+
+  /* servers late or early to apply the leap look one second off */
+  engine->m_noStep = state->m_when && now + ktLEAP_GUARD >= state->m_when && now < state->m_when + ktLEAP_GUARD;
+
+  *smear = 0;
+  engine->m_freqBias = 0;
+  if( state->m_leap == NTP_LI_NONE) return NTP_LI_NONE;
+
+  if( gAppOptions.m_smear) {
+    /* inserted: the smeared time is behind the servers, by a second
+       less once they have applied the leap */
+    sign = (state->m_leap == NTP_LI_INSERT) ? -1 : 1;
+    part = leap_smear( gAppOptions.m_smear, gAppOptions.m_smearWindow, (double)now - state->m_when, &rate);
+    *smear = sign * (part - passed);
+    engine->m_freqBias = sign * rate;
+    return NTP_LI_NONE;
+  }
+
+  if( !passed && !state->m_armed && state->m_when - now <= 86400 &&
+      gAppOptions.m_daemon && !gAppOptions.m_debug && !gAppOptions.m_refclock) {
+    if( (err = leap_kernel_arm( state->m_leap)) != 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot arm the kernel for the leap second: %s"), strerror( err));
+    }
+    else {
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Kernel armed for the leap second"));
+    }
+    state->m_armed = 1;
+  }
+  return passed ? NTP_LI_NONE : state->m_leap;
+}
+
+/*!
+  \brief remember what the servers did for the next runs (--state)
+  ******************************************************************
+
+  A server is compared to the others when there are several samples
+  and a majority of them agree.
+
+  \param result  result of sync_update()
+  \param samples samples of the servers
+  \param valid   which samples are valid
+  \param errs    results of the queries
+  \param queried servers queried, the first ones
+*/
+static void reputation_poll( const sync_result_t *result, const ntp_sample_t *samples, const int *valid,
+                             const int *errs, int queried)
+{
+  time_t now = time( NULL);
+  int i, compared = 0;
+
+  for( i = 0; i < queried; i++) compared += valid[i];
+  compared = (compared >= 2 && result->m_survivors);
+  for( i = 0; i < queried; i++) {
+    reputation_update( reputation_find( gAppOptions.m_hosts[i]), errs[i], &samples[i],
+                       (result->m_selected >> i) & 1,
+                       (compared && valid[i]) ? fabs( samples[i].m_offset - result->m_offset) : -1, now);
+  }
+  reputation_save( gAppOptions.m_stateFile);
+}
+
+/*!
+  \brief tell systemd how the synchronization goes (Type=notify)
+  ******************************************************************
+
+  The service is ready once the clock is synchronized, so the units
+  after time-sync.target wait for that and no longer.
+
+  \param result result of sync_update()
+  \param best   reference server, <0 if the clock was not updated
+*/
+static void notify_status( const sync_result_t *result, int best)
+{
+  static int ready = 0;
+
+  if( best >= 0) {
+    systemd_notify( "%sSTATUS=Synchronized to %s, clock was %+.6fs off, frequency %+.3f ppm",
+                    ready ? "" : "READY=1\n", gAppOptions.m_hosts[best], -result->m_offset, result->m_freq * 1e6);
+    ready = 1;
+  }
+  else if( result->m_action == eSYNC_HOLDOVER) {
+    systemd_notify( "STATUS=%s for %.0fs, error bound %.3fms",
+                    holdover_expired( result) ? "Not synchronized, no server" : "Holdover, no server",
+                    result->m_holdover, holdover_error( result) * 1e3);
+  }
+  else if( !ready) {
+    systemd_notify( "STATUS=Waiting for a majority of servers");
+  }
+}
+
+/*!
+  \brief options of the servers in the configuration file (--config)
+  ******************************************************************
+
+  \param config   snapshot of the file
+  \param servers  addresses of the servers, their port set
+  \param nservers their number
+*/
+static void server_options( const config_t *config, struct sockaddr_in *servers, int nservers)
+{
+  const config_server_t *server;
+  int i;
+
+  for( i = 0; i < nservers; i++) {
+    server = config_server( config, gAppOptions.m_hosts[i]);
+    servers[i].sin_port = htons( (server && server->m_port) ? server->m_port : gAppOptions.m_port);
+    gNoSelect[i] = server && server->m_noselect;
+  }
+}
+
+/*!
+  \brief apply a configuration file reloaded (--config)
+  ******************************************************************
+
+  The options given on the command line are left. The servers become
+  the ones of the file then the ones of the command line; a server
+  still there keeps its samples, a new one is resolved.
+
+  \param config   the new snapshot
+  \param engine   synchronization engine
+  \param servers  addresses of the servers
+  \param nservers their number, updated
+  \param fixed    servers of the command line
+  \param nfixed   their number
+*/
+static void reconfigure( const config_t *config, sync_engine_t *engine, struct sockaddr_in *servers, int *nservers,
+                         char fixed[][ktHOSTNAMELEN+1], int nfixed)
+{
+  char               hosts[ktMAXHOSTS][ktHOSTNAMELEN+1];
+  struct sockaddr_in addrs[ktMAXHOSTS];
+  sync_peer_t        peers[ktSYNC_MAXPEERS];
+  int i, j, n = 0;
+
+  if( !(gAppOptions.m_fixed & eCONFIG_POLL))    gAppOptions.m_poll = config->m_poll;
+  if( !(gAppOptions.m_fixed & eCONFIG_TIMEOUT)) gAppOptions.m_timeout = config->m_timeout;
+  if( !(gAppOptions.m_fixed & eCONFIG_FILTER))  gAppOptions.m_filter = engine->m_filter = config->m_filter;
+  if( !(gAppOptions.m_fixed & eCONFIG_HOLDOVER)) {
+    gAppOptions.m_holdoverRate = engine->m_holdoverRate = config->m_holdoverRate;
+    gAppOptions.m_holdoverMax  = config->m_holdoverMax;
+  }
+  if( !(gAppOptions.m_fixed & eCONFIG_STEP))    gAppOptions.m_stepThreshold = engine->m_stepThreshold = config->m_step;
+  if( !(gAppOptions.m_fixed & eCONFIG_VERBOSE)) gAppOptions.m_verbose = config->m_verbose;
+  sync_set_poll( engine, gAppOptions.m_poll);
+
+  if( !gAppOptions.m_bclient) {              // broadcast client: the servers heard
+    memset( hosts, 0, sizeof(hosts));
+    for( i = 0; i < config->m_nservers && n < ktSYNC_MAXPEERS; i++) strcpy( hosts[n++], config->m_servers[i].m_host);
+    for( i = 0; i < nfixed && n < ktSYNC_MAXPEERS; i++) {
+      if( !config_server( config, fixed[i])) strcpy( hosts[n++], fixed[i]);
+    }
+    for( j = 0; j < n; j++) {
+      for( i = 0; i < *nservers && strcmp( gAppOptions.m_hosts[i], hosts[j]); i++);
+      if( i < *nservers) {
+        addrs[j] = servers[i];
+        peers[j] = engine->m_peers[i];
+        continue;
+      }
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s added"), hosts[j]);
+      resolve_host( hosts[j], &addrs[j]);
+      memset( &peers[j], 0, sizeof(peers[j]));
+    }
+    for( i = 0; i < *nservers; i++) {
+      for( j = 0; j < n && strcmp( gAppOptions.m_hosts[i], hosts[j]); j++);
+      if( j == n) trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s removed"), gAppOptions.m_hosts[i]);
+    }
+    memcpy( gAppOptions.m_hosts, hosts, sizeof(hosts));
+    memcpy( servers, addrs, n * sizeof(addrs[0]));
+    memcpy( engine->m_peers, peers, n * sizeof(peers[0]));
+    gAppOptions.m_nhosts = *nservers = engine->m_npeers = n;
+    server_options( config, servers, n);
+    xleave_release( servers, n);
+    if( gAppOptions.m_ntsDir) nts_release( servers, n);
+    for( i = 0; gAppOptions.m_ntsDir && i < n; i++) {
+      if( !nts_find( &servers[i])) nts_open( hosts[i], &servers[i]);
+    }
+  }
+
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Configuration %u: %d server(s), poll %ds, step %.3fs"),
+               config->m_generation, *nservers, gAppOptions.m_poll, gAppOptions.m_stepThreshold);
+  trace_flush( gAppTrace);
+}
+
+#endif
+
+/*!
+  \brief trace what the synchronization engine did
+  ******************************************************************
+
+  \param result result of sync_update()
+*/
+static void report( const sync_result_t *result)
+{
+  time_t tmit;
+
+  if( result->m_action == eSYNC_NOSOURCE) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No majority of servers agree, clock not set"));
+    return;
+  }
+  if( result->m_action == eSYNC_HOLDOVER) {
+    if( holdover_expired( result)) {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No server for %.0fs, clock not synchronized, error bound %.3fms"),
+                   result->m_holdover, holdover_error( result) * 1e3);
+    }
+    else {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No server, holdover for %.0fs at %+.3f ppm, error bound %.3fms"),
+                   result->m_holdover, result->m_freq * 1e6, holdover_error( result) * 1e3);
+    }
+    trace_flush( gAppTrace);
+    return;
+  }
+  if( result->m_holdover > 0) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Servers back after %.0fs of holdover, error bound was %.3fms"),
+                 result->m_holdover, holdover_error( result) * 1e3);
+  }
+
   /*
    * calculate new time and delta
    ***************************************************************************
    */
-  i = time(0);
+  tmit = ntp_ts_to_time( ntp_ts_add( ntp_ts_now(), gDryRunApplied +
+                                    ((result->m_action == eSYNC_SLEW && !gAppOptions.m_debug) ? result->m_offset : 0)));
   trace_write( gAppTrace,  eINFO_MSG_TYPE, _("Time (new) : %s"), zctime(&tmit));
-  trace_write( gAppTrace,  eINFO_MSG_TYPE, _("System time is %d seconds off"),i-tmit);
+  trace_write( gAppTrace,  eINFO_MSG_TYPE, _("System time is %.6f seconds off"), -result->m_offset);
+  if( gAppOptions.m_verbose) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("%d server(s) selected, jitter %.6fs"),
+                 result->m_survivors, result->m_jitter);
+  }
+
+  switch( result->m_action) {
+  case eSYNC_NONE:
+    { trace_write(gAppTrace,  eINFO_MSG_TYPE, _("Set time of day is not necessary"));
+    } break;
+
+  case eSYNC_STEP:
+    { if( gAppOptions.m_debug) {
+        trace_write( gAppTrace, eWARNING_MSG_TYPE, _("DEBUG ON: no set time of day activated."));
+      }
+      else {
+        trace_write(gAppTrace,  eINFO_MSG_TYPE, _("Set time of day OK"));
+      }
+    } break;
+
+  case eSYNC_SLEW:
+    { trace_write( gAppTrace, eINFO_MSG_TYPE, _("%sClock slewed, frequency %+.3f ppm"),
+                   gAppOptions.m_debug ? "DEBUG ON: " : "", result->m_freq * 1e6);
+    } break;
+
+  case eSYNC_HOLD:
+    { trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Leap second near, clock not stepped"));
+    } break;
+
+  case eSYNC_ERROR:
+    { trace_write(gAppTrace,  eERROR_MSG_TYPE, _("Set time of day failed !"));	
+      if( gAppOptions.m_verbose) {
+        trace_write( gAppTrace, eERROR_MSG_TYPE, _("settimeofday() failed, [error %d]: %s"),
+                     result->m_err,
+                     strerror(result->m_err));
+      }
+    } break;
+
+  default:
+    break;
+  }
+  trace_flush(gAppTrace);
+}
+
+/*!
+  \brief one-shot mode of the tiny build: the samples of all the servers
+  through the synchronization engine, which steps the clock
+  ******************************************************************
+
+  The same as a poll of ntpdate() without -D (see tiny.c).
+
+  \param samples  sample of each server, offsets shifted here
+  \param valid    which samples are valid
+  \param nservers number of servers
+  \return 0 if OK, errno if the clock could not be set or <0 if failed
+*/
+int ntp_oneshot( ntp_sample_t *samples, const int *valid, int nservers)
+{
+  sync_engine_t engine;
+  sync_result_t result;
+  time_t tmit = 0;
+  double shift;
+  int i, err, got = 0;
+
+  for( i = 0; i < nservers; i++) {
+    if( !valid[i]) continue;
+    tmit = ntp_ts_to_time( samples[i].m_t3);
+    trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("Time (GMT0): %s"), zctime(&tmit));
+    got++;
+  }
+  if( !got) return eNTP_ETIMEOUT;
+
+  sync_init( &engine, gAppOptions.m_debug ? &gDryRunClock : &gSystemClock, nservers, eSYNC_STRATEGY_STEP,
+             gAppOptions.m_filter, gAppOptions.m_poll);
+  engine.m_stepThreshold = gAppOptions.m_stepThreshold;
+
+  /* the wanted local time is the same for all samples */
+  shift = time_shift( tmit);
+  for( i = 0; i < nservers; i++) {
+    if( !valid[i]) continue;
+    samples[i].m_offset += shift;
+    sync_add_sample( &engine, i, &samples[i]);
+  }
+  err = (sync_update( &engine, &result) == eSYNC_ERROR) ? result.m_err : 0;
+  report( &result);
+  if( result.m_action == eSYNC_NOSOURCE) err = -1;   // replies, but no majority
+  return err;
+}
+
+#ifndef ZNTP_TINY
+/*!
+  \brief main ntpdate function
+   ******************************************************************
+ 
+   Use this function to set date/time get by NTP protocol.
+   All servers are queried, their samples go through the
+   synchronization engine which steps the clock (or slews it in
+   daemon mode, where this is done every poll interval).
+   The time spent in each phase is measured (see timing.c).
+
+   return 0 if OK or <0 if failed
+*/
+int ntpdate(void)
+{
+  int    err=0;
+  int    i, got, queried;
+  int    s = -1;                           // socket
+  int    bs = -1;                          // broadcasts socket (--bclient)
+  int    nservers = 0;
+  time_t tmit = -1;                        // the time -- This is a time_t sort of
+  double shift = 0;                        // seconds to add to UTC
+  double smear = 0;                        // part of a leap second smeared
+  int    li = NTP_LI_NONE;                 // leap indicator to tell
+
+  struct protoent    *proto = NULL;	       // proto
+  struct sockaddr_in servers[ktMAXHOSTS];  // the socket structures
+  ntp_sample_t       samples[ktMAXHOSTS];  // results of the NTP exchanges
+  int                valid[ktMAXHOSTS];
+  int                errs[ktMAXHOSTS];     // results of the queries
+
+  sync_engine_t      engine;               // synchronization engine
+  sync_result_t      result;
+
+  timing_t           timing;               // time spent in each phase
+  timing_hist_t      hist;                 // daemon mode: phases of all polls
+  double             start, mark;          // monotonic time-stamps
+  FILE               *stats = NULL;        // JSON lines output (--stats)
+
+  leap_table_t       leaps;                // leap-seconds.list (--leapfile)
+  leap_state_t       leap;                 // leap second to come
+  quick_result_t     quick;                // quick mode (--quick)
+
+  const config_t     *config = NULL;       // configuration file (--config)
+  const config_t     *latest;
+  int                reader = -1;          // ...read at each poll in daemon mode
+  char               fixed[ktMAXHOSTS][ktHOSTNAMELEN+1]; // servers of the command line
+  int                nfixed = 0;
+
+  memset( &timing, 0, sizeof(timing));
+  memset( &leaps, 0, sizeof(leaps));
+  memset( &leap, 0, sizeof(leap));
+  memset( &hist, 0, sizeof(hist));
+  start = mark = timing_now();
+
+  if( gAppOptions.m_statsFile) {
+    stats = strcmp( gAppOptions.m_statsFile, "-") ? fopen( gAppOptions.m_statsFile, "a") : stdout;
+    if( !stats) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open statistics file %s"), gAppOptions.m_statsFile);
+      err = -1;
+      goto BAIL;
+    }
+  }
+  if( gAppOptions.m_leapFile && leap_load( gAppOptions.m_leapFile, &leaps) < 0) {
+    err = -1;
+    goto BAIL;
+  }
+  if( gAppOptions.m_refclock && refclock_open( gAppOptions.m_refclock) < 0) {
+    err = -1;
+    goto BAIL;
+  }
+  if( gAppOptions.m_publishFile && publish_open( gAppOptions.m_publishFile) < 0) {
+    err = -1;
+    goto BAIL;
+  }
+  if( gAppOptions.m_historyFile && history_open( gAppOptions.m_historyFile, gAppOptions.m_historyRecords) < 0) {
+    err = -1;
+    goto BAIL;
+  }
 
   /*
-   * set time of day if it's necessary
+   * open UDP socket
    ***************************************************************************
    */
-  if( 0 == i-tmit) {
-    trace_write(gAppTrace,  eINFO_MSG_TYPE, _("Set time of day is not necessary"));
-  }
-  else if( gAppOptions.m_debug ) {
-    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("DEBUG ON: no set time of day activated."));
+  proto = getprotobyname( "udp");
+  if( (s = socket( PF_INET, SOCK_DGRAM, proto ? proto->p_proto : 0)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+    err = -1;
+    goto BAIL;    
   }
   else {
-    struct timeval new_timeval;
-    
-    memset(&new_timeval, 0, sizeof(new_timeval));
-    new_timeval.tv_sec = tmit;
-    
-#ifdef SYSV_TIMEOFDAY 
-    err = settimeofday( &new_timeval);
-#else
-    err = settimeofday( &new_timeval, 0);
-#endif   
-    if( err) {
-      trace_write(gAppTrace,  eERROR_MSG_TYPE, _("Set time of day failed !"));	
-      err = errno;
-      if( gAppOptions.m_verbose) {
-        trace_write( gAppTrace, eERROR_MSG_TYPE, _("settimeofday() failed, [error %d]: %s"),
-                     err,
-                     strerror(err));
+    if( s && gAppOptions.m_verbose ) {
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Open socket: %d"),s);
+    }
+  }
+  if( gAppOptions.m_xleave) {
+    i = 1;
+    setsockopt( s, SOL_SOCKET, SO_TIMESTAMPNS, &i, sizeof(i));
+    if( netio_tx_enable( s) < 0 && gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No kernel transmit time-stamps"));
+    }
+  }
+  if( gAppOptions.m_bclient && (bs = bclient_open( gAppOptions.m_bclient)) < 0) {
+    err = -1;
+    goto BAIL;
+  }
+  mark = timing_add( &timing, eTIMING_SOCKET, mark);
+
+  /*
+   * quick mode: everything within the budget, name resolution included
+   ***************************************************************************
+   */
+  if( gAppOptions.m_quick) {
+    err = quick_sync( s, gAppOptions.m_debug ? &gDryRunClock : &gSystemClock, start, gAppOptions.m_quick, &quick);
+    if( stats) quick_write_json( stats, &quick, gAppOptions.m_quick, time( NULL));
+    goto BAIL;
+  }
+  
+  /*
+   * get ip addresses of servers
+   ***************************************************************************
+   */
+  nservers = (gAppOptions.m_nhosts > ktSYNC_MAXPEERS) ? ktSYNC_MAXPEERS : gAppOptions.m_nhosts;
+  if( gAppOptions.m_configFile) {            // the servers of the file come first
+    config = config_get( -1);
+    for( i = config->m_nservers; i < nservers; i++) strcpy( fixed[nfixed++], gAppOptions.m_hosts[i]);
+  }
+  if( gAppOptions.m_stateFile) {             // the best servers of former runs first
+    reputation_load( gAppOptions.m_stateFile);
+    nservers = reputation_order( gAppOptions.m_hosts, nservers, time( NULL), !gAppOptions.m_daemon);
+  }
+  for( i = 0; i < nservers; i++) {
+    if( gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eINFO_MSG_TYPE,
+                   _("Try NTP with host: %s"), gAppOptions.m_hosts[i]);
+    }
+    resolve_host( gAppOptions.m_hosts[i], &servers[i]);
+  }
+  if( config) server_options( config, servers, nservers);
+  mark = timing_add( &timing, eTIMING_DNS, mark);
+
+  /*
+   * NTS keys and cookies of the servers, from the cache if possible
+   ***************************************************************************
+   */
+  if( gAppOptions.m_ntsDir) {
+    for( i = 0; i < nservers; i++) nts_open( gAppOptions.m_hosts[i], &servers[i]);
+    mark = timing_add( &timing, eTIMING_KE, mark);
+  }
+  
+  if( gAppOptions.m_verbose) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("NTP version: %d"), gAppOptions.m_version);
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Attempt receive with timeout %ds"), gAppOptions.m_timeout);
+    trace_flush( gAppTrace);
+  }
+
+  // broadcast client: servers are added as they are heard, unless given
+  sync_init( &engine, gAppOptions.m_debug ? &gDryRunClock : &gSystemClock,
+             (gAppOptions.m_bclient && !nservers) ? ktSYNC_MAXPEERS : nservers,
+             gAppOptions.m_refclock ? eSYNC_STRATEGY_MEASURE :
+             gAppOptions.m_daemon ? eSYNC_STRATEGY_SLEW : eSYNC_STRATEGY_STEP,
+             gAppOptions.m_filter, gAppOptions.m_poll);
+  engine.m_stepThreshold = gAppOptions.m_stepThreshold;
+  engine.m_holdoverRate  = gAppOptions.m_holdoverRate;
+
+  // daemon mode: the configuration file is reloaded when it changes
+  if( config && gAppOptions.m_daemon) {
+    reader = config_reader();
+    config = config_get( reader);
+    if( config_watch( gAppOptions.m_configFile) < 0) reader = -1;
+  }
+
+  for(;;) {
+    /*
+     * a new configuration is taken at the start of a poll, never waited for
+     ***************************************************************************
+     */
+    if( reader >= 0 && (latest = config_get( reader)) != config) {
+      config = latest;
+      reconfigure( config, &engine, servers, &nservers, fixed, nfixed);
+    }
+
+    /*
+     * send to NTP servers and get the data back
+     ***************************************************************************
+     */ 
+    memset( valid, 0, sizeof(valid));
+    if( gAppOptions.m_bclient) {
+      // the servers talk: listen to them for a poll interval
+      queried = 0;
+      got = bclient_collect( bs, s, gAppOptions.m_poll, servers, &nservers, gAppOptions.m_nhosts > 0,
+                             samples, valid, &gAuthFailures);
+      for( i = 0; i < nservers; i++) {
+        if( valid[i]) tmit = ntp_ts_to_time( samples[i].m_t3);
       }
-    } 
+      err = 0;
+    }
     else {
-      trace_write(gAppTrace,  eINFO_MSG_TYPE, _("Set time of day OK"));
+      for( i = 0, got = 0, queried = 0; i < nservers; i++) {
+        // interleaved mode: a first exchange for the second one to go on with
+        if( gAppOptions.m_xleave && !gAppOptions.m_daemon) ntp_query( s, &servers[i], &samples[i], &timing);
+        err = errs[i] = ntp_query( s, &servers[i], &samples[i], &timing);
+        systemd_watchdog();
+        queried++;
+        valid[i] = (err == 0);
+        if( !valid[i]) continue;
+
+        /* 
+         * The transmit time-stamp contains the time as the packet left the NTP server.
+         * The number of seconds correspond to the seconds passed since 1900.
+         * Convert time to unix standard time NTP is number of seconds since 0000
+         * UT on 1 January 1900 unix time is seconds since 0000 UT on 1 January
+         * 1970. Leap seconds, at the end of June or December, are announced by
+         * the leap indicator of the replies (see leap_poll()).
+         ***************************************************************************
+         */
+        tmit = ntp_ts_to_time( samples[i].m_t3);
+        if( gAppOptions.m_verbose) {
+          trace_write( gAppTrace, eINFO_IN_MSG_TYPE, "NTP.TransmitTime: 0x%.8x (%lu)",
+                       (uint32_t)(samples[i].m_t3 >> 32), (unsigned long)(uint32_t)(samples[i].m_t3 >> 32));
+          trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("UNIX time: %ld"), (long)tmit);
+        } 
+        trace_write( gAppTrace,  eINFO_IN_MSG_TYPE, _("Time (GMT0): %s"), zctime(&tmit));
+        got++;
+
+        // one-shot mode: the first reply of a server with a good record is enough
+        if( gAppOptions.m_stateFile && !gAppOptions.m_daemon &&
+            reputation_trusted( reputation_find( gAppOptions.m_hosts[i]), &samples[i], time( NULL))) {
+          if( gAppOptions.m_verbose && i + 1 < nservers) {
+            trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s trusted, %d other(s) not queried"),
+                         gAppOptions.m_hosts[i], nservers - i - 1);
+          }
+          break;
+        }
+      }
+    }
+
+    li = leap_poll( &leap, &leaps, leap_vote( samples, valid, nservers), &engine, &smear);
+
+    if( got) {
+      /* the wanted local time is the same for all samples of this poll */
+      shift = time_shift( tmit) - gDryRunApplied + smear;
+      if( engine.m_strategy == eSYNC_STRATEGY_SLEW && !gAppOptions.m_debug) shift -= sys_pending();
+      for( i = 0; i < nservers; i++) {
+        if( !valid[i]) continue;
+        samples[i].m_offset += shift;
+        if( !gNoSelect[i]) sync_add_sample( &engine, i, &samples[i]);
+      }
+      err = 0;
     }
-    trace_flush(gAppTrace);
+
+    /*
+     * set time of day if it's necessary
+     ***************************************************************************
+     */
+    mark = timing_now();
+    if( sync_update( &engine, &result) == eSYNC_ERROR) err = result.m_err;
+    timing_add( &timing, eTIMING_CLOCK, mark);
+    if( gAppOptions.m_refclock) export_sample( &result, samples, valid, nservers, li);
+    else if( got || result.m_action == eSYNC_HOLDOVER) report( &result);
+    if( (result.m_action == eSYNC_STEP || result.m_action == eSYNC_SLEW) &&
+        (i = best_sample( &result, samples, valid, nservers)) >= 0) gSyncError = error_bound( &result, &samples[i]);
+    if( gAppOptions.m_daemon && !gAppOptions.m_debug && !gAppOptions.m_refclock) {
+      if( result.m_action == eSYNC_STEP || result.m_action == eSYNC_SLEW) sys_synced( gSyncError, result.m_jitter);
+      else if( holdover_expired( &result)) sys_synced( -1, 0);
+    }
+    notify_status( &result, best_sample( &result, samples, valid, nservers));
+    if( gAppOptions.m_servePort) serve_source( &result, samples, valid, servers, nservers, li);
+    if( gAppOptions.m_publishFile) publish_clock( &result, samples, valid, nservers, li);
+    for( i = 0; gAppOptions.m_historyFile && i < nservers; i++) {
+      if( valid[i]) history_add( history_server( gAppOptions.m_hosts[i]), &samples[i], result.m_action,
+                                 (result.m_selected >> i) & 1);
+    }
+
+    /*
+     * where the time went
+     ***************************************************************************
+     */
+    timing_add( &timing, eTIMING_TOTAL, start);
+    if( gAppOptions.m_verbose) timing_trace( gAppTrace, &timing);
+    trace_flush( gAppTrace);
+    if( stats) timing_write_json( stats, &timing, time( NULL));
+    if( stats && result.m_action == eSYNC_HOLDOVER) {
+      fprintf( stats, "{\"type\":\"holdover\",\"time\":%ld,\"seconds\":%.0f,\"freq\":%.3f,\"error\":%.6f,\"synced\":%d}\n",
+               (long)time( NULL), result.m_holdover, result.m_freq * 1e6, holdover_error( &result),
+               !holdover_expired( &result));
+      fflush( stats);
+    }
+    if( gAppOptions.m_ntsDir) nts_save();      // cookies left for the next poll or run
+    if( gAppOptions.m_stateFile) reputation_poll( &result, samples, valid, errs, queried);
+
+    if( !gAppOptions.m_daemon) {
+      if( result.m_action == eSYNC_NOSOURCE && !err) err = -1;   // replies, but no majority
+      break;
+    }
+
+    timing_hist_add( &hist, &timing);
+    if( hist.m_count % ktTIMING_REPORT_POLLS == 0) {
+      if( gAppOptions.m_verbose) timing_hist_trace( gAppTrace, &hist);
+      if( gAppOptions.m_verbose && gAppOptions.m_servePort) server_trace( gAppTrace);
+      if( gAppOptions.m_verbose && (gAppOptions.m_keyId || gAppOptions.m_ntsDir)) {
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("Authentication failures: %lu"), gAuthFailures);
+      }
+      trace_flush( gAppTrace);
+      if( stats) timing_hist_write_json( stats, &hist, time( NULL));
+      if( stats && gAppOptions.m_servePort) server_write_json( stats, time( NULL));
+      if( stats && (gAppOptions.m_keyId || gAppOptions.m_ntsDir)) {
+        fprintf( stats, "{\"type\":\"auth\",\"time\":%ld,\"key\":%u,\"failures\":%lu}\n",
+                 (long)time( NULL), gAppOptions.m_keyId, gAuthFailures);
+        fflush( stats);
+      }
+    }
+
+    if( !gAppOptions.m_bclient) systemd_sleep( gAppOptions.m_poll);
+    memset( &timing, 0, sizeof(timing));
+    start = timing_now();
   }
   
 BAIL:
-  if( gAppOptions.m_verbose)
+  if( gAppOptions.m_verbose && s >= 0)
     trace_write(gAppTrace,  eINFO_MSG_TYPE, _("Close socket: %d"), s);
-  close(s);
+  if( s >= 0) close(s);
+  if( bs >= 0) close( bs);
+  if( stats && stats != stdout) fclose( stats);
+  if( leap.m_armed && leap.m_leap != NTP_LI_NONE) leap_kernel_arm( NTP_LI_NONE);
+  if( gAppOptions.m_ntsDir) nts_close();
+  publish_close();
+  history_close();
+  refclock_close();
   return err;
 }
+#endif
@@ -12,10 +12,83 @@
 #ifndef NTPDATE_H_
 #define NTPDATE_H_
 
+#include <netinet/in.h>
+
+#include "ntppacket.h"
+#include "timing.h"
+
+#define TIMEOUT_SECS                10  /*!< time for waiting response of NTP Server */
+
+/*!
+  \enum ntp_query_err
+  \brief result of a NTP exchange
+  ******************************************************************
+*/
+typedef enum ntp_query_err {
+  eNTP_OK        =  0,             /*!< got a valid reply                      */
+  eNTP_ESYSTEM   = -1,             /*!< system call failed                     */
+  eNTP_ESEND     = -2,             /*!< request could not be sent              */
+  eNTP_ETIMEOUT  = -3,             /*!< no reply after all tries               */
+  eNTP_EINVALID  = -4,             /*!< reply is not usable                    */
+  eNTP_EKOD      = -5,             /*!< Kiss-o'-Death, see m_refId             */
+  eNTP_EUNSYNC   = -6,             /*!< server not synchronized (leap alarm)   */
+  eNTP_EAUTH     = -7,             /*!< reply not authenticated by our key     */
+
+}ntp_query_err;
+
+/*!
+  \struct ntp_sample_t
+  \brief result of one NTP exchange
+  ******************************************************************
+*/
+typedef struct ntp_sample_t {
+  ntp_ts_t m_t1;                 /*!< client transmit time-stamp                 */
+  ntp_ts_t m_t2;                 /*!< server receive time-stamp                  */
+  ntp_ts_t m_t3;                 /*!< server transmit time-stamp                 */
+  ntp_ts_t m_t4;                 /*!< client receive time-stamp                  */
+  double   m_offset;             /*!< clock offset (s), > 0 if we are late       */
+  double   m_delay;              /*!< round trip delay (s)                       */
+  double   m_rootDelay;          /*!< server root delay (s)                      */
+  double   m_rootDisp;           /*!< server root dispersion (s)                 */
+  int      m_leap;               /*!< leap indicator                             */
+  int      m_stratum;            /*!< server stratum                             */
+  uint32_t m_refId;              /*!< server reference id (host order)           */
+  int      m_interleaved;        /*!< m_t3 is when the reply really left (-x)    */
+
+} ntp_sample_t;
+
+/*!
+  \brief compute offset and delay of a sample from its time-stamps
+  ******************************************************************
+
+  With our transmit time (T1), the server receive (T2) and transmit
+  (T3) time-stamps and our receive time (T4), we get:
+
+    offset = ((T2 - T1) + (T3 - T4)) / 2
+    delay  = (T4 - T1) - (T3 - T2)
+
+  \param sample the sample, m_t1 to m_t4 set
+*/
+static inline void ntp_sample_compute( ntp_sample_t *sample)
+{
+  sample->m_offset = (ntp_ts_diff( sample->m_t2, sample->m_t1) + ntp_ts_diff( sample->m_t3, sample->m_t4)) / 2;
+  sample->m_delay  = ntp_ts_diff( sample->m_t4, sample->m_t1) - ntp_ts_diff( sample->m_t3, sample->m_t2);
+}
+
 /*
   Function prototype
   ******************************************************************
   */
-int ntpdate(void);
+int  ntpdate(void);
+int  ntp_query( int s, const struct sockaddr_in *addr, ntp_sample_t *sample, timing_t *timing);
+void ntp_request_build( ntp_packet_t *request, ntp_ts_t t1);
+void ntp_reply_sample( const ntp_packet_t *reply, ntp_ts_t t1, ntp_ts_t t4, ntp_sample_t *sample);
+int  ntp_sample_check( const ntp_sample_t *sample);
+int  ntp_oneshot( ntp_sample_t *samples, const int *valid, int nservers);
+void resolve_host( const char *hostname, struct sockaddr_in *addr);
+double time_shift( time_t tmit);
+#ifdef ZNTP_TINY
+int  tiny_sync( void);
+#endif
 
 #endif /* NTPDATE_H_ */
@@ -0,0 +1,157 @@
+/**
+ * \file ntppacket.h
+ * \brief NTP packet layout and timestamp helpers
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef NTPPACKET_H_
+#define NTPPACKET_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define NTP_PORT                   123  /*!< NTP is port 123                          */
+#define NTP_TIMESTAMP_DELTA 2208988800UL /*!< NTP time-stamp of 1 Jan 1970            */
+#define NTP_FRAC            4294967296.0 /*!< 2^32, one second in NTP fraction units  */
+
+#define NTP_MODE_CLIENT              3  /*!< mode of a client request                */
+#define NTP_MODE_SERVER              4  /*!< mode of a server reply                  */
+#define NTP_MODE_BROADCAST           5  /*!< mode of a broadcast packet              */
+
+#define NTP_LI_NONE                  0  /*!< leap indicator: no warning              */
+#define NTP_LI_INSERT                1  /*!< leap indicator: last minute has 61 s    */
+#define NTP_LI_DELETE                2  /*!< leap indicator: last minute has 59 s    */
+#define NTP_LI_ALARM                 3  /*!< leap indicator: clock not synchronized  */
+
+/*! use these macros to split or build the li_vn_mode byte              */
+#define NTP_LI(x)          ( ((x) >> 6) & 0x3 )
+#define NTP_VN(x)          ( ((x) >> 3) & 0x7 )
+#define NTP_MODE(x)        ( (x) & 0x7 )
+#define NTP_LI_VN_MODE(li, vn, mode) ( (uint8_t)(((li) << 6) | ((vn) << 3) | (mode)) )
+
+/*!
+  \struct ntp_packet
+  \brief ntp packet structure
+  ******************************************************************
+  */
+typedef struct ntp_packet_t {
+  uint8_t li_vn_mode;       /*!<  8 bits. li, vn, and mode.
+                                       li.  Two bits.   Leap indicator.
+                                       vn.  Three bits. Version number of the protocol.
+                                     mode.  Three bits. Client will pick mode 3 for client. */
+
+  uint8_t stratum;          /*!<  8 bits. Stratum level of the local clock.                 */
+  uint8_t poll;             /*!<  8 bits. Maximum interval between successive messages.     */
+  uint8_t precision;        /*!<  8 bits. Precision of the local clock.                     */
+
+  uint32_t rootDelay;       /*!<  32 bits. Total round trip delay time.                     */
+  uint32_t rootDispersion;  /*!<  32 bits. Max error aloud from primary clock source.       */
+  uint32_t refId;           /*!<  32 bits. Reference clock identifier.                      */
+
+  uint32_t refTm_s;         /*!<  32 bits. Reference time-stamp seconds.                    */
+  uint32_t refTm_f;         /*!<  32 bits. Reference time-stamp fraction of a second.       */
+
+  uint32_t origTm_s;        /*!<  32 bits. Originate time-stamp seconds.                    */
+  uint32_t origTm_f;        /*!<  32 bits. Originate time-stamp fraction of a second.       */
+
+  uint32_t rxTm_s;          /*!<  32 bits. Received time-stamp seconds.                     */
+  uint32_t rxTm_f;          /*!<  32 bits. Received time-stamp fraction of a second.        */
+
+  uint32_t txTm_s;          /*!<  32 bits. The most important field the client cares about.
+                                  Transmit time-stamp seconds.                              */
+  uint32_t txTm_f;          /*!<  32 bits. Transmit time-stamp fraction of a second.        */
+
+} ntp_packet_t;
+
+/*!
+  \enum ntp_version
+  \brief many NTP protocol version (eNTP_V3 by default)
+  ******************************************************************
+*/
+typedef enum ntp_version {
+  eNTP_V1 = 010,                   /*!< 00 001 000 binary = v1 */
+  eNTP_V2 = 020,                   /*!< 00 010 000 binary = v2 */
+  eNTP_V3 = 030,                   /*!< 00 011 000 binary = v3 */
+  eNTP_V4 = 040,                   /*!< 00 100 000 binary = v4 */
+
+}ntp_version;
+
+/*! 64 bits NTP timestamp: seconds since 1900 (32 bits) and fraction (32 bits) */
+typedef uint64_t ntp_ts_t;
+
+/*!
+  \brief NTP timestamp of a timespec (UNIX time)
+*/
+static inline ntp_ts_t ntp_ts_from_timespec( const struct timespec *ts)
+{
+  return ((ntp_ts_t)(uint32_t)(ts->tv_sec + NTP_TIMESTAMP_DELTA) << 32) |
+         (ntp_ts_t)(((uint64_t)ts->tv_nsec << 32) / 1000000000UL);
+}
+
+/*!
+  \brief current system time as NTP timestamp
+*/
+static inline ntp_ts_t ntp_ts_now( void)
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_REALTIME, &ts);
+  return ntp_ts_from_timespec( &ts);
+}
+
+/*!
+  \brief NTP timestamp of two packet fields (network order)
+*/
+static inline ntp_ts_t ntp_ts_get( uint32_t s, uint32_t f)
+{
+  return ((ntp_ts_t)ntohl(s) << 32) | ntohl(f);
+}
+
+/*!
+  \brief store a NTP timestamp into two packet fields (network order)
+*/
+static inline void ntp_ts_put( ntp_ts_t ts, uint32_t *s, uint32_t *f)
+{
+  *s = htonl( (uint32_t)(ts >> 32));
+  *f = htonl( (uint32_t)ts);
+}
+
+/*!
+  \brief difference a - b in seconds, valid across NTP eras
+*/
+static inline double ntp_ts_diff( ntp_ts_t a, ntp_ts_t b)
+{
+  return (double)(int64_t)(a - b) / NTP_FRAC;
+}
+
+/*!
+  \brief NTP timestamp shifted by a number of seconds
+*/
+static inline ntp_ts_t ntp_ts_add( ntp_ts_t ts, double secs)
+{
+  return ts + (ntp_ts_t)(int64_t)(secs * NTP_FRAC);
+}
+
+/*!
+  \brief UNIX time (seconds) of a NTP timestamp, era of 1900-2036
+  extended until 2106
+*/
+static inline time_t ntp_ts_to_time( ntp_ts_t ts)
+{
+  return (time_t)(uint32_t)((uint32_t)(ts >> 32) - NTP_TIMESTAMP_DELTA);
+}
+
+/*!
+  \brief NTP short format (16.16, used by root delay/dispersion) in seconds
+*/
+static inline double ntp_short_to_secs( uint32_t v)
+{
+  return (double)ntohl(v) / 65536.0;
+}
+
+#endif /* NTPPACKET_H_ */
@@ -0,0 +1,963 @@
+/**
+ * \file nts.c
+ * \brief Network Time Security client (RFC 8915)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --nts, each server is first asked for keys and cookies by the
+ * NTS key establishment protocol (NTS-KE: TLS 1.3, ALPN "ntske/1",
+ * port 4460): the keys are exported from the TLS session, the cookies
+ * are opaque to us. Then every NTP request carries a unique identifier,
+ * one cookie, placeholders asking for as many new cookies as used, and
+ * an authenticator: AEAD_AES_SIV_CMAC_256 of the packet with the client
+ * to server key. The reply is authenticated by the server to client key
+ * and brings the new cookies encrypted.
+ *
+ * The keys and the cookies left are written into DIR/host.nts (0600)
+ * after each poll, so the next run or poll needs no TLS handshake: a
+ * cached exchange costs one AES-SIV on each side. A new key exchange
+ * is done when no cookie is left or when the server refused them
+ * (Kiss-o'-Death NTSN, e.g. after its key rotation).
+ *
+ * OpenSSL's AES-128-SIV computes no tag for an empty plaintext, which
+ * is what a request encrypts, so SIV (RFC 5297) is done here: S2V on a
+ * keyed AES-CBC context, as the CMAC of auth.c, and AES-CTR on a keyed
+ * AES-ECB one. Setting an IV costs more than encrypting a packet, so
+ * the contexts are never reset per packet: each CMAC goes on from the
+ * chaining value left by the previous one, removed from its first
+ * block, and the CTR key stream is the ECB encryption of the counters.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntppacket.h"
+#include "nts.h"
+
+#ifdef HAVE_NTS
+#  include <openssl/evp.h>
+#  include <openssl/ssl.h>
+#  include <openssl/err.h>
+#  include <openssl/rand.h>
+#  include <openssl/crypto.h>
+#  include <openssl/x509v3.h>
+#endif
+
+#define ktNTS_CACHE_MAGIC 0x5A4E5453u /*!< "ZNTS"                                */
+#define ktNTS_CACHE_VERSION 1
+#define ktNTS_AUTHLEN (8 + ktNTS_NONCELEN + 16) /*!< our authenticator body      */
+#define SIV_CHUNK         256    /*!< bytes encrypted per EVP call               */
+
+/*!
+  \struct nts_session_t
+  \brief keys and cookies of a server
+  ******************************************************************
+*/
+struct nts_session_t {
+  char               m_host[ktHOSTNAMELEN + 1]; /*!< NTS-KE server               */
+  struct sockaddr_in m_id;       /*!< address given to nts_open()                */
+  struct sockaddr_in m_addr;     /*!< NTP server told by the key exchange        */
+  uint8_t            m_c2s[ktNTS_KEYLEN]; /*!< client to server key              */
+  uint8_t            m_s2c[ktNTS_KEYLEN]; /*!< server to client key              */
+  nts_aead_t         m_seal;     /*!< keyed with m_c2s                           */
+  nts_aead_t         m_open;     /*!< keyed with m_s2c                           */
+  uint8_t            m_cookie[ktNTS_COOKIES][ktNTS_MAXCOOKIE];
+  int                m_cookieLen[ktNTS_COOKIES];
+  int                m_ncookies; /*!< cookies left, the last one is used first   */
+  uint8_t            m_uid[ktNTS_UIDLEN]; /*!< of the request in flight          */
+  int                m_dirty;    /*!< to write into the cache                    */
+};
+
+/*!
+  \struct nts_cache_t
+  \brief head of a cache file, followed by the cookies (16 bits length, data)
+  ******************************************************************
+*/
+typedef struct nts_cache_t {
+  uint32_t m_magic;              /*!< ktNTS_CACHE_MAGIC                          */
+  uint32_t m_version;            /*!< ktNTS_CACHE_VERSION                        */
+  uint32_t m_addr;               /*!< NTP server, network order                  */
+  uint16_t m_port;               /*!< its port, network order                    */
+  uint16_t m_count;              /*!< cookies                                    */
+  uint8_t  m_c2s[ktNTS_KEYLEN];
+  uint8_t  m_s2c[ktNTS_KEYLEN];
+
+} nts_cache_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static nts_session_t gSessions[ktMAXHOSTS];
+static int           gNsessions = 0;
+
+static inline uint16_t get16( const uint8_t *p)
+{
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void put16( uint8_t *p, int v)
+{
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+#ifdef HAVE_NTS
+static SSL_CTX *gCtx = NULL;
+
+/*!
+  \brief doubling in GF(2^128): shift left one bit, reduce by the polynomial
+*/
+static void siv_double( uint8_t b[16])
+{
+  int i, carry = b[0] >> 7;
+
+  for( i = 0; i < 15; i++) b[i] = (uint8_t)(b[i] << 1 | b[i + 1] >> 7);
+  b[15] = (uint8_t)(b[15] << 1);
+  if( carry) b[15] ^= 0x87;
+}
+
+/*!
+  \brief AES-CMAC (RFC 4493) with the MAC key
+*/
+static void siv_cmac( nts_aead_t *aead, const uint8_t *msg, int len, uint8_t mac[16])
+{
+  EVP_CIPHER_CTX *cbc = (EVP_CIPHER_CTX *)aead->m_cbc;
+  uint8_t buf[SIV_CHUNK], last[16];
+  const uint8_t *sub;
+  int i, j, n, rest, done = 0, out;
+
+  /* all blocks but the last, by chunks: only the chaining value matters,
+     the one left in the context is removed from the first block */
+  rest = len ? len - 16 * ((len - 1) / 16) : 0;
+  for( n = len - rest; done < n; done += i) {
+    i = (n - done > SIV_CHUNK) ? SIV_CHUNK : n - done;
+    memcpy( buf, msg + done, (size_t)i);
+    for( j = 0; !done && j < 16; j++) buf[j] ^= aead->m_chain[j];
+    EVP_EncryptUpdate( cbc, buf, &out, buf, i);
+  }
+
+  memset( last, 0, sizeof(last));
+  memcpy( last, msg + done, (size_t)rest);
+  if( rest == 16) sub = aead->m_k1;
+  else {
+    last[rest] = 0x80;
+    sub = aead->m_k2;
+  }
+  for( i = 0; i < 16; i++) last[i] ^= sub[i] ^ (n ? 0 : aead->m_chain[i]);
+  EVP_EncryptUpdate( cbc, mac, &out, last, 16);
+  memcpy( aead->m_chain, mac, 16);
+}
+
+/*!
+  \brief S2V of the associated data, the nonce and the plaintext
+*/
+static int siv_s2v( nts_aead_t *aead, const uint8_t *ad, int adlen, const uint8_t *nonce, int nlen,
+                    const uint8_t *p, int len, uint8_t v[16])
+{
+  uint8_t d[16], mac[16], t[ktNTS_MSGLEN];
+  int i;
+
+  if( len > ktNTS_MSGLEN) return -1;
+  memcpy( d, aead->m_d0, 16);
+  if( ad) {
+    siv_double( d);
+    siv_cmac( aead, ad, adlen, mac);
+    for( i = 0; i < 16; i++) d[i] ^= mac[i];
+  }
+  if( nonce) {
+    siv_double( d);
+    siv_cmac( aead, nonce, nlen, mac);
+    for( i = 0; i < 16; i++) d[i] ^= mac[i];
+  }
+  if( len >= 16) {
+    memcpy( t, p, (size_t)len);
+    for( i = 0; i < 16; i++) t[len - 16 + i] ^= d[i];
+    siv_cmac( aead, t, len, v);
+  }
+  else {
+    siv_double( d);
+    for( i = 0; i < len; i++) d[i] ^= p[i];
+    d[len] ^= 0x80;
+    siv_cmac( aead, d, 16, v);
+  }
+  return 0;
+}
+
+/*!
+  \brief AES-CTR from the synthetic IV, 128 bits counter
+*/
+static void siv_ctr( nts_aead_t *aead, const uint8_t v[16], const uint8_t *in, int len, uint8_t *out)
+{
+  uint8_t q[16], stream[SIV_CHUNK];
+  int i, j, n, done;
+
+  memcpy( q, v, 16);
+  q[8]  &= 0x7f;
+  q[12] &= 0x7f;
+  for( done = 0; done < len; done += n) {
+    n = (len - done > SIV_CHUNK) ? SIV_CHUNK : len - done;
+    for( i = 0; i < n; i += 16) {
+      memcpy( stream + i, q, 16);
+      for( j = 15; j >= 0 && ++q[j] == 0; j--);
+    }
+    EVP_EncryptUpdate( (EVP_CIPHER_CTX *)aead->m_ctr, stream, &j, stream, (n + 15) & ~15);
+    for( i = 0; i < n; i++) out[done + i] = in[done + i] ^ stream[i];
+  }
+}
+#endif
+
+/*!
+  \brief key AEAD_AES_SIV_CMAC_256 contexts
+  ******************************************************************
+
+  \param aead the contexts
+  \param key  MAC key then encryption key
+  \return 0 if OK else -1
+*/
+int nts_aead_init( nts_aead_t *aead, const uint8_t key[ktNTS_KEYLEN])
+{
+  memset( aead, 0, sizeof(*aead));
+  return nts_aead_rekey( aead, key);
+}
+
+/*!
+  \brief change the key of AEAD contexts
+  ******************************************************************
+
+  The contexts are allocated by the first key only, and the key
+  schedule is skipped if the key did not change: a server keyed by
+  the cookie of each request does not allocate nor derive per packet
+  for the same client.
+
+  \param aead the contexts, given to nts_aead_init() before
+  \param key  MAC key then encryption key
+  \return 0 if OK else -1 (the contexts are freed)
+*/
+int nts_aead_rekey( nts_aead_t *aead, const uint8_t key[ktNTS_KEYLEN])
+{
+#ifdef HAVE_NTS
+  static const uint8_t zero[16] = { 0 };
+  EVP_CIPHER_CTX *cbc, *ctr;
+  uint8_t l[16];
+  int out;
+
+  if( aead->m_cbc && !CRYPTO_memcmp( aead->m_key, key, ktNTS_KEYLEN)) return 0;
+  if( !aead->m_cbc) {
+    if( !(aead->m_cbc = EVP_CIPHER_CTX_new()) || !(aead->m_ctr = EVP_CIPHER_CTX_new()) ||
+        !EVP_EncryptInit_ex( (EVP_CIPHER_CTX *)aead->m_cbc, EVP_aes_128_cbc(), NULL, NULL, NULL) ||
+        !EVP_EncryptInit_ex( (EVP_CIPHER_CTX *)aead->m_ctr, EVP_aes_128_ecb(), NULL, NULL, NULL) ||
+        !EVP_CIPHER_CTX_set_padding( (EVP_CIPHER_CTX *)aead->m_cbc, 0) ||
+        !EVP_CIPHER_CTX_set_padding( (EVP_CIPHER_CTX *)aead->m_ctr, 0)) {
+      nts_aead_free( aead);
+      return -1;
+    }
+  }
+  cbc = (EVP_CIPHER_CTX *)aead->m_cbc;
+  ctr = (EVP_CIPHER_CTX *)aead->m_ctr;
+  if( !EVP_EncryptInit_ex( cbc, NULL, NULL, key, zero) || !EVP_EncryptInit_ex( ctr, NULL, NULL, key + 16, NULL) ||
+      !EVP_EncryptUpdate( cbc, l, &out, zero, 16)) {
+    nts_aead_free( aead);
+    return -1;
+  }
+  memcpy( aead->m_k1, l, 16);
+  siv_double( aead->m_k1);
+  memcpy( aead->m_k2, aead->m_k1, 16);
+  siv_double( aead->m_k2);
+  memcpy( aead->m_chain, l, 16);
+  siv_cmac( aead, zero, 16, aead->m_d0);
+  memcpy( aead->m_key, key, ktNTS_KEYLEN);
+  return 0;
+#else
+  (void)aead; (void)key;
+  return -1;
+#endif
+}
+
+/*!
+  \brief free AEAD contexts
+*/
+void nts_aead_free( nts_aead_t *aead)
+{
+#ifdef HAVE_NTS
+  EVP_CIPHER_CTX_free( (EVP_CIPHER_CTX *)aead->m_cbc);
+  EVP_CIPHER_CTX_free( (EVP_CIPHER_CTX *)aead->m_ctr);
+#endif
+  memset( aead, 0, sizeof(*aead));
+}
+
+/*!
+  \brief encrypt and authenticate
+  ******************************************************************
+
+  \param aead  keyed contexts
+  \param ad    associated data, NULL if none
+  \param adlen its length
+  \param nonce the nonce, NULL if none
+  \param nlen  its length
+  \param in    plaintext
+  \param len   its length (0 to only authenticate)
+  \param out   synthetic IV (16 bytes) then ciphertext
+  \return length of out or -1
+*/
+int nts_seal( nts_aead_t *aead, const uint8_t *ad, int adlen, const uint8_t *nonce, int nlen,
+              const uint8_t *in, int len, uint8_t *out)
+{
+#ifdef HAVE_NTS
+  if( !aead->m_cbc || siv_s2v( aead, ad, adlen, nonce, nlen, in, len, out) < 0) return -1;
+  siv_ctr( aead, out, in, len, out + 16);
+  return 16 + len;
+#else
+  (void)aead; (void)ad; (void)adlen; (void)nonce; (void)nlen; (void)in; (void)len; (void)out;
+  return -1;
+#endif
+}
+
+/*!
+  \brief decrypt and check
+  ******************************************************************
+
+  Parameters as nts_seal(), in holds the synthetic IV then the
+  ciphertext.
+
+  \return length of the plaintext or -1 if not authentic
+*/
+int nts_unseal( nts_aead_t *aead, const uint8_t *ad, int adlen, const uint8_t *nonce, int nlen,
+                const uint8_t *in, int len, uint8_t *out)
+{
+#ifdef HAVE_NTS
+  uint8_t v[16];
+
+  if( !aead->m_cbc || len < 16 || len - 16 > ktNTS_MSGLEN) return -1;
+  siv_ctr( aead, in, in + 16, len - 16, out);
+  if( siv_s2v( aead, ad, adlen, nonce, nlen, out, len - 16, v) < 0 || CRYPTO_memcmp( v, in, 16)) {
+    memset( out, 0, (size_t)(len - 16));
+    return -1;
+  }
+  return len - 16;
+#else
+  (void)aead; (void)ad; (void)adlen; (void)nonce; (void)nlen; (void)in; (void)len; (void)out;
+  return -1;
+#endif
+}
+
+/*!
+  \brief keys of the NTP exchanges from a NTS-KE TLS session
+  ******************************************************************
+
+  \param ssl the TLS session (SSL *)
+  \param c2s client to server key
+  \param s2c server to client key
+  \return 0 if OK else -1
+*/
+int nts_export_keys( void *ssl, uint8_t c2s[ktNTS_KEYLEN], uint8_t s2c[ktNTS_KEYLEN])
+{
+#ifdef HAVE_NTS
+  static const char label[] = "EXPORTER-network-time-security";
+  /* next protocol (NTPv4), AEAD, then 0 for the client to server key */
+  uint8_t context[5] = { 0, 0, 0, ktNTS_AEAD_SIV, 0 };
+
+  if( SSL_export_keying_material( (SSL *)ssl, c2s, ktNTS_KEYLEN, label, sizeof(label) - 1,
+                                  context, sizeof(context), 1) != 1) return -1;
+  context[4] = 1;
+  if( SSL_export_keying_material( (SSL *)ssl, s2c, ktNTS_KEYLEN, label, sizeof(label) - 1,
+                                  context, sizeof(context), 1) != 1) return -1;
+  return 0;
+#else
+  (void)ssl; (void)c2s; (void)s2c;
+  return -1;
+#endif
+}
+
+/*!
+  \brief name of a nts_status
+*/
+const char *nts_status_name( int status)
+{
+  switch( status) {
+  case eNTS_OK:   return _("authenticated");
+  case eNTS_NONE: return _("other request");
+  case eNTS_BAD:  return _("bad authenticator");
+  case eNTS_NAK:  return _("cookies refused");
+  default:        return "?";
+  }
+}
+
+/*!
+  \brief random bytes for unique identifiers, nonces and cookies
+  ******************************************************************
+
+  RAND_bytes() costs as much per call as the rest of a request: the
+  bytes are drawn ktNTS_RANDPOOL at once into a pool of the thread,
+  and cleared from it when given.
+
+  \param buf where to put them
+  \param len how many
+  \return 0 if OK else -1
+*/
+int nts_random( uint8_t *buf, int len)
+{
+#ifdef HAVE_NTS
+  static __thread uint8_t pool[ktNTS_RANDPOOL];
+  static __thread int     left = 0;
+
+  if( len > ktNTS_RANDPOOL) return RAND_bytes( buf, len) == 1 ? 0 : -1;
+  if( len > left) {
+    if( RAND_bytes( pool, ktNTS_RANDPOOL) != 1) return -1;
+    left = ktNTS_RANDPOOL;
+  }
+  left -= len;
+  memcpy( buf, pool + left, (size_t)len);
+  OPENSSL_cleanse( pool + left, (size_t)len);
+  return 0;
+#else
+  (void)buf; (void)len;
+  return -1;
+#endif
+}
+
+/*!
+  \brief cache file of a session
+*/
+static void cache_path( const nts_session_t *s, char *path, size_t size)
+{
+  snprintf( path, size, "%s/%s.nts", gAppOptions.m_ntsDir, s->m_host);
+}
+
+/*!
+  \brief write the keys and the cookies left, atomically
+*/
+static int cache_write( const nts_session_t *s)
+{
+  uint8_t buf[sizeof(nts_cache_t) + ktNTS_COOKIES * (2 + ktNTS_MAXCOOKIE)];
+  nts_cache_t *head = (nts_cache_t *)buf;
+  char path[512], tmp[520];
+  int fd, i, len = sizeof(nts_cache_t), n;
+
+  memset( head, 0, sizeof(*head));
+  head->m_magic   = ktNTS_CACHE_MAGIC;
+  head->m_version = ktNTS_CACHE_VERSION;
+  head->m_addr    = s->m_addr.sin_addr.s_addr;
+  head->m_port    = s->m_addr.sin_port;
+  head->m_count   = (uint16_t)s->m_ncookies;
+  memcpy( head->m_c2s, s->m_c2s, ktNTS_KEYLEN);
+  memcpy( head->m_s2c, s->m_s2c, ktNTS_KEYLEN);
+  for( i = 0; i < s->m_ncookies; i++) {
+    put16( buf + len, s->m_cookieLen[i]);
+    memcpy( buf + len + 2, s->m_cookie[i], (size_t)s->m_cookieLen[i]);
+    len += 2 + s->m_cookieLen[i];
+  }
+
+  cache_path( s, path, sizeof(path));
+  snprintf( tmp, sizeof(tmp), "%s.tmp", path);
+  if( (fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot write %s: %s"), tmp, strerror( errno));
+    return -1;
+  }
+  n = (int)write( fd, buf, (size_t)len);
+  close( fd);
+  if( n != len || rename( tmp, path) < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot write %s: %s"), path, strerror( errno));
+    unlink( tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/*!
+  \brief read the keys and the cookies of a former run
+  \return cookies read, 0 if none usable
+*/
+static int cache_read( nts_session_t *s)
+{
+  uint8_t buf[sizeof(nts_cache_t) + ktNTS_COOKIES * (2 + ktNTS_MAXCOOKIE)];
+  const nts_cache_t *head = (const nts_cache_t *)buf;
+  char path[512];
+  int fd, i, len, pos = sizeof(nts_cache_t), n;
+
+  cache_path( s, path, sizeof(path));
+  if( (fd = open( path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+  len = (int)read( fd, buf, sizeof(buf));
+  close( fd);
+  if( len < (int)sizeof(nts_cache_t) || head->m_magic != ktNTS_CACHE_MAGIC ||
+      head->m_version != ktNTS_CACHE_VERSION || head->m_count > ktNTS_COOKIES) return 0;
+
+  for( i = 0; i < head->m_count; i++, pos += 2 + n) {
+    if( pos + 2 > len || (n = get16( buf + pos)) == 0 || n > ktNTS_MAXCOOKIE || pos + 2 + n > len) return 0;
+    memcpy( s->m_cookie[i], buf + pos + 2, (size_t)n);
+    s->m_cookieLen[i] = n;
+  }
+  if( nts_aead_init( &s->m_seal, head->m_c2s) < 0 || nts_aead_init( &s->m_open, head->m_s2c) < 0) return 0;
+  memcpy( s->m_c2s, head->m_c2s, ktNTS_KEYLEN);
+  memcpy( s->m_s2c, head->m_s2c, ktNTS_KEYLEN);
+  s->m_addr.sin_addr.s_addr = head->m_addr;
+  s->m_addr.sin_port        = head->m_port;
+  s->m_ncookies             = head->m_count;
+  return s->m_ncookies;
+}
+
+#ifdef HAVE_NTS
+/*!
+  \brief read exactly len bytes of the TLS stream
+*/
+static int ke_read( SSL *ssl, uint8_t *buf, int len)
+{
+  int n, done = 0;
+
+  while( done < len) {
+    if( (n = SSL_read( ssl, buf + done, len - done)) <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+/*!
+  \brief TLS 1.3 client context, trust anchors of --nts-ca or the system ones
+*/
+static SSL_CTX *ke_context( void)
+{
+  static const uint8_t alpn[] = { 7, 'n', 't', 's', 'k', 'e', '/', '1' };
+
+  if( gCtx) return gCtx;
+  if( !(gCtx = SSL_CTX_new( TLS_client_method()))) return NULL;
+  SSL_CTX_set_min_proto_version( gCtx, TLS1_3_VERSION);
+  SSL_CTX_set_verify( gCtx, SSL_VERIFY_PEER, NULL);
+  if( SSL_CTX_set_alpn_protos( gCtx, alpn, sizeof(alpn)) != 0 ||
+      !(gAppOptions.m_ntsCa ? SSL_CTX_load_verify_locations( gCtx, gAppOptions.m_ntsCa, NULL)
+                            : SSL_CTX_set_default_verify_paths( gCtx))) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS: cannot load the trust anchors %s"),
+                 gAppOptions.m_ntsCa ? gAppOptions.m_ntsCa : "");
+    SSL_CTX_free( gCtx);
+    gCtx = NULL;
+  }
+  return gCtx;
+}
+
+/*!
+  \brief NTS-KE exchange on a connected socket
+  \return 0 if OK, else -1 and an error traced
+*/
+static int ke_exchange( nts_session_t *s, int fd)
+{
+  static const uint8_t request[] = {
+    0x80, eNTS_KE_NEXTPROTO, 0, 2, 0, 0,              // NTPv4
+    0x80, eNTS_KE_AEAD,      0, 2, 0, ktNTS_AEAD_SIV, // AEAD_AES_SIV_CMAC_256
+    0x80, eNTS_KE_END,       0, 0,
+  };
+  uint8_t head[4], body[ktNTS_MAXCOOKIE];
+  char server[ktHOSTNAMELEN + 1] = "";
+  const uint8_t *alpn = NULL;
+  unsigned alpnLen = 0;
+  int type, len, proto = -1, aead = -1, port = 0, err = -1;
+  SSL *ssl;
+
+  if( !ke_context() || !(ssl = SSL_new( gCtx))) return -1;
+  SSL_set_fd( ssl, fd);
+  if( inet_addr( s->m_host) == INADDR_NONE) {
+    SSL_set_tlsext_host_name( ssl, s->m_host);
+    SSL_set1_host( ssl, s->m_host);
+  }
+  else X509_VERIFY_PARAM_set1_ip_asc( SSL_get0_param( ssl), s->m_host);
+
+  if( SSL_connect( ssl) != 1) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: TLS handshake failed (%s)"), s->m_host,
+                 SSL_get_verify_result( ssl) != X509_V_OK ?
+                 X509_verify_cert_error_string( SSL_get_verify_result( ssl)) :
+                 ERR_reason_error_string( ERR_peek_last_error()));
+    goto DONE;
+  }
+  SSL_get0_alpn_selected( ssl, &alpn, &alpnLen);
+  if( alpnLen != 7 || memcmp( alpn, "ntske/1", 7)) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: not a NTS-KE server"), s->m_host);
+    goto DONE;
+  }
+  if( SSL_write( ssl, request, sizeof(request)) != (int)sizeof(request)) goto READ;
+
+  s->m_ncookies = 0;
+  for(;;) {
+    if( ke_read( ssl, head, 4) < 0) goto READ;
+    type = get16( head) & ~eNTS_KE_CRITICAL;
+    len  = get16( head + 2);
+    if( len > (int)sizeof(body) || ke_read( ssl, body, len) < 0) goto READ;
+    if( type == eNTS_KE_END) break;
+
+    switch( type) {
+    case eNTS_KE_NEXTPROTO: proto = (len >= 2) ? get16( body) : -1; break;
+    case eNTS_KE_AEAD:      aead  = (len >= 2) ? get16( body) : -1; break;
+    case eNTS_KE_ERROR:
+    case eNTS_KE_WARNING:
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: %s %d"), s->m_host,
+                   (type == eNTS_KE_ERROR) ? _("error") : _("warning"), (len >= 2) ? get16( body) : -1);
+      goto DONE;
+    case eNTS_KE_COOKIE:
+      if( len > 0 && s->m_ncookies < ktNTS_COOKIES) {
+        memcpy( s->m_cookie[s->m_ncookies], body, (size_t)len);
+        s->m_cookieLen[s->m_ncookies++] = len;
+      }
+      break;
+    case eNTS_KE_SERVER:
+      if( len > ktHOSTNAMELEN) len = ktHOSTNAMELEN;
+      memcpy( server, body, (size_t)len);
+      server[len] = '\0';
+      break;
+    case eNTS_KE_PORT:      port = (len >= 2) ? get16( body) : 0; break;
+    default:
+      if( get16( head) & eNTS_KE_CRITICAL) {
+        trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: unknown critical record %d"), s->m_host, type);
+        goto DONE;
+      }
+      break;
+    }
+  }
+  if( proto != 0 || aead != ktNTS_AEAD_SIV || !s->m_ncookies) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: no NTPv4 with AES-SIV, or no cookie"), s->m_host);
+    s->m_ncookies = 0;
+    goto DONE;
+  }
+  if( nts_export_keys( ssl, s->m_c2s, s->m_s2c) < 0) goto DONE;
+
+  /* the NTP server: the one told, else the NTS-KE server */
+  s->m_addr = s->m_id;
+  if( server[0]) {
+    struct hostent *he;
+
+    if( (s->m_addr.sin_addr.s_addr = inet_addr( server)) == INADDR_NONE) {
+      if( !(he = gethostbyname( server)) || he->h_addrtype != AF_INET) {
+        trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: cannot resolve %s"), s->m_host, server);
+        goto DONE;
+      }
+      memcpy( &s->m_addr.sin_addr, he->h_addr_list[0], sizeof(s->m_addr.sin_addr));
+    }
+  }
+  if( port) s->m_addr.sin_port = htons( port);
+  err = 0;
+  goto DONE;
+
+READ:
+  trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: connection lost"), s->m_host);
+DONE:
+  if( err < 0) s->m_ncookies = 0;
+  SSL_shutdown( ssl);
+  SSL_free( ssl);
+  return err;
+}
+#endif
+
+/*!
+  \brief new keys and cookies by a NTS-KE exchange
+  ******************************************************************
+
+  \param session the server
+  \return 0 if OK else -1
+*/
+int nts_ke( nts_session_t *session)
+{
+#ifdef HAVE_NTS
+  struct sockaddr_in addr = session->m_id;
+  struct timeval tv = { gAppOptions.m_timeout, 0 };
+  int fd;
+
+  session->m_ncookies = 0;
+  session->m_dirty    = 1;
+
+  addr.sin_port = htons( gAppOptions.m_ntsPort);
+  if( (fd = socket( PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if( connect( fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: cannot connect to port %d: %s"),
+                 session->m_host, gAppOptions.m_ntsPort, strerror( errno));
+    close( fd);
+    return -1;
+  }
+  if( ke_exchange( session, fd) < 0 ||
+      nts_aead_rekey( &session->m_seal, session->m_c2s) < 0 ||
+      nts_aead_rekey( &session->m_open, session->m_s2c) < 0) {
+    session->m_ncookies = 0;
+    close( fd);
+    return -1;
+  }
+  close( fd);
+
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("NTS-KE with %s: %d cookies, NTP server %s:%d"), session->m_host,
+               session->m_ncookies, inet_ntoa( session->m_addr.sin_addr), ntohs( session->m_addr.sin_port));
+  return 0;
+#else
+  trace_write( gAppTrace, eERROR_MSG_TYPE, _("NTS-KE with %s: built without TLS (libssl)"), session->m_host);
+  return -1;
+#endif
+}
+
+/*!
+  \brief session of a server, from the cache else by a key exchange
+  ******************************************************************
+
+  The session is kept even if the key exchange failed, it is tried
+  again by the next request.
+
+  \param host NTS-KE server name
+  \param addr its address
+  \return the session, NULL if too many servers
+*/
+nts_session_t *nts_open( const char *host, const struct sockaddr_in *addr)
+{
+  nts_session_t *s;
+
+  if( gNsessions >= ktMAXHOSTS) return NULL;
+  s = &gSessions[gNsessions++];
+  memset( s, 0, sizeof(*s));
+  strncpy( s->m_host, host, ktHOSTNAMELEN);
+  s->m_id   = *addr;
+  s->m_addr = *addr;
+
+  if( mkdir( gAppOptions.m_ntsDir, 0700) < 0 && errno != EEXIST) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot create %s: %s"), gAppOptions.m_ntsDir, strerror( errno));
+  }
+  if( cache_read( s) > 0) {
+    if( gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("NTS: %d cookies of %s from the cache"), s->m_ncookies, host);
+    }
+  }
+  else nts_ke( s);
+  return s;
+}
+
+/*!
+  \brief session of a server address given to nts_open(), or NULL
+*/
+nts_session_t *nts_find( const struct sockaddr_in *addr)
+{
+  int i;
+
+  for( i = 0; i < gNsessions; i++) {
+    if( gSessions[i].m_id.sin_addr.s_addr == addr->sin_addr.s_addr &&
+        gSessions[i].m_id.sin_port == addr->sin_port) return &gSessions[i];
+  }
+  return NULL;
+}
+
+/*!
+  \brief cookies left
+*/
+int nts_cookies( const nts_session_t *session)
+{
+  return session->m_ncookies;
+}
+
+/*!
+  \brief where to send the NTP requests
+*/
+const struct sockaddr_in *nts_address( const nts_session_t *session)
+{
+  return &session->m_addr;
+}
+
+#ifdef HAVE_NTS
+/*!
+  \brief append an extension field, padded to 4 bytes
+*/
+static int ef_put( uint8_t *packet, int len, int type, const uint8_t *body, int blen)
+{
+  int size = 4 + ((blen + 3) & ~3);
+
+  put16( packet + len, type);
+  put16( packet + len + 2, size);
+  memset( packet + len + 4, 0, (size_t)(size - 4));
+  if( body) memcpy( packet + len + 4, body, (size_t)blen);
+  return len + size;
+}
+#endif
+
+/*!
+  \brief add the NTS extension fields to a request
+  ******************************************************************
+
+  \param session the server, with a cookie left
+  \param packet  the request, its 48 bytes header set
+  \param size    room in packet
+  \return length of the request or -1
+*/
+int nts_request( nts_session_t *session, uint8_t *packet, int size)
+{
+#ifdef HAVE_NTS
+  uint8_t nonce[ktNTS_NONCELEN], *auth;
+  int i, c, len = sizeof(ntp_packet_t), need, holders;
+
+  if( !session->m_ncookies) return -1;
+  c = --session->m_ncookies;
+  session->m_dirty = 1;
+
+  /* ask for as many cookies as used, if they fit */
+  holders = ktNTS_COOKIES - 1 - session->m_ncookies;
+  need    = len + 4 + ktNTS_UIDLEN + 4 + ktNTS_AUTHLEN;
+  while( holders > 0 && need + (1 + holders) * (4 + ((session->m_cookieLen[c] + 3) & ~3)) > size) holders--;
+  if( need + 4 + ((session->m_cookieLen[c] + 3) & ~3) > size) return -1;
+
+  if( nts_random( session->m_uid, ktNTS_UIDLEN) < 0 || nts_random( nonce, sizeof(nonce)) < 0) return -1;
+  len = ef_put( packet, len, eNTS_EF_UID, session->m_uid, ktNTS_UIDLEN);
+  len = ef_put( packet, len, eNTS_EF_COOKIE, session->m_cookie[c], session->m_cookieLen[c]);
+  for( i = 0; i < holders; i++) len = ef_put( packet, len, eNTS_EF_PLACEHOLDER, NULL, session->m_cookieLen[c]);
+
+  /* authenticator: lengths, nonce, then the SIV of everything before it */
+  auth = packet + len;
+  put16( auth, eNTS_EF_AUTH);
+  put16( auth + 2, 4 + ktNTS_AUTHLEN);
+  put16( auth + 4, ktNTS_NONCELEN);
+  put16( auth + 6, 16);
+  memcpy( auth + 8, nonce, ktNTS_NONCELEN);
+  if( nts_seal( &session->m_seal, packet, len, nonce, ktNTS_NONCELEN, NULL, 0, auth + 8 + ktNTS_NONCELEN) != 16) return -1;
+  return len + 4 + ktNTS_AUTHLEN;
+#else
+  (void)session; (void)packet; (void)size;
+  return -1;
+#endif
+}
+
+/*!
+  \brief check a reply and keep its cookies
+  ******************************************************************
+
+  \param session the server
+  \param packet  the reply
+  \param len     its length
+  \return nts_status
+*/
+int nts_reply( nts_session_t *session, const uint8_t *packet, int len)
+{
+  const ntp_packet_t *head = (const ntp_packet_t *)packet;
+  uint8_t plain[ktNTS_MSGLEN];
+  const uint8_t *p;
+  int pos, type, size, uid = 0, auth = -1, nlen, clen, n;
+
+  for( pos = sizeof(ntp_packet_t); pos + 4 <= len; pos += size) {
+    type = get16( packet + pos);
+    size = get16( packet + pos + 2);
+    if( size < 4 || size % 4 || pos + size > len) return eNTS_BAD;
+    if( type == eNTS_EF_UID && size == 4 + ktNTS_UIDLEN && !memcmp( packet + pos + 4, session->m_uid, ktNTS_UIDLEN)) uid = 1;
+    else if( type == eNTS_EF_AUTH) {
+      auth = pos;
+      break;
+    }
+  }
+  if( !uid) return eNTS_NONE;
+
+  /* the only Kiss-o'-Death believed without authenticator */
+  if( head->stratum == 0 && !memcmp( &head->refId, "NTSN", 4)) {
+    session->m_ncookies = 0;
+    session->m_dirty    = 1;
+    return eNTS_NAK;
+  }
+  if( auth < 0) return eNTS_BAD;
+
+  p    = packet + auth;
+  nlen = get16( p + 4);
+  clen = get16( p + 6);
+  if( size < 8 + ((nlen + 3) & ~3) + ((clen + 3) & ~3)) return eNTS_BAD;
+  if( (n = nts_unseal( &session->m_open, packet, auth, p + 8, nlen,
+                       p + 8 + ((nlen + 3) & ~3), clen, plain)) < 0) return eNTS_BAD;
+
+  /* the encrypted fields: new cookies */
+  for( pos = 0; pos + 4 <= n; pos += size) {
+    type = get16( plain + pos);
+    size = get16( plain + pos + 2);
+    if( size < 4 || pos + size > n) break;
+    if( type == eNTS_EF_COOKIE && size > 4 && size - 4 <= ktNTS_MAXCOOKIE && session->m_ncookies < ktNTS_COOKIES) {
+      memcpy( session->m_cookie[session->m_ncookies], plain + pos + 4, (size_t)(size - 4));
+      session->m_cookieLen[session->m_ncookies++] = size - 4;
+    }
+  }
+  session->m_dirty = 1;
+  return eNTS_OK;
+}
+
+/*!
+  \brief write the sessions changed into the cache
+*/
+void nts_save( void)
+{
+  int i;
+
+  for( i = 0; i < gNsessions; i++) {
+    if( gSessions[i].m_dirty && cache_write( &gSessions[i]) == 0) gSessions[i].m_dirty = 0;
+  }
+}
+
+/*!
+  \brief save and forget the sessions of the servers no longer queried
+  ******************************************************************
+
+  A reloaded configuration may drop servers or move them to another
+  port: their slots are freed for the servers of the new one.
+
+  \param servers addresses of the servers queried, as given to nts_open()
+  \param n       their number
+*/
+void nts_release( const struct sockaddr_in *servers, int n)
+{
+  int i, j;
+
+  for( i = 0; i < gNsessions; ) {
+    for( j = 0; j < n; j++) {
+      if( gSessions[i].m_id.sin_addr.s_addr == servers[j].sin_addr.s_addr &&
+          gSessions[i].m_id.sin_port == servers[j].sin_port) break;
+    }
+    if( j < n) {
+      i++;
+      continue;
+    }
+    if( gSessions[i].m_dirty) cache_write( &gSessions[i]);
+    nts_aead_free( &gSessions[i].m_seal);
+    nts_aead_free( &gSessions[i].m_open);
+    // the last session takes the slot
+    gSessions[i] = gSessions[--gNsessions];
+    memset( &gSessions[gNsessions], 0, sizeof(gSessions[0]));
+  }
+}
+
+/*!
+  \brief save and forget the sessions
+*/
+void nts_close( void)
+{
+  int i;
+
+  nts_save();
+  for( i = 0; i < gNsessions; i++) {
+    nts_aead_free( &gSessions[i].m_seal);
+    nts_aead_free( &gSessions[i].m_open);
+  }
+  memset( gSessions, 0, sizeof(gSessions));
+  gNsessions = 0;
+#ifdef HAVE_NTS
+  SSL_CTX_free( gCtx);
+  gCtx = NULL;
+#endif
+}
@@ -0,0 +1,122 @@
+/**
+ * \file nts.h
+ * \brief Network Time Security client (RFC 8915) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef NTS_H_
+#define NTS_H_
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+/* NTS-KE needs TLS 1.3 (libssl), AES-SIV is built on libcrypto */
+#if defined(HAVE_OPENSSL_SSL_H) && defined(HAVE_LIBSSL) && defined(HAVE_LIBCRYPTO)
+#  define HAVE_NTS 1
+#endif
+
+#define ktNTS_KE_PORT      4460  /*!< NTS-KE TCP port (--nts-port)               */
+#define ktNTS_COOKIES         8  /*!< cookies kept per server                    */
+#define ktNTS_MAXCOOKIE     256  /*!< longest cookie (bytes)                     */
+#define ktNTS_KEYLEN         32  /*!< AEAD_AES_SIV_CMAC_256 key                  */
+#define ktNTS_NONCELEN       16  /*!< nonce of our authenticators                */
+#define ktNTS_UIDLEN         32  /*!< unique identifier of a request             */
+#define ktNTS_MSGLEN       1280  /*!< longest NTS packet, placeholders included  */
+#define ktNTS_RANDPOOL     4096  /*!< random bytes drawn at once (nts_random())  */
+
+#define ktNTS_AEAD_SIV       15  /*!< AEAD_AES_SIV_CMAC_256 (IANA)               */
+
+/*!
+  \enum nts_ef_type
+  \brief NTP extension fields of NTS
+  ******************************************************************
+*/
+typedef enum nts_ef_type {
+  eNTS_EF_UID         = 0x0104,  /*!< unique identifier, echoed by the server    */
+  eNTS_EF_COOKIE      = 0x0204,  /*!< a cookie                                   */
+  eNTS_EF_PLACEHOLDER = 0x0304,  /*!< asks for one more cookie                   */
+  eNTS_EF_AUTH        = 0x0404,  /*!< authenticator and encrypted fields         */
+
+}nts_ef_type;
+
+/*!
+  \enum nts_ke_record
+  \brief NTS-KE record types, the high bit marks critical ones
+  ******************************************************************
+*/
+typedef enum nts_ke_record {
+  eNTS_KE_END      = 0,          /*!< end of message                             */
+  eNTS_KE_NEXTPROTO,             /*!< next protocol, 0 for NTPv4                 */
+  eNTS_KE_ERROR,                 /*!< error code                                 */
+  eNTS_KE_WARNING,               /*!< warning code                               */
+  eNTS_KE_AEAD,                  /*!< AEAD algorithms                            */
+  eNTS_KE_COOKIE,                /*!< a cookie                                   */
+  eNTS_KE_SERVER,                /*!< NTP server name or address                 */
+  eNTS_KE_PORT,                  /*!< NTP server port                            */
+  eNTS_KE_CRITICAL = 0x8000,     /*!< critical bit                               */
+
+}nts_ke_record;
+
+/*!
+  \enum nts_status
+  \brief result of nts_reply()
+  ******************************************************************
+*/
+typedef enum nts_status {
+  eNTS_OK    =  0,               /*!< reply authenticated, cookies stored        */
+  eNTS_NONE  = -1,               /*!< not the reply of our request (UID)         */
+  eNTS_BAD   = -2,               /*!< authenticator missing or wrong             */
+  eNTS_NAK   = -3,               /*!< Kiss-o'-Death NTSN: cookies refused        */
+
+}nts_status;
+
+/*!
+  \struct nts_aead_t
+  \brief AEAD_AES_SIV_CMAC_256 (RFC 5297) keyed contexts
+  ******************************************************************
+*/
+typedef struct nts_aead_t {
+  void    *m_cbc;                /*!< AES-128-CBC with the MAC key (S2V)         */
+  void    *m_ctr;                /*!< AES-128-ECB with the encryption key (CTR)  */
+  uint8_t  m_k1[16];             /*!< CMAC subkeys                               */
+  uint8_t  m_k2[16];
+  uint8_t  m_d0[16];             /*!< CMAC of the zero block, first S2V value    */
+  uint8_t  m_chain[16];          /*!< CBC chaining value left in m_cbc           */
+  uint8_t  m_key[ktNTS_KEYLEN];  /*!< key of the contexts                        */
+
+} nts_aead_t;
+
+/*! a server: its keys and cookies */
+typedef struct nts_session_t nts_session_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+nts_session_t *nts_open   ( const char *host, const struct sockaddr_in *addr);
+nts_session_t *nts_find   ( const struct sockaddr_in *addr);
+int            nts_ke     ( nts_session_t *session);
+int            nts_cookies( const nts_session_t *session);
+const struct sockaddr_in *nts_address( const nts_session_t *session);
+int            nts_request( nts_session_t *session, uint8_t *packet, int size);
+int            nts_reply  ( nts_session_t *session, const uint8_t *packet, int len);
+void           nts_save   ( void);
+void           nts_release( const struct sockaddr_in *servers, int n);
+void           nts_close  ( void);
+
+int            nts_aead_init( nts_aead_t *aead, const uint8_t key[ktNTS_KEYLEN]);
+int            nts_aead_rekey( nts_aead_t *aead, const uint8_t key[ktNTS_KEYLEN]);
+void           nts_aead_free( nts_aead_t *aead);
+int            nts_seal   ( nts_aead_t *aead, const uint8_t *ad, int adlen, const uint8_t *nonce, int nlen,
+                            const uint8_t *in, int len, uint8_t *out);
+int            nts_unseal ( nts_aead_t *aead, const uint8_t *ad, int adlen, const uint8_t *nonce, int nlen,
+                            const uint8_t *in, int len, uint8_t *out);
+int            nts_export_keys( void *ssl, uint8_t c2s[ktNTS_KEYLEN], uint8_t s2c[ktNTS_KEYLEN]);
+const char    *nts_status_name( int status);
+int            nts_random ( uint8_t *buf, int len);
+
+#endif /* NTS_H_ */
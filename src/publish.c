@@ -0,0 +1,120 @@
+/**
+ * \file publish.c
+ * \brief publication of the clock state in shared memory
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --publish FILE, every update of the clock is written into FILE
+ * mapped in memory (see zntpclock.h for the layout and the reader).
+ * There is one writer, the daemon loop; readers are not known and
+ * never block it.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "publish.h"
+
+/* -- GLOBALES -- */
+extern trace_desc_t* gAppTrace;
+
+static zntp_clock_page_t *gPage = NULL;  /*!< the mapped file                  */
+
+/*!
+  \brief create (or reuse) and map the file, told not synchronized
+  ******************************************************************
+
+  \param path the file, readable by all
+  \return 0 if OK or -1 if failed
+*/
+int publish_open( const char *path)
+{
+  zntp_clock_t clock;
+  void *page;
+  int fd;
+
+  fd = open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if( fd < 0 || ftruncate( fd, sizeof(zntp_clock_page_t)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot publish to %s: %s"), path, strerror( errno));
+    if( fd >= 0) close( fd);
+    return -1;
+  }
+  page = mmap( NULL, sizeof(zntp_clock_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close( fd);
+  if( page == MAP_FAILED) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot publish to %s: %s"), path, strerror( errno));
+    return -1;
+  }
+  gPage = (zntp_clock_page_t *)page;
+
+  /* a previous run may have left a state: readers wait for the new one */
+  __atomic_store_n( &gPage->m_magic, 0, __ATOMIC_RELEASE);
+  gPage->m_version = ZNTP_CLOCK_VERSION;
+  if( gPage->m_seq & 1) gPage->m_seq++;
+
+  memset( &clock, 0, sizeof(clock));
+  clock.m_leap      = 3;
+  clock.m_stratum   = 16;
+  clock.m_error     = 16;                  // NTP MAXDISP
+  clock.m_errorRate = ktPUBLISH_ERRORRATE;
+  publish_update( &clock);
+  __atomic_store_n( &gPage->m_magic, ZNTP_CLOCK_MAGIC, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/*!
+  \brief publish a new state
+  ******************************************************************
+
+  \param clock the state, m_updateReal and m_updateMono are set here
+*/
+void publish_update( const zntp_clock_t *clock)
+{
+  struct timespec real, mono;
+  uint32_t seq;
+
+  if( !gPage) return;
+
+  clock_gettime( CLOCK_REALTIME, &real);
+  clock_gettime( CLOCK_MONOTONIC, &mono);
+
+  seq = gPage->m_seq;
+  __atomic_store_n( &gPage->m_seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence( __ATOMIC_RELEASE);
+  memcpy( &gPage->m_clock, clock, sizeof(gPage->m_clock));
+  gPage->m_clock.m_updateReal = (int64_t)real.tv_sec * 1000000000 + real.tv_nsec;
+  gPage->m_clock.m_updateMono = (int64_t)mono.tv_sec * 1000000000 + mono.tv_nsec;
+  __atomic_store_n( &gPage->m_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*!
+  \brief unmap the file, readers keep the last state
+*/
+void publish_close( void)
+{
+  if( gPage) munmap( gPage, sizeof(*gPage));
+  gPage = NULL;
+}
@@ -0,0 +1,26 @@
+/**
+ * \file publish.h
+ * \brief publication of the clock state in shared memory header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef PUBLISH_H_
+#define PUBLISH_H_
+
+#include "zntpclock.h"
+
+#define ktPUBLISH_ERRORRATE  15e-6  /*!< error bound growth (NTP PHI), s/s       */
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int  publish_open  ( const char *path);
+void publish_update( const zntp_clock_t *clock);
+void publish_close ( void);
+
+#endif /* PUBLISH_H_ */
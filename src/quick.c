@@ -0,0 +1,505 @@
+/**
+ * \file quick.c
+ * \brief quick synchronization within a time budget (--quick)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * At boot or at the start of a container, the clock should be close at
+ * once and precise soon after, and the command must not outlast its
+ * budget (e.g. 300 ms) whatever the name servers and the network do:
+ *
+ *  - the names are resolved by threads, which are given up at the end
+ *    of the budget; a server is queried as soon as its address is known
+ *    (addresses are used at once),
+ *  - all the servers are queried together, then every budget / 8, from
+ *    a single socket waited on with the time left as timeout; a reply
+ *    is matched to one of the requests of its server,
+ *  - the first plausible reply (stratum 1-15, root distance below
+ *    ktQUICK_MAXDIST) steps the clock if it is off by more than 128 ms,
+ *  - at the end, the replies of each server (the ones of requests sent
+ *    before the step brought to the new clock) go through the filter
+ *    and the selection of the synchronization engine, and the refined
+ *    offset is slewed, or stepped if the first reply was a falseticker.
+ *
+ * The clock is only slewed by the kernel after the command ended.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "timing.h"
+#include "auth.h"
+#include "netio.h"
+#include "quick.h"
+
+/*!
+  \struct quick_dns_t
+  \brief a name resolved by a thread
+*/
+typedef struct quick_dns_t {
+  char           m_host[ktHOSTNAMELEN+1]; /*!< the name                          */
+  struct in_addr m_addr;         /*!< its address, when written to the pipe      */
+  int            m_ok;           /*!< resolved                                   */
+
+} quick_dns_t;
+
+/*!
+  \struct quick_server_t
+  \brief a server and its replies
+*/
+typedef struct quick_server_t {
+  struct sockaddr_in m_addr;     /*!< address, NTP port                          */
+  int          m_state;          /*!< 0: resolving, 1: queried, -1: given up     */
+  ntp_ts_t     m_t1[ktQUICK_SAMPLES];   /*!< requests sent, 0 once answered      */
+  double       m_sentCorr[ktQUICK_SAMPLES]; /*!< corrections done before each    */
+  int          m_sent;           /*!< requests sent                              */
+  double       m_next;           /*!< monotonic time of the next request         */
+  ntp_sample_t m_samples[ktQUICK_SAMPLES];  /*!< replies                         */
+  double       m_corr[ktQUICK_SAMPLES];     /*!< corrections done when each came */
+  int          m_count;          /*!< replies                                    */
+
+} quick_server_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+/*
+ * Threads still resolving at the end of the budget are not waited for:
+ * what they write stays valid until the exit, and the pipe is never
+ * closed so that they cannot get SIGPIPE.
+ */
+static quick_dns_t gDns[ktSYNC_MAXPEERS];
+static int         gDnsPipe[2] = { -1, -1 };
+
+/*!
+  \brief resolve a name, then tell its index through the pipe
+*/
+static void *resolver( void *arg)
+{
+  quick_dns_t *dns = (quick_dns_t *)arg;
+  struct addrinfo hints, *res = NULL;
+  uint8_t index = (uint8_t)(dns - gDns);
+
+  memset( &hints, 0, sizeof(hints));
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if( getaddrinfo( dns->m_host, NULL, &hints, &res) == 0 && res) {
+    dns->m_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    dns->m_ok   = 1;
+  }
+  if( res) freeaddrinfo( res);
+  if( write( gDnsPipe[1], &index, 1) < 0) return NULL;
+  return NULL;
+}
+
+/*!
+  \brief start resolving the servers, addresses are taken at once
+  ******************************************************************
+
+  \param servers the servers
+  \param n       their number
+  \return names being resolved
+*/
+static int resolve_start( quick_server_t *servers, int n)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int i, pending = 0;
+
+  if( gDnsPipe[0] < 0 && pipe( gDnsPipe) < 0) gDnsPipe[0] = -1;
+  if( gDnsPipe[0] >= 0) {
+    fcntl( gDnsPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl( gDnsPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl( gDnsPipe[1], F_SETFD, FD_CLOEXEC);
+  }
+  pthread_attr_init( &attr);
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED);
+
+  for( i = 0; i < n; i++) {
+    servers[i].m_addr.sin_family = AF_INET;
+    servers[i].m_addr.sin_port   = htons( gAppOptions.m_port);
+    if( inet_aton( gAppOptions.m_hosts[i], &servers[i].m_addr.sin_addr)) {
+      servers[i].m_state = 1;
+      continue;
+    }
+    strncpy( gDns[i].m_host, gAppOptions.m_hosts[i], ktHOSTNAMELEN);
+    gDns[i].m_ok = 0;
+    if( gDnsPipe[0] < 0 || pthread_create( &thread, &attr, resolver, &gDns[i])) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot resolve %s"), gAppOptions.m_hosts[i]);
+      servers[i].m_state = -1;
+      continue;
+    }
+    pending++;
+  }
+  pthread_attr_destroy( &attr);
+  return pending;
+}
+
+/*!
+  \brief take the names resolved meanwhile
+  ******************************************************************
+
+  \param servers the servers
+  \param now     monotonic time
+  \return names resolved or given up
+*/
+static int resolve_done( quick_server_t *servers, double now)
+{
+  uint8_t index;
+  int got = 0;
+
+  while( read( gDnsPipe[0], &index, 1) == 1) {
+    if( index >= ktSYNC_MAXPEERS) continue;
+    got++;
+    if( !gDns[index].m_ok) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot resolve %s"), gAppOptions.m_hosts[index]);
+      servers[index].m_state = -1;
+      continue;
+    }
+    servers[index].m_addr.sin_addr = gDns[index].m_addr;
+    servers[index].m_state = 1;
+    servers[index].m_next  = now;
+    if( gAppOptions.m_verbose) {
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s is %s"), gAppOptions.m_hosts[index],
+                   inet_ntoa( gDns[index].m_addr));
+    }
+  }
+  return got;
+}
+
+/*!
+  \brief send the next request to a server
+  ******************************************************************
+
+  \param s       UDP socket
+  \param server  the server
+  \param key     key of the MAC or NULL
+  \param applied corrections done so far (s)
+*/
+static void request( int s, quick_server_t *server, const auth_key_t *key, double applied)
+{
+  uint8_t out[ktQUICK_BUFSIZE];
+  ntp_ts_t t1 = ntp_ts_now();
+  int len;
+
+  ntp_request_build( (ntp_packet_t *)out, t1);
+  len = key ? auth_sign( key, out, sizeof(ntp_packet_t)) : (int)sizeof(ntp_packet_t);
+  if( sendto( s, out, (size_t)len, 0, (const struct sockaddr *)&server->m_addr, sizeof(server->m_addr)) != len) {
+    if( gAppOptions.m_verbose) trace_write( gAppTrace, eWARNING_MSG_TYPE, "sendto(): %s", strerror( errno));
+  }
+  server->m_t1[server->m_sent]       = t1;
+  server->m_sentCorr[server->m_sent] = applied;
+  server->m_sent++;
+}
+
+/*!
+  \brief read a reply, if any
+  ******************************************************************
+
+  \param s       UDP socket
+  \param servers the servers
+  \param n       their number
+  \param applied corrections done so far (s)
+  \param sample  where to put the reply, relative to the clock now
+  \return index of its server, -1 if nothing usable, -2 if nothing left
+*/
+static int reply( int s, quick_server_t *servers, int n, double applied, ntp_sample_t *sample)
+{
+  union {
+    struct cmsghdr m_align;
+    uint8_t        m_buf[128];
+  } ctrl;                                    // kernel receive time-stamps
+  uint8_t in[ktQUICK_BUFSIZE];
+  const ntp_packet_t *packet = (const ntp_packet_t *)in;
+  struct sockaddr_in from;
+  struct msghdr hdr;
+  struct iovec iov;
+  struct timespec stamp;
+  quick_server_t *server;
+  ntp_ts_t t4, org;
+  uint32_t keyId;
+  int i, k, len;
+
+  memset( &hdr, 0, sizeof(hdr));
+  iov.iov_base       = in;
+  iov.iov_len        = sizeof(in);
+  hdr.msg_name       = &from;
+  hdr.msg_namelen    = sizeof(from);
+  hdr.msg_iov        = &iov;
+  hdr.msg_iovlen     = 1;
+  hdr.msg_control    = &ctrl;
+  hdr.msg_controllen = sizeof(ctrl);
+  if( (len = (int)recvmsg( s, &hdr, MSG_DONTWAIT)) < 0) return -2;
+  netio_rx_stamp( &hdr, &stamp);
+  t4 = stamp.tv_sec ? ntp_ts_from_timespec( &stamp) : ntp_ts_now();
+
+  if( len < (int)sizeof(ntp_packet_t) || NTP_MODE( packet->li_vn_mode) != NTP_MODE_SERVER) return -1;
+  for( i = 0; i < n; i++) {
+    if( servers[i].m_state > 0 && servers[i].m_addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+        servers[i].m_addr.sin_port == from.sin_port) break;
+  }
+  if( i == n) return -1;
+  server = &servers[i];
+
+  // the reply of one of our requests, once
+  org = ntp_ts_get( packet->origTm_s, packet->origTm_f);
+  for( k = 0; k < server->m_sent && server->m_t1[k] != org; k++);
+  if( k == server->m_sent || !org) return -1;
+  server->m_t1[k] = 0;
+
+  if( gAppOptions.m_keyId && (auth_verify( in, len, &keyId) != eAUTH_OK || keyId != gAppOptions.m_keyId)) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Reply not authenticated (%s)"), gAppOptions.m_hosts[i]);
+    return -1;
+  }
+  if( packet->stratum == 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Kiss-o'-Death received: %.4s"), (const char *)&packet->refId);
+    server->m_state = -1;
+    return -1;
+  }
+  if( NTP_LI( packet->li_vn_mode) == NTP_LI_ALARM || packet->stratum >= 16 || !packet->rxTm_s || !packet->txTm_s) {
+    return -1;
+  }
+
+  memset( sample, 0, sizeof(*sample));
+  sample->m_t1        = org;
+  sample->m_t2        = ntp_ts_get( packet->rxTm_s, packet->rxTm_f);
+  sample->m_t3        = ntp_ts_get( packet->txTm_s, packet->txTm_f);
+  sample->m_t4        = t4;
+  sample->m_leap      = NTP_LI( packet->li_vn_mode);
+  sample->m_stratum   = packet->stratum;
+  sample->m_refId     = ntohl( packet->refId);
+  sample->m_rootDelay = ntp_short_to_secs( packet->rootDelay);
+  sample->m_rootDisp  = ntp_short_to_secs( packet->rootDispersion);
+
+  // a step between the request and the reply: T1 on the new clock
+  if( !gAppOptions.m_debug) sample->m_t1 = ntp_ts_add( sample->m_t1, applied - server->m_sentCorr[k]);
+  ntp_sample_compute( sample);
+  // debug mode: the clock was not corrected
+  if( gAppOptions.m_debug) sample->m_offset -= applied;
+  return i;
+}
+
+/*!
+  \brief is a reply good enough to step the clock on?
+*/
+static int plausible( const ntp_sample_t *sample)
+{
+  return sample->m_delay >= 0 &&
+         sample->m_delay / 2 + sample->m_rootDelay / 2 + sample->m_rootDisp < ktQUICK_MAXDIST;
+}
+
+/*!
+  \brief all the servers are done, nothing to wait for
+*/
+static int finished( const quick_server_t *servers, int n)
+{
+  int i, k;
+
+  for( i = 0; i < n; i++) {
+    if( !servers[i].m_state) return 0;
+    if( servers[i].m_state < 0) continue;
+    if( servers[i].m_sent < ktQUICK_SAMPLES) return 0;
+    for( k = 0; k < servers[i].m_sent; k++) if( servers[i].m_t1[k]) return 0;
+  }
+  return 1;
+}
+
+/*!
+  \brief synchronize the clock within a time budget
+  ******************************************************************
+
+  \param s      UDP socket
+  \param clock  the clock corrected
+  \param start  monotonic time the budget started at
+  \param budget the budget (ms)
+  \param result what was done
+  \return 0 if OK, -1 if no server answered in time or -2 if the servers
+          did not agree
+*/
+int quick_sync( int s, const sync_clock_t *clock, double start, int budget, quick_result_t *result)
+{
+  static quick_server_t servers[ktSYNC_MAXPEERS];
+  const auth_key_t *key = gAppOptions.m_keyId ? auth_find( gAppOptions.m_keyId) : NULL;
+  sync_engine_t engine;
+  sync_result_t refined;
+  ntp_sample_t sample;
+  struct timeval tv;
+  fd_set fds;
+  double end = start + budget / 1e3 - ktQUICK_RESERVE, spacing = budget / 1e3 / ktQUICK_SAMPLES;
+  double now, wake, applied = 0, shift = 0;
+  int i, k, n, fd, shifted = 0;
+
+  memset( result, 0, sizeof(*result));
+  memset( servers, 0, sizeof(servers));
+  result->m_first  = -1;
+  result->m_action = eSYNC_NOSOURCE;
+
+  n = (gAppOptions.m_nhosts > ktSYNC_MAXPEERS) ? ktSYNC_MAXPEERS : gAppOptions.m_nhosts;
+  i = 1;
+  setsockopt( s, SOL_SOCKET, SO_TIMESTAMPNS, &i, sizeof(i));
+  resolve_start( servers, n);
+
+  while( (now = timing_now()) < end && !finished( servers, n)) {
+    // requests due, the next one of each server
+    wake = end;
+    for( i = 0; i < n; i++) {
+      if( servers[i].m_state <= 0 || servers[i].m_sent >= ktQUICK_SAMPLES) continue;
+      if( servers[i].m_next <= now) {
+        request( s, &servers[i], key, applied);
+        servers[i].m_next = now + spacing;
+      }
+      if( servers[i].m_sent < ktQUICK_SAMPLES && servers[i].m_next < wake) wake = servers[i].m_next;
+    }
+
+    FD_ZERO( &fds);
+    FD_SET( s, &fds);
+    fd = s;
+    if( gDnsPipe[0] >= 0) {
+      FD_SET( gDnsPipe[0], &fds);
+      if( gDnsPipe[0] > fd) fd = gDnsPipe[0];
+    }
+    wake -= timing_now();
+    if( wake < 0) wake = 0;
+    tv.tv_sec  = (time_t)wake;
+    tv.tv_usec = (suseconds_t)((wake - tv.tv_sec) * 1e6);
+    if( select( fd + 1, &fds, NULL, NULL, &tv) <= 0) continue;
+
+    if( gDnsPipe[0] >= 0 && FD_ISSET( gDnsPipe[0], &fds)) resolve_done( servers, timing_now());
+    if( !FD_ISSET( s, &fds)) continue;
+
+    // a flood of replies must not outlast the budget
+    while( timing_now() < end && (i = reply( s, servers, n, applied, &sample)) != -2) {
+      if( i < 0 || servers[i].m_count >= ktQUICK_SAMPLES) continue;
+      // the wanted local time (-E, -O), the same for the whole run
+      if( !shifted) {
+        shift   = time_shift( ntp_ts_to_time( sample.m_t3));
+        shifted = 1;
+      }
+      sample.m_offset += shift;
+      if( gAppOptions.m_verbose) {
+        trace_write( gAppTrace, eINFO_IN_MSG_TYPE, _("%s: offset %+.6fs, delay %.6fs"), gAppOptions.m_hosts[i],
+                     sample.m_offset, sample.m_delay);
+      }
+      servers[i].m_samples[servers[i].m_count] = sample;
+      servers[i].m_corr[servers[i].m_count++]  = applied;
+      result->m_samples++;
+
+      // close at once: the first plausible reply
+      if( result->m_first >= 0 || !plausible( &sample)) continue;
+      result->m_first = timing_now() - start;
+      if( fabs( sample.m_offset) < ktSYNC_STEP_THRESHOLD) continue;
+      if( (k = clock->m_step( clock->m_ctx, sample.m_offset)) != 0) {
+        trace_write( gAppTrace, eERROR_MSG_TYPE, _("Unable to set time of day: %s"), strerror( k));
+        continue;
+      }
+      applied += sample.m_offset;
+      result->m_step = sample.m_offset;
+      trace_write( gAppTrace, eINFO_MSG_TYPE, _("Clock stepped by %+.6fs after %.0fms (%s)"),
+                   sample.m_offset, result->m_first * 1e3, gAppOptions.m_hosts[i]);
+    }
+  }
+
+  /*
+   * then precise: the replies of all the servers through the engine
+   ***************************************************************************
+   */
+  sync_init( &engine, clock, n, eSYNC_STRATEGY_MEASURE, eSYNC_FILTER_MINDELAY, budget / 1e3);
+  for( i = 0; i < n; i++) {
+    if( servers[i].m_count) result->m_servers++;
+    for( k = 0; k < servers[i].m_count; k++) {
+      sample = servers[i].m_samples[k];
+      sample.m_offset -= applied - servers[i].m_corr[k];
+      sync_add_sample( &engine, i, &sample);
+    }
+  }
+  result->m_elapsed = timing_now() - start;
+  if( !result->m_servers) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("No server answered within %dms"), budget);
+    return -1;
+  }
+  if( sync_update( &engine, &refined) == eSYNC_NOSOURCE) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("No majority of servers within %dms, %d replies of %d servers"),
+                 budget, result->m_samples, result->m_servers);
+    return -2;
+  }
+  result->m_offset    = refined.m_offset;
+  result->m_jitter    = refined.m_jitter;
+  result->m_survivors = refined.m_survivors;
+
+  // a first reply from a falseticker is undone by a step
+  if( fabs( refined.m_offset) >= ktSYNC_STEP_THRESHOLD) {
+    result->m_action = eSYNC_STEP;
+    k = clock->m_step( clock->m_ctx, refined.m_offset);
+  }
+  else if( refined.m_offset != 0) {
+    result->m_action = eSYNC_SLEW;
+    k = clock->m_slew( clock->m_ctx, refined.m_offset);
+  }
+  else {
+    result->m_action = eSYNC_NONE;
+    k = 0;
+  }
+  if( k) {
+    result->m_action = eSYNC_ERROR;
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Unable to set time of day: %s"), strerror( k));
+    return -1;
+  }
+  result->m_elapsed = timing_now() - start;
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Clock %s by %+.6fs, jitter %.6fs"),
+               (result->m_action == eSYNC_STEP) ? _("stepped") : _("slewed"), refined.m_offset, refined.m_jitter);
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("%d replies of %d servers, %d kept, in %.1fms"),
+               result->m_samples, result->m_servers, refined.m_survivors, result->m_elapsed * 1e3);
+  return 0;
+}
+
+/*!
+  \brief write what was done as a JSON line (--stats)
+  ******************************************************************
+
+  \param out    the stream
+  \param result result of quick_sync()
+  \param budget the budget (ms)
+  \param now    UTC time
+*/
+void quick_write_json( FILE *out, const quick_result_t *result, int budget, time_t now)
+{
+  fprintf( out, "{\"type\":\"quick\",\"time\":%ld,\"budget_ms\":%d,\"elapsed_ms\":%.3f,\"first_ms\":%.3f,"
+                "\"step\":%.6f,\"offset\":%.6f,\"jitter\":%.6f,\"action\":\"%s\","
+                "\"samples\":%d,\"servers\":%d,\"survivors\":%d}\n",
+           (long)now, budget, result->m_elapsed * 1e3, result->m_first * 1e3, result->m_step,
+           result->m_offset, result->m_jitter,
+           (result->m_action == eSYNC_STEP) ? "step" : (result->m_action == eSYNC_SLEW) ? "slew" :
+           (result->m_action == eSYNC_NONE) ? "none" : (result->m_action == eSYNC_ERROR) ? "error" : "nosource",
+           result->m_samples, result->m_servers, result->m_survivors);
+  fflush( out);
+}
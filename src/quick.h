@@ -0,0 +1,51 @@
+/**
+ * \file quick.h
+ * \brief quick synchronization within a time budget (--quick) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef QUICK_H_
+#define QUICK_H_
+
+#include <stdio.h>
+#include <time.h>
+
+#include "sync.h"
+
+#define ktQUICK_MINBUDGET  10     /*!< shortest budget (ms)                       */
+#define ktQUICK_SAMPLES     8     /*!< requests to each server at most            */
+#define ktQUICK_RESERVE 0.002     /*!< end of the budget kept for the last slew (s) */
+#define ktQUICK_MAXDIST   1.5     /*!< root distance of a plausible reply (s)     */
+#define ktQUICK_BUFSIZE   512     /*!< largest reply read (MAC included)          */
+
+/*!
+  \struct quick_result_t
+  \brief what a quick synchronization did
+  ******************************************************************
+*/
+typedef struct quick_result_t {
+  int         m_servers;         /*!< servers which answered                     */
+  int         m_samples;         /*!< replies used                               */
+  double      m_first;           /*!< first plausible reply, seconds after the
+                                      start, <0 if none                          */
+  double      m_step;            /*!< step done on it (s), 0 if none             */
+  sync_action m_action;          /*!< what was done with the refined offset      */
+  double      m_offset;          /*!< refined offset, after the first step (s)   */
+  double      m_jitter;          /*!< its jitter (s)                             */
+  int         m_survivors;       /*!< servers kept by the selection              */
+  double      m_elapsed;         /*!< time used (s)                              */
+
+} quick_result_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int  quick_sync      ( int s, const sync_clock_t *clock, double start, int budget, quick_result_t *result);
+void quick_write_json( FILE *out, const quick_result_t *result, int budget, time_t now);
+
+#endif /* QUICK_H_ */
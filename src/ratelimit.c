@@ -0,0 +1,200 @@
+/**
+ * \file ratelimit.c
+ * \brief per-client rate limiting of the server
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Like "restrict limited" of ntpd, a client may send a burst of
+ * requests then one every 'average' seconds; above, its requests are
+ * dropped, the first one being answered by a Kiss-o'-Death RATE if
+ * asked.
+ *
+ * Each client has a score (leaky bucket): +1 per request, -1 every
+ * 'average' seconds, limited when above 'burst'. Clients live in a
+ * fixed table of cache line sized buckets of 8 clients; a new client
+ * takes the place of the one idle for the longest time of its bucket,
+ * so memory does not depend on the number of clients.
+ *
+ * A client is one 64 bits word updated by compare-and-swap, server
+ * threads never lock. The check reads and writes one cache line.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ratelimit.h"
+
+#define TIME_BITS    22
+#define TIME_MASK    ((1U << TIME_BITS) - 1)
+#define SCORE_BITS   10
+#define SCORE_MASK   ((1U << SCORE_BITS) - 1)
+#define CAS_TRIES    4               /*!< give up (and answer) after n races  */
+
+#define ENTRY(addr, time, score) ( (uint64_t)(addr) << 32 | (uint64_t)((time) & TIME_MASK) << SCORE_BITS | (score) )
+#define ENTRY_ADDR(e)            ( (uint32_t)((e) >> 32) )
+#define ENTRY_TIME(e)            ( (uint32_t)((e) >> SCORE_BITS) & TIME_MASK )
+#define ENTRY_SCORE(e)           ( (uint32_t)(e) & SCORE_MASK )
+
+/*!
+  \brief bucket of a client (Fibonacci hashing)
+*/
+static inline uint32_t rate_hash( uint32_t addr)
+{
+  return (uint32_t)((addr * 0x9E3779B97F4A7C15ULL) >> 32) & (ktRATE_BUCKETS - 1);
+}
+
+/*!
+  \brief initialize a table
+  ******************************************************************
+
+  \param t       the table
+  \param average seconds between requests allowed on average
+  \param burst   requests allowed at once
+  \param kod     answer Kiss-o'-Death RATE to the first limited request
+  \return 0 if OK or -1 if no memory
+*/
+int rate_init( rate_table_t *t, int average, int burst, int kod)
+{
+  memset( t, 0, sizeof(*t));
+  if( posix_memalign( (void **)&t->m_buckets, 64, ktRATE_BUCKETS * sizeof(rate_bucket_t))) {
+    t->m_buckets = NULL;
+    return -1;
+  }
+  memset( t->m_buckets, 0, ktRATE_BUCKETS * sizeof(rate_bucket_t));
+  t->m_average = (average > 0) ? average : ktRATE_AVERAGE;
+  t->m_burst   = ((burst > 0 && burst <= ktRATE_MAXBURST) ? burst : ktRATE_BURST) * ktRATE_ONE;
+  t->m_kod     = kod;
+  return 0;
+}
+
+/*!
+  \brief release a table
+*/
+void rate_free( rate_table_t *t)
+{
+  free( t->m_buckets);
+  t->m_buckets = NULL;
+}
+
+/*!
+  \brief current time in table units (1/16 s), coarse monotonic clock
+*/
+uint32_t rate_now( void)
+{
+  struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime( CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime( CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint32_t)(ts.tv_sec * ktRATE_TICKS + ts.tv_nsec / (1000000000 / ktRATE_TICKS));
+}
+
+/*!
+  \brief account a request and tell what to do with it
+  ******************************************************************
+
+  \param t    the table
+  \param addr IPv4 address of the client (any order, not 0)
+  \param now  rate_now()
+  \return the rate_verdict
+*/
+int rate_check( rate_table_t *t, uint32_t addr, uint32_t now)
+{
+  rate_bucket_t *b = &t->m_buckets[rate_hash( addr)];
+  uint64_t old, new, *slot;
+  uint32_t elapsed, leak, score, time, idle, oldest;
+  int i, tries, verdict;
+
+  for( tries = 0; tries < CAS_TRIES; tries++) {
+    /*
+     * find the client or the entry idle for the longest time
+     ***************************************************************************
+     */
+    slot = NULL;
+    oldest = 0;
+    for( i = 0; i < ktRATE_WAYS; i++) {
+      old = __atomic_load_n( &b->m_entry[i], __ATOMIC_RELAXED);
+      if( ENTRY_ADDR( old) == addr) {
+        slot = &b->m_entry[i];
+        break;
+      }
+      idle = old ? ((now - ENTRY_TIME( old)) & TIME_MASK) : TIME_MASK + 1;
+      if( !slot || idle > oldest) {
+        slot = &b->m_entry[i];
+        oldest = idle;
+      }
+    }
+
+    if( i == ktRATE_WAYS) {
+      /* new client: one request in its bucket */
+      old = __atomic_load_n( slot, __ATOMIC_RELAXED);
+      new = ENTRY( addr, now, ktRATE_ONE);
+      verdict = (ktRATE_ONE > t->m_burst) ? eRATE_DROP : eRATE_PASS;
+    }
+    else {
+      /* leak one packet per 'average' seconds, keep the remainder of time */
+      elapsed = (now - ENTRY_TIME( old)) & TIME_MASK;
+      leak    = elapsed * ktRATE_ONE / (t->m_average * ktRATE_TICKS);
+      score   = ENTRY_SCORE( old);
+      if( leak >= score) {
+        score = 0;
+        time  = now;
+      }
+      else {
+        score -= leak;
+        time   = ENTRY_TIME( old) + leak * t->m_average * ktRATE_TICKS / ktRATE_ONE;
+      }
+
+      if( score + ktRATE_ONE <= t->m_burst) verdict = eRATE_PASS;
+      else verdict = (t->m_kod && score <= t->m_burst) ? eRATE_KOD : eRATE_DROP;
+
+      score += ktRATE_ONE;
+      if( score > SCORE_MASK) score = SCORE_MASK;
+      new = ENTRY( addr, time, score);
+    }
+
+    if( __atomic_compare_exchange_n( slot, &old, new, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return verdict;
+  }
+  return eRATE_PASS;                         // too many races, be nice
+}
+
+/*!
+  \brief parse the --limit option
+  ******************************************************************
+
+  \param spec    "AVERAGE[:BURST[:kod]]"
+  \param average seconds between requests on average
+  \param burst   requests allowed at once
+  \param kod     1 if ":kod" is given
+  \return 0 if OK else -1
+*/
+int rate_parse( const char *spec, int *average, int *burst, int *kod)
+{
+  char tail[8] = "";
+  int n;
+
+  *burst = ktRATE_BURST;
+  *kod   = 0;
+  n = sscanf( spec, "%d:%d:%7s", average, burst, tail);
+  if( n < 1 || *average <= 0 || *burst <= 0 || *burst > ktRATE_MAXBURST) return -1;
+  if( n == 3) {
+    if( strcmp( tail, "kod")) return -1;
+    *kod = 1;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * \file ratelimit.h
+ * \brief per-client rate limiting of the server header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef RATELIMIT_H_
+#define RATELIMIT_H_
+
+#include <stdint.h>
+
+#define ktRATE_BUCKETS     4096  /*!< buckets of the table (power of 2)          */
+#define ktRATE_WAYS        8     /*!< clients per bucket, one cache line         */
+#define ktRATE_TICKS       16    /*!< time unit: 1/16 s                          */
+#define ktRATE_ONE         16    /*!< one packet in score units                  */
+#define ktRATE_MAXBURST    60    /*!< highest burst the score can hold           */
+#define ktRATE_AVERAGE     8     /*!< default seconds between packets (ntpd)     */
+#define ktRATE_BURST       8     /*!< default packets allowed at once            */
+
+/*!
+  \enum rate_verdict
+  \brief what to do with a request
+  ******************************************************************
+*/
+typedef enum rate_verdict {
+  eRATE_PASS = 0,                /*!< answer                                     */
+  eRATE_KOD,                     /*!< just went over the limit: Kiss-o'-Death    */
+  eRATE_DROP,                    /*!< over the limit: no answer                  */
+
+}rate_verdict;
+
+/*!
+  \struct rate_bucket_t
+  \brief clients hashed to the same bucket, one cache line
+  ******************************************************************
+
+  Each client is a 64 bits word updated with compare-and-swap:
+  IPv4 address (32 bits, 0: free), time of last update in 1/16 s
+  (22 bits, wraps after 72 hours) and score (10 bits, 1/16 packet).
+*/
+typedef struct rate_bucket_t {
+  uint64_t m_entry[ktRATE_WAYS]; /*!< clients                                    */
+
+} __attribute__((aligned(64))) rate_bucket_t;
+
+/*!
+  \struct rate_table_t
+  \brief rate limiting table, fixed size whatever the clients
+  ******************************************************************
+*/
+typedef struct rate_table_t {
+  rate_bucket_t *m_buckets;      /*!< ktRATE_BUCKETS buckets                     */
+  uint32_t       m_average;      /*!< seconds between packets on average         */
+  uint32_t       m_burst;        /*!< score above which a client is limited      */
+  int            m_kod;          /*!< send Kiss-o'-Death RATE to limited clients */
+
+} rate_table_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int      rate_init ( rate_table_t *t, int average, int burst, int kod);
+void     rate_free ( rate_table_t *t);
+uint32_t rate_now  ( void);
+int      rate_check( rate_table_t *t, uint32_t addr, uint32_t now);
+int      rate_parse( const char *spec, int *average, int *burst, int *kod);
+
+#endif /* RATELIMIT_H_ */
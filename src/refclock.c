@@ -0,0 +1,202 @@
+/**
+ * \file refclock.c
+ * \brief export of the samples to ntpd or chronyd
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --refclock, zntpdate measures but another daemon disciplines the
+ * clock: the offset selected and combined at each poll is handed over
+ * as a reference clock sample, the clock itself is never touched.
+ *
+ *  shm:N     ntpd (and chronyd) shared memory driver, unit N: System V
+ *            segment of key 0x4E545030 + N, written with the mode 1
+ *            protocol (count incremented before and after, then valid).
+ *            ntpd:    server 127.127.28.N
+ *            chronyd: refclock SHM N
+ *  sock:PATH chronyd SOCK driver: one datagram per sample to the Unix
+ *            socket chronyd listens on.
+ *            chronyd: refclock SOCK PATH
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "refclock.h"
+
+/*!
+  \struct refclock_shm_t
+  \brief segment of the ntpd SHM driver (layout shared with ntpd, chronyd, gpsd)
+*/
+typedef struct refclock_shm_t {
+  int          mode;             /*!< 1: readers check count                     */
+  volatile int count;            /*!< incremented before and after a write       */
+  time_t       clockTimeStampSec;  /*!< true time of the sample                  */
+  int          clockTimeStampUSec;
+  time_t       receiveTimeStampSec; /*!< system time of the sample               */
+  int          receiveTimeStampUSec;
+  int          leap;             /*!< NTP leap indicator                         */
+  int          precision;        /*!< log2 s                                     */
+  int          nsamples;
+  volatile int valid;            /*!< set by the writer, cleared by the reader   */
+  unsigned     clockTimeStampNSec;
+  unsigned     receiveTimeStampNSec;
+  int          dummy[8];
+
+} refclock_shm_t;
+
+/*!
+  \struct refclock_sock_t
+  \brief datagram of the chronyd SOCK driver
+*/
+typedef struct refclock_sock_t {
+  struct timeval tv;             /*!< system time of the sample                  */
+  double         offset;         /*!< true time - system time (s)                */
+  int            pulse;          /*!< 0: not a PPS                               */
+  int            leap;           /*!< 0, 1: insert, 2: delete                    */
+  int            pad;
+  int            magic;          /*!< ktREFCLOCK_SOCKMAGIC                       */
+
+} refclock_sock_t;
+
+/* -- GLOBALES -- */
+extern trace_desc_t* gAppTrace;
+
+static refclock_shm_t    *gShm = NULL;   /*!< shm: the segment                 */
+static int                gSock = -1;    /*!< sock: our socket                 */
+static struct sockaddr_un gSockAddr;     /*!< sock: chronyd socket             */
+
+/*!
+  \brief attach the ntpd segment or open the socket to chronyd
+  ******************************************************************
+
+  \param spec "shm:N" or "sock:PATH"
+  \return 0 if OK or -1 if failed
+*/
+int refclock_open( const char *spec)
+{
+  int unit, id;
+
+  if( !strncmp( spec, "shm:", 4)) {
+    unit = atoi( spec + 4);
+    if( unit < 0 || unit > 255) return -1;
+    /* units 0 and 1 are for root only, as ntpd creates them */
+    id = shmget( ktREFCLOCK_SHMKEY + unit, sizeof(refclock_shm_t), IPC_CREAT | (unit <= 1 ? 0600 : 0666));
+    if( id < 0 || (gShm = (refclock_shm_t *)shmat( id, NULL, 0)) == (void *)-1) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot attach SHM unit %d: %s"), unit, strerror( errno));
+      gShm = NULL;
+      return -1;
+    }
+    return 0;
+  }
+
+  if( !strncmp( spec, "sock:", 5) && spec[5] && strlen( spec + 5) < sizeof(gSockAddr.sun_path)) {
+    memset( &gSockAddr, 0, sizeof(gSockAddr));
+    gSockAddr.sun_family = AF_UNIX;
+    strcpy( gSockAddr.sun_path, spec + 5);
+    if( (gSock = socket( AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+      return -1;
+    }
+    return 0;
+  }
+
+  trace_write( gAppTrace, eERROR_MSG_TYPE, _("Unknown reference clock %s"), spec);
+  return -1;
+}
+
+/*!
+  \brief hand a sample over
+  ******************************************************************
+
+  \param offset true time - system time now (s)
+  \param leap   NTP leap indicator of the servers (not NTP_LI_ALARM)
+  \return 0 if OK or -1 if failed (chronyd not listening)
+*/
+int refclock_send( double offset, int leap)
+{
+  struct timespec now, ref;
+  refclock_sock_t sample;
+  double secs;
+
+  clock_gettime( CLOCK_REALTIME, &now);
+  secs = (double)now.tv_nsec * 1e-9 + offset;
+  ref.tv_sec  = now.tv_sec + (time_t)floor( secs);
+  ref.tv_nsec = (long)((secs - floor( secs)) * 1e9);
+  if( ref.tv_nsec >= 1000000000) { ref.tv_sec++; ref.tv_nsec -= 1000000000; }
+
+  if( gShm) {
+    gShm->mode  = 1;
+    gShm->valid = 0;
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    gShm->count++;
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    gShm->clockTimeStampSec    = ref.tv_sec;
+    gShm->clockTimeStampUSec   = (int)(ref.tv_nsec / 1000);
+    gShm->clockTimeStampNSec   = (unsigned)ref.tv_nsec;
+    gShm->receiveTimeStampSec  = now.tv_sec;
+    gShm->receiveTimeStampUSec = (int)(now.tv_nsec / 1000);
+    gShm->receiveTimeStampNSec = (unsigned)now.tv_nsec;
+    gShm->leap      = leap;
+    gShm->precision = ktREFCLOCK_PRECISION;
+    gShm->nsamples  = 0;
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    gShm->count++;
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    gShm->valid = 1;
+    return 0;
+  }
+
+  if( gSock >= 0) {
+    memset( &sample, 0, sizeof(sample));
+    sample.tv.tv_sec  = now.tv_sec;
+    sample.tv.tv_usec = now.tv_nsec / 1000;
+    sample.offset     = offset;
+    sample.leap       = leap;
+    sample.magic      = ktREFCLOCK_SOCKMAGIC;
+    if( sendto( gSock, &sample, sizeof(sample), 0, (struct sockaddr *)&gSockAddr, sizeof(gSockAddr)) < 0) {
+      trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot send to %s: %s"), gSockAddr.sun_path, strerror( errno));
+      return -1;
+    }
+    return 0;
+  }
+  return -1;
+}
+
+/*!
+  \brief detach or close
+*/
+void refclock_close( void)
+{
+  if( gShm) shmdt( gShm);
+  if( gSock >= 0) close( gSock);
+  gShm  = NULL;
+  gSock = -1;
+}
@@ -0,0 +1,26 @@
+/**
+ * \file refclock.h
+ * \brief export of the samples to ntpd or chronyd header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef REFCLOCK_H_
+#define REFCLOCK_H_
+
+#define ktREFCLOCK_SHMKEY   0x4E545030 /*!< "NTP0": key of the ntpd SHM unit 0     */
+#define ktREFCLOCK_SOCKMAGIC 0x534F434B /*!< "SOCK": magic of chrony samples      */
+#define ktREFCLOCK_PRECISION -20       /*!< told precision (log2 s)                */
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int  refclock_open ( const char *spec);
+int  refclock_send ( double offset, int leap);
+void refclock_close( void);
+
+#endif /* REFCLOCK_H_ */
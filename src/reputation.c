@@ -0,0 +1,314 @@
+/**
+ * \file reputation.c
+ * \brief servers remembered from run to run (--state)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * With --state, what each server did is kept in a small file from run
+ * to run: a reachability register (a bit per query, as in ntpd), a
+ * register of the selections it went through, its average round trip
+ * delay, its RMS distance to the combined offset and the end of a
+ * Kiss-o'-Death back-off.
+ *
+ * The next run queries the servers best first:
+ *
+ *   score = misses + 0.5 if left out of the last selection
+ *           + delay + 4 jitter                      (seconds)
+ *
+ * a server never seen scores 1, after the good known ones. Without
+ * -D, a server under Kiss-o'-Death, or which did not answer its last
+ * 8 queries within ktREPUTATION_RETRY, is not queried at all (unless
+ * no server is left). And a server that answered its last 8 queries,
+ * was kept by its last 4 selections, was compared to the others within
+ * ktREPUTATION_CHECK and answers with a usual delay is enough alone:
+ * the run ends on its first reply.
+ *
+ * The file is written atomically (rename), in host byte order.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "trace.h"
+#include "reputation.h"
+
+#define ktREPUTATION_MAGIC   0x5A524550u /*!< "ZREP"                             */
+#define ktREPUTATION_VERSION 1
+#define ktREPUTATION_SLACK   0.010       /*!< usual delay: at most twice the average plus this (s) */
+
+/*!
+  \struct reputation_file_t
+  \brief head of the state file, followed by the servers
+  ******************************************************************
+*/
+typedef struct reputation_file_t {
+  uint32_t m_magic;              /*!< ktREPUTATION_MAGIC                         */
+  uint32_t m_version;            /*!< ktREPUTATION_VERSION                       */
+  uint32_t m_count;              /*!< servers                                    */
+
+} reputation_file_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static reputation_t gReputations[ktREPUTATION_MAX];
+static int          gNreputations = 0;
+
+/*!
+  \brief number of bits set
+*/
+static int bits( unsigned x)
+{
+  int n = 0;
+
+  for( ; x; x &= x - 1) n++;
+  return n;
+}
+
+/*!
+  \brief queries not answered among the last ones
+*/
+static int misses( const reputation_t *r)
+{
+  return r->m_queries - bits( r->m_reach & ((1u << r->m_queries) - 1));
+}
+
+/*!
+  \brief rank of a server, the lowest first
+*/
+static double score( const reputation_t *r)
+{
+  if( !r->m_queries) return 1.0;
+  return misses( r) + ((r->m_selected & 1) ? 0 : 0.5) + r->m_delay + 4 * r->m_jitter;
+}
+
+/*!
+  \brief why a server is not queried: 0 if it is
+*/
+static const char *pruned( const reputation_t *r, time_t now)
+{
+  if( r->m_kodUntil > (uint32_t)now) return _("Kiss-o'-Death");
+  if( r->m_queries >= 8 && !r->m_reach && (uint32_t)now - r->m_last < ktREPUTATION_RETRY) return _("unreachable");
+  return NULL;
+}
+
+/*!
+  \brief read the state of a former run
+  ******************************************************************
+
+  \param path the state file, missing at first
+  \return servers read or -1 if the file is not usable
+*/
+int reputation_load( const char *path)
+{
+  reputation_file_t head;
+  int fd, n;
+
+  gNreputations = 0;
+  if( (fd = open( path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+  n = (int)read( fd, &head, sizeof(head));
+  if( n != (int)sizeof(head) || head.m_magic != ktREPUTATION_MAGIC ||
+      head.m_version != ktREPUTATION_VERSION || head.m_count > ktREPUTATION_MAX) {
+    close( fd);
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Ignoring state file %s"), path);
+    return -1;
+  }
+  n = (int)read( fd, gReputations, head.m_count * sizeof(reputation_t));
+  close( fd);
+  if( n != (int)(head.m_count * sizeof(reputation_t))) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Ignoring state file %s"), path);
+    return -1;
+  }
+  gNreputations = (int)head.m_count;
+  for( n = 0; n < gNreputations; n++) gReputations[n].m_host[ktHOSTNAMELEN] = '\0';
+  return gNreputations;
+}
+
+/*!
+  \brief write the state, atomically
+  ******************************************************************
+
+  \param path the state file
+  \return 0 if OK or -1 if failed
+*/
+int reputation_save( const char *path)
+{
+  reputation_file_t head;
+  char tmp[512];
+  int fd, n, len;
+
+  memset( &head, 0, sizeof(head));
+  head.m_magic   = ktREPUTATION_MAGIC;
+  head.m_version = ktREPUTATION_VERSION;
+  head.m_count   = (uint32_t)gNreputations;
+  len = (int)(gNreputations * sizeof(reputation_t));
+
+  snprintf( tmp, sizeof(tmp), "%s.tmp", path);
+  if( (fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot write %s: %s"), tmp, strerror( errno));
+    return -1;
+  }
+  n = (int)write( fd, &head, sizeof(head));
+  if( n == (int)sizeof(head)) n = (int)write( fd, gReputations, (size_t)len);
+  close( fd);
+  if( n != len || rename( tmp, path) < 0) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("Cannot write %s: %s"), path, strerror( errno));
+    unlink( tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/*!
+  \brief state of a server, added if new
+  ******************************************************************
+
+  When the table is full, the server queried the longest ago is
+  forgotten. A new server counts as queried now, so that the servers
+  added by this run do not push each other out.
+
+  \param host name or address, as on the command line
+  \return its state
+*/
+reputation_t *reputation_find( const char *host)
+{
+  reputation_t *r = NULL;
+  int i;
+
+  for( i = 0; i < gNreputations; i++) {
+    if( !strncmp( gReputations[i].m_host, host, ktHOSTNAMELEN)) return &gReputations[i];
+  }
+  if( gNreputations < ktREPUTATION_MAX) r = &gReputations[gNreputations++];
+  else {
+    for( r = &gReputations[0], i = 1; i < ktREPUTATION_MAX; i++) {
+      if( gReputations[i].m_last < r->m_last) r = &gReputations[i];
+    }
+  }
+  memset( r, 0, sizeof(*r));
+  strncpy( r->m_host, host, ktHOSTNAMELEN);
+  r->m_last = (uint32_t)time( NULL);
+  return r;
+}
+
+/*!
+  \brief sort the servers best first, maybe leave out the bad ones
+  ******************************************************************
+
+  \param hosts the servers, sorted in place
+  \param n     their number
+  \param now   UTC time
+  \param prune leave out the servers not to query (one-shot mode)
+  \return servers to query, first in hosts
+*/
+int reputation_order( char hosts[][ktHOSTNAMELEN+1], int n, time_t now, int prune)
+{
+  char sorted[ktMAXHOSTS][ktHOSTNAMELEN+1];
+  double scores[ktMAXHOSTS], s;
+  const reputation_t *r;
+  const char *why;
+  int i, j, kept = 0;
+
+  if( n > ktMAXHOSTS) n = ktMAXHOSTS;
+
+  /* insertion sort, stable: equal servers keep the command line order */
+  for( i = 0; i < n; i++) {
+    r = reputation_find( hosts[i]);
+    s = score( r);
+    if( prune && pruned( r, now)) s += 1e9;
+    for( j = i; j > 0 && scores[j - 1] > s; j--) {
+      scores[j] = scores[j - 1];
+      memcpy( sorted[j], sorted[j - 1], sizeof(sorted[j]));
+    }
+    scores[j] = s;
+    memcpy( sorted[j], hosts[i], sizeof(sorted[j]));
+  }
+
+  for( i = 0; i < n; i++) {
+    memcpy( hosts[i], sorted[i], sizeof(hosts[i]));
+    r = reputation_find( hosts[i]);
+    why = prune ? pruned( r, now) : NULL;
+    if( !why) kept = i + 1;
+    if( gAppOptions.m_verbose) {
+      if( why) trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s left out: %s"), hosts[i], why);
+      else if( r->m_queries) {
+        trace_write( gAppTrace, eINFO_MSG_TYPE, _("Server %s: reach %d/%d, delay %.3fms, jitter %.3fms"),
+                     hosts[i], r->m_queries - misses( r), r->m_queries, r->m_delay * 1e3, r->m_jitter * 1e3);
+      }
+    }
+  }
+  return kept ? kept : n;                    // none left: query them all anyway
+}
+
+/*!
+  \brief is the first reply of a server enough?
+  ******************************************************************
+
+  \param r      the server
+  \param sample its reply
+  \param now    UTC time
+  \return 1 if the other servers need not be queried
+*/
+int reputation_trusted( const reputation_t *r, const ntp_sample_t *sample, time_t now)
+{
+  return r->m_queries >= 8 && r->m_reach == 0xFF && (r->m_selected & 0x0F) == 0x0F &&
+         (uint32_t)now - r->m_checked < ktREPUTATION_CHECK &&
+         sample->m_delay <= 2 * r->m_delay + ktREPUTATION_SLACK;
+}
+
+/*!
+  \brief add the result of a query
+  ******************************************************************
+
+  \param r         the server
+  \param err       result of ntp_query()
+  \param sample    the sample if err is eNTP_OK
+  \param selected  the selection kept it
+  \param deviation distance to the combined offset of several servers
+                   (s), <0 if it was not compared
+  \param now       UTC time
+*/
+void reputation_update( reputation_t *r, int err, const ntp_sample_t *sample, int selected,
+                        double deviation, time_t now)
+{
+  double delay;
+
+  r->m_last  = (uint32_t)now;
+  r->m_reach = (uint8_t)((r->m_reach << 1) | (err == eNTP_OK));
+  if( r->m_queries < 8) r->m_queries++;
+  if( err == eNTP_EKOD) r->m_kodUntil = (uint32_t)now + ktREPUTATION_KOD;
+  if( err != eNTP_OK) return;
+
+  delay = (sample->m_delay > 0) ? sample->m_delay : 0;
+  if( r->m_reach >> 1) r->m_delay += (float)((delay - r->m_delay) / 8);
+  else r->m_delay = (float)delay;            // first answer in the register
+  r->m_offset = (float)sample->m_offset;
+
+  if( deviation >= 0) {
+    r->m_jitter   = r->m_checked ? (float)sqrt( (7 * r->m_jitter * r->m_jitter + deviation * deviation) / 8) :
+                    (float)deviation;
+    r->m_selected = (uint8_t)((r->m_selected << 1) | (selected != 0));
+    r->m_checked  = (uint32_t)now;
+  }
+}
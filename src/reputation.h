@@ -0,0 +1,56 @@
+/**
+ * \file reputation.h
+ * \brief servers remembered from run to run (--state) header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef REPUTATION_H_
+#define REPUTATION_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "main.h"
+#include "ntpdate.h"
+
+#define ktREPUTATION_MAX     32  /*!< servers kept in the state file             */
+#define ktREPUTATION_KOD   1024  /*!< seconds without query after a Kiss-o'-Death */
+#define ktREPUTATION_RETRY 3600  /*!< seconds before an unreachable server is tried again */
+#define ktREPUTATION_CHECK 86400 /*!< trusted alone if compared to others within (s) */
+
+/*!
+  \struct reputation_t
+  \brief what is known of a server
+  ******************************************************************
+*/
+typedef struct reputation_t {
+  char     m_host[ktHOSTNAMELEN+1]; /*!< name or address, as on the command line */
+  uint8_t  m_queries;            /*!< bits of the registers that count, 8 max    */
+  uint8_t  m_reach;              /*!< reachability: a bit per query, last in bit 0 */
+  uint8_t  m_selected;           /*!< a bit per comparison, set if kept by the selection */
+  uint32_t m_last;               /*!< UTC time of the last query                 */
+  uint32_t m_kodUntil;           /*!< UTC time to wait for after a Kiss-o'-Death */
+  uint32_t m_checked;            /*!< UTC time it was last compared to others    */
+  float    m_delay;              /*!< average round trip delay (s)               */
+  float    m_jitter;             /*!< RMS distance to the combined offset (s)    */
+  float    m_offset;             /*!< last offset (s)                            */
+
+} reputation_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int           reputation_load   ( const char *path);
+int           reputation_save   ( const char *path);
+reputation_t *reputation_find   ( const char *host);
+int           reputation_order  ( char hosts[][ktHOSTNAMELEN+1], int n, time_t now, int prune);
+int           reputation_trusted( const reputation_t *r, const ntp_sample_t *sample, time_t now);
+void          reputation_update ( reputation_t *r, int err, const ntp_sample_t *sample, int selected,
+                                  double deviation, time_t now);
+
+#endif /* REPUTATION_H_ */
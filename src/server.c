@@ -0,0 +1,617 @@
+/**
+ * \file server.c
+ * \brief NTP server mode
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Answer NTP client requests (--serve) with the system clock, e.g. on
+ * a LAN gateway. With servers on the command line, the clock is
+ * disciplined as in daemon mode and the server tells it is one stratum
+ * below the best of them; without, it tells --stratum (or that it is
+ * not synchronized).
+ *
+ * Each thread (--threads) has its own socket on the port
+ * (SO_REUSEPORT), or one of the sockets of a systemd .socket unit, and
+ * answers alone, by batches (see netio.c); the receive time-stamp is
+ * the kernel one, so it does not depend on the position in a batch.
+ * The synchronization state is written by the daemon loop as a
+ * ready-made reply (template) that the threads read through a sequence
+ * lock, so the response path never takes a lock and only copies 48
+ * bytes then stores the version, poll and time-stamps.
+ * Clients going over --limit are dropped or get a Kiss-o'-Death RATE
+ * (see ratelimit.c). Requests with a MAC of a key of --keys get replies
+ * signed by the same key, others with a MAC get a crypto-NAK (auth.c).
+ *
+ * Each thread counts the requests in its own cache line, the counters
+ * are only summed when reported.
+ *
+ * Interleaved mode: the transmit time-stamp of a reply is taken before
+ * it is sent. Each thread remembers the last reply to each client (a
+ * table by address, so that floods of other clients do not push it
+ * out), with the time the kernel tells it really left (see
+ * netio_tx_enable()). A client whose request carries as origin the
+ * receive time-stamp of its previous request gets, as transmit
+ * time-stamp, the time its previous reply left, and as origin the
+ * receive time-stamp of the request (its receive time of the previous
+ * reply), like ntpd and chronyd.
+ *
+ * With --broadcast, a thread also sends the template in mode 5 (signed
+ * by --key if set) to a broadcast address or a multicast group every
+ * poll interval, for the clients of bclient.c, from its own socket.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntppacket.h"
+#include "ratelimit.h"
+#include "netio.h"
+#include "auth.h"
+#include "timing.h"
+#include "systemd.h"
+#include "server.h"
+
+#define REFID_LOCL   0x4C4F434C      /*!< "LOCL": local clock, set by --stratum */
+#define REFID_INIT   0x494E4954      /*!< "INIT": not synchronized yet          */
+#define REFID_RATE   0x52415445      /*!< "RATE": Kiss-o'-Death, slow down      */
+
+#define VN_MASK      0x38            /*!< version bits of li_vn_mode            */
+#define XLEAVE_LATE  42949673        /*!< 10 ms (NTP units): later transmit times are not of this reply */
+
+/* counters are written by their thread only and read by the reporting one */
+#define COUNT(c)     __atomic_store_n( &(c), __atomic_load_n( &(c), __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED)
+
+/*!
+  \struct server_reply_t
+  \brief a reply and its MAC
+*/
+typedef struct server_reply_t {
+  ntp_packet_t m_packet;         /*!< the reply                                  */
+  uint8_t      m_mac[ktAUTH_MACLEN]; /*!< MAC or crypto-NAK, if any              */
+
+} server_reply_t;
+
+/*!
+  \struct server_xleave_t
+  \brief a reply, for the interleaved mode
+*/
+typedef struct server_xleave_t {
+  ntp_ts_t m_rx;                 /*!< receive time-stamp of the request          */
+  ntp_ts_t m_tx;                 /*!< when the reply left, kernel time if known  */
+
+} server_xleave_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+/*!
+  \struct server_worker_t
+  \brief a serving thread
+*/
+typedef struct server_worker_t {
+  server_counters_t m_counters;  /*!< its requests, first for alignment          */
+  pthread_t         m_thread;    /*!< the thread                                 */
+  int               m_socket;    /*!< its UDP socket                             */
+  netio_t          *m_io;        /*!< batched I/O on the socket                  */
+
+  server_xleave_t  *m_xleave;    /*!< ktSERVER_XLEAVE last replies, by client    */
+  uint32_t         *m_sent;      /*!< their slots, by number of the reply sent   */
+  uint32_t          m_txId;      /*!< number of the next reply sent              */
+  int               m_txStamps;  /*!< the kernel tells when replies leave        */
+
+} server_worker_t;
+
+static server_worker_t gWorkers[ktSERVER_MAXTHREADS];
+static int             gNworkers = 0;
+
+static rate_table_t    gRate;            /*!< rate limiting, if m_buckets       */
+
+static ntp_packet_t    gTemplate;        /*!< reply but client dependant fields */
+static unsigned        gTemplateSeq = 0; /*!< sequence lock of gTemplate        */
+static ntp_packet_t    gKodTemplate;     /*!< Kiss-o'-Death RATE reply          */
+
+static pthread_t       gBroadcaster;     /*!< broadcasting thread (--broadcast) */
+static int             gBroadcastSocket = -1;
+static struct sockaddr_in gBroadcastTo;  /*!< broadcast address or group        */
+static unsigned long   gBroadcasts = 0;  /*!< packets sent                      */
+
+/*!
+  \brief NTP short format (16.16) of seconds, network order
+*/
+static inline uint32_t secs_to_short( double secs)
+{
+  if( secs < 0) secs = 0;
+  if( secs > 65535) secs = 65535;
+  return htonl( (uint32_t)(secs * 65536.0));
+}
+
+/*!
+  \brief copy the reply template, retry while it is written
+*/
+static inline void template_read( ntp_packet_t *reply)
+{
+  unsigned seq;
+
+  do {
+    seq = __atomic_load_n( &gTemplateSeq, __ATOMIC_ACQUIRE);
+    memcpy( reply, &gTemplate, sizeof(*reply));
+    __atomic_thread_fence( __ATOMIC_ACQUIRE);
+  } while( (seq & 1) || seq != __atomic_load_n( &gTemplateSeq, __ATOMIC_RELAXED));
+}
+
+/*!
+  \brief publish a new synchronization state to the serving threads
+  ******************************************************************
+
+  The reply template is rebuilt here, once per clock update. Only one
+  thread may call it.
+
+  \param source the new state
+*/
+void server_update( const server_source_t *source)
+{
+  ntp_packet_t reply;
+  unsigned seq = gTemplateSeq;
+
+  memset( &reply, 0, sizeof(reply));
+  reply.li_vn_mode     = NTP_LI_VN_MODE( source->m_leap, 4, NTP_MODE_SERVER);
+  reply.stratum        = (uint8_t)source->m_stratum;
+  reply.precision      = (uint8_t)ktSERVER_PRECISION;
+  reply.refId          = htonl( source->m_refId);
+  reply.rootDelay      = secs_to_short( source->m_rootDelay);
+  reply.rootDispersion = secs_to_short( source->m_rootDisp);
+  ntp_ts_put( source->m_refTime, &reply.refTm_s, &reply.refTm_f);
+
+  __atomic_store_n( &gTemplateSeq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence( __ATOMIC_RELEASE);
+  memcpy( &gTemplate, &reply, sizeof(gTemplate));
+  __atomic_store_n( &gTemplateSeq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*!
+  \brief slot of the last reply to a client in the interleaved mode table
+*/
+static inline uint32_t xleave_slot( const struct sockaddr_in *addr)
+{
+  uint32_t h = (addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port << 16)) * 2654435761U;
+
+  return (h >> 16) & (ktSERVER_XLEAVE - 1);
+}
+
+/*!
+  \brief read the kernel transmit times of the replies sent
+  ******************************************************************
+
+  A time only replaces the one of the reply if the slot was not given
+  to a later reply and the time is a bit later than the one taken
+  before sending.
+
+  \param w the thread
+*/
+static void xleave_stamps( server_worker_t *w)
+{
+  server_xleave_t *x;
+  struct timespec stamp;
+  ntp_ts_t tx;
+  uint32_t id;
+
+  while( netio_tx_stamp( w->m_socket, &id, &stamp) > 0) {
+    x  = &w->m_xleave[w->m_sent[id % ktSERVER_TXRING]];
+    tx = ntp_ts_from_timespec( &stamp);
+    if( !x->m_rx || tx - x->m_tx > XLEAVE_LATE) continue;
+    x->m_tx = tx;
+    COUNT( w->m_counters.m_txStamped);
+  }
+}
+
+/*!
+  \brief serving thread
+*/
+static void *server_worker( void *arg)
+{
+  server_worker_t *w = (server_worker_t *)arg;
+  server_counters_t *c = &w->m_counters;
+  netio_msg_t in[ktNETIO_BATCH], out[ktNETIO_BATCH];
+  server_reply_t replies[ktNETIO_BATCH];
+  ntp_packet_t *request, *reply;
+  const auth_key_t *key;
+  server_xleave_t *x;
+  ntp_ts_t rx, now, org;
+  uint32_t keyId;
+  int i, n, k, vn, verdict, status;
+
+  for(;;) {
+    n = netio_recv( w->m_io, in, ktNETIO_BATCH, -1);
+    if( w->m_txStamps) xleave_stamps( w);   // before the requests which may want them
+    if( n <= 0) continue;
+    now = ntp_ts_now();
+
+    for( i = 0, k = 0; i < n; i++) {
+      COUNT( c->m_received);
+      request = (ntp_packet_t *)in[i].m_data;
+      if( in[i].m_len < (int)sizeof(*request) || NTP_MODE( request->li_vn_mode) != NTP_MODE_CLIENT) {
+        COUNT( c->m_ignored);
+        continue;
+      }
+      rx = in[i].m_stamp.tv_sec ? ntp_ts_from_timespec( &in[i].m_stamp) : now;
+
+      verdict = eRATE_PASS;
+      if( gRate.m_buckets && in[i].m_addr.sin_addr.s_addr) {
+        verdict = rate_check( &gRate, in[i].m_addr.sin_addr.s_addr, rate_now());
+        if( verdict == eRATE_DROP) {
+          COUNT( c->m_dropped);
+          continue;
+        }
+      }
+
+      /* a request with a MAC gets a reply with a MAC of the same key, or a crypto-NAK */
+      key = NULL;
+      status = eAUTH_NONE;
+      if( in[i].m_len > (int)sizeof(*request)) {
+        status = auth_verify( in[i].m_data, in[i].m_len, &keyId);
+        if( status == eAUTH_OK) {
+          key = auth_find( keyId);
+          COUNT( c->m_authenticated);
+        }
+        else if( status != eAUTH_NONE) COUNT( c->m_authFailed);
+      }
+
+      /*
+       * the template with the client fields: version, poll, time-stamps
+       ***************************************************************************
+       */
+      reply = &replies[k].m_packet;
+      if( verdict == eRATE_KOD) {
+        memcpy( reply, &gKodTemplate, sizeof(*reply));
+        reply->poll = (request->poll < 3) ? 3 : request->poll;    // hint: slow down
+        COUNT( c->m_kod);
+      }
+      else {
+        template_read( reply);
+        reply->poll = request->poll;
+        COUNT( c->m_answered);
+      }
+      vn = NTP_VN( request->li_vn_mode);
+      if( vn >= 1 && vn <= 4) reply->li_vn_mode = (reply->li_vn_mode & ~VN_MASK) | (vn << 3);
+
+      /* interleaved: the origin is our receive time-stamp of the previous request */
+      x = &w->m_xleave[xleave_slot( &in[i].m_addr)];
+      org = ntp_ts_get( request->origTm_s, request->origTm_f);
+      if( org && org == x->m_rx && verdict != eRATE_KOD) {
+        reply->origTm_s = request->rxTm_s;
+        reply->origTm_f = request->rxTm_f;
+        ntp_ts_put( x->m_tx, &reply->txTm_s, &reply->txTm_f);
+        COUNT( c->m_interleaved);
+      }
+      else {
+        reply->origTm_s = request->txTm_s;
+        reply->origTm_f = request->txTm_f;
+        ntp_ts_put( ntp_ts_now(), &reply->txTm_s, &reply->txTm_f);
+      }
+      ntp_ts_put( rx, &reply->rxTm_s, &reply->rxTm_f);
+
+      /* remembered for the next request of the client */
+      w->m_sent[(w->m_txId + k) % ktSERVER_TXRING] = xleave_slot( &in[i].m_addr);
+      if( verdict != eRATE_KOD) {
+        x->m_rx = rx;
+        x->m_tx = ntp_ts_now();
+      }
+
+      out[k].m_data = (uint8_t *)reply;
+      out[k].m_len  = sizeof(*reply);
+      if( key) out[k].m_len = auth_sign( key, out[k].m_data, out[k].m_len);
+      else if( status != eAUTH_NONE) out[k].m_len = auth_nak( out[k].m_data, out[k].m_len);
+      out[k].m_addr = in[i].m_addr;
+      k++;
+    }
+    // the kernel numbers the queued sends only (SOF_TIMESTAMPING_OPT_ID)
+    if( k && (k = netio_send( w->m_io, out, k)) > 0) w->m_txId += k;
+  }
+  return NULL;
+}
+
+/*!
+  \brief send the time to the broadcast clients every poll interval
+  ******************************************************************
+
+  Nothing is sent while the server is not synchronized.
+
+  \param arg unused
+*/
+static void *server_broadcaster( void *arg)
+{
+  uint8_t out[sizeof(ntp_packet_t) + ktAUTH_MACLEN];
+  ntp_packet_t *packet = (ntp_packet_t *)out;
+  const auth_key_t *key = gAppOptions.m_keyId ? auth_find( gAppOptions.m_keyId) : NULL;
+  int len, poll;
+
+  (void)arg;
+  for( poll = 0; poll < 17 && (1 << (poll + 1)) <= gAppOptions.m_poll; poll++);
+
+  for(;;) {
+    template_read( packet);
+    if( NTP_LI( packet->li_vn_mode) != NTP_LI_ALARM) {
+      packet->li_vn_mode = NTP_LI_VN_MODE( NTP_LI( packet->li_vn_mode), 4, NTP_MODE_BROADCAST);
+      packet->poll       = (uint8_t)poll;
+      ntp_ts_put( ntp_ts_now(), &packet->txTm_s, &packet->txTm_f);
+      len = key ? auth_sign( key, out, sizeof(ntp_packet_t)) : (int)sizeof(ntp_packet_t);
+      if( sendto( gBroadcastSocket, out, len, 0, (struct sockaddr *)&gBroadcastTo, sizeof(gBroadcastTo)) == len) {
+        __atomic_add_fetch( &gBroadcasts, 1, __ATOMIC_RELAXED);
+      }
+    }
+    sleep( gAppOptions.m_poll);
+  }
+  return NULL;
+}
+
+/*!
+  \brief open the sockets and start serving
+  ******************************************************************
+
+  \return 0 if OK or <0 if failed
+*/
+int server_run( void)
+{
+  server_source_t source;
+  struct sockaddr_in addr;
+  sigset_t all, saved;
+  int fds[ktSERVER_MAXTHREADS];
+  socklen_t len;
+  int i, one = 1, nsockets, activated;
+
+  /*
+   * state until the first synchronization
+   ***************************************************************************
+   */
+  memset( &source, 0, sizeof(source));
+  if( gAppOptions.m_stratum > 0 && gAppOptions.m_stratum < 16) {
+    source.m_leap    = NTP_LI_NONE;
+    source.m_stratum = gAppOptions.m_stratum;
+    source.m_refId   = REFID_LOCL;
+    source.m_refTime = ntp_ts_now();
+  }
+  else {
+    source.m_leap    = NTP_LI_ALARM;
+    source.m_stratum = 16;
+    source.m_refId   = REFID_INIT;
+  }
+  server_update( &source);
+
+  memset( &gKodTemplate, 0, sizeof(gKodTemplate));
+  gKodTemplate.li_vn_mode = NTP_LI_VN_MODE( NTP_LI_ALARM, 4, NTP_MODE_SERVER);
+  gKodTemplate.precision  = (uint8_t)ktSERVER_PRECISION;
+  gKodTemplate.refId      = htonl( REFID_RATE);
+
+  if( gAppOptions.m_rateAverage > 0 &&
+      rate_init( &gRate, gAppOptions.m_rateAverage, gAppOptions.m_rateBurst, gAppOptions.m_rateKod) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+    return -1;
+  }
+
+  /*
+   * one socket per thread if the system can share the port
+   ***************************************************************************
+   */
+  gNworkers = (gAppOptions.m_threads > ktSERVER_MAXTHREADS) ? ktSERVER_MAXTHREADS : gAppOptions.m_threads;
+#ifdef SO_REUSEPORT
+  nsockets = gNworkers;
+#else
+  nsockets = 1;
+#endif
+
+  /* sockets of a .socket unit (systemd socket activation): taken as they are */
+  if( (activated = systemd_listen_fds( fds, ktSERVER_MAXTHREADS)) > 0) {
+    nsockets = activated;
+    if( gNworkers < nsockets) gNworkers = nsockets;
+    for( i = 0; i < nsockets; i++) {
+      gWorkers[i].m_socket = fds[i];
+      setsockopt( fds[i], SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    }
+    len = sizeof(addr);
+    if( getsockname( fds[0], (struct sockaddr *)&addr, &len) == 0) gAppOptions.m_servePort = ntohs( addr.sin_port);
+  }
+
+  memset( &addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY);
+  addr.sin_port        = htons( gAppOptions.m_servePort);
+
+  for( i = activated; i < nsockets; i++) {
+    if( (gWorkers[i].m_socket = socket( PF_INET, SOCK_DGRAM, 0)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+      return -1;
+    }
+#ifdef SO_REUSEPORT
+    if( nsockets > 1) setsockopt( gWorkers[i].m_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+    setsockopt( gWorkers[i].m_socket, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    if( bind( gWorkers[i].m_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot listen on port %d: %s"),
+                   gAppOptions.m_servePort, strerror( errno));
+      return -1;
+    }
+  }
+  for( ; i < gNworkers; i++) gWorkers[i].m_socket = gWorkers[i % nsockets].m_socket;
+
+  for( i = 0; i < gNworkers; i++) {
+    gWorkers[i].m_xleave = (server_xleave_t *)calloc( ktSERVER_XLEAVE, sizeof(server_xleave_t));
+    gWorkers[i].m_sent   = (uint32_t *)calloc( ktSERVER_TXRING, sizeof(uint32_t));
+    if( !(gWorkers[i].m_io = netio_open( gWorkers[i].m_socket, gAppOptions.m_io, 1)) ||
+        !gWorkers[i].m_xleave || !gWorkers[i].m_sent) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("Not enough memory"));
+      return -1;
+    }
+    // transmit times are numbered by socket: only when each thread has its own
+    if( nsockets == gNworkers) gWorkers[i].m_txStamps = (netio_tx_enable( gWorkers[i].m_socket) == 0);
+  }
+  if( gAppOptions.m_broadcast) {
+    memset( &gBroadcastTo, 0, sizeof(gBroadcastTo));
+    gBroadcastTo.sin_family = AF_INET;
+    gBroadcastTo.sin_port   = htons( gAppOptions.m_servePort);
+    inet_aton( gAppOptions.m_broadcast, &gBroadcastTo.sin_addr);
+    if( (gBroadcastSocket = socket( PF_INET, SOCK_DGRAM, 0)) < 0) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+      return -1;
+    }
+    setsockopt( gBroadcastSocket, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  }
+  if( gAppOptions.m_io == eNETIO_URING && netio_backend_of( gWorkers[0].m_io) != eNETIO_URING) {
+    trace_write( gAppTrace, eWARNING_MSG_TYPE, _("io_uring not available, using mmsg"));
+  }
+
+  /*
+   * threads do not take signals (SIGALRM is for the client)
+   ***************************************************************************
+   */
+  sigfillset( &all);
+  pthread_sigmask( SIG_BLOCK, &all, &saved);
+  for( i = 0; i < gNworkers; i++) {
+    if( pthread_create( &gWorkers[i].m_thread, NULL, server_worker, &gWorkers[i])) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("pthread_create() failed"));
+      pthread_sigmask( SIG_SETMASK, &saved, NULL);
+      return -1;
+    }
+  }
+  if( gBroadcastSocket >= 0 && pthread_create( &gBroadcaster, NULL, server_broadcaster, NULL)) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("pthread_create() failed"));
+    pthread_sigmask( SIG_SETMASK, &saved, NULL);
+    return -1;
+  }
+  pthread_sigmask( SIG_SETMASK, &saved, NULL);
+
+  trace_write( gAppTrace, eINFO_MSG_TYPE, _("Serving NTP on port %d, %d thread(s), %s"),
+               gAppOptions.m_servePort, gNworkers, netio_name( netio_backend_of( gWorkers[0].m_io)));
+  if( gRate.m_buckets) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Rate limit: 1 request per %ds, burst %d%s"),
+                 gAppOptions.m_rateAverage, gAppOptions.m_rateBurst,
+                 gAppOptions.m_rateKod ? _(", KoD") : "");
+  }
+  if( gBroadcastSocket >= 0) {
+    trace_write( gAppTrace, eINFO_MSG_TYPE, _("Broadcasting to %s every %ds"),
+                 gAppOptions.m_broadcast, gAppOptions.m_poll);
+  }
+  trace_flush( gAppTrace);
+  return 0;
+}
+
+/*!
+  \brief serve until killed (no server to synchronize with)
+  ******************************************************************
+
+  The counters are reported (verbose mode, --stats) every
+  ktTIMING_REPORT_POLLS polls, like the timing of the daemon mode.
+  Under systemd, the service is ready at once.
+*/
+void server_wait( void)
+{
+  FILE *stats = NULL;
+
+  if( gAppOptions.m_statsFile) {
+    stats = strcmp( gAppOptions.m_statsFile, "-") ? fopen( gAppOptions.m_statsFile, "a") : stdout;
+    if( !stats) trace_write( gAppTrace, eERROR_MSG_TYPE, _("Cannot open statistics file %s"), gAppOptions.m_statsFile);
+  }
+  systemd_notify( "READY=1\nSTATUS=Serving NTP on port %d, stratum %d", gAppOptions.m_servePort,
+                  gAppOptions.m_stratum ? gAppOptions.m_stratum : 16);
+
+  for(;;) {
+    systemd_sleep( gAppOptions.m_poll * ktTIMING_REPORT_POLLS);
+    if( gAppOptions.m_verbose) server_trace( gAppTrace);
+    trace_flush( gAppTrace);
+    if( stats) server_write_json( stats, time( NULL));
+  }
+}
+
+/*!
+  \brief sum the counters of all threads
+  ******************************************************************
+
+  \param total the sum
+*/
+void server_counters( server_counters_t *total)
+{
+  const server_counters_t *c;
+  int i;
+
+  memset( total, 0, sizeof(*total));
+  for( i = 0; i < gNworkers; i++) {
+    c = &gWorkers[i].m_counters;
+    total->m_received += __atomic_load_n( &c->m_received, __ATOMIC_RELAXED);
+    total->m_ignored  += __atomic_load_n( &c->m_ignored, __ATOMIC_RELAXED);
+    total->m_answered += __atomic_load_n( &c->m_answered, __ATOMIC_RELAXED);
+    total->m_kod      += __atomic_load_n( &c->m_kod, __ATOMIC_RELAXED);
+    total->m_dropped  += __atomic_load_n( &c->m_dropped, __ATOMIC_RELAXED);
+    total->m_authenticated += __atomic_load_n( &c->m_authenticated, __ATOMIC_RELAXED);
+    total->m_authFailed    += __atomic_load_n( &c->m_authFailed, __ATOMIC_RELAXED);
+    total->m_interleaved   += __atomic_load_n( &c->m_interleaved, __ATOMIC_RELAXED);
+    total->m_txStamped     += __atomic_load_n( &c->m_txStamped, __ATOMIC_RELAXED);
+  }
+  total->m_broadcasts = __atomic_load_n( &gBroadcasts, __ATOMIC_RELAXED);
+}
+
+/*!
+  \brief trace the counters
+*/
+void server_trace( trace_desc_t *logID)
+{
+  server_counters_t c;
+
+  server_counters( &c);
+  trace_write( logID, eINFO_MSG_TYPE, _("Served %lu, KoD %lu, dropped %lu, ignored %lu"),
+               c.m_answered, c.m_kod, c.m_dropped, c.m_ignored);
+  if( c.m_authenticated || c.m_authFailed) {
+    trace_write( logID, eINFO_MSG_TYPE, _("Authenticated %lu, authentication failed %lu"),
+                 c.m_authenticated, c.m_authFailed);
+  }
+  if( c.m_interleaved) {
+    trace_write( logID, eINFO_MSG_TYPE, _("Interleaved %lu, kernel transmit time-stamps %lu"),
+                 c.m_interleaved, c.m_txStamped);
+  }
+  if( c.m_broadcasts) trace_write( logID, eINFO_MSG_TYPE, _("Broadcasts %lu"), c.m_broadcasts);
+}
+
+/*!
+  \brief write the counters as a JSON line
+  ******************************************************************
+
+  \param out  output file
+  \param when UTC time of the report
+*/
+void server_write_json( FILE *out, time_t when)
+{
+  server_counters_t c;
+
+  server_counters( &c);
+  fprintf( out, "{\"type\":\"server\",\"time\":%ld,\"threads\":%d,\"received\":%lu,\"ignored\":%lu,"
+           "\"answered\":%lu,\"kod\":%lu,\"dropped\":%lu,\"authenticated\":%lu,\"auth_failed\":%lu,"
+           "\"interleaved\":%lu,\"tx_stamped\":%lu,\"broadcasts\":%lu}\n",
+           (long)when, gNworkers, c.m_received, c.m_ignored, c.m_answered, c.m_kod, c.m_dropped,
+           c.m_authenticated, c.m_authFailed, c.m_interleaved, c.m_txStamped, c.m_broadcasts);
+  fflush( out);
+}
@@ -0,0 +1,71 @@
+/**
+ * \file server.h
+ * \brief NTP server mode header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ntppacket.h"
+#include "trace.h"
+
+#define ktSERVER_MAXTHREADS  64   /*!< max serving threads                       */
+#define ktSERVER_PRECISION  -20   /*!< advertised precision (log2 s), about 1 us */
+#define ktSERVER_XLEAVE    4096   /*!< clients remembered per thread (interleaved) */
+#define ktSERVER_TXRING    1024   /*!< replies waiting for their transmit time   */
+
+/*!
+  \struct server_source_t
+  \brief what the server tells about its own synchronization
+  ******************************************************************
+*/
+typedef struct server_source_t {
+  int      m_leap;               /*!< leap indicator, NTP_LI_ALARM if not synced */
+  int      m_stratum;            /*!< our stratum (16: not synchronized)         */
+  uint32_t m_refId;              /*!< reference id (host order)                  */
+  double   m_rootDelay;          /*!< delay to the primary source (s)            */
+  double   m_rootDisp;           /*!< dispersion to the primary source (s)       */
+  ntp_ts_t m_refTime;            /*!< last time the clock was set                */
+
+} server_source_t;
+
+/*!
+  \struct server_counters_t
+  \brief requests seen by the server, each thread has its own
+  ******************************************************************
+*/
+typedef struct server_counters_t {
+  unsigned long m_received;      /*!< datagrams read                             */
+  unsigned long m_ignored;       /*!< not a NTP client request                   */
+  unsigned long m_answered;      /*!< replies with the time                      */
+  unsigned long m_kod;           /*!< Kiss-o'-Death RATE sent                    */
+  unsigned long m_dropped;       /*!< rate limited, no reply                     */
+  unsigned long m_authenticated; /*!< requests with a valid MAC, signed replies   */
+  unsigned long m_authFailed;    /*!< bad MAC or unknown key: crypto-NAK sent    */
+  unsigned long m_interleaved;   /*!< replies in interleaved mode                */
+  unsigned long m_txStamped;     /*!< replies whose kernel transmit time is known */
+  unsigned long m_broadcasts;    /*!< broadcast packets sent (--broadcast)       */
+
+} __attribute__((aligned(64))) server_counters_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int  server_run       ( void);
+void server_update    ( const server_source_t *source);
+void server_wait      ( void);
+void server_counters  ( server_counters_t *total);
+void server_trace     ( trace_desc_t *logID);
+void server_write_json( FILE *out, time_t when);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,112 @@
+/**
+ * \file sha1.c
+ * \brief SHA-1 message digest (FIPS 180-4)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Used to check leap-seconds.list and for the NTP symmetric keys of
+ * type SHA1 (RFC 5905): a plain portable implementation is enough.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "sha1.h"
+
+#define ROL(x, n)  ( ((x) << (n)) | ((x) >> (32 - (n))) )
+
+/* one of the 80 steps, f the round function, k its constant */
+#define STEP(f, k) \
+  do { t = ROL( a, 5) + (f) + e + (k) + w[i]; e = d; d = c; c = ROL( b, 30); b = a; a = t; } while( 0)
+
+/*!
+  \brief hash one 64 bytes block
+*/
+static void sha1_block( sha1_t *h, const uint8_t *p)
+{
+  uint32_t w[80], a, b, c, d, e, t;
+  int i;
+
+  for( i = 0; i < 16; i++) {
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  }
+  for( ; i < 80; i++) w[i] = ROL( w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  /* one loop per round function, no branch in the loops */
+  a = h->m_state[0]; b = h->m_state[1]; c = h->m_state[2]; d = h->m_state[3]; e = h->m_state[4];
+  for( i = 0; i < 20; i++) STEP( (b & c) | (~b & d), 0x5A827999);
+  for( ; i < 40; i++)      STEP( b ^ c ^ d, 0x6ED9EBA1);
+  for( ; i < 60; i++)      STEP( (b & c) | (b & d) | (c & d), 0x8F1BBCDC);
+  for( ; i < 80; i++)      STEP( b ^ c ^ d, 0xCA62C1D6);
+  h->m_state[0] += a; h->m_state[1] += b; h->m_state[2] += c; h->m_state[3] += d; h->m_state[4] += e;
+}
+
+/*!
+  \brief start a digest
+*/
+void sha1_init( sha1_t *h)
+{
+  h->m_state[0] = 0x67452301;
+  h->m_state[1] = 0xEFCDAB89;
+  h->m_state[2] = 0x98BADCFE;
+  h->m_state[3] = 0x10325476;
+  h->m_state[4] = 0xC3D2E1F0;
+  h->m_length   = 0;
+}
+
+/*!
+  \brief hash more bytes
+*/
+void sha1_update( sha1_t *h, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t used = (size_t)(h->m_length % 64), n;
+
+  h->m_length += len;
+  while( len) {
+    n = 64 - used;
+    if( n > len) n = len;
+    memcpy( h->m_block + used, p, n);
+    used += n;
+    p    += n;
+    len  -= n;
+    if( used == 64) {
+      sha1_block( h, h->m_block);
+      used = 0;
+    }
+  }
+}
+
+/*!
+  \brief end the digest
+*/
+void sha1_final( sha1_t *h, uint8_t digest[ktSHA1_LEN])
+{
+  uint64_t bits = h->m_length * 8;
+  uint8_t pad[72];
+  size_t used = (size_t)(h->m_length % 64), n;
+  int i;
+
+  n = (used < 56) ? 56 - used : 120 - used;
+  memset( pad, 0, sizeof(pad));
+  pad[0] = 0x80;
+  for( i = 0; i < 8; i++) pad[n + i] = (uint8_t)(bits >> (56 - 8 * i));
+  sha1_update( h, pad, n + 8);
+
+  for( i = 0; i < 5; i++) {
+    digest[4 * i]     = (uint8_t)(h->m_state[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(h->m_state[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(h->m_state[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)h->m_state[i];
+  }
+}
@@ -0,0 +1,39 @@
+/**
+ * \file sha1.h
+ * \brief SHA-1 message digest header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef SHA1_H_
+#define SHA1_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ktSHA1_LEN   20          /*!< digest length (bytes)                      */
+
+/*!
+  \struct sha1_t
+  \brief SHA-1 computation in progress
+  ******************************************************************
+*/
+typedef struct sha1_t {
+  uint32_t m_state[5];           /*!< intermediate hash                          */
+  uint64_t m_length;             /*!< bytes hashed                               */
+  uint8_t  m_block[64];          /*!< pending bytes                              */
+
+} sha1_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+void sha1_init  ( sha1_t *h);
+void sha1_update( sha1_t *h, const void *data, size_t len);
+void sha1_final ( sha1_t *h, uint8_t digest[ktSHA1_LEN]);
+
+#endif /* SHA1_H_ */
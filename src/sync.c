@@ -0,0 +1,435 @@
+/**
+ * \file sync.c
+ * \brief clock synchronization engine
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * From the samples of several servers, decide how to correct a clock:
+ *
+ *  1. clock filter: each server keeps its last samples, one of them
+ *     (last, lowest delay or median) gives the server offset;
+ *  2. selection: each server offset is widened into a correctness
+ *     interval (delay/2 + root delay/2 + root dispersion + jitter), the
+ *     servers whose interval meets the intersection of the majority
+ *     survive (Marzullo's algorithm), the others are falsetickers;
+ *  3. combine: survivors offsets are averaged, weighted by 1/interval;
+ *  4. discipline: the clock is stepped, or slewed while a type II
+ *     phase locked loop estimates its frequency error.
+ *
+ * When no server is left (holdover), the clock keeps the frequency
+ * learnt so far, its error bound grows by m_holdoverRate. The first
+ * update after that only uses the new samples, and slews an offset
+ * the holdover explains (up to ktSYNC_REJOIN_MAXSLEW) rather than
+ * stepping the clock again; while this slew lasts, the next updates
+ * neither step what is left of it nor learn it as frequency error.
+ *
+ * The clock is only reached through sync_clock_t so that the same code
+ * drives the system clock (ntpdate.c) and a simulated one (zntpsim).
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sync.h"
+
+#define MIN_DISTANCE   1e-6          /*!< lowest correctness interval (s)     */
+#define PLL_TC_POLLS   16            /*!< PLL time constant, in polls         */
+
+/*!
+  \struct endpoint_t
+  \brief one end of a correctness interval
+*/
+typedef struct endpoint_t {
+  double m_value;                    /*!< position (s)                        */
+  int    m_type;                     /*!< -1 lower end, +1 upper end          */
+
+} endpoint_t;
+
+/* -- local functions -- */
+
+/*!
+  \brief compare endpoints for qsort(), lower ends first on ties
+*/
+static int cmp_endpoint( const void *a, const void *b)
+{
+  const endpoint_t *x = (const endpoint_t *)a, *y = (const endpoint_t *)b;
+
+  if( x->m_value != y->m_value) return (x->m_value > y->m_value) - (x->m_value < y->m_value);
+  return x->m_type - y->m_type;
+}
+
+/*!
+  \brief compare samples offsets for qsort()
+*/
+static int cmp_offset( const void *a, const void *b)
+{
+  double x = ((const ntp_sample_t *)a)->m_offset, y = ((const ntp_sample_t *)b)->m_offset;
+
+  return (x > y) - (x < y);
+}
+
+/*!
+  \brief compute filtered offset, delay, jitter of a server
+  ******************************************************************
+
+  \param e the engine
+  \param p the server
+*/
+static void peer_filter( const sync_engine_t *e, sync_peer_t *p)
+{
+  ntp_sample_t sorted[ktSYNC_FILTERLEN];
+  const ntp_sample_t *best = NULL, *last = NULL;
+  double sq = 0;
+  int i;
+
+  last = &p->m_filter[(p->m_next + ktSYNC_FILTERLEN - 1) % ktSYNC_FILTERLEN];
+  best = last;
+
+  switch( e->m_filter) {
+  case eSYNC_FILTER_MINDELAY:
+    { for( i = 0; i < p->m_count; i++) {
+        if( p->m_filter[i].m_delay < best->m_delay) best = &p->m_filter[i];
+      }
+    } break;
+
+  case eSYNC_FILTER_MEDIAN:
+    { memcpy( sorted, p->m_filter, p->m_count * sizeof(*sorted));
+      qsort( sorted, (size_t)p->m_count, sizeof(*sorted), cmp_offset);
+      best = &sorted[p->m_count / 2];
+    } break;
+
+  default:
+    break;
+  }
+
+  p->m_offset = best->m_offset;
+  p->m_delay  = best->m_delay;
+  p->m_leap   = last->m_leap;
+
+  for( i = 0; i < p->m_count; i++) {
+    sq += (p->m_filter[i].m_offset - p->m_offset) * (p->m_filter[i].m_offset - p->m_offset);
+  }
+  p->m_jitter = (p->m_count > 1) ? sqrt( sq / (p->m_count - 1)) : 0;
+
+  p->m_distance = p->m_delay / 2 + best->m_rootDelay / 2 + best->m_rootDisp + p->m_jitter;
+  if( p->m_distance < MIN_DISTANCE) p->m_distance = MIN_DISTANCE;
+}
+
+/*!
+  \brief keep only the samples got since the last update, oldest first
+  ******************************************************************
+
+  \param p clock filter of a server
+*/
+static void keep_fresh( sync_peer_t *p)
+{
+  ntp_sample_t kept[ktSYNC_FILTERLEN];
+  int i;
+
+  for( i = 0; i < p->m_fresh; i++) {
+    kept[i] = p->m_filter[(p->m_next + ktSYNC_FILTERLEN - p->m_fresh + i) % ktSYNC_FILTERLEN];
+  }
+  memcpy( p->m_filter, kept, (size_t)p->m_fresh * sizeof(kept[0]));
+  p->m_count = p->m_fresh;
+  p->m_next  = p->m_fresh % ktSYNC_FILTERLEN;
+}
+
+/*!
+  \brief shift the kept samples after the clock was corrected
+  ******************************************************************
+
+  \param e      the engine
+  \param offset correction applied to the clock (s)
+*/
+static void shift_samples( sync_engine_t *e, double offset)
+{
+  int i, j;
+
+  for( i = 0; i < e->m_npeers; i++) {
+    for( j = 0; j < e->m_peers[i].m_count; j++) {
+      e->m_peers[i].m_filter[j].m_offset -= offset;
+    }
+  }
+}
+
+/*!
+  \brief select the truechimers and combine their offsets
+  ******************************************************************
+
+  \param e      the engine
+  \param result where to put offset, jitter and survivors
+  \return 0 if a majority of servers agree else -1
+*/
+static int select_combine( sync_engine_t *e, sync_result_t *result)
+{
+  endpoint_t ends[2 * ktSYNC_MAXPEERS];
+  sync_peer_t *p = NULL;
+  double lo = 0, hi = 0, w, wsum = 0, sum = 0, sq = 0;
+  int i, n = 0, valid = 0, count = 0, best = 0;
+
+  for( i = 0; i < e->m_npeers; i++) {
+    p = &e->m_peers[i];
+    if( !p->m_count) continue;
+    ends[n].m_value   = p->m_offset - p->m_distance;
+    ends[n++].m_type  = -1;
+    ends[n].m_value   = p->m_offset + p->m_distance;
+    ends[n++].m_type  = +1;
+    valid++;
+  }
+  if( !valid) return -1;
+
+  /* Marzullo: the region covered by the most intervals */
+  qsort( ends, (size_t)n, sizeof(*ends), cmp_endpoint);
+  for( i = 0; i < n; i++) {
+    count -= ends[i].m_type;
+    if( count > best) {
+      best = count;
+      lo = ends[i].m_value;
+      hi = ends[i + 1].m_value;
+    }
+  }
+  if( 2 * best <= valid) return -1;
+
+  /* survivors are the servers whose interval meets this region */
+  for( i = 0; i < e->m_npeers; i++) {
+    p = &e->m_peers[i];
+    if( !p->m_count ||
+        p->m_offset + p->m_distance < lo ||
+        p->m_offset - p->m_distance > hi) continue;
+    w = 1 / p->m_distance;
+    wsum += w;
+    sum  += w * p->m_offset;
+    result->m_survivors++;
+    result->m_selected |= 1u << i;
+  }
+  result->m_offset = sum / wsum;
+
+  for( i = 0; i < e->m_npeers; i++) {
+    p = &e->m_peers[i];
+    if( !p->m_count ||
+        p->m_offset + p->m_distance < lo ||
+        p->m_offset - p->m_distance > hi) continue;
+    sq += (1 / p->m_distance) * ((p->m_offset - result->m_offset) * (p->m_offset - result->m_offset)
+                                 + p->m_jitter * p->m_jitter);
+  }
+  result->m_jitter = sqrt( sq / wsum);
+
+  return 0;
+}
+
+
+/*!
+  \brief initialize the engine
+  ******************************************************************
+
+  \param e        the engine
+  \param clock    the clock to drive
+  \param npeers   number of servers (<= ktSYNC_MAXPEERS)
+  \param strategy correction strategy
+  \param filter   filter algorithm
+  \param poll     seconds between updates (sets the PLL time constant)
+*/
+void sync_init( sync_engine_t *e, const sync_clock_t *clock, int npeers,
+                sync_strategy strategy, sync_filter filter, double poll)
+{
+  memset( e, 0, sizeof(*e));
+  e->m_clock         = *clock;
+  e->m_npeers        = (npeers > ktSYNC_MAXPEERS) ? ktSYNC_MAXPEERS : npeers;
+  e->m_strategy      = strategy;
+  e->m_filter        = filter;
+  e->m_stepThreshold = ktSYNC_STEP_THRESHOLD;
+  e->m_minStep       = ktSYNC_MIN_STEP;
+  e->m_timeConstant  = PLL_TC_POLLS * (poll > 0 ? poll : 64);
+  e->m_lastUpdate    = -1;
+  e->m_holdoverRate  = ktSYNC_HOLDOVER_RATE;
+}
+
+/*!
+  \brief change the poll interval of the engine
+  ******************************************************************
+
+  \param e    the engine
+  \param poll seconds between updates (sets the PLL time constant)
+*/
+void sync_set_poll( sync_engine_t *e, double poll)
+{
+  e->m_timeConstant = PLL_TC_POLLS * (poll > 0 ? poll : 64);
+}
+
+/*!
+  \brief give a new sample of a server to the engine
+  ******************************************************************
+
+  \param e      the engine
+  \param peer   index of the server
+  \param sample the sample
+*/
+void sync_add_sample( sync_engine_t *e, int peer, const ntp_sample_t *sample)
+{
+  sync_peer_t *p = NULL;
+
+  if( peer < 0 || peer >= e->m_npeers) return;
+
+  p = &e->m_peers[peer];
+  p->m_filter[p->m_next] = *sample;
+  p->m_next = (p->m_next + 1) % ktSYNC_FILTERLEN;
+  if( p->m_count < ktSYNC_FILTERLEN) p->m_count++;
+  if( p->m_fresh < ktSYNC_FILTERLEN) p->m_fresh++;
+}
+
+/*!
+  \brief filter, select, combine then correct the clock
+  ******************************************************************
+
+  Only servers with a new sample since the last call make the engine
+  act, so calling it twice in a row does not correct twice.
+
+  \param e      the engine
+  \param result what was done
+  \return the action (see sync_action)
+*/
+int sync_update( sync_engine_t *e, sync_result_t *result)
+{
+  double now, dt, threshold;
+  int i, fresh = 0;
+
+  memset( result, 0, sizeof(*result));
+  result->m_action = eSYNC_NOSOURCE;
+  result->m_freq   = e->m_freq;
+
+  for( i = 0; i < e->m_npeers; i++) fresh += e->m_peers[i].m_fresh;
+  now = (e->m_holdover && fresh) ? e->m_clock.m_elapsed( e->m_clock.m_ctx) : 0;
+
+  for( i = 0; i < e->m_npeers; i++) {
+    /* back from a long holdover: older samples measured a clock that drifted since */
+    if( e->m_holdover && fresh && now - e->m_lastUpdate > e->m_timeConstant) keep_fresh( &e->m_peers[i]);
+    if( !e->m_peers[i].m_count) continue;
+    peer_filter( e, &e->m_peers[i]);
+    e->m_peers[i].m_fresh = 0;
+  }
+  if( !fresh || select_combine( e, result) < 0) {
+    /* holdover: the clock was disciplined, it keeps its last frequency */
+    if( e->m_strategy == eSYNC_STRATEGY_SLEW && e->m_lastUpdate >= 0) {
+      if( !e->m_holdover && e->m_clock.m_freq) {
+        e->m_clock.m_freq( e->m_clock.m_ctx, e->m_freq + e->m_freqBias);
+      }
+      e->m_holdover      = 1;
+      result->m_action   = eSYNC_HOLDOVER;
+      result->m_holdover = e->m_clock.m_elapsed( e->m_clock.m_ctx) - e->m_lastUpdate;
+    }
+    return result->m_action;
+  }
+
+  /* the offset is only measured, samples keep being relative to the clock */
+  if( e->m_strategy == eSYNC_STRATEGY_MEASURE) {
+    result->m_action = eSYNC_NONE;
+    return result->m_action;
+  }
+
+  now = e->m_clock.m_elapsed( e->m_clock.m_ctx);
+
+  /* after a holdover, an offset within the error bound it built is slewed */
+  threshold = e->m_stepThreshold;
+  if( e->m_holdover) {
+    result->m_holdover = now - e->m_lastUpdate;
+    dt = e->m_holdoverRate * result->m_holdover;
+    if( dt > threshold) {
+      e->m_rejoinSlew = (dt < ktSYNC_REJOIN_MAXSLEW) ? dt : ktSYNC_REJOIN_MAXSLEW;
+      e->m_rejoinEnd  = now + fabs( result->m_offset) / ktSYNC_MAX_FREQ;
+    }
+  }
+  if( now < e->m_rejoinEnd) threshold = e->m_rejoinSlew;
+
+  if( e->m_strategy == eSYNC_STRATEGY_STEP || fabs( result->m_offset) >= threshold) {
+    if( fabs( result->m_offset) < e->m_minStep) {
+      result->m_action = eSYNC_NONE;
+      return result->m_action;
+    }
+    if( e->m_noStep) {
+      result->m_action = eSYNC_HOLD;
+      return result->m_action;
+    }
+    result->m_err = e->m_clock.m_step( e->m_clock.m_ctx, result->m_offset);
+    if( result->m_err) {
+      result->m_action = eSYNC_ERROR;
+      return result->m_action;
+    }
+    shift_samples( e, result->m_offset);
+    e->m_steps++;
+    result->m_action = eSYNC_STEP;
+  }
+  else {
+    /* type II PLL: the whole phase error is slewed away at each update,
+       so the offset left since the last one is the frequency error
+       integrated over dt, frequency follows it with the time constant */
+    if( e->m_lastUpdate >= 0 && (dt = now - e->m_lastUpdate) > 0 && (e->m_holdover || now >= e->m_rejoinEnd)) {
+      e->m_freq += result->m_offset / (dt > e->m_timeConstant ? dt : e->m_timeConstant);
+      if( e->m_freq >  ktSYNC_MAX_FREQ) e->m_freq =  ktSYNC_MAX_FREQ;
+      if( e->m_freq < -ktSYNC_MAX_FREQ) e->m_freq = -ktSYNC_MAX_FREQ;
+    }
+    if( e->m_clock.m_freq && (e->m_lastUpdate >= 0 || e->m_freqBias != 0)) {
+      e->m_clock.m_freq( e->m_clock.m_ctx, e->m_freq + e->m_freqBias);
+    }
+    result->m_err = e->m_clock.m_slew( e->m_clock.m_ctx, result->m_offset);
+    if( result->m_err) {
+      result->m_action = eSYNC_ERROR;
+      return result->m_action;
+    }
+    shift_samples( e, result->m_offset);
+    result->m_action = eSYNC_SLEW;
+  }
+  e->m_lastUpdate = now;
+  e->m_holdover   = 0;
+  result->m_freq  = e->m_freq;
+
+  return result->m_action;
+}
+
+/*!
+  \brief filter algorithm from its name
+  ******************************************************************
+
+  \param name "last", "mindelay" or "median"
+  \return the sync_filter or <0 if unknown
+*/
+int sync_filter_parse( const char *name)
+{
+  if( !strcmp( name, "last"))     return eSYNC_FILTER_LAST;
+  if( !strcmp( name, "mindelay")) return eSYNC_FILTER_MINDELAY;
+  if( !strcmp( name, "median"))   return eSYNC_FILTER_MEDIAN;
+  return -1;
+}
+
+/*!
+  \brief holdover from its option
+  ******************************************************************
+
+  \param spec    "ppm[:hours]", error growth of the clock without
+                 server and longest holdover
+  \param rate    error growth (s/s)
+  \param seconds longest holdover
+  \return 0 if OK or -1 if invalid
+*/
+int sync_holdover_parse( const char *spec, double *rate, int *seconds)
+{
+  double ppm = 0;
+  int hours = ktSYNC_HOLDOVER_MAX / 3600;
+
+  if( sscanf( spec, "%lf:%d", &ppm, &hours) < 1 || ppm <= 0 || ppm > 500 || hours < 1 || hours > 720) return -1;
+  *rate    = ppm * 1e-6;
+  *seconds = hours * 3600;
+  return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * \file sync.h
+ * \brief clock synchronization engine header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef SYNC_H_
+#define SYNC_H_
+
+#include "ntpdate.h"
+
+#define ktSYNC_MAXPEERS         8    /*!< max servers used at the same time       */
+#define ktSYNC_FILTERLEN        8    /*!< samples kept by the clock filter        */
+#define ktSYNC_STEP_THRESHOLD   0.128 /*!< above this offset (s) the clock is stepped */
+#define ktSYNC_MIN_STEP         0.001 /*!< below this offset (s) nothing is done     */
+#define ktSYNC_MAX_FREQ         500e-6 /*!< max frequency correction (s/s)           */
+#define ktSYNC_HOLDOVER_RATE    15e-6 /*!< holdover: error growth of the clock (s/s)  */
+#define ktSYNC_HOLDOVER_MAX     86400 /*!< holdover: longest one (s)                  */
+#define ktSYNC_REJOIN_MAXSLEW   1.0   /*!< after a holdover, slew up to this (s)      */
+
+/*!
+  \enum sync_filter
+  \brief how the samples of one server are filtered
+  ******************************************************************
+*/
+typedef enum sync_filter {
+  eSYNC_FILTER_LAST = 0,         /*!< use the last sample                        */
+  eSYNC_FILTER_MINDELAY,         /*!< sample with the lowest delay (NTP filter)  */
+  eSYNC_FILTER_MEDIAN,           /*!< median offset of the kept samples          */
+
+}sync_filter;
+
+/*!
+  \enum sync_strategy
+  \brief how the clock is corrected
+  ******************************************************************
+*/
+typedef enum sync_strategy {
+  eSYNC_STRATEGY_STEP = 0,       /*!< always step (ntpdate behaviour)            */
+  eSYNC_STRATEGY_SLEW,           /*!< slew and discipline frequency, step only
+                                      above ktSYNC_STEP_THRESHOLD                */
+  eSYNC_STRATEGY_MEASURE,        /*!< never correct: another daemon does         */
+
+}sync_strategy;
+
+/*!
+  \enum sync_action
+  \brief what sync_update() did
+  ******************************************************************
+*/
+typedef enum sync_action {
+  eSYNC_NONE = 0,                /*!< offset too small, nothing done             */
+  eSYNC_NOSOURCE,                /*!< no sample or no majority of servers        */
+  eSYNC_STEP,                    /*!< clock stepped                              */
+  eSYNC_SLEW,                    /*!< clock slewed                               */
+  eSYNC_ERROR,                   /*!< clock operation failed (see m_err)         */
+  eSYNC_HOLD,                    /*!< step needed but refused (m_noStep)         */
+  eSYNC_HOLDOVER,                /*!< no source, the clock runs on its frequency */
+
+}sync_action;
+
+/*!
+  \struct sync_clock_t
+  \brief the clock driven by the engine (system clock or simulated one)
+  ******************************************************************
+*/
+typedef struct sync_clock_t {
+  int    (*m_step)   ( void *ctx, double offset); /*!< add offset at once, 0 if OK  */
+  int    (*m_slew)   ( void *ctx, double offset); /*!< add offset gradually, 0 if OK*/
+  int    (*m_freq)   ( void *ctx, double freq);   /*!< set frequency correction     */
+  double (*m_elapsed)( void *ctx);                /*!< monotonic time (s)           */
+  void   *m_ctx;                                  /*!< context of the functions     */
+
+} sync_clock_t;
+
+/*!
+  \struct sync_peer_t
+  \brief clock filter of one server
+  ******************************************************************
+*/
+typedef struct sync_peer_t {
+  ntp_sample_t m_filter[ktSYNC_FILTERLEN]; /*!< last samples (circular)          */
+  int          m_count;          /*!< number of samples in m_filter              */
+  int          m_next;           /*!< next slot of m_filter                      */
+  int          m_fresh;          /*!< samples since last update, the newest ones */
+
+  double       m_offset;         /*!< filtered offset (s)                        */
+  double       m_delay;          /*!< filtered delay (s)                         */
+  double       m_jitter;         /*!< RMS of offset differences (s)              */
+  double       m_distance;       /*!< half width of the correctness interval (s) */
+  int          m_leap;           /*!< leap indicator of the last sample          */
+
+} sync_peer_t;
+
+/*!
+  \struct sync_result_t
+  \brief result of sync_update()
+  ******************************************************************
+*/
+typedef struct sync_result_t {
+  sync_action m_action;          /*!< what was done                              */
+  double      m_offset;          /*!< combined offset (s)                        */
+  double      m_jitter;          /*!< combined jitter (s)                        */
+  double      m_freq;            /*!< frequency correction after update (s/s)    */
+  int         m_survivors;       /*!< servers kept by the selection              */
+  unsigned    m_selected;        /*!< bit i set if server i was kept             */
+  double      m_holdover;        /*!< seconds since the last correction, in a
+                                      holdover or at the end of one              */
+  int         m_err;             /*!< error of the clock operation               */
+
+} sync_result_t;
+
+/*!
+  \struct sync_engine_t
+  \brief state of the synchronization engine
+  ******************************************************************
+*/
+typedef struct sync_engine_t {
+  sync_clock_t  m_clock;         /*!< driven clock                               */
+  sync_filter   m_filter;        /*!< filter algorithm                           */
+  sync_strategy m_strategy;      /*!< correction strategy                        */
+  double        m_stepThreshold; /*!< slew strategy: step above this (s)         */
+  double        m_minStep;       /*!< do nothing below this (s)                  */
+  double        m_timeConstant;  /*!< PLL time constant (s)                      */
+
+  sync_peer_t   m_peers[ktSYNC_MAXPEERS]; /*!< one filter per server             */
+  int           m_npeers;        /*!< number of servers                          */
+
+  double        m_freq;          /*!< frequency correction (s/s)                 */
+  double        m_lastUpdate;    /*!< m_elapsed() at last correction (<0: none)  */
+  int           m_steps;         /*!< number of steps done                       */
+  int           m_noStep;        /*!< refuse to step (leap second near)          */
+  double        m_freqBias;      /*!< added to the frequency told to the clock,
+                                      not learnt by the PLL (leap smear) (s/s)   */
+  double        m_holdoverRate;  /*!< error growth without source (s/s)          */
+  int           m_holdover;      /*!< no source since m_lastUpdate               */
+  double        m_rejoinSlew;    /*!< after a holdover: largest offset slewed (s) */
+  double        m_rejoinEnd;     /*!< ... until this m_elapsed(), time to slew it */
+
+} sync_engine_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+void sync_init       ( sync_engine_t *e, const sync_clock_t *clock, int npeers,
+                       sync_strategy strategy, sync_filter filter, double poll);
+void sync_set_poll   ( sync_engine_t *e, double poll);
+void sync_add_sample ( sync_engine_t *e, int peer, const ntp_sample_t *sample);
+int  sync_update     ( sync_engine_t *e, sync_result_t *result);
+int  sync_filter_parse( const char *name);
+int  sync_holdover_parse( const char *spec, double *rate, int *seconds);
+
+#endif /* SYNC_H_ */
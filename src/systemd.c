@@ -0,0 +1,177 @@
+/**
+ * \file systemd.c
+ * \brief run as a systemd service: readiness, watchdog, socket activation
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * The protocols of sd_notify(3) and sd_listen_fds(3), without
+ * libsystemd: they are a datagram and a few environment variables.
+ *
+ *  - NOTIFY_SOCKET: Unix datagram socket (abstract if it starts with
+ *    '@') where "READY=1", "STATUS=..." and "WATCHDOG=1" lines go. The
+ *    daemon tells it is ready once the clock is synchronized, so units
+ *    after time-sync.target wait for a real synchronization only.
+ *  - WATCHDOG_USEC (and WATCHDOG_PID): the service is restarted if it
+ *    does not ping within this; pings are sent every half of it from
+ *    the daemon loop, whose sleeps are cut accordingly.
+ *  - LISTEN_PID, LISTEN_FDS: sockets opened by a .socket unit, from
+ *    file descriptor 3, given to the server mode.
+ *
+ * Without systemd all of this does nothing.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "timing.h"
+#include "systemd.h"
+
+/* -- GLOBALES -- */
+static int                gNotify = -1;      /*!< socket to systemd, -1: not a service   */
+static struct sockaddr_un gNotifyAddr;
+static socklen_t          gNotifyLen = 0;
+static double             gWatchdog = 0;     /*!< seconds between pings, 0: none         */
+static double             gLastPing = 0;     /*!< monotonic time of the last ping        */
+
+/*!
+  \brief find out whether systemd runs us
+  ******************************************************************
+
+  \return 1 if notifications are sent, 0 if not
+*/
+int systemd_init( void)
+{
+  const char *path = getenv( "NOTIFY_SOCKET"), *usec = getenv( "WATCHDOG_USEC"), *pid = getenv( "WATCHDOG_PID");
+  size_t len;
+
+  if( !path || (path[0] != '/' && path[0] != '@') || (len = strlen( path)) >= sizeof(gNotifyAddr.sun_path)) return 0;
+  if( (gNotify = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) return 0;
+
+  memset( &gNotifyAddr, 0, sizeof(gNotifyAddr));
+  gNotifyAddr.sun_family = AF_UNIX;
+  memcpy( gNotifyAddr.sun_path, path, len);
+  if( path[0] == '@') gNotifyAddr.sun_path[0] = '\0';
+  gNotifyLen = (socklen_t)(offsetof( struct sockaddr_un, sun_path) + len);
+
+  if( usec && (!pid || atol( pid) == (long)getpid())) gWatchdog = atof( usec) / 1e6 / 2;
+  gLastPing = timing_now();
+  return 1;
+}
+
+/*!
+  \brief send a notification, e.g. "READY=1\nSTATUS=..."
+  ******************************************************************
+
+  \param fmt printf() format of the lines
+  \return 0 if sent or -1 (not a service or failed)
+*/
+int systemd_notify( const char *fmt, ...)
+{
+  char msg[ktSYSTEMD_MSGLEN];
+  va_list ap;
+  int n;
+
+  if( gNotify < 0) return -1;
+
+  va_start( ap, fmt);
+  n = vsnprintf( msg, sizeof(msg), fmt, ap);
+  va_end( ap);
+  if( n < 0) return -1;
+  if( n >= (int)sizeof(msg)) n = sizeof(msg) - 1;
+  return (sendto( gNotify, msg, (size_t)n, MSG_NOSIGNAL, (struct sockaddr *)&gNotifyAddr, gNotifyLen) == n) ? 0 : -1;
+}
+
+/*!
+  \brief ping the watchdog if it is time to
+*/
+void systemd_watchdog( void)
+{
+  double now;
+
+  if( gWatchdog <= 0) return;
+  now = timing_now();
+  if( now - gLastPing < gWatchdog) return;
+  systemd_notify( "WATCHDOG=1");
+  gLastPing = now;
+}
+
+/*!
+  \brief seconds between two watchdog pings, 0 if there is no watchdog
+*/
+double systemd_interval( void)
+{
+  return gWatchdog;
+}
+
+/*!
+  \brief sleep, pinging the watchdog meanwhile
+  ******************************************************************
+
+  \param seconds how long
+*/
+void systemd_sleep( unsigned seconds)
+{
+  struct timespec ts;
+  double end = timing_now() + seconds, left;
+
+  if( gWatchdog <= 0) {
+    sleep( seconds);
+    return;
+  }
+  while( (left = end - timing_now()) > 0) {
+    if( left > gWatchdog) left = gWatchdog;
+    ts.tv_sec  = (time_t)left;
+    ts.tv_nsec = (long)((left - ts.tv_sec) * 1e9);
+    nanosleep( &ts, NULL);
+    systemd_watchdog();
+  }
+}
+
+/*!
+  \brief sockets passed by a .socket unit
+  ******************************************************************
+
+  The variables are removed so that children do not take them.
+
+  \param fds where to put them
+  \param max room in fds
+  \return number of sockets, 0 if none
+*/
+int systemd_listen_fds( int *fds, int max)
+{
+  const char *pid = getenv( "LISTEN_PID"), *n = getenv( "LISTEN_FDS");
+  int i, count;
+
+  if( !pid || !n || atol( pid) != (long)getpid()) return 0;
+  count = atoi( n);
+  unsetenv( "LISTEN_PID");
+  unsetenv( "LISTEN_FDS");
+  unsetenv( "LISTEN_FDNAMES");
+
+  if( count < 0) count = 0;
+  if( count > max) count = max;
+  for( i = 0; i < count; i++) {
+    fds[i] = ktSYSTEMD_LISTEN_START + i;
+    fcntl( fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  return count;
+}
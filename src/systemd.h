@@ -0,0 +1,28 @@
+/**
+ * \file systemd.h
+ * \brief run as a systemd service: readiness, watchdog, socket activation header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef SYSTEMD_H_
+#define SYSTEMD_H_
+
+#define ktSYSTEMD_LISTEN_START  3    /*!< first socket passed (SD_LISTEN_FDS_START) */
+#define ktSYSTEMD_MSGLEN      256    /*!< longest notification                     */
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int    systemd_init      ( void);
+int    systemd_notify    ( const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void   systemd_watchdog  ( void);
+double systemd_interval  ( void);
+void   systemd_sleep     ( unsigned seconds);
+int    systemd_listen_fds( int *fds, int max);
+
+#endif /* SYSTEMD_H_ */
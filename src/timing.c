@@ -0,0 +1,180 @@
+/**
+ * \file timing.c
+ * \brief latency instrumentation of the sync path
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Each phase of ntpdate() (socket, DNS, NTS key exchange, send, wait
+ * for the reply, retries, clock correction) is timed with the monotonic
+ * clock into a timing_t. It is traced in verbose mode, written as a
+ * JSON line with --stats, and in daemon mode added to log2 histograms
+ * which are reported every ktTIMING_REPORT_POLLS polls.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "timing.h"
+
+/*! names of the phases, used in trace and JSON */
+static const char *gTimingNames[eTIMING_PHASES] = {
+  "socket", "dns", "ke", "send", "wait", "retry", "clock", "total",
+};
+
+/*!
+  \brief monotonic time
+  ******************************************************************
+
+  \return seconds since an unspecified start
+*/
+double timing_now( void)
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*!
+  \brief add the time elapsed since start to a phase
+  ******************************************************************
+
+  \param t     the timing, may be NULL
+  \param phase the phase
+  \param start timing_now() at the start of the phase
+  \return timing_now(), to chain phases
+*/
+double timing_add( timing_t *t, timing_phase phase, double start)
+{
+  double now = timing_now();
+
+  if( t) t->m_phase[phase] += now - start;
+  return now;
+}
+
+/*!
+  \brief add one synchronization to the histograms
+  ******************************************************************
+
+  \param h the histograms
+  \param t the timing of the synchronization
+*/
+void timing_hist_add( timing_hist_t *h, const timing_t *t)
+{
+  double us;
+  int i, b;
+
+  for( i = 0; i < eTIMING_PHASES; i++) {
+    for( b = 0, us = t->m_phase[i] * 1e6; us >= 2 && b < ktTIMING_BUCKETS - 1; b++) us /= 2;
+    h->m_bucket[i][b]++;
+    if( !h->m_count || t->m_phase[i] < h->m_min[i]) h->m_min[i] = t->m_phase[i];
+    if( !h->m_count || t->m_phase[i] > h->m_max[i]) h->m_max[i] = t->m_phase[i];
+    h->m_sum[i] += t->m_phase[i];
+  }
+  h->m_retries += t->m_retries;
+  h->m_count++;
+}
+
+/*!
+  \brief trace the phases of one synchronization
+  ******************************************************************
+
+  \param logID the trace
+  \param t     the timing
+*/
+void timing_trace( trace_desc_t *logID, const timing_t *t)
+{
+  trace_write( logID, eINFO_MSG_TYPE, _("Timing (ms): socket %.3f, dns %.3f, ke %.3f, send %.3f"),
+               t->m_phase[eTIMING_SOCKET] * 1e3, t->m_phase[eTIMING_DNS] * 1e3,
+               t->m_phase[eTIMING_KE] * 1e3, t->m_phase[eTIMING_SEND] * 1e3);
+  trace_write( logID, eINFO_MSG_TYPE, _("Timing (ms): wait %.3f, retry %.3f (%d), clock %.3f, total %.3f"),
+               t->m_phase[eTIMING_WAIT] * 1e3, t->m_phase[eTIMING_RETRY] * 1e3, t->m_retries,
+               t->m_phase[eTIMING_CLOCK] * 1e3, t->m_phase[eTIMING_TOTAL] * 1e3);
+}
+
+/*!
+  \brief trace a summary of the histograms
+  ******************************************************************
+
+  \param logID the trace
+  \param h     the histograms
+*/
+void timing_hist_trace( trace_desc_t *logID, const timing_hist_t *h)
+{
+  int i;
+
+  if( !h->m_count) return;
+
+  trace_write( logID, eINFO_MSG_TYPE, _("Timing of %lu polls, %lu retries (ms):"), h->m_count, h->m_retries);
+  for( i = 0; i < eTIMING_PHASES; i++) {
+    trace_write( logID, eINFO_MSG_TYPE, _("  %-6s min %.3f, mean %.3f, max %.3f"), gTimingNames[i],
+                 h->m_min[i] * 1e3, h->m_sum[i] / h->m_count * 1e3, h->m_max[i] * 1e3);
+  }
+}
+
+/*!
+  \brief write one synchronization as a JSON line
+  ******************************************************************
+
+  \param out  output file
+  \param t    the timing
+  \param when UTC time of the synchronization
+*/
+void timing_write_json( FILE *out, const timing_t *t, time_t when)
+{
+  int i;
+
+  fprintf( out, "{\"type\":\"sync\",\"time\":%ld,\"retries\":%d,\"ms\":{", (long)when, t->m_retries);
+  for( i = 0; i < eTIMING_PHASES; i++) {
+    fprintf( out, "%s\"%s\":%.3f", i ? "," : "", gTimingNames[i], t->m_phase[i] * 1e3);
+  }
+  fprintf( out, "}}\n");
+  fflush( out);
+}
+
+/*!
+  \brief write the histograms as a JSON line
+  ******************************************************************
+
+  Buckets are [lower bound in us, count], empty ones are omitted.
+
+  \param out  output file
+  \param h    the histograms
+  \param when UTC time of the report
+*/
+void timing_hist_write_json( FILE *out, const timing_hist_t *h, time_t when)
+{
+  int i, b, first;
+
+  if( !h->m_count) return;
+
+  fprintf( out, "{\"type\":\"histogram\",\"time\":%ld,\"polls\":%lu,\"retries\":%lu,\"phases\":{",
+           (long)when, h->m_count, h->m_retries);
+  for( i = 0; i < eTIMING_PHASES; i++) {
+    fprintf( out, "%s\"%s\":{\"min_ms\":%.3f,\"mean_ms\":%.3f,\"max_ms\":%.3f,\"buckets_us\":[",
+             i ? "," : "", gTimingNames[i], h->m_min[i] * 1e3, h->m_sum[i] / h->m_count * 1e3, h->m_max[i] * 1e3);
+    for( b = 0, first = 1; b < ktTIMING_BUCKETS; b++) {
+      if( !h->m_bucket[i][b]) continue;
+      fprintf( out, "%s[%lu,%lu]", first ? "" : ",", b ? 1UL << b : 0UL, h->m_bucket[i][b]);
+      first = 0;
+    }
+    fprintf( out, "]}");
+  }
+  fprintf( out, "}}\n");
+  fflush( out);
+}
@@ -0,0 +1,78 @@
+/**
+ * \file timing.h
+ * \brief latency instrumentation of the sync path header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <stdio.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define ktTIMING_BUCKETS      24   /*!< histogram buckets, [2^i, 2^(i+1)) us, first [0,2) */
+#define ktTIMING_REPORT_POLLS 16   /*!< daemon mode: polls between histogram reports   */
+
+/*!
+  \enum timing_phase
+  \brief measured phases of a synchronization
+  ******************************************************************
+*/
+typedef enum timing_phase {
+  eTIMING_SOCKET = 0,            /*!< socket setup                               */
+  eTIMING_DNS,                   /*!< name resolution (gethostbyname)            */
+  eTIMING_KE,                    /*!< NTS key exchanges (TLS), 0 if cached       */
+  eTIMING_SEND,                  /*!< sendto() calls                             */
+  eTIMING_WAIT,                  /*!< wait in recv() for the answered request    */
+  eTIMING_RETRY,                 /*!< time lost in requests that timed out       */
+  eTIMING_CLOCK,                 /*!< clock correction (settimeofday, adjtime)   */
+  eTIMING_TOTAL,                 /*!< whole synchronization                      */
+  eTIMING_PHASES,                /*!< number of phases                           */
+
+}timing_phase;
+
+/*!
+  \struct timing_t
+  \brief time spent in each phase of one synchronization
+  ******************************************************************
+*/
+typedef struct timing_t {
+  double m_phase[eTIMING_PHASES]; /*!< seconds per phase                         */
+  int    m_retries;               /*!< requests sent again after a timeout       */
+
+} timing_t;
+
+/*!
+  \struct timing_hist_t
+  \brief phases of many synchronizations (daemon mode)
+  ******************************************************************
+*/
+typedef struct timing_hist_t {
+  unsigned long m_bucket[eTIMING_PHASES][ktTIMING_BUCKETS]; /*!< log2 histogram */
+  double        m_min[eTIMING_PHASES];   /*!< lowest value (s)                   */
+  double        m_max[eTIMING_PHASES];   /*!< highest value (s)                  */
+  double        m_sum[eTIMING_PHASES];   /*!< sum of values (s)                  */
+  unsigned long m_count;                 /*!< synchronizations added             */
+  unsigned long m_retries;               /*!< sum of retries                     */
+
+} timing_hist_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+double timing_now           ( void);
+double timing_add           ( timing_t *t, timing_phase phase, double start);
+void   timing_hist_add      ( timing_hist_t *h, const timing_t *t);
+void   timing_trace         ( trace_desc_t *logID, const timing_t *t);
+void   timing_hist_trace    ( trace_desc_t *logID, const timing_hist_t *h);
+void   timing_write_json    ( FILE *out, const timing_t *t, time_t when);
+void   timing_hist_write_json( FILE *out, const timing_hist_t *h, time_t when);
+
+#endif /* TIMING_H_ */
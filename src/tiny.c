@@ -0,0 +1,224 @@
+/**
+ * \file tiny.c
+ * \brief small static one-shot client (configure --enable-tiny)
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Initramfs and embedded targets only need to set the clock once at
+ * boot, within a short budget. With configure --enable-tiny (ZNTP_TINY),
+ * zntpdate is built statically from main.c, ntpdate.c, sync.c and a few
+ * others with the other modes left out by #ifdef, and:
+ *
+ *  - no NLS, no threads, no libcrypto nor libssl,
+ *  - system calls only for the network and the clock, no name
+ *    resolution: servers are IPv4 addresses,
+ *  - no syslog, no verbose mode (-s, -v): the trace functions are the
+ *    ones below, writing each message to the standard output with
+ *    write(2), without heap nor stdio buffer.
+ *
+ * The options are the ones of the one-shot mode, parsed by main.c. This
+ * file only queries the servers together from one socket, each request
+ * being sent again after --timeout seconds (3 times at most, as
+ * ntp_query()) until every server answered. The requests, the checks of
+ * the replies, -E/-O/--tz, the synchronization engine and the report
+ * are the ones of ntpdate.c (see ntp_oneshot()).
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gettext.h"      /* for gettext functions          */
+#define _(String) gettext (String)
+#define N_(String) String
+
+#include "main.h"
+#include "trace.h"
+#include "ntpdate.h"
+
+#define ktTINY_TRIES    3        /*!< requests to each server at most            */
+
+/*!
+  \struct tiny_server_t
+  \brief a server and its last request
+*/
+typedef struct tiny_server_t {
+  struct sockaddr_in m_addr;     /*!< address and port                           */
+  ntp_ts_t     m_t1;             /*!< transmit time of the last request          */
+  int          m_done;           /*!< answered                                   */
+
+} tiny_server_t;
+
+/* -- GLOBALES -- */
+extern options_t     gAppOptions;
+extern trace_desc_t* gAppTrace;
+
+static tiny_server_t gServers[ktMAXHOSTS];
+static ntp_sample_t  gSamples[ktMAXHOSTS];
+static int           gValid[ktMAXHOSTS];
+static trace_desc_t  gTrace = { eStdout, NULL };
+
+/*!
+  \brief the trace of this build, always the standard output
+*/
+trace_desc_t *trace_init( TraceType tt)
+{
+  (void)tt;
+  return &gTrace;
+}
+
+void trace_close( trace_desc_t **logID)
+{
+  *logID = NULL;
+  if( write( STDOUT_FILENO, "\n", 1) < 0) return;
+}
+
+void trace_flush( trace_desc_t *logID)
+{
+  (void)logID;                               // nothing is buffered
+}
+
+/*!
+  \brief write a message as trace.c does, without the time-stamp
+*/
+void trace_write( trace_desc_t *logID, LogMsgType msgType, const char *format, ...)
+{
+  char line[ktLOGSIGNMAXLEN + ktLOGMESSMAXLEN + 3];
+  va_list pa;
+  int n;
+
+  (void)logID;
+  n = snprintf( line, sizeof(line), "\n%s ", gLogSignature[LOG_MSG_TYPE(msgType)]);
+  va_start( pa, format);
+  vsnprintf( line + n, sizeof(line) - n, format, pa);
+  va_end( pa);
+  if( write( STDOUT_FILENO, line, strlen( line)) < 0) return;
+}
+
+/*!
+  \brief send a request to the servers which did not answer yet
+*/
+static void tiny_send( int s, int nservers)
+{
+  ntp_packet_t request;
+  int i;
+
+  for( i = 0; i < nservers; i++) {
+    if( gServers[i].m_done) continue;
+    gServers[i].m_t1 = ntp_ts_now();
+    ntp_request_build( &request, gServers[i].m_t1);
+    if( sendto( s, &request, sizeof(request), 0, (const struct sockaddr *)&gServers[i].m_addr,
+                sizeof(gServers[i].m_addr)) != sizeof(request)) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("sendto() failed"));
+    }
+  }
+}
+
+/*!
+  \brief read a reply
+  ******************************************************************
+
+  The reply to the last request of a server, checked as by ntp_query().
+
+  \param s        the socket
+  \param nservers number of servers
+  \return 1 if a server is done, 0 if not
+*/
+static int tiny_receive( int s, int nservers)
+{
+  ntp_packet_t reply;
+  struct sockaddr_in from;
+  socklen_t len = sizeof(from);
+  ntp_ts_t t4;
+  int i, n;
+
+  n = recvfrom( s, &reply, sizeof(reply), MSG_DONTWAIT, (struct sockaddr *)&from, &len);
+  t4 = ntp_ts_now();
+  if( n < (int)sizeof(reply) || NTP_MODE( reply.li_vn_mode) != NTP_MODE_SERVER) return 0;
+  for( i = 0; i < nservers; i++) {
+    if( !gServers[i].m_done && gServers[i].m_addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+        gServers[i].m_addr.sin_port == from.sin_port &&
+        ntp_ts_get( reply.origTm_s, reply.origTm_f) == gServers[i].m_t1) break;
+  }
+  if( i == nservers) return 0;
+
+  gServers[i].m_done = 1;
+  ntp_reply_sample( &reply, gServers[i].m_t1, t4, &gSamples[i]);
+  if( ntp_sample_check( &gSamples[i]) != eNTP_OK) return 1;
+  ntp_sample_compute( &gSamples[i]);
+  gValid[i] = 1;
+  return 1;
+}
+
+/*!
+  \brief the one-shot mode of the tiny build
+  ******************************************************************
+
+  \return 0 if the clock is set (or did not need to be) else the error
+*/
+int tiny_sync( void)
+{
+  struct pollfd pfd;
+  double end;
+  int s, i, tries, left, got = 0;
+  int nservers = gAppOptions.m_nhosts;
+
+  for( i = 0; i < nservers; i++) {
+    memset( &gServers[i], 0, sizeof(gServers[i]));
+    gServers[i].m_addr.sin_family = AF_INET;
+    gServers[i].m_addr.sin_port   = htons( gAppOptions.m_port);
+    if( !inet_aton( gAppOptions.m_hosts[i], &gServers[i].m_addr.sin_addr)) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s: IPv4 address expected, no name resolution in this build"),
+                   gAppOptions.m_hosts[i]);
+      return -1;
+    }
+  }
+
+  /*
+   * query all the servers at once
+   ***************************************************************************
+   */
+  if( (s = socket( PF_INET, SOCK_DGRAM, 0)) < 0) {
+    trace_write( gAppTrace, eERROR_MSG_TYPE, _("socket() failed"));
+    return -1;
+  }
+  pfd.fd     = s;
+  pfd.events = POLLIN;
+  for( tries = 0; tries < ktTINY_TRIES && got < nservers; tries++) {
+    tiny_send( s, nservers);
+    end = timing_now() + gAppOptions.m_timeout;
+    while( got < nservers && (left = (int)((end - timing_now()) * 1000)) > 0) {
+      if( poll( &pfd, 1, left) > 0) got += tiny_receive( s, nservers);
+    }
+  }
+  close( s);
+  for( i = 0; i < nservers; i++) {
+    if( !gServers[i].m_done) {
+      trace_write( gAppTrace, eERROR_MSG_TYPE, _("%s: no response, %d tries"), gAppOptions.m_hosts[i], ktTINY_TRIES);
+    }
+  }
+
+  /*
+   * the synchronization engine of ntpdate(), one-shot mode
+   ***************************************************************************
+   */
+  return ntp_oneshot( gSamples, gValid, nservers);
+}
@@ -197,7 +197,7 @@ void trace_write( trace_desc_t *logID, LogMsgType msgType, const char *format, .
       char *tmp = NULL;
 
       if(!logID->m_file) goto DONE;
-	  vsprintf( logMess, format, pa);
+	  vsnprintf( logMess, sizeof(logMess), format, pa);
       str_chug_chomp(logMess);
 
       // ajout de la date
@@ -0,0 +1,96 @@
+/**
+ * \file tzgen.c
+ * \brief Summer time transitions table generator
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Build time tool (see configure --with-tz-table): compiles a POSIX TZ
+ * rule and writes on stdout a C header holding the sorted table of its
+ * summer time transitions (UTC) over a range of years. zntpdate then
+ * only does a binary search in this table (see tzrule_is_dst()).
+ *
+ * Usage: tzgen RULE FIRST-LAST > tztable.h
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tzrule.h"
+
+/*!
+  \brief compare two instants for qsort()
+  ******************************************************************
+*/
+static int cmp_time( const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*!
+  \brief Generator entry point
+  ******************************************************************
+
+  \param argc number of argument
+  \param argv arguments list
+  \return 0 if success else 1
+*/
+int main( int argc, char **argv)
+{
+  tzrule_t   rule;
+  int        first = 0, last = 0, year, n = 0, i, firstDst = 0;
+  time_t     begin, end;
+  long long *table = NULL;
+
+  if( argc != 3 || sscanf( argv[2], "%d-%d", &first, &last) != 2 ||
+      first < 1970 || last < first) {
+    fprintf( stderr, "usage: tzgen RULE FIRST-LAST\n");
+    return 1;
+  }
+  if( tzrule_parse( &rule, argv[1]) < 0) {
+    fprintf( stderr, "tzgen: invalid POSIX TZ rule <%s>\n", argv[1]);
+    return 1;
+  }
+
+  table = (long long *)calloc( 2 * (size_t)(last - first + 1) + 1, sizeof(*table));
+  if( !table) return 1;
+
+  for( year = first; rule.m_hasDst && year <= last; year++) {
+    tzrule_transitions( &rule, year, &begin, &end);
+
+    /* southern hemisphere: summer time is in effect before the first transition */
+    if( year == first) firstDst = end < begin;
+    table[n++] = (long long)begin;
+    table[n++] = (long long)end;
+  }
+  qsort( table, (size_t)n, sizeof(*table), cmp_time);
+
+  printf( "/* tztable.h: generated by tzgen, do not edit */\n\n");
+  printf( "#define ktTZTABLE_RULE        \"%s\"\n", argv[1]);
+  printf( "#define ktTZTABLE_FIRST_YEAR  %d\n", first);
+  printf( "#define ktTZTABLE_LAST_YEAR   %d\n", last);
+  printf( "#define ktTZTABLE_SIZE        %d\n", n);
+  printf( "#define ktTZTABLE_FIRST_DST   %d\n\n", firstDst);
+
+  printf( "/*! sorted summer time transitions (UTC) */\n");
+  printf( "static const long long gTzTable[ktTZTABLE_SIZE + 1] = {");
+  for( i = 0; i < n; i++) {
+    printf( "%s%lldLL,", (i % 4) ? " " : "\n  ", table[i]);
+  }
+  printf( "\n  0LL\n};\n");
+
+  free( table);
+  return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * \file tzrule.c
+ * \brief POSIX TZ rule engine
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * Parse a POSIX TZ string (see IEEE Std 1003.1, chapter 8.3):
+ *
+ *   std offset [dst [offset] [,start[/time],end[/time]]]
+ *
+ * e.g. "CET-1CEST,M3.5.0,M10.5.0/3" or "AEST-10AEDT,M10.1.0,M4.1.0/3"
+ * and compute the summer time transitions of a year with plain integer
+ * arithmetic: neither mktime() nor localtime() are used, so the result
+ * does not depend on the TZ of the system nor on tzdata files.
+ *
+ * When zntpdate is configured with --with-tz-table, the transitions of
+ * the configured rule are precomputed at build time by tzgen into
+ * tztable.h and tzrule_is_dst() is a binary search into this table.
+ *=====================================================================
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "tzrule.h"
+#if defined(HAVE_TZTABLE) && !defined(TZGEN)
+#  include "tztable.h"
+#endif
+
+#define SECSPERMIN     60L
+#define SECSPERHOUR    3600L
+#define SECSPERDAY     86400L
+#define DEFAULT_TRANS  (2 * SECSPERHOUR) /*!< POSIX default transition time 02:00 */
+
+static const int gMonthDays[2][12] = {
+  { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+  { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+};
+
+/* -- local functions -- */
+
+/*!
+  \brief tell if year is a leap year
+  ******************************************************************
+
+  \param year the year
+  \return 1 if leap year else 0
+*/
+static int is_leap( int year)
+{
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/*!
+  \brief number of days since 1 Jan 1970 of 1 Jan of year
+  ******************************************************************
+
+  Proleptic gregorian calendar, valid for any year.
+
+  \param year the year
+  \return days since epoch (may be negative)
+*/
+static long days_from_year( int year)
+{
+  long y = (long)year - 1;
+
+  return 365L * (y - 1969) + (y / 4 - 492) - (y / 100 - 19) + (y / 400 - 4);
+}
+
+/*!
+  \brief parse a time zone abbreviation
+  ******************************************************************
+
+  \param p    string to parse
+  \param name where to put the abbreviation
+  \return pointer after the name or NULL if invalid
+*/
+static const char *parse_name( const char *p, char *name)
+{
+  size_t len = 0;
+
+  if( *p == '<') {
+    for( p++; *p && *p != '>'; p++) {
+      if( !isalnum((unsigned char)*p) && *p != '+' && *p != '-') return NULL;
+      if( len < ktTZNAMELEN) name[len++] = *p;
+    }
+    if( *p++ != '>') return NULL;
+  }
+  else {
+    for( ; isalpha((unsigned char)*p); p++) {
+      if( len < ktTZNAMELEN) name[len++] = *p;
+    }
+  }
+  name[len] = '\0';
+
+  return (len < 3) ? NULL : p;
+}
+
+/*!
+  \brief parse a [+-]hh[:mm[:ss]] duration
+  ******************************************************************
+
+  \param p    string to parse
+  \param secs where to put the number of seconds
+  \return pointer after the duration or NULL if invalid
+*/
+static const char *parse_secs( const char *p, long *secs)
+{
+  long sign = 1, v = 0, unit = SECSPERHOUR;
+  int  field = 0;
+
+  if( *p == '+' || *p == '-') {
+    if( *p++ == '-') sign = -1;
+  }
+  if( !isdigit((unsigned char)*p)) return NULL;
+
+  *secs = 0;
+  for( field = 0; field < 3; field++) {
+    for( v = 0; isdigit((unsigned char)*p); p++) {
+      v = v * 10 + (*p - '0');
+      if( v > 167) return NULL;
+    }
+    if( field > 0 && v > 59) return NULL;
+    *secs += v * unit;
+    unit /= 60;
+    if( field == 2 || *p != ':' || !isdigit((unsigned char)p[1])) break;
+    p++;
+  }
+  *secs *= sign;
+
+  return p;
+}
+
+/*!
+  \brief parse a transition date: Jn, n or Mm.w.d then optional /time
+  ******************************************************************
+
+  \param p    string to parse
+  \param date where to put the compiled date
+  \return pointer after the date or NULL if invalid
+*/
+static const char *parse_date( const char *p, tzdate_t *date)
+{
+  char *end = NULL;
+
+  memset( date, 0, sizeof(*date));
+  if( *p == 'M') {
+    date->m_kind = eTZ_MONTH_WEEK_DAY;
+    date->m_month = (int)strtol( p + 1, &end, 10);
+    if( *end != '.') return NULL;
+    date->m_week = (int)strtol( end + 1, &end, 10);
+    if( *end != '.') return NULL;
+    date->m_wday = (int)strtol( end + 1, &end, 10);
+    if( date->m_month < 1 || date->m_month > 12 ||
+        date->m_week < 1 || date->m_week > 5 ||
+        date->m_wday < 0 || date->m_wday > 6) return NULL;
+  }
+  else if( *p == 'J') {
+    date->m_kind = eTZ_JULIAN_NOLEAP;
+    date->m_day = (int)strtol( p + 1, &end, 10);
+    if( end == p + 1 || date->m_day < 1 || date->m_day > 365) return NULL;
+  }
+  else if( isdigit((unsigned char)*p)) {
+    date->m_kind = eTZ_JULIAN_LEAP;
+    date->m_day = (int)strtol( p, &end, 10);
+    if( date->m_day > 365) return NULL;
+  }
+  else {
+    return NULL;
+  }
+
+  p = end;
+  date->m_secs = DEFAULT_TRANS;
+  if( *p == '/') p = parse_secs( p + 1, &date->m_secs);
+
+  return p;
+}
+
+/*!
+  \brief day of year (0-365) of a transition date
+  ******************************************************************
+
+  \param date the compiled date
+  \param year the year
+  \return day of year
+*/
+static int date_yday( const tzdate_t *date, int year)
+{
+  int leap = is_leap(year);
+  int yday = 0, m, mday, wday;
+
+  switch( date->m_kind) {
+  case eTZ_JULIAN_NOLEAP:
+    { yday = date->m_day - 1;
+      if( leap && date->m_day >= 60) yday++;
+    } break;
+
+  case eTZ_JULIAN_LEAP:
+    { yday = date->m_day;
+    } break;
+
+  case eTZ_MONTH_WEEK_DAY:
+    {
+      for( m = 0; m < date->m_month - 1; m++) yday += gMonthDays[leap][m];
+
+      /* 1 Jan 1970 was a thursday (4) */
+      wday = (int)(((days_from_year(year) + yday + 4) % 7 + 7) % 7);
+      mday = 1 + (date->m_wday - wday + 7) % 7 + (date->m_week - 1) * 7;
+      if( mday > gMonthDays[leap][date->m_month - 1]) mday -= 7;
+      yday += mday - 1;
+    } break;
+  }
+
+  return yday;
+}
+
+
+#if defined(HAVE_TZTABLE) && !defined(TZGEN)
+/*!
+  \brief lookup the precomputed table
+  ******************************************************************
+
+  Branchless lower bound search of the last transition <= t: the
+  parity of the number of transitions passed gives the state.
+
+  \param t the instant (UTC)
+  \return 1 if summer time, 0 if standard time or <0 if out of table
+*/
+static int table_is_dst( time_t t)
+{
+  const long long *base = gTzTable;
+  size_t n = ktTZTABLE_SIZE, half;
+
+  if( n == 0 || (long long)t < gTzTable[0] || (long long)t >= gTzTable[n - 1]) return -1;
+
+  while( n > 1) {
+    half = n / 2;
+    base = (base[half] <= (long long)t) ? base + half : base;
+    n -= half;
+  }
+
+  return ktTZTABLE_FIRST_DST ^ (int)((base - gTzTable + 1) & 1);
+}
+#endif
+
+
+/*!
+  \brief compile a POSIX TZ string
+  ******************************************************************
+
+  \param rule where to put the compiled rule
+  \param spec the POSIX TZ string (a leading ':' is not supported)
+  \return 0 if OK or <0 if the string is invalid
+*/
+int tzrule_parse( tzrule_t *rule, const char *spec)
+{
+  const char *p = spec;
+  long secs = 0;
+
+  memset( rule, 0, sizeof(*rule));
+  if( !p || !(p = parse_name( p, rule->m_stdName))) return -1;
+
+  /* POSIX offsets are west of UTC, we keep them east of UTC */
+  if( !(p = parse_secs( p, &secs))) return -2;
+  rule->m_stdOffset = -secs;
+  rule->m_dstOffset = rule->m_stdOffset;
+  if( *p == '\0') return 0;
+
+  if( !(p = parse_name( p, rule->m_dstName))) return -3;
+  rule->m_hasDst = 1;
+  rule->m_dstOffset = rule->m_stdOffset + SECSPERHOUR;
+  if( *p != ',' && *p != '\0') {
+    if( !(p = parse_secs( p, &secs))) return -4;
+    rule->m_dstOffset = -secs;
+  }
+
+  if( *p == '\0') {
+    /* no rule: use the current US one like most libc do */
+    p = ",M3.2.0,M11.1.0";
+  }
+  if( *p++ != ',' || !(p = parse_date( p, &rule->m_start))) return -5;
+  if( *p++ != ',' || !(p = parse_date( p, &rule->m_end))) return -6;
+  if( *p != '\0') return -7;
+
+#if defined(HAVE_TZTABLE) && !defined(TZGEN)
+  rule->m_useTable = !strcmp( spec, ktTZTABLE_RULE);
+#endif
+
+  return 0;
+}
+
+/*!
+  \brief compute summer time start and end of a year
+  ******************************************************************
+
+  The result of the last call is cached so calling it again for the
+  same year costs nothing.
+
+  \param rule  the compiled rule
+  \param year  calculates for this year
+  \param begin the start date (UTC)
+  \param end   the end date (UTC)
+  \return 0 if OK or <0 if the rule has no summer time
+*/
+int tzrule_transitions( tzrule_t *rule, int year, time_t *begin, time_t *end)
+{
+  long days = 0;
+
+  if( !rule->m_hasDst) return -1;
+
+  if( rule->m_cacheYear != year) {
+    days = days_from_year( year);
+
+    /* start is given in standard time, end in summer time */
+    rule->m_cacheBegin = (time_t)((days + date_yday( &rule->m_start, year)) * SECSPERDAY
+                                  + rule->m_start.m_secs - rule->m_stdOffset);
+    rule->m_cacheEnd   = (time_t)((days + date_yday( &rule->m_end, year)) * SECSPERDAY
+                                  + rule->m_end.m_secs - rule->m_dstOffset);
+    rule->m_cacheYear  = year;
+  }
+  *begin = rule->m_cacheBegin;
+  *end   = rule->m_cacheEnd;
+
+  return 0;
+}
+
+/*!
+  \brief tell if summer time is in effect at a given instant
+  ******************************************************************
+
+  Works for both hemispheres: when the start is after the end in
+  the year, summer time wraps around new year. Uses the precomputed
+  table when available and in range.
+
+  \param rule the compiled rule
+  \param t    the instant (UTC)
+  \return 1 if summer time, 0 if standard time
+*/
+int tzrule_is_dst( tzrule_t *rule, time_t t)
+{
+  time_t begin, end;
+
+#if defined(HAVE_TZTABLE) && !defined(TZGEN)
+  int dst;
+
+  if( rule->m_useTable && (dst = table_is_dst(t)) >= 0) return dst;
+#endif
+
+  if( tzrule_transitions( rule, tzrule_year(t), &begin, &end) < 0) return 0;
+
+  if( begin < end)
+    return t >= begin && t < end;
+
+  return !(t >= end && t < begin);
+}
+
+/*!
+  \brief seconds to add to standard time in summer
+  ******************************************************************
+
+  \param rule the compiled rule
+  \return summer time shift in seconds (usually 3600)
+*/
+long tzrule_dst_shift( const tzrule_t *rule)
+{
+  return rule->m_dstOffset - rule->m_stdOffset;
+}
+
+/*!
+  \brief UTC year of an instant
+  ******************************************************************
+
+  \param t the instant
+  \return the year
+*/
+int tzrule_year( time_t t)
+{
+  long days = (long)(t / SECSPERDAY);
+  int  year = 0;
+
+  if( t % SECSPERDAY < 0) days--;
+
+  year = 1970 + (int)(days / 365);
+  while( days_from_year(year) > days) year--;
+  while( days_from_year(year + 1) <= days) year++;
+
+  return year;
+}
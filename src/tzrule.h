@@ -0,0 +1,85 @@
+/**
+ * \file tzrule.h
+ * \brief POSIX TZ rule engine header
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+#ifndef TZRULE_H_
+#define TZRULE_H_
+
+#include <time.h>
+
+#define ktTZNAMELEN        15    /*!< max time zone abbreviation len             */
+#define ktTZRULELEN        63    /*!< max POSIX TZ string len                    */
+
+/*! default rule used by -E: the one of the precomputed table if any (see
+    configure --with-tz-table) else European Union (CET/CEST), 01:00 UTC switches */
+#ifdef TZTABLE_RULE
+#  define ktTZ_DEFAULT_RULE  TZTABLE_RULE
+#else
+#  define ktTZ_DEFAULT_RULE  "CET-1CEST,M3.5.0,M10.5.0/3"
+#endif
+
+/*!
+  \enum tzdate_kind
+  \brief the three forms of a POSIX TZ transition date
+  ******************************************************************
+*/
+typedef enum tzdate_kind {
+  eTZ_JULIAN_NOLEAP = 0,         /*!< Jn: 1..365, February 29 never counted     */
+  eTZ_JULIAN_LEAP,               /*!< n: 0..365, February 29 counted            */
+  eTZ_MONTH_WEEK_DAY,            /*!< Mm.w.d: day d of week w of month m        */
+
+}tzdate_kind;
+
+/*!
+  \struct tzdate_t
+  \brief a compiled transition date (start or end of summer time)
+  ******************************************************************
+*/
+typedef struct tzdate_t {
+  tzdate_kind m_kind;            /*!< form of the date                           */
+  int  m_day;                    /*!< Jn or n day                                */
+  int  m_month;                  /*!< Mm.w.d month (1-12)                        */
+  int  m_week;                   /*!< Mm.w.d week (1-5, 5 means last)            */
+  int  m_wday;                   /*!< Mm.w.d day of week (0 = Sunday)            */
+  long m_secs;                   /*!< local wall time of transition (seconds)    */
+
+} tzdate_t;
+
+/*!
+  \struct tzrule_t
+  \brief a compiled POSIX TZ rule with its transitions cache
+  ******************************************************************
+*/
+typedef struct tzrule_t {
+  char     m_stdName[ktTZNAMELEN+1]; /*!< standard time abbreviation             */
+  char     m_dstName[ktTZNAMELEN+1]; /*!< summer time abbreviation (or empty)    */
+  long     m_stdOffset;          /*!< standard time offset, seconds east of UTC  */
+  long     m_dstOffset;          /*!< summer time offset, seconds east of UTC    */
+  int      m_hasDst;             /*!< rule has summer time                       */
+  tzdate_t m_start;              /*!< summer time start                          */
+  tzdate_t m_end;                /*!< summer time end                            */
+  int      m_useTable;           /*!< rule is the one of the precomputed table   */
+
+  int      m_cacheYear;          /*!< year of cached transitions (0 = none)      */
+  time_t   m_cacheBegin;         /*!< cached summer time start (UTC)             */
+  time_t   m_cacheEnd;           /*!< cached summer time end (UTC)               */
+
+} tzrule_t;
+
+/*
+  Function prototype
+  ******************************************************************
+  */
+int    tzrule_parse       ( tzrule_t *rule, const char *spec);
+int    tzrule_transitions ( tzrule_t *rule, int year, time_t *begin, time_t *end);
+int    tzrule_is_dst      ( tzrule_t *rule, time_t t);
+long   tzrule_dst_shift   ( const tzrule_t *rule);
+int    tzrule_year        ( time_t t);
+
+#endif /* TZRULE_H_ */
@@ -0,0 +1,150 @@
+/**
+ * \file zntpclock.h
+ * \brief clock quality published by zntpdate (--publish), header-only reader
+ *
+ * \author Jean-Michel Marino
+ * \author Copyright (C) 2008-2019 Jean-Michel Marino
+ *
+ * \note Options for source edition: tab = 2 spaces
+ */
+
+/*
+ *=====================================================================
+ * zntpdate writes the state of the clock synchronization into a small
+ * file mapped in memory. Applications map it read-only and read it
+ * without system call nor lock:
+ *
+ *   const zntp_clock_page_t *page = zntp_clock_open( "/run/zntpdate.clock");
+ *   zntp_clock_t clock;
+ *
+ *   if( page && zntp_clock_read( page, &clock) == 0 && clock.m_synced)
+ *     bound = zntp_clock_error( &clock, zntp_clock_mono());
+ *
+ * The page is protected by a sequence lock: m_seq is odd while it is
+ * written, readers copy it and retry if m_seq changed meanwhile. Only
+ * this header is needed, C or C++ compilers with the GCC atomic
+ * builtins (gcc, clang).
+ *=====================================================================
+ */
+
+#ifndef ZNTPCLOCK_H_
+#define ZNTPCLOCK_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ZNTP_CLOCK_MAGIC     0x5A4E5450u  /*!< "ZNTP"                             */
+#define ZNTP_CLOCK_VERSION   1            /*!< layout version                     */
+
+/*!
+  \struct zntp_clock_t
+  \brief state of the clock synchronization
+  ******************************************************************
+*/
+typedef struct zntp_clock_t {
+  int64_t  m_updateReal;         /*!< last update, ns since 1970 (UTC)           */
+  int64_t  m_updateMono;         /*!< last update, CLOCK_MONOTONIC ns            */
+  double   m_offset;             /*!< offset measured by the last update: what
+                                      was added to the system clock (s)          */
+  double   m_error;              /*!< error bound at the last update (s)         */
+  double   m_errorRate;          /*!< growth of the error bound (s/s)            */
+  double   m_freq;               /*!< frequency correction (ppm)                 */
+  int32_t  m_leap;               /*!< NTP leap indicator (3: not synchronized)   */
+  int32_t  m_stratum;            /*!< stratum of the host (16: not synchronized) */
+  int32_t  m_synced;             /*!< 1 if the clock has a server                */
+  int32_t  m_poll;               /*!< seconds between updates                    */
+  int32_t  m_holdover;           /*!< seconds the clock has been on its own since
+                                      its last server (0: it has one)            */
+
+} zntp_clock_t;
+
+/*!
+  \struct zntp_clock_page_t
+  \brief the mapped file, 128 bytes
+  ******************************************************************
+*/
+typedef struct zntp_clock_page_t {
+  uint32_t     m_magic;          /*!< ZNTP_CLOCK_MAGIC                           */
+  uint32_t     m_version;        /*!< ZNTP_CLOCK_VERSION                         */
+  uint32_t     m_seq;            /*!< sequence lock, odd while written           */
+  uint32_t     m_reserved;
+  zntp_clock_t m_clock;          /*!< the state                                  */
+  uint8_t      m_pad[128 - 16 - sizeof(zntp_clock_t)];
+
+} zntp_clock_page_t;
+
+/*!
+  \brief map the published page read-only, NULL if not available
+*/
+static inline const zntp_clock_page_t *zntp_clock_open( const char *path)
+{
+  void *page;
+  int fd = open( path, O_RDONLY | O_CLOEXEC);
+
+  if( fd < 0) return NULL;
+  page = mmap( NULL, sizeof(zntp_clock_page_t), PROT_READ, MAP_SHARED, fd, 0);
+  close( fd);
+  return (page == MAP_FAILED) ? NULL : (const zntp_clock_page_t *)page;
+}
+
+/*!
+  \brief unmap the page
+*/
+static inline void zntp_clock_close( const zntp_clock_page_t *page)
+{
+  if( page) munmap( (void *)page, sizeof(*page));
+}
+
+/*!
+  \brief copy the state, consistent whatever the writer does
+  ******************************************************************
+
+  \param page  the mapped page
+  \param clock the copy
+  \return 0 if OK, -1 if the page is not (yet) a zntpdate one
+*/
+static inline int zntp_clock_read( const zntp_clock_page_t *page, zntp_clock_t *clock)
+{
+  uint32_t seq;
+
+  if( __atomic_load_n( &page->m_magic, __ATOMIC_RELAXED) != ZNTP_CLOCK_MAGIC ||
+      page->m_version != ZNTP_CLOCK_VERSION) return -1;
+  do {
+    seq = __atomic_load_n( &page->m_seq, __ATOMIC_ACQUIRE);
+    memcpy( clock, (const void *)&page->m_clock, sizeof(*clock));
+    __atomic_thread_fence( __ATOMIC_ACQUIRE);
+  } while( (seq & 1) || seq != __atomic_load_n( &page->m_seq, __ATOMIC_RELAXED));
+  return 0;
+}
+
+/*!
+  \brief CLOCK_MONOTONIC in ns (vDSO, no system call)
+*/
+static inline int64_t zntp_clock_mono( void)
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*!
+  \brief error bound of the system clock now (s)
+  ******************************************************************
+
+  \param clock state read by zntp_clock_read()
+  \param mono  zntp_clock_mono() now
+  \return the bound, growing since the last update
+*/
+static inline double zntp_clock_error( const zntp_clock_t *clock, int64_t mono)
+{
+  double age = (double)(mono - clock->m_updateMono) * 1e-9;
+
+  return clock->m_error + (age > 0 ? age : 0) * clock->m_errorRate;
+}
+
+#endif /* ZNTPCLOCK_H_ */